@@ -0,0 +1,1095 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/**
+ * @file usbg-bench.c
+ * Benchmark of libusbg operations on synthetic gadget trees.
+ * Tree of N gadgets, each with M functions and K configs, is created,
+ * parsed, searched, exported, removed and imported again. Time of each
+ * phase is printed as JSON and may be compared with earlier results.
+ *
+ * With -S, integer attribute of single function is swept instead. For
+ * each value gadget is created, bound to UDC and optional workload
+ * command is run, e.g. writing to /dev/usb/lp0 of host side with
+ * dummy_hcd loaded. Emulated UDC of memory backend stands in for real
+ * one when only configuration and binding times are of interest.
+ *
+ * Pseudo attribute os_desc of rndis and ncm turns Microsoft OS
+ * descriptors on for non-zero values, so -S rndis:os_desc=0,1 -e
+ * compares enumeration time on Windows host with and without them.
+ * Windows asks for OS descriptors only on first enumeration of given
+ * idVendor, idProduct and bcdDevice, so its usbflags entry for the
+ * device has to be removed between runs.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_backend.h>
+#include <usbg/usbg_stats.h>
+
+#define BENCH_CONFIGFS "/sys/kernel/config"
+#define BENCH_MAX_REPEAT 100
+#define BENCH_THRESHOLD 10.0
+#define BENCH_MAX_VALUES 32
+#define BENCH_SWEEP_GADGET "sweep"
+#define BENCH_SWEEP_INSTANCE "b0"
+#define BENCH_SWEEP_UDC "dummy_udc.0"
+#define BENCH_OS_DESC_ATTR "os_desc"
+#define BENCH_ENUM_TIMEOUT_MS 10000
+#define BENCH_ENUM_POLL_US 500
+/* EXIT_FAILURE is taken by errors */
+#define BENCH_EXIT_REGRESSION 2
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+enum bench_phase {
+	BENCH_CREATE,
+	BENCH_INIT,
+	BENCH_LOOKUP,
+	BENCH_EXPORT,
+	BENCH_REMOVE,
+	BENCH_IMPORT,
+	BENCH_PHASES,
+};
+
+static const char *phase_names[] = {
+	[BENCH_CREATE] = "create",
+	[BENCH_INIT] = "init",
+	[BENCH_LOOKUP] = "lookup",
+	[BENCH_EXPORT] = "export",
+	[BENCH_REMOVE] = "remove",
+	[BENCH_IMPORT] = "import",
+};
+
+/* Function types which may be created without any backing resources */
+static const usbg_function_type bench_types[] = {
+	F_ACM, F_ECM, F_NCM, F_RNDIS, F_SERIAL, F_OBEX, F_EEM, F_SUBSET,
+};
+
+struct bench_params {
+	int gadgets;
+	int functions;
+	int configs;
+	int repeat;
+	int mem;
+	const char *path;
+};
+
+enum bench_sweep_phase {
+	SWEEP_SETUP,
+	SWEEP_BIND,
+	SWEEP_ENUM,
+	SWEEP_RUN,
+	SWEEP_PHASES,
+};
+
+static const char *sweep_phase_names[] = {
+	[SWEEP_SETUP] = "setup",
+	[SWEEP_BIND] = "bind",
+	[SWEEP_ENUM] = "enumerate",
+	[SWEEP_RUN] = "run",
+};
+
+/* IDs Windows binds its inbox drivers by */
+static const struct {
+	usbg_function_type type;
+	usbg_function_os_desc ids;
+} bench_os_desc_ids[] = {
+	{ F_RNDIS, { "RNDIS", "5162001" } },
+	{ F_NCM, { "WINNCM", "" } },
+};
+
+struct bench_sweep {
+	usbg_function_type type;
+	char attr[USBG_MAX_NAME_LENGTH];
+	int values[BENCH_MAX_VALUES];
+	int n_values;
+	int os_desc;
+	int enumerate;
+	const char *udc;
+	const char *cmd;
+	long long bytes;
+	int settle_ms;
+};
+
+struct bench_result {
+	long ops;
+	uint64_t ns[BENCH_MAX_REPEAT];
+	uint64_t min, median, max;
+	double per_op;
+	double baseline;
+};
+
+struct bench_export {
+	char *buf;
+	size_t len;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void gadget_name(char *buf, size_t len, int i)
+{
+	/* Not zero padded to exercise ordered insertion */
+	snprintf(buf, len, "bench%d", i);
+}
+
+static void instance_name(char *buf, size_t len, int j)
+{
+	snprintf(buf, len, "b%d", j);
+}
+
+static int phase_create(usbg_state *s, struct bench_params *p)
+{
+	char name[USBG_MAX_NAME_LENGTH];
+	char inst[USBG_MAX_NAME_LENGTH];
+	usbg_gadget_attrs g_attrs = {
+		.bcdUSB = 0x0200,
+		.bMaxPacketSize0 = 64,
+		.idVendor = 0x1d6b,
+		.idProduct = 0x0104,
+	};
+	usbg_gadget *g;
+	usbg_function **f;
+	usbg_config *c;
+	int i, j, k;
+	int usbg_ret = USBG_ERROR_NO_MEM;
+
+	f = calloc(p->functions ? p->functions : 1, sizeof(*f));
+	if (!f)
+		goto out;
+
+	for (i = 0; i < p->gadgets; ++i) {
+		gadget_name(name, sizeof(name), i);
+		usbg_ret = usbg_create_gadget(s, name, &g_attrs, NULL, &g);
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		for (j = 0; j < p->functions; ++j) {
+			instance_name(inst, sizeof(inst), j);
+			usbg_ret = usbg_create_function(g,
+				bench_types[j % ARRAY_SIZE(bench_types)],
+				inst, NULL, &f[j]);
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+		}
+
+		for (k = 0; k < p->configs; ++k) {
+			usbg_ret = usbg_create_config(g, k + 1, "c", NULL,
+						      NULL, &c);
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+
+			for (j = k; j < p->functions; j += p->configs) {
+				snprintf(name, sizeof(name), "f%d", j);
+				usbg_ret = usbg_add_config_function(c, name,
+								    f[j]);
+				if (usbg_ret != USBG_SUCCESS)
+					goto out;
+			}
+		}
+	}
+
+out:
+	free(f);
+	return usbg_ret;
+}
+
+static int phase_lookup(usbg_state *s, struct bench_params *p)
+{
+	char name[USBG_MAX_NAME_LENGTH];
+	char inst[USBG_MAX_NAME_LENGTH];
+	usbg_gadget *g;
+	int i, j, k;
+
+	for (i = 0; i < p->gadgets; ++i) {
+		gadget_name(name, sizeof(name), i);
+		g = usbg_get_gadget(s, name);
+		if (!g)
+			return USBG_ERROR_NOT_FOUND;
+
+		for (j = 0; j < p->functions; ++j) {
+			instance_name(inst, sizeof(inst), j);
+			if (!usbg_get_function(g,
+				    bench_types[j % ARRAY_SIZE(bench_types)],
+				    inst))
+				return USBG_ERROR_NOT_FOUND;
+		}
+
+		for (k = 0; k < p->configs; ++k)
+			if (!usbg_get_config(g, k + 1, NULL))
+				return USBG_ERROR_NOT_FOUND;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int phase_export(usbg_state *s, struct bench_params *p,
+			struct bench_export *exp)
+{
+	char name[USBG_MAX_NAME_LENGTH];
+	FILE *stream;
+	int i;
+	int usbg_ret = USBG_SUCCESS;
+
+	for (i = 0; i < p->gadgets && usbg_ret == USBG_SUCCESS; ++i) {
+		gadget_name(name, sizeof(name), i);
+		stream = open_memstream(&exp[i].buf, &exp[i].len);
+		if (!stream)
+			return USBG_ERROR_NO_MEM;
+
+		usbg_ret = usbg_export_gadget(usbg_get_gadget(s, name), stream);
+		fclose(stream);
+	}
+
+	return usbg_ret;
+}
+
+static int phase_remove(usbg_state *s)
+{
+	usbg_gadget *g;
+	int usbg_ret = USBG_SUCCESS;
+
+	while ((g = usbg_get_first_gadget(s)) && usbg_ret == USBG_SUCCESS)
+		usbg_ret = usbg_rm_gadget(g, USBG_RM_RECURSE);
+
+	return usbg_ret;
+}
+
+static int phase_import(usbg_state *s, struct bench_params *p,
+			struct bench_export *exp)
+{
+	char name[USBG_MAX_NAME_LENGTH];
+	FILE *stream;
+	int i;
+	int usbg_ret = USBG_SUCCESS;
+
+	for (i = 0; i < p->gadgets && usbg_ret == USBG_SUCCESS; ++i) {
+		gadget_name(name, sizeof(name), i);
+		stream = fmemopen(exp[i].buf, exp[i].len, "r");
+		if (!stream)
+			return USBG_ERROR_NO_MEM;
+
+		usbg_ret = usbg_import_gadget(s, stream, name, NULL);
+		fclose(stream);
+	}
+
+	return usbg_ret;
+}
+
+#define TIMED(res, call) \
+	({ \
+		uint64_t _start = now_ns(); \
+		int _ret = (call); \
+		(res)->ns[rep] = now_ns() - _start; \
+		_ret; \
+	})
+
+static int bench_run(struct bench_params *p, struct bench_result *res)
+{
+	usbg_backend *b = NULL;
+	usbg_state *s = NULL;
+	struct bench_export *exp = NULL;
+	const char *phase = "setup";
+	int rep, i;
+	int usbg_ret = USBG_SUCCESS;
+
+	res[BENCH_CREATE].ops = (long)p->gadgets *
+		(1 + 2 * p->functions + p->configs);
+	res[BENCH_INIT].ops = 1;
+	res[BENCH_LOOKUP].ops = (long)p->gadgets *
+		(1 + p->functions + p->configs);
+	res[BENCH_EXPORT].ops = p->gadgets;
+	res[BENCH_REMOVE].ops = p->gadgets;
+	res[BENCH_IMPORT].ops = p->gadgets;
+
+	for (rep = 0; rep < p->repeat; ++rep) {
+		if (p->mem) {
+			usbg_ret = usbg_backend_mem_create(p->path, &b);
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+			usbg_set_backend(b);
+		}
+
+		exp = calloc(p->gadgets, sizeof(*exp));
+		if (!exp) {
+			usbg_ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		usbg_ret = usbg_init(p->path, &s);
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		if (usbg_get_first_gadget(s)) {
+			fprintf(stderr, "%s/usb_gadget is not empty\n",
+				p->path);
+			usbg_ret = USBG_ERROR_EXIST;
+			goto out;
+		}
+
+		phase = phase_names[BENCH_CREATE];
+		usbg_ret = TIMED(&res[BENCH_CREATE], phase_create(s, p));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		usbg_cleanup(s);
+		s = NULL;
+
+		phase = phase_names[BENCH_INIT];
+		usbg_ret = TIMED(&res[BENCH_INIT], usbg_init(p->path, &s));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = phase_names[BENCH_LOOKUP];
+		usbg_ret = TIMED(&res[BENCH_LOOKUP], phase_lookup(s, p));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = phase_names[BENCH_EXPORT];
+		usbg_ret = TIMED(&res[BENCH_EXPORT], phase_export(s, p, exp));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = phase_names[BENCH_REMOVE];
+		usbg_ret = TIMED(&res[BENCH_REMOVE], phase_remove(s));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = phase_names[BENCH_IMPORT];
+		usbg_ret = TIMED(&res[BENCH_IMPORT], phase_import(s, p, exp));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = "cleanup";
+		usbg_ret = phase_remove(s);
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		usbg_cleanup(s);
+		s = NULL;
+
+		for (i = 0; i < p->gadgets; ++i)
+			free(exp[i].buf);
+		free(exp);
+		exp = NULL;
+
+		if (b) {
+			usbg_set_backend(NULL);
+			usbg_backend_destroy(b);
+			b = NULL;
+		}
+	}
+
+out:
+	if (usbg_ret != USBG_SUCCESS)
+		fprintf(stderr, "Error in %s phase: %s : %s\n", phase,
+			usbg_error_name(usbg_ret), usbg_strerror(usbg_ret));
+
+	if (s)
+		usbg_cleanup(s);
+
+	if (exp) {
+		for (i = 0; i < p->gadgets; ++i)
+			free(exp[i].buf);
+		free(exp);
+	}
+
+	if (b) {
+		usbg_set_backend(NULL);
+		usbg_backend_destroy(b);
+	}
+
+	return usbg_ret;
+}
+
+/* Spec is type:attr=v1,v2,... with type named as in configfs */
+static int parse_sweep(const char *spec, struct bench_sweep *sw)
+{
+	char type[USBG_MAX_NAME_LENGTH];
+	const usbg_attr_desc *descs;
+	const char *pos;
+	char *end;
+	int i, n, len;
+
+	/* Both buffers have USBG_MAX_NAME_LENGTH bytes */
+	if (sscanf(spec, "%39[^:]:%39[^=]=%n", type, sw->attr, &len) != 2)
+		return -EINVAL;
+
+	for (i = 0; i < USBG_FUNCTION_TYPE_MAX; ++i)
+		if (!strcmp(type, usbg_get_function_type_str(i)))
+			break;
+	if (i == USBG_FUNCTION_TYPE_MAX) {
+		fprintf(stderr, "Unknown function type %s\n", type);
+		return -EINVAL;
+	}
+	sw->type = i;
+
+	n = usbg_get_function_attr_descs(sw->type, &descs);
+	for (i = 0; i < n; ++i)
+		if (!strcmp(descs[i].name, sw->attr))
+			break;
+
+	/* Not an attribute of function, see sweep_os_desc() */
+	if (!strcmp(sw->attr, BENCH_OS_DESC_ATTR)) {
+		for (i = 0; i < ARRAY_SIZE(bench_os_desc_ids); ++i)
+			if (bench_os_desc_ids[i].type == sw->type)
+				break;
+		if (i == ARRAY_SIZE(bench_os_desc_ids)) {
+			fprintf(stderr, "%s has no OS descriptors\n", type);
+			return -EINVAL;
+		}
+		sw->os_desc = 1;
+	} else if (i >= n || descs[i].type != USBG_ATTR_INT
+		   || !descs[i].writable) {
+		fprintf(stderr, "%s has no writable integer attribute %s\n",
+			type, sw->attr);
+		return -EINVAL;
+	}
+
+	for (pos = spec + len; *pos; pos = end + (*end == ',')) {
+		if (sw->n_values == BENCH_MAX_VALUES)
+			return -EINVAL;
+
+		sw->values[sw->n_values++] = strtol(pos, &end, 0);
+		if (end == pos || (*end && *end != ','))
+			return -EINVAL;
+	}
+
+	return sw->n_values ? 0 : -EINVAL;
+}
+
+static int sweep_os_desc(struct bench_sweep *sw, usbg_gadget *g,
+			 usbg_function *f, usbg_config *c)
+{
+	usbg_gadget_os_desc os_desc = {
+		.use = 1,
+		.b_vendor_code = 0xcd,
+		.qw_sign = "MSFT100",
+	};
+	int i, usbg_ret;
+
+	for (i = 0; bench_os_desc_ids[i].type != sw->type; ++i)
+		;
+
+	usbg_ret = usbg_set_gadget_os_desc(g, &os_desc);
+	if (usbg_ret == USBG_SUCCESS)
+		usbg_ret = usbg_set_function_os_desc(f,
+						&bench_os_desc_ids[i].ids);
+	if (usbg_ret == USBG_SUCCESS)
+		usbg_ret = usbg_set_os_desc_config(g, c);
+
+	return usbg_ret;
+}
+
+static int sweep_setup(usbg_state *s, struct bench_sweep *sw, int value,
+		       usbg_gadget **g)
+{
+	usbg_gadget_attrs g_attrs = {
+		.bcdUSB = 0x0200,
+		.bMaxPacketSize0 = 64,
+		.idVendor = 0x1d6b,
+		.idProduct = 0x0104,
+	};
+	usbg_function *f;
+	usbg_config *c;
+	int usbg_ret;
+
+	usbg_ret = usbg_create_gadget(s, BENCH_SWEEP_GADGET, &g_attrs, NULL, g);
+	if (usbg_ret != USBG_SUCCESS)
+		return usbg_ret;
+
+	usbg_ret = usbg_create_function(*g, sw->type, BENCH_SWEEP_INSTANCE,
+					NULL, &f);
+	if (usbg_ret != USBG_SUCCESS)
+		return usbg_ret;
+
+	if (!sw->os_desc) {
+		usbg_ret = usbg_set_function_attr_int(f, sw->attr, value);
+		if (usbg_ret != USBG_SUCCESS)
+			return usbg_ret;
+	}
+
+	usbg_ret = usbg_create_config(*g, 1, "c", NULL, NULL, &c);
+	if (usbg_ret != USBG_SUCCESS)
+		return usbg_ret;
+
+	usbg_ret = usbg_add_config_function(c, "f0", f);
+	if (usbg_ret == USBG_SUCCESS && sw->os_desc && value)
+		usbg_ret = sweep_os_desc(sw, *g, f, c);
+
+	return usbg_ret;
+}
+
+/* Wait for host to select configuration, UDC state is polled */
+static int sweep_enumerate(usbg_gadget *g)
+{
+	char state[USBG_MAX_STR_LENGTH];
+	uint64_t end;
+	int usbg_ret;
+
+	end = now_ns() + BENCH_ENUM_TIMEOUT_MS * 1000000ULL;
+	do {
+		usbg_ret = usbg_get_gadget_udc_state(g, state, sizeof(state));
+		if (usbg_ret != USBG_SUCCESS)
+			return usbg_ret;
+
+		if (!strcmp(state, "configured"))
+			return USBG_SUCCESS;
+
+		usleep(BENCH_ENUM_POLL_US);
+	} while (now_ns() < end);
+
+	fprintf(stderr, "Device not configured by host within %d ms\n",
+		BENCH_ENUM_TIMEOUT_MS);
+	return USBG_ERROR_OTHER_ERROR;
+}
+
+/* Workload gets swept value and function in environment */
+static int sweep_run(struct bench_sweep *sw, int value)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+	int status;
+
+	snprintf(buf, sizeof(buf), "%d", value);
+	setenv("USBG_BENCH_VALUE", buf, 1);
+	snprintf(buf, sizeof(buf), "%s.%s",
+		 usbg_get_function_type_str(sw->type), BENCH_SWEEP_INSTANCE);
+	setenv("USBG_BENCH_FUNCTION", buf, 1);
+
+	status = system(sw->cmd);
+	if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "Workload failed with status %d\n", status);
+		return USBG_ERROR_OTHER_ERROR;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int sweep_value(struct bench_params *p, struct bench_sweep *sw,
+		       int value, struct bench_result *res)
+{
+	usbg_backend *b = NULL;
+	usbg_state *s = NULL;
+	usbg_gadget *g;
+	const char *phase = "init";
+	int rep;
+	int usbg_ret = USBG_SUCCESS;
+
+	for (rep = 0; rep < p->repeat; ++rep) {
+		if (p->mem) {
+			usbg_ret = usbg_backend_mem_create(p->path, &b);
+			if (usbg_ret == USBG_SUCCESS)
+				usbg_ret = usbg_backend_mem_add_udc(b,
+						sw->udc ? sw->udc
+						: BENCH_SWEEP_UDC);
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+			usbg_set_backend(b);
+		}
+
+		phase = "init";
+		usbg_ret = usbg_init(p->path, &s);
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = sweep_phase_names[SWEEP_SETUP];
+		usbg_ret = TIMED(&res[SWEEP_SETUP],
+				 sweep_setup(s, sw, value, &g));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = sweep_phase_names[SWEEP_BIND];
+		usbg_ret = TIMED(&res[SWEEP_BIND],
+				 usbg_enable_gadget(g, sw->udc));
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		phase = sweep_phase_names[SWEEP_ENUM];
+		if (sw->enumerate) {
+			usbg_ret = TIMED(&res[SWEEP_ENUM], sweep_enumerate(g));
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+		}
+
+		/* Let host enumerate device before workload starts */
+		if (sw->settle_ms)
+			usleep(sw->settle_ms * 1000);
+
+		phase = sweep_phase_names[SWEEP_RUN];
+		if (sw->cmd) {
+			usbg_ret = TIMED(&res[SWEEP_RUN], sweep_run(sw, value));
+			if (usbg_ret != USBG_SUCCESS)
+				goto out;
+		}
+
+		phase = "cleanup";
+		usbg_ret = usbg_rm_gadget(g, USBG_RM_RECURSE);
+		if (usbg_ret != USBG_SUCCESS)
+			goto out;
+
+		usbg_cleanup(s);
+		s = NULL;
+
+		if (b) {
+			usbg_set_backend(NULL);
+			usbg_backend_destroy(b);
+			b = NULL;
+		}
+	}
+
+out:
+	if (usbg_ret != USBG_SUCCESS)
+		fprintf(stderr, "Error in %s phase for %s=%d: %s : %s\n", phase,
+			sw->attr, value, usbg_error_name(usbg_ret),
+			usbg_strerror(usbg_ret));
+
+	if (s) {
+		g = usbg_get_gadget(s, BENCH_SWEEP_GADGET);
+		if (g)
+			usbg_rm_gadget(g, USBG_RM_RECURSE);
+		usbg_cleanup(s);
+	}
+
+	if (b) {
+		usbg_set_backend(NULL);
+		usbg_backend_destroy(b);
+	}
+
+	return usbg_ret;
+}
+
+static void bench_summarize(struct bench_params *p, struct bench_result *r)
+{
+	uint64_t sorted[BENCH_MAX_REPEAT];
+
+	memcpy(sorted, r->ns, p->repeat * sizeof(*sorted));
+	qsort(sorted, p->repeat, sizeof(*sorted), cmp_u64);
+
+	r->min = sorted[0];
+	r->median = sorted[p->repeat / 2];
+	r->max = sorted[p->repeat - 1];
+	r->per_op = (double)r->median / r->ops;
+}
+
+/*
+ * Baseline is an earlier output of this program. Only ns_per_op of each
+ * phase is used, so the parser relies on our own formatting.
+ */
+static int load_baseline(const char *file, struct bench_result *res)
+{
+	char line[256];
+	char key[32];
+	FILE *fp;
+	int phase = -1;
+	int i;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		perror(file);
+		return -errno;
+	}
+
+	for (i = 0; i < BENCH_PHASES; ++i)
+		res[i].baseline = -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, " { \"name\": \"%31[^\"]\"", key) == 1) {
+			phase = -1;
+			for (i = 0; i < BENCH_PHASES; ++i)
+				if (!strcmp(key, phase_names[i]))
+					phase = i;
+		} else if (phase >= 0) {
+			sscanf(line, " \"ns_per_op\": %lf", &res[phase].baseline);
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static void print_stats(FILE *out)
+{
+	usbg_stats st;
+	usbg_op_stats *o;
+	int i, first = 1;
+
+	usbg_get_stats(&st);
+	fprintf(out, ",\n  \"stats\": [\n");
+
+	for (i = 0; i < USBG_STAT_OP_MAX; ++i) {
+		o = &st.ops[i];
+		if (!o->count)
+			continue;
+
+		fprintf(out, "%s    { \"op\": \"%s\", \"count\": %llu, "
+			"\"errors\": %llu, \"total_ns\": %llu, "
+			"\"min_ns\": %llu, \"p50_ns\": %llu, "
+			"\"p99_ns\": %llu, \"max_ns\": %llu }",
+			first ? "" : ",\n", usbg_stat_op_name(i),
+			(unsigned long long)o->count,
+			(unsigned long long)o->errors,
+			(unsigned long long)o->total_ns,
+			(unsigned long long)o->min_ns,
+			(unsigned long long)usbg_stats_percentile(o, 50),
+			(unsigned long long)usbg_stats_percentile(o, 99),
+			(unsigned long long)o->max_ns);
+		first = 0;
+	}
+
+	fprintf(out, "\n  ]");
+}
+
+static void print_sweep_json(FILE *out, struct bench_params *p,
+			     struct bench_sweep *sw,
+			     struct bench_result (*res)[SWEEP_PHASES])
+{
+	struct bench_result *r;
+	int i, j;
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"usbg-bench\",\n");
+	fprintf(out, "  \"params\": {\n");
+	fprintf(out, "    \"backend\": \"%s\",\n", p->mem ? "mem" : "fs");
+	fprintf(out, "    \"function\": \"%s\",\n",
+		usbg_get_function_type_str(sw->type));
+	fprintf(out, "    \"attr\": \"%s\",\n", sw->attr);
+	fprintf(out, "    \"enumerate\": %s,\n",
+		sw->enumerate ? "true" : "false");
+	fprintf(out, "    \"workload\": %s,\n", sw->cmd ? "true" : "false");
+	fprintf(out, "    \"bytes\": %lld,\n", sw->bytes);
+	fprintf(out, "    \"repeat\": %d\n", p->repeat);
+	fprintf(out, "  },\n");
+	fprintf(out, "  \"sweep\": [\n");
+
+	for (i = 0; i < sw->n_values; ++i) {
+		fprintf(out, "    { \"value\": %d", sw->values[i]);
+		for (j = 0; j < SWEEP_PHASES; ++j) {
+			if ((j == SWEEP_RUN && !sw->cmd)
+			    || (j == SWEEP_ENUM && !sw->enumerate))
+				continue;
+			fprintf(out, ",\n      \"%s_median_ns\": %llu",
+				sweep_phase_names[j],
+				(unsigned long long)res[i][j].median);
+		}
+
+		r = &res[i][SWEEP_RUN];
+		if (sw->cmd && sw->bytes && r->median)
+			fprintf(out, ",\n      \"bytes_per_sec\": %.0f",
+				sw->bytes * 1e9 / r->median);
+		fprintf(out, "\n    }%s\n", i + 1 < sw->n_values ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+}
+
+static void print_json(FILE *out, struct bench_params *p,
+		       struct bench_result *res, int baseline, int stats)
+{
+	int i;
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"usbg-bench\",\n");
+	fprintf(out, "  \"params\": {\n");
+	fprintf(out, "    \"backend\": \"%s\",\n", p->mem ? "mem" : "fs");
+	fprintf(out, "    \"gadgets\": %d,\n", p->gadgets);
+	fprintf(out, "    \"functions\": %d,\n", p->functions);
+	fprintf(out, "    \"configs\": %d,\n", p->configs);
+	fprintf(out, "    \"repeat\": %d\n", p->repeat);
+	fprintf(out, "  },\n");
+	fprintf(out, "  \"results\": [\n");
+
+	for (i = 0; i < BENCH_PHASES; ++i) {
+		fprintf(out, "    { \"name\": \"%s\",\n", phase_names[i]);
+		fprintf(out, "      \"ops\": %ld,\n", res[i].ops);
+		fprintf(out, "      \"min_ns\": %llu,\n",
+			(unsigned long long)res[i].min);
+		fprintf(out, "      \"median_ns\": %llu,\n",
+			(unsigned long long)res[i].median);
+		fprintf(out, "      \"max_ns\": %llu,\n",
+			(unsigned long long)res[i].max);
+		if (baseline && res[i].baseline > 0) {
+			fprintf(out, "      \"baseline_ns_per_op\": %.1f,\n",
+				res[i].baseline);
+			fprintf(out, "      \"change_pct\": %.1f,\n",
+				(res[i].per_op - res[i].baseline) * 100.0
+				/ res[i].baseline);
+		}
+		fprintf(out, "      \"ns_per_op\": %.1f\n", res[i].per_op);
+		fprintf(out, "    }%s\n", i + 1 < BENCH_PHASES ? "," : "");
+	}
+
+	fprintf(out, "  ]");
+	if (stats)
+		print_stats(out);
+	fprintf(out, "\n}\n");
+}
+
+/* Returns number of phases slower than baseline by more than threshold */
+static int compare_baseline(struct bench_result *res, double threshold)
+{
+	double change;
+	int i, regressions = 0;
+
+	fprintf(stderr, "%-8s %18s %18s %8s\n", "phase", "baseline",
+		"current", "change");
+	for (i = 0; i < BENCH_PHASES; ++i) {
+		if (res[i].baseline <= 0) {
+			fprintf(stderr, "%-8s no baseline\n", phase_names[i]);
+			continue;
+		}
+
+		change = (res[i].per_op - res[i].baseline) * 100.0
+			/ res[i].baseline;
+		fprintf(stderr, "%-8s %12.1f ns/op %12.1f ns/op %+7.1f%%%s\n",
+			phase_names[i], res[i].baseline, res[i].per_op, change,
+			change > threshold ? "  REGRESSION" : "");
+		if (change > threshold)
+			++regressions;
+	}
+
+	return regressions;
+}
+
+static FILE *open_output(const char *out_file)
+{
+	FILE *out;
+
+	if (!out_file)
+		return stdout;
+
+	out = fopen(out_file, "w");
+	if (!out)
+		perror(out_file);
+
+	return out;
+}
+
+static int run_sweep(struct bench_params *p, struct bench_sweep *sw,
+		     const char *spec, const char *out_file)
+{
+	struct bench_result (*res)[SWEEP_PHASES];
+	FILE *out;
+	int i, j;
+	int ret = -EINVAL;
+
+	if (parse_sweep(spec, sw) != 0) {
+		fprintf(stderr, "Invalid sweep %s\n", spec);
+		return ret;
+	}
+
+	if (sw->settle_ms < 0)
+		sw->settle_ms = p->mem || sw->enumerate ? 0 : 1000;
+
+	res = calloc(sw->n_values, sizeof(*res));
+	if (!res)
+		return -ENOMEM;
+
+	for (i = 0; i < sw->n_values; ++i) {
+		for (j = 0; j < SWEEP_PHASES; ++j)
+			res[i][j].ops = 1;
+
+		if (sweep_value(p, sw, sw->values[i], res[i])
+		    != USBG_SUCCESS) {
+			ret = -EIO;
+			goto out;
+		}
+
+		for (j = 0; j < SWEEP_PHASES; ++j)
+			bench_summarize(p, &res[i][j]);
+	}
+
+	out = open_output(out_file);
+	if (!out) {
+		ret = -errno;
+		goto out;
+	}
+
+	print_sweep_json(out, p, sw, res);
+	if (out != stdout)
+		fclose(out);
+	ret = 0;
+out:
+	free(res);
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -g N     number of gadgets (default 8)\n"
+		"  -f M     functions per gadget (default 4)\n"
+		"  -c K     configs per gadget (default 2)\n"
+		"  -r R     repetitions, at most %d (default 5)\n"
+		"  -b TYPE  backend: mem (default) or fs\n"
+		"  -p PATH  configfs mount point (default %s)\n"
+		"  -o FILE  write JSON results to FILE instead of stdout\n"
+		"  -B FILE  compare with results stored in FILE, exit\n"
+		"           with status 2 on regression\n"
+		"  -t PCT   regression threshold in percent (default %.0f)\n"
+		"  -s       add per operation library statistics to results\n"
+		"  -S SPEC  sweep attribute, SPEC is type:attr=v1,v2,...\n"
+		"           e.g. printer:q_len=4,16,64 or midi:qlen=8,32,\n"
+		"           rndis:os_desc=0,1 toggles OS descriptors\n"
+		"  -u UDC   UDC used by sweep (default first one, %s\n"
+		"           for memory backend)\n"
+		"  -x CMD   workload run after each bind of sweep\n"
+		"  -n N     bytes moved by workload, gives throughput\n"
+		"  -w MS    time for host to enumerate before workload\n"
+		"           (default 1000 for fs backend without -e)\n"
+		"  -e       wait until host configures device and time it\n",
+		name, BENCH_MAX_REPEAT, BENCH_CONFIGFS, BENCH_THRESHOLD,
+		BENCH_SWEEP_UDC);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_params p = {
+		.gadgets = 8,
+		.functions = 4,
+		.configs = 2,
+		.repeat = 5,
+		.mem = 1,
+		.path = BENCH_CONFIGFS,
+	};
+	struct bench_result res[BENCH_PHASES];
+	struct bench_sweep sweep = { .settle_ms = -1 };
+	const char *sweep_spec = NULL;
+	const char *out_file = NULL;
+	const char *baseline = NULL;
+	double threshold = BENCH_THRESHOLD;
+	int stats = 0;
+	FILE *out;
+	int ret;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "g:f:c:r:b:p:o:B:t:sS:u:x:n:w:eh"))
+	       != -1) {
+		switch (opt) {
+		case 'g':
+			p.gadgets = atoi(optarg);
+			break;
+		case 'f':
+			p.functions = atoi(optarg);
+			break;
+		case 'c':
+			p.configs = atoi(optarg);
+			break;
+		case 'r':
+			p.repeat = atoi(optarg);
+			break;
+		case 'b':
+			if (!strcmp(optarg, "mem")) {
+				p.mem = 1;
+			} else if (!strcmp(optarg, "fs")) {
+				p.mem = 0;
+			} else {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'p':
+			p.path = optarg;
+			break;
+		case 'o':
+			out_file = optarg;
+			break;
+		case 'B':
+			baseline = optarg;
+			break;
+		case 't':
+			threshold = atof(optarg);
+			break;
+		case 's':
+			stats = 1;
+			break;
+		case 'S':
+			sweep_spec = optarg;
+			break;
+		case 'u':
+			sweep.udc = optarg;
+			break;
+		case 'x':
+			sweep.cmd = optarg;
+			break;
+		case 'n':
+			sweep.bytes = atoll(optarg);
+			break;
+		case 'w':
+			sweep.settle_ms = atoi(optarg);
+			break;
+		case 'e':
+			sweep.enumerate = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (p.gadgets < 1 || p.functions < 0 || p.configs < 1 ||
+	    p.repeat < 1 || p.repeat > BENCH_MAX_REPEAT) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (sweep_spec)
+		return run_sweep(&p, &sweep, sweep_spec, out_file) ?
+			EXIT_FAILURE : EXIT_SUCCESS;
+
+	memset(res, 0, sizeof(res));
+	if (baseline && load_baseline(baseline, res) != 0)
+		return EXIT_FAILURE;
+
+	usbg_enable_stats(stats);
+	ret = bench_run(&p, res);
+	if (ret != USBG_SUCCESS)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < BENCH_PHASES; ++i)
+		bench_summarize(&p, &res[i]);
+
+	out = open_output(out_file);
+	if (!out)
+		return EXIT_FAILURE;
+
+	print_json(out, &p, res, baseline != NULL, stats);
+	if (out != stdout)
+		fclose(out);
+
+	if (baseline && compare_baseline(res, threshold))
+		return BENCH_EXIT_REGRESSION;
+
+	return EXIT_SUCCESS;
+}
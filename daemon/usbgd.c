@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/**
+ * @file usbgd.c
+ * Daemon sharing one view of configfs gadgets between processes.
+ * Clients select backend created by usbg_backend_client_create() and then
+ * use libusbg as usual. Daemon runs in foreground until SIGINT or SIGTERM.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_daemon.h>
+#include <usbg/usbg_log.h>
+
+#define USBGD_CONFIGFS "/sys/kernel/config"
+#define USBGD_SOCKET "/run/usbgd.sock"
+
+static volatile sig_atomic_t usbgd_stop;
+
+static void usbgd_signal(int sig)
+{
+	usbgd_stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p PATH  configfs mount point (default %s)\n"
+		"  -s PATH  socket for clients (default %s)\n"
+		"  -m SIZE  size of shared memory in bytes (default %d)\n"
+		"  -v       log also debug messages\n",
+		name, USBGD_CONFIGFS, USBGD_SOCKET,
+		USBG_DAEMON_DEFAULT_SHM_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+	const char *configfs = USBGD_CONFIGFS;
+	const char *socket_path = USBGD_SOCKET;
+	size_t shm_size = 0;
+	struct sigaction sa;
+	struct pollfd pfd;
+	usbg_daemon *d;
+	int ret = -EINVAL;
+	int usbg_ret;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:s:m:vh")) != -1) {
+		switch (opt) {
+		case 'p':
+			configfs = optarg;
+			break;
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'm':
+			shm_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			usbg_set_log_level(USBG_LOG_DEBUG);
+			break;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = usbgd_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	usbg_ret = usbg_daemon_create(configfs, socket_path, shm_size, &d);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on daemon start\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+			usbg_strerror(usbg_ret));
+		return ret;
+	}
+
+	pfd.fd = usbg_daemon_get_fd(d);
+	pfd.events = POLLIN;
+	ret = 0;
+
+	while (!usbgd_stop) {
+		/* Signal interrupts poll() with EINTR */
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+
+		/* Failure of single request is not fatal for daemon */
+		usbg_ret = usbg_daemon_process(d);
+		if (usbg_ret != USBG_SUCCESS)
+			fprintf(stderr, "Error: %s : %s\n",
+				usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+	}
+
+	usbg_daemon_destroy(d);
+	return ret;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_hid.h>
+
+/**
+ * @file gadget-hid.c
+ * @example gadget-hid.c
+ * This is an example of how to create boot keyboard gadget and type
+ * on it with report writer. Time each keystroke spent on device side
+ * is printed, so it may be compared with time of input event on host.
+ *
+ * Usage: gadget-hid [interval]
+ */
+
+#define VENDOR		0x1d6b
+#define PRODUCT		0x0104
+
+#define REPORT_LENGTH	8
+
+/* Keyboard with modifiers, LEDs and 6 keys from HID 1.11 appendix B.1 */
+static const unsigned char report_desc[] = {
+	0x05, 0x01,	/* Usage Page (Generic Desktop) */
+	0x09, 0x06,	/* Usage (Keyboard) */
+	0xa1, 0x01,	/* Collection (Application) */
+	0x05, 0x07,	/*   Usage Page (Key Codes) */
+	0x19, 0xe0,	/*   Usage Minimum (224) */
+	0x29, 0xe7,	/*   Usage Maximum (231) */
+	0x15, 0x00,	/*   Logical Minimum (0) */
+	0x25, 0x01,	/*   Logical Maximum (1) */
+	0x75, 0x01,	/*   Report Size (1) */
+	0x95, 0x08,	/*   Report Count (8) */
+	0x81, 0x02,	/*   Input (Data, Variable, Absolute) */
+	0x95, 0x01,	/*   Report Count (1) */
+	0x75, 0x08,	/*   Report Size (8) */
+	0x81, 0x03,	/*   Input (Constant) */
+	0x95, 0x05,	/*   Report Count (5) */
+	0x75, 0x01,	/*   Report Size (1) */
+	0x05, 0x08,	/*   Usage Page (LEDs) */
+	0x19, 0x01,	/*   Usage Minimum (1) */
+	0x29, 0x05,	/*   Usage Maximum (5) */
+	0x91, 0x02,	/*   Output (Data, Variable, Absolute) */
+	0x95, 0x01,	/*   Report Count (1) */
+	0x75, 0x03,	/*   Report Size (3) */
+	0x91, 0x03,	/*   Output (Constant) */
+	0x95, 0x06,	/*   Report Count (6) */
+	0x75, 0x08,	/*   Report Size (8) */
+	0x15, 0x00,	/*   Logical Minimum (0) */
+	0x25, 0x65,	/*   Logical Maximum (101) */
+	0x05, 0x07,	/*   Usage Page (Key Codes) */
+	0x19, 0x00,	/*   Usage Minimum (0) */
+	0x29, 0x65,	/*   Usage Maximum (101) */
+	0x81, 0x00,	/*   Input (Data, Array) */
+	0xc0,		/* End Collection */
+};
+
+/* "hello", each key is pressed and released */
+static const unsigned char keys[] = { 0x0b, 0x08, 0x0f, 0x0f, 0x12 };
+
+static int type_keys(usbg_function *f)
+{
+	usbg_hid_timestamp ts[2 * sizeof(keys)];
+	unsigned char report[REPORT_LENGTH];
+	usbg_hid_writer *w;
+	int i, n;
+	int usbg_ret;
+
+	usbg_ret = usbg_hid_writer_open_function(f, 0, &w);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error opening HID device\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		return usbg_ret;
+	}
+
+	for (i = 0; i < sizeof(keys); ++i) {
+		memset(report, 0, sizeof(report));
+		report[2] = keys[i];
+		usbg_hid_writer_queue(w, report);
+		report[2] = 0;
+		usbg_hid_writer_queue(w, report);
+	}
+
+	n = usbg_hid_writer_flush(w, ts, 2 * sizeof(keys));
+	if (n < 0) {
+		fprintf(stderr, "Error writing reports\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(n),
+				usbg_strerror(n));
+		usbg_hid_writer_close(w);
+		return n;
+	}
+
+	for (i = 0; i < n; ++i)
+		fprintf(stdout, "report %d: written after %llu us, done after %llu us\n",
+			i, (unsigned long long)(ts[i].written_ns
+						- ts[i].queued_ns) / 1000,
+			ts[i].done_ns ? (unsigned long long)(ts[i].done_ns
+						- ts[i].queued_ns) / 1000 : 0);
+
+	usbg_hid_writer_close(w);
+	return USBG_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	usbg_state *s;
+	usbg_gadget *g;
+	usbg_config *c;
+	usbg_function *f_hid;
+	int ret = -EINVAL;
+	int usbg_ret;
+
+	usbg_gadget_attrs g_attrs = {
+			0x0200, /* bcdUSB */
+			0x00, /* Defined at interface level */
+			0x00, /* subclass */
+			0x00, /* device protocol */
+			0x0040, /* Max allowed packet size */
+			VENDOR,
+			PRODUCT,
+			0x0001, /* Verson of device */
+	};
+
+	usbg_gadget_strs g_strs = {
+			"0123456789", /* Serial number */
+			"Foo Inc.", /* Manufacturer */
+			"Keyboard gadget" /* Product string */
+	};
+
+	usbg_config_strs c_strs = {
+			"HID"
+	};
+
+	/* Poll each microframe at high speed, 1 ms at full speed */
+	usbg_f_hid_attrs hid_attrs = {
+		.protocol = 1,
+		.subclass = 1,
+		.report_length = REPORT_LENGTH,
+		.interval = 1,
+	};
+
+	if (argc > 1)
+		hid_attrs.interval = atoi(argv[1]);
+
+	usbg_ret = usbg_init("/sys/kernel/config", &s);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on USB gadget init\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out1;
+	}
+
+	usbg_ret = usbg_create_gadget(s, "g1", &g_attrs, &g_strs, &g);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on create gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_function(g, F_HID, "usb0",
+			(usbg_function_attrs *)&hid_attrs, &f_hid);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating HID function\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_set_hid_report_desc(f_hid, report_desc,
+					    sizeof(report_desc));
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error setting report descriptor\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_config(g, 1, "The only one", NULL, &c_strs, &c);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating config\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_add_config_function(c, "hid.usb0", f_hid);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error adding hid.usb0\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_enable_gadget(g, DEFAULT_UDC);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error enabling gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	/* Give host time to enumerate device */
+	sleep(2);
+	if (type_keys(f_hid) == USBG_SUCCESS)
+		ret = 0;
+
+out2:
+	usbg_cleanup(s);
+
+out1:
+	return ret;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <usbg/usbg.h>
+
+/**
+ * @file gadget-uvc.c
+ * @example gadget-uvc.c
+ * This is an example of how to create webcam gadget with uncompressed
+ * and MJPEG formats in several resolutions. Frames are supplied by user
+ * space application (e.g. uvc-gadget) through V4L2 output device.
+ *
+ * Usage: gadget-uvc [streaming_maxpacket [streaming_maxburst]]
+ */
+
+#define VENDOR		0x1d6b
+#define PRODUCT		0x0102
+
+/* Frame intervals in 100 ns units */
+#define FPS_30		333333
+#define FPS_15		666666
+#define FPS_5		2000000
+
+int main(int argc, char **argv)
+{
+	usbg_state *s;
+	usbg_gadget *g;
+	usbg_config *c;
+	usbg_function *f_uvc;
+	int ret = -EINVAL;
+	int usbg_ret;
+
+	usbg_gadget_attrs g_attrs = {
+			0x0200, /* bcdUSB */
+			0xef, /* Miscellaneous, required for IAD */
+			0x02, /* Common class */
+			0x01, /* Interface association */
+			0x0040, /* Max allowed packet size */
+			VENDOR,
+			PRODUCT,
+			0x0001, /* Verson of device */
+	};
+
+	usbg_gadget_strs g_strs = {
+			"0123456789", /* Serial number */
+			"Foo Inc.", /* Manufacturer */
+			"Webcam gadget" /* Product string */
+	};
+
+	usbg_config_strs c_strs = {
+			"UVC"
+	};
+
+	static const usbg_uvc_frame yuyv_frames[] = {
+		{ 640, 360, 2, { FPS_30, FPS_15 } },
+		{ 1280, 720, 2, { FPS_15, FPS_5 } },
+	};
+
+	static const usbg_uvc_frame mjpeg_frames[] = {
+		{ 640, 360, 1, { FPS_30 } },
+		{ 1280, 720, 1, { FPS_30 } },
+		{ 1920, 1080, 2, { FPS_30, FPS_15 } },
+	};
+
+	static const usbg_uvc_format formats[] = {
+		{ USBG_UVC_FORMAT_UNCOMPRESSED, NULL, 2, yuyv_frames },
+		{ USBG_UVC_FORMAT_MJPEG, NULL, 3, mjpeg_frames },
+	};
+
+	/* High bandwidth endpoint, 3 transactions per microframe */
+	usbg_f_uvc_attrs uvc_attrs = {
+		.streaming_interval = 1,
+		.streaming_maxpacket = 3072,
+		.streaming_maxburst = 0,
+	};
+
+	if (argc > 1)
+		uvc_attrs.streaming_maxpacket = atoi(argv[1]);
+	if (argc > 2)
+		uvc_attrs.streaming_maxburst = atoi(argv[2]);
+
+	usbg_ret = usbg_init("/sys/kernel/config", &s);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on USB gadget init\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out1;
+	}
+
+	usbg_ret = usbg_create_gadget(s, "g1", &g_attrs, &g_strs, &g);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on create gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_uvc_function(g, "usb0", &uvc_attrs, formats,
+					    2, &f_uvc);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating UVC function\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_config(g, 1, "The only one", NULL, &c_strs, &c);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating config\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_add_config_function(c, "uvc.usb0", f_uvc);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error adding uvc.usb0\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_enable_gadget(g, DEFAULT_UDC);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error enabling gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	ret = 0;
+
+out2:
+	usbg_cleanup(s);
+
+out1:
+	return ret;
+}
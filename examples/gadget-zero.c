@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <usbg/usbg.h>
+
+/**
+ * @file gadget-zero.c
+ * @example gadget-zero.c
+ * This is an example of how to create gadget equivalent to g_zero module,
+ * used to measure throughput of UDC and cable with host side test tools
+ * like testusb. Configuration 1 contains SourceSink function, which
+ * produces and consumes data, configuration 2 contains Loopback function,
+ * which sends back whatever it receives.
+ *
+ * Usage: gadget-zero [bulk_buflen [qlen [pattern]]]
+ */
+
+#define VENDOR		0x0525
+#define PRODUCT		0xa4a0
+
+int main(int argc, char **argv)
+{
+	usbg_state *s;
+	usbg_gadget *g;
+	usbg_config *c;
+	usbg_function *f_ss, *f_lb;
+	int ret = -EINVAL;
+	int usbg_ret;
+
+	usbg_gadget_attrs g_attrs = {
+			0x0200, /* bcdUSB */
+			0xff, /* Vendor specific */
+			0x00, /* subclass */
+			0x00, /* device protocol */
+			0x0040, /* Max allowed packet size */
+			VENDOR,
+			PRODUCT,
+			0x0001, /* Verson of device */
+	};
+
+	usbg_gadget_strs g_strs = {
+			"0123456789", /* Serial number */
+			"Foo Inc.", /* Manufacturer */
+			"Gadget Zero" /* Product string */
+	};
+
+	usbg_config_strs ss_strs = {
+			"source and sink data"
+	};
+
+	usbg_config_strs lb_strs = {
+			"loop input to output"
+	};
+
+	/* Defaults of the kernel, tuned by command line */
+	usbg_function_attrs ss_attrs = {
+		.sourcesink = {
+			.pattern = 0,
+			.isoc_interval = 4,
+			.isoc_maxpacket = 1024,
+			.isoc_mult = 0,
+			.isoc_maxburst = 0,
+			.bulk_buflen = 4096,
+			.bulk_qlen = 32,
+			.iso_qlen = 8,
+		},
+	};
+
+	usbg_function_attrs lb_attrs = {
+		.loopback = {
+			.bulk_buflen = 4096,
+			.qlen = 32,
+		},
+	};
+
+	if (argc > 1)
+		ss_attrs.sourcesink.bulk_buflen = lb_attrs.loopback.bulk_buflen
+			= atoi(argv[1]);
+	if (argc > 2)
+		ss_attrs.sourcesink.bulk_qlen = lb_attrs.loopback.qlen
+			= atoi(argv[2]);
+	if (argc > 3)
+		ss_attrs.sourcesink.pattern = atoi(argv[3]);
+
+	usbg_ret = usbg_init("/sys/kernel/config", &s);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on USB gadget init\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out1;
+	}
+
+	usbg_ret = usbg_create_gadget(s, "g1", &g_attrs, &g_strs, &g);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error on create gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_function(g, F_SOURCESINK, "zero", &ss_attrs,
+					&f_ss);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating SourceSink function\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_function(g, F_LOOPBACK, "zero", &lb_attrs,
+					&f_lb);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating Loopback function\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_config(g, 1, "The first", NULL, &ss_strs, &c);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating config 1\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_add_config_function(c, "SourceSink.zero", f_ss);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error adding SourceSink.zero\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_create_config(g, 2, "The second", NULL, &lb_strs, &c);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error creating config 2\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_add_config_function(c, "Loopback.zero", f_lb);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error adding Loopback.zero\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	usbg_ret = usbg_enable_gadget(g, DEFAULT_UDC);
+	if (usbg_ret != USBG_SUCCESS) {
+		fprintf(stderr, "Error enabling gadget\n");
+		fprintf(stderr, "Error: %s : %s\n", usbg_error_name(usbg_ret),
+				usbg_strerror(usbg_ret));
+		goto out2;
+	}
+
+	ret = 0;
+
+out2:
+	usbg_cleanup(s);
+
+out1:
+	return ret;
+}
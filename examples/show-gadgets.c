@@ -68,6 +68,58 @@ void show_gadget(usbg_gadget *g)
 	fprintf(stdout, "  Product\t\t%s\n", g_strs.str_prd);
 }
 
+void show_ms_luns(usbg_function *f)
+{
+	usbg_f_ms_lun_attrs lun_attrs;
+	unsigned int luns;
+	int lun, usbg_ret;
+
+	usbg_ret = usbg_get_ms_luns(f, &luns);
+	if (usbg_ret != USBG_SUCCESS)
+		return;
+
+	for (lun = 0; lun < USBG_MAX_MS_LUNS; ++lun) {
+		if (!(luns & (1U << lun)) ||
+		    usbg_get_ms_lun_attrs(f, lun, &lun_attrs) != USBG_SUCCESS)
+			continue;
+
+		fprintf(stdout, "    lun.%d\t\t%s%s%s%s%s\n", lun,
+			lun_attrs.file[0] ? lun_attrs.file : "(no medium)",
+			lun_attrs.ro ? " ro" : "",
+			lun_attrs.removable ? " removable" : "",
+			lun_attrs.cdrom ? " cdrom" : "",
+			lun_attrs.nofua ? " nofua" : "");
+	}
+}
+
+void show_uvc_formats(usbg_function *f)
+{
+	usbg_uvc_format *formats;
+	const usbg_uvc_frame *frame;
+	int i, j, n, usbg_ret;
+
+	usbg_ret = usbg_get_uvc_formats(f, &formats, &n);
+	if (usbg_ret != USBG_SUCCESS)
+		return;
+
+	for (i = 0; i < n; ++i) {
+		fprintf(stdout, "    format %s\t\t%s\n", formats[i].name,
+			formats[i].type == USBG_UVC_FORMAT_MJPEG ?
+			"mjpeg" : "uncompressed");
+		for (j = 0; j < formats[i].n_frames; ++j) {
+			frame = formats[i].frames + j;
+			if (!frame->n_intervals)
+				continue;
+			fprintf(stdout, "      %dx%d\t\t%d.%d fps default\n",
+				frame->width, frame->height,
+				10000000 / frame->intervals[0],
+				100000000 / frame->intervals[0] % 10);
+		}
+	}
+
+	usbg_free_uvc_formats(formats, n);
+}
+
 void show_function(usbg_function *f)
 {
 	char instance[USBG_MAX_STR_LENGTH];
@@ -111,6 +163,86 @@ void show_function(usbg_function *f)
 	case F_FFS:
 		fprintf(stdout, "    dev_name\t\t%s\n", f_attrs.ffs.dev_name);
 		break;
+	case F_LOOPBACK:
+		fprintf(stdout, "    bulk_buflen\t\t%d\n",
+				f_attrs.loopback.bulk_buflen);
+		fprintf(stdout, "    qlen\t\t%d\n", f_attrs.loopback.qlen);
+		break;
+	case F_SOURCESINK:
+		fprintf(stdout, "    pattern\t\t%d\n",
+				f_attrs.sourcesink.pattern);
+		fprintf(stdout, "    bulk_buflen\t\t%d\n",
+				f_attrs.sourcesink.bulk_buflen);
+		fprintf(stdout, "    bulk_qlen\t\t%d\n",
+				f_attrs.sourcesink.bulk_qlen);
+		fprintf(stdout, "    iso_qlen\t\t%d\n",
+				f_attrs.sourcesink.iso_qlen);
+		fprintf(stdout, "    isoc_interval\t%d\n",
+				f_attrs.sourcesink.isoc_interval);
+		fprintf(stdout, "    isoc_maxpacket\t%d\n",
+				f_attrs.sourcesink.isoc_maxpacket);
+		fprintf(stdout, "    isoc_mult\t\t%d\n",
+				f_attrs.sourcesink.isoc_mult);
+		fprintf(stdout, "    isoc_maxburst\t%d\n",
+				f_attrs.sourcesink.isoc_maxburst);
+		break;
+	case F_MASS_STORAGE:
+		fprintf(stdout, "    stall\t\t%d\n", f_attrs.ms.stall);
+		show_ms_luns(f);
+		break;
+	case F_UVC:
+		fprintf(stdout, "    streaming_interval\t%d\n",
+				f_attrs.uvc.streaming_interval);
+		fprintf(stdout, "    streaming_maxpacket\t%d\n",
+				f_attrs.uvc.streaming_maxpacket);
+		fprintf(stdout, "    streaming_maxburst\t%d\n",
+				f_attrs.uvc.streaming_maxburst);
+		show_uvc_formats(f);
+		break;
+	case F_UAC2:
+		fprintf(stdout, "    c_chmask\t\t0x%x\n", f_attrs.uac2.c_chmask);
+		fprintf(stdout, "    c_srate\t\t%d\n", f_attrs.uac2.c_srate);
+		fprintf(stdout, "    c_ssize\t\t%d\n", f_attrs.uac2.c_ssize);
+		fprintf(stdout, "    c_sync\t\t%s\n", f_attrs.uac2.c_sync);
+		fprintf(stdout, "    p_chmask\t\t0x%x\n", f_attrs.uac2.p_chmask);
+		fprintf(stdout, "    p_srate\t\t%d\n", f_attrs.uac2.p_srate);
+		fprintf(stdout, "    p_ssize\t\t%d\n", f_attrs.uac2.p_ssize);
+		fprintf(stdout, "    req_number\t\t%d\n",
+				f_attrs.uac2.req_number);
+		fprintf(stdout, "    fb_max\t\t%d\n", f_attrs.uac2.fb_max);
+		break;
+	case F_UAC1:
+		fprintf(stdout, "    c_chmask\t\t0x%x\n", f_attrs.uac1.c_chmask);
+		fprintf(stdout, "    c_srate\t\t%d\n", f_attrs.uac1.c_srate);
+		fprintf(stdout, "    c_ssize\t\t%d\n", f_attrs.uac1.c_ssize);
+		fprintf(stdout, "    p_chmask\t\t0x%x\n", f_attrs.uac1.p_chmask);
+		fprintf(stdout, "    p_srate\t\t%d\n", f_attrs.uac1.p_srate);
+		fprintf(stdout, "    p_ssize\t\t%d\n", f_attrs.uac1.p_ssize);
+		fprintf(stdout, "    req_number\t\t%d\n",
+				f_attrs.uac1.req_number);
+		break;
+	case F_HID:
+		fprintf(stdout, "    protocol\t\t%d\n", f_attrs.hid.protocol);
+		fprintf(stdout, "    subclass\t\t%d\n", f_attrs.hid.subclass);
+		fprintf(stdout, "    report_length\t%d\n",
+				f_attrs.hid.report_length);
+		fprintf(stdout, "    interval\t\t%d\n", f_attrs.hid.interval);
+		fprintf(stdout, "    dev\t\t\t%s\n", f_attrs.hid.dev);
+		break;
+	case F_PRINTER:
+		fprintf(stdout, "    pnp_string\t\t%s\n",
+				f_attrs.printer.pnp_string);
+		fprintf(stdout, "    q_len\t\t%d\n", f_attrs.printer.q_len);
+		break;
+	case F_MIDI:
+		fprintf(stdout, "    index\t\t%d\n", f_attrs.midi.index);
+		fprintf(stdout, "    id\t\t\t%s\n", f_attrs.midi.id);
+		fprintf(stdout, "    in_ports\t\t%d\n", f_attrs.midi.in_ports);
+		fprintf(stdout, "    out_ports\t\t%d\n",
+				f_attrs.midi.out_ports);
+		fprintf(stdout, "    buflen\t\t%d\n", f_attrs.midi.buflen);
+		fprintf(stdout, "    qlen\t\t%d\n", f_attrs.midi.qlen);
+		break;
 	default:
 		fprintf(stdout, "    UNKNOWN\n");
 	}
@@ -24,6 +24,10 @@
 #include <limits.h>
 #include <stdio.h> /* For FILE * */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @file include/usbg/usbg.h
  * @todo Clean up static buffers in structures
@@ -32,6 +36,15 @@
 /**
  * @addtogroup libusbg
  * Public API for USB gadget-configfs library
+ *
+ * All functions may be called concurrently from many threads for the
+ * same usbg_state. Lookups and iteration run in parallel; changes of a
+ * gadget (its configs, functions, bindings and UDC) lock only this
+ * gadget. Objects must not be used after they have been removed, also
+ * by other threads, so removal has to be coordinated by the application.
+ * Functions returning import error details must be called by the thread
+ * which did the import. usbg_set_backend(), usbg_set_log_callback() and
+ * usbg_set_trace_callback() should be called before other threads start.
  * @{
  */
 
@@ -148,7 +161,17 @@ typedef enum
 	F_EEM,
 	F_RNDIS,
 	F_PHONET,
-	F_FFS
+	F_FFS,
+	F_LOOPBACK,
+	F_SOURCESINK,
+	F_MASS_STORAGE,
+	F_UVC,
+	F_UAC2,
+	F_UAC1,
+	F_HID,
+	F_PRINTER,
+	F_MIDI,
+	USBG_FUNCTION_TYPE_MAX,
 } usbg_function_type;
 
 /**
@@ -188,6 +211,203 @@ typedef struct {
 	char dev_name[USBG_MAX_DEV_LENGTH];
 } usbg_f_ffs_attrs;
 
+/**
+ * @typedef usbg_f_loopback_attrs
+ * @brief Attributes for the Loopback test function
+ */
+typedef struct {
+	int bulk_buflen;
+	int qlen;
+} usbg_f_loopback_attrs;
+
+/**
+ * @typedef usbg_f_sourcesink_attrs
+ * @brief Attributes for the SourceSink test function
+ * @details pattern selects data sent to host: 0 for zeros, 1 for
+ * mod63, 2 for none (data is not checked or filled at all).
+ */
+typedef struct {
+	int pattern;
+	int isoc_interval;
+	int isoc_maxpacket;
+	int isoc_mult;
+	int isoc_maxburst;
+	int bulk_buflen;
+	int bulk_qlen;
+	int iso_qlen;
+} usbg_f_sourcesink_attrs;
+
+/**
+ * @brief Maximal number of logical units of mass storage function
+ */
+#define USBG_MAX_MS_LUNS 16
+
+/**
+ * @typedef usbg_f_ms_attrs
+ * @brief Attributes for the mass storage function
+ * @details Logical units are managed separately, see usbg_create_ms_lun()
+ */
+typedef struct {
+	int stall;
+} usbg_f_ms_attrs;
+
+/**
+ * @typedef usbg_f_ms_lun_attrs
+ * @brief Attributes of single logical unit of mass storage function
+ * @details Empty file means no medium. nofua makes the function ignore
+ * FUA flag of SCSI WRITE(10,12), so writes are not synced to backing
+ * file one by one, which is much faster.
+ */
+typedef struct {
+	int cdrom;
+	int nofua;
+	int removable;
+	int ro;
+	char file[USBG_MAX_PATH_LENGTH];
+} usbg_f_ms_lun_attrs;
+
+/**
+ * @typedef usbg_f_uvc_attrs
+ * @brief Attributes of isochronous streaming endpoint of UVC function
+ * @details Bandwidth reserved for video is streaming_maxpacket (up to
+ * 1024 bytes, or 3072 for high bandwidth endpoints with 2 or 3
+ * transactions) times streaming_maxburst + 1 (SuperSpeed only) per
+ * 2^(streaming_interval - 1) microframes. Formats and frames are managed
+ * separately, see usbg_set_uvc_formats().
+ */
+typedef struct {
+	int streaming_interval;
+	int streaming_maxpacket;
+	int streaming_maxburst;
+} usbg_f_uvc_attrs;
+
+/**
+ * @brief Maximal number of frame intervals of single UVC frame
+ */
+#define USBG_UVC_MAX_INTERVALS 16
+
+/**
+ * @typedef usbg_uvc_format_type
+ * @brief Video format, selects directory in streaming/
+ */
+typedef enum {
+	USBG_UVC_FORMAT_UNCOMPRESSED,
+	USBG_UVC_FORMAT_MJPEG,
+	USBG_UVC_FORMAT_TYPE_MAX,
+} usbg_uvc_format_type;
+
+/**
+ * @typedef usbg_uvc_frame
+ * @brief Single resolution of UVC format
+ * @details Intervals are in 100 ns units, first one is the default,
+ * e.g. 333333 for 30 fps. Bit rates and size of frame buffer are
+ * computed from resolution assuming 16 bits per pixel.
+ */
+typedef struct {
+	int width;
+	int height;
+	int n_intervals;
+	int intervals[USBG_UVC_MAX_INTERVALS];
+} usbg_uvc_frame;
+
+/**
+ * @typedef usbg_uvc_format
+ * @brief UVC format with its frames
+ * @details Name of format directory may be NULL to use "u" for
+ * uncompressed and "m" for MJPEG format. The first frame is the default.
+ */
+typedef struct {
+	usbg_uvc_format_type type;
+	const char *name;
+	int n_frames;
+	const usbg_uvc_frame *frames;
+} usbg_uvc_format;
+
+/**
+ * @typedef usbg_f_uac2_attrs
+ * @brief Attributes for the USB Audio Class 2.0 function
+ * @details c_ is for capture (host to device), p_ for playback. Channel
+ * mask of 0 disables given direction. req_number is number of requests
+ * queued on each endpoint, more of them tolerate longer scheduling
+ * latency at cost of audio latency. fb_max is maximal deviation of
+ * feedback in 1/1000 for async capture, c_sync is "async" or "adaptive".
+ */
+typedef struct {
+	int c_chmask;
+	int c_srate;
+	int c_ssize;
+	int p_chmask;
+	int p_srate;
+	int p_ssize;
+	int req_number;
+	int fb_max;
+	char c_sync[USBG_MAX_STR_LENGTH];
+} usbg_f_uac2_attrs;
+
+/**
+ * @typedef usbg_f_uac1_attrs
+ * @brief Attributes for the USB Audio Class 1.0 function
+ * @details Meaning is the same as for usbg_f_uac2_attrs.
+ */
+typedef struct {
+	int c_chmask;
+	int c_srate;
+	int c_ssize;
+	int p_chmask;
+	int p_srate;
+	int p_ssize;
+	int req_number;
+} usbg_f_uac1_attrs;
+
+/**
+ * @typedef usbg_f_hid_attrs
+ * @brief Attributes for the HID function
+ * @details protocol and subclass go to interface descriptor, 1 and 1
+ * for boot keyboard, 2 and 1 for boot mouse. report_length is size of
+ * single report in bytes. interval is polling interval of interrupt
+ * endpoints in frames (full speed) or in 2^(interval-1) microframes,
+ * older kernels don't have it and use 10 and 4 respectively. dev is
+ * "major:minor" of /dev/hidgN, read only. Report descriptor is binary,
+ * see usbg_set_hid_report_desc().
+ */
+typedef struct {
+	int protocol;
+	int subclass;
+	int report_length;
+	int interval;
+	char dev[USBG_MAX_STR_LENGTH];
+} usbg_f_hid_attrs;
+
+/**
+ * @typedef usbg_f_printer_attrs
+ * @brief Attributes for the Printer function
+ * @details pnp_string is IEEE 1284 device ID returned to host, e.g.
+ * "MFG:Foo;MDL:Bar;CMD:PCL;CLS:PRINTER;". q_len is number of requests
+ * queued in each direction, it can be changed only while
+ * /dev/g_printerN is not open.
+ */
+typedef struct {
+	char pnp_string[USBG_MAX_STR_LENGTH];
+	int q_len;
+} usbg_f_printer_attrs;
+
+/**
+ * @typedef usbg_f_midi_attrs
+ * @brief Attributes for the MIDI function
+ * @details index and id select ALSA sound card created on device side,
+ * -1 and empty id let ALSA choose. in_ports and out_ports are numbers
+ * of jacks, buflen is size of single request and qlen number of
+ * requests queued on each endpoint.
+ */
+typedef struct {
+	int index;
+	char id[USBG_MAX_STR_LENGTH];
+	int in_ports;
+	int out_ports;
+	int buflen;
+	int qlen;
+} usbg_f_midi_attrs;
+
 /**
  * @typedef attrs
  * @brief Attributes for a given function type
@@ -197,8 +417,56 @@ typedef union {
 	usbg_f_net_attrs net;
 	usbg_f_phonet_attrs phonet;
 	usbg_f_ffs_attrs ffs;
+	usbg_f_loopback_attrs loopback;
+	usbg_f_sourcesink_attrs sourcesink;
+	usbg_f_ms_attrs ms;
+	usbg_f_uvc_attrs uvc;
+	usbg_f_uac2_attrs uac2;
+	usbg_f_uac1_attrs uac1;
+	usbg_f_hid_attrs hid;
+	usbg_f_printer_attrs printer;
+	usbg_f_midi_attrs midi;
 } usbg_function_attrs;
 
+/**
+ * @typedef usbg_attr_type
+ * @brief Kind of value kept in function attribute
+ */
+typedef enum {
+	USBG_ATTR_INT,
+	USBG_ATTR_STRING,
+	USBG_ATTR_ETHER_ADDR,
+	USBG_ATTR_PATH,
+} usbg_attr_type;
+
+/**
+ * @typedef usbg_attr_desc
+ * @brief Description of single attribute of function type
+ * @details Value of attribute is kept in usbg_function_attrs at given
+ * offset as int, char[USBG_MAX_STR_LENGTH], struct ether_addr or
+ * char[USBG_MAX_PATH_LENGTH] for USBG_ATTR_PATH.
+ */
+typedef struct {
+	const char *name;
+	usbg_attr_type type;
+	int base;		/**< Base of USBG_ATTR_INT: 10 or 16 */
+	int writable;
+	int optional;		/**< Missing in older kernels, reads as 0 */
+	size_t offset;		/**< Position in usbg_function_attrs */
+} usbg_attr_desc;
+
+/**
+ * @typedef usbg_attr_cb
+ * @brief Called for each attribute found in function directory
+ * @param name Name of attribute
+ * @param desc Description or NULL if attribute is not in schema
+ * @param value Content of attribute without trailing newline
+ * @param data User data
+ * @return 0 to continue, any other value stops iteration
+ */
+typedef int (*usbg_attr_cb)(const char *name, const usbg_attr_desc *desc,
+			    const char *value, void *data);
+
 /* Error codes */
 
 /**
@@ -270,6 +538,13 @@ extern size_t usbg_get_configfs_path_len(usbg_state *s);
  */
 extern int usbg_get_configfs_path(usbg_state *s, char *buf, size_t len);
 
+/**
+ * @brief Get ConfigFS path without copying
+ * @param s Pointer to state
+ * @return Path owned by state, valid until usbg_cleanup(), or NULL
+ */
+extern const char *usbg_get_configfs_path_str(usbg_state *s);
+
 /* USB gadget queries */
 
 /**
@@ -417,6 +692,13 @@ extern size_t usbg_get_gadget_name_len(usbg_gadget *g);
  */
 extern int usbg_get_gadget_name(usbg_gadget *g, char *buf, size_t len);
 
+/**
+ * @brief Get gadget name without copying
+ * @param g Pointer to gadget
+ * @return Name owned by gadget, valid as long as gadget exists, or NULL
+ */
+extern const char *usbg_get_gadget_name_str(usbg_gadget *g);
+
 /**
  * @brief Set the USB gadget vendor id
  * @param g Pointer to gadget
@@ -568,6 +850,14 @@ extern size_t usbg_get_function_instance_len(usbg_function *f);
  */
 extern int usbg_get_function_instance(usbg_function *f, char *buf, size_t len);
 
+/**
+ * @brief Get function instance name without copying
+ * @param f Pointer to function
+ * @return Instance name owned by function, valid as long as function
+ * exists, or NULL
+ */
+extern const char *usbg_get_function_instance_str(usbg_function *f);
+
 /**
  * @brief Get function type as a string
  * @param type Function type
@@ -607,6 +897,13 @@ extern size_t usbg_get_config_label_len(usbg_config *c);
  */
 extern int usbg_get_config_label(usbg_config *c, char *buf, size_t len);
 
+/**
+ * @brief Get config label without copying
+ * @param c Pointer to config
+ * @return Label owned by config, valid as long as config exists, or NULL
+ */
+extern const char *usbg_get_config_label_str(usbg_config *c);
+
 /**
  * @brieg Get config id
  * @param c Pointer to config
@@ -709,6 +1006,13 @@ extern size_t usbg_get_binding_name_len(usbg_binding *b);
  */
 extern int usbg_get_binding_name(usbg_binding *b, char *buf, size_t len);
 
+/**
+ * @brief Get binding name without copying
+ * @param b Pointer to binding
+ * @return Name owned by binding, valid as long as binding exists, or NULL
+ */
+extern const char *usbg_get_binding_name_str(usbg_binding *b);
+
 /* USB gadget setup and teardown */
 
 /**
@@ -720,6 +1024,9 @@ extern int usbg_get_udcs(struct dirent ***udc_list);
 
 /**
  * @brief Enable a USB gadget device
+ * @details Profiles set with usbg_set_net_profile() are applied after
+ * bind. Their failures are only logged, as gadget is bound and works
+ * anyway. usbg_apply_net_profile() may be used to get their status.
  * @param g Pointer to gadget
  * @param udc Name of UDC to enable gadget
  * @return 0 on success or usbg_error if error occurred.
@@ -751,6 +1058,18 @@ extern size_t usbg_get_gadget_udc_len(usbg_gadget *g);
  */
 extern int usbg_get_gadget_udc(usbg_gadget *g, char *buf, size_t len);
 
+/**
+ * @brief Get state of UDC gadget is bound to
+ * @details State is "configured" once host has selected configuration,
+ * so polling it after usbg_enable_gadget() gives enumeration time.
+ * @param g Pointer to gadget
+ * @param buf Buffer for state, e.g. "not attached" or "configured"
+ * @param len Size of buffer
+ * @return 0 on success, USBG_ERROR_NOT_FOUND if gadget is not bound,
+ * other usbg_error if error occurred
+ */
+extern int usbg_get_gadget_udc_state(usbg_gadget *g, char *buf, size_t len);
+
 /*
  * USB function-specific attribute configuration
  */
@@ -780,6 +1099,70 @@ extern int usbg_get_function_attrs(usbg_function *f,
  */
 extern int usbg_set_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs);
 
+/**
+ * @brief Get schema of attributes of given function type
+ * @param type Function type
+ * @param descs Pointer to be filled with array of descriptions
+ * @return Number of attributes or usbg_error if error occurred
+ */
+extern int usbg_get_function_attr_descs(usbg_function_type type,
+					const usbg_attr_desc **descs);
+
+/**
+ * @brief Get value of function attribute by name
+ * @param f Pointer to function
+ * @param name Name of attribute from schema of function type
+ * @param buf Buffer where value without trailing newline is stored
+ * @param len Length of given buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_function_attr(usbg_function *f, const char *name,
+				  char *buf, size_t len);
+
+/**
+ * @brief Get value of integer function attribute by name
+ * @param f Pointer to function
+ * @param name Name of USBG_ATTR_INT attribute
+ * @param val Pointer to be filled with value
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_function_attr_int(usbg_function *f, const char *name,
+				      int *val);
+
+/**
+ * @brief Set value of function attribute by name
+ * @details Value is validated against schema before it is written.
+ * @param f Pointer to function
+ * @param name Name of writable attribute from schema of function type
+ * @param val Value as it would be shown by usbg_get_function_attr()
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_function_attr(usbg_function *f, const char *name,
+				  const char *val);
+
+/**
+ * @brief Set value of integer function attribute by name
+ * @param f Pointer to function
+ * @param name Name of writable USBG_ATTR_INT attribute
+ * @param val Value to be set
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_function_attr_int(usbg_function *f, const char *name,
+				      int val);
+
+/**
+ * @brief Read all attributes of function in single directory pass
+ * @details Attributes which are not described by schema are reported
+ * too, unless they cannot be read.
+ * @param f Pointer to function
+ * @param cb Callback called for each attribute in alphabetical order
+ * @param data User data passed to callback
+ * @return 0 on success, value returned by callback if it stopped
+ * iteration or usbg_error if error occurred
+ */
+extern int usbg_for_each_function_attr(usbg_function *f, usbg_attr_cb cb,
+				       void *data);
+
 /**
  * @brief Set USB function network device address
  * @param f Pointer to function
@@ -804,6 +1187,411 @@ extern int usbg_set_net_host_addr(usbg_function *f, struct ether_addr *addr);
  */
 extern int usbg_set_net_qmult(usbg_function *f, int qmult);
 
+/**
+ * @brief Create logical unit of mass storage function
+ * @details Unit 0 is created by kernel together with function.
+ * @param f Pointer to mass storage function
+ * @param lun Number of unit, from 1 to USBG_MAX_MS_LUNS - 1
+ * @param attrs Attributes to be set or NULL to use kernel defaults
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_create_ms_lun(usbg_function *f, int lun,
+			      usbg_f_ms_lun_attrs *attrs);
+
+/**
+ * @brief Remove logical unit of mass storage function
+ * @param f Pointer to mass storage function
+ * @param lun Number of unit, unit 0 cannot be removed
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_rm_ms_lun(usbg_function *f, int lun);
+
+/**
+ * @brief Get logical units of mass storage function
+ * @param f Pointer to mass storage function
+ * @param luns Filled with bit mask of existing units, bit N for lun.N
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_ms_luns(usbg_function *f, unsigned int *luns);
+
+/**
+ * @brief Get attributes of logical unit
+ * @param f Pointer to mass storage function
+ * @param lun Number of unit
+ * @param attrs Structure to be filled
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_ms_lun_attrs(usbg_function *f, int lun,
+				 usbg_f_ms_lun_attrs *attrs);
+
+/**
+ * @brief Set attributes of logical unit
+ * @details Only attributes which differ from current values are written,
+ * so nofua or file may be changed while the unit is in use. Kernel
+ * refuses to change ro and cdrom while unit has backing file, so if they
+ * change together with file, the old medium is ejected first.
+ * @param f Pointer to mass storage function
+ * @param lun Number of unit
+ * @param attrs Attributes to be set
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_ms_lun_attrs(usbg_function *f, int lun,
+				 usbg_f_ms_lun_attrs *attrs);
+
+/**
+ * @brief Replace backing file of logical unit
+ * @details Works while gadget is bound. If host prevents medium removal,
+ * medium is ejected forcibly when kernel supports it.
+ * @param f Pointer to mass storage function
+ * @param lun Number of unit
+ * @param file Path of new backing file or empty string to eject medium
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_ms_lun_file(usbg_function *f, int lun, const char *file);
+
+/**
+ * @brief Replace formats and frames of UVC function
+ * @details Builds whole streaming tree in one go: format and frame
+ * directories, streaming header linking all formats and its links in
+ * class/fs, class/hs and class/ss. Control header and its class links
+ * are created as well. Previous tree is removed first, so formats can be
+ * changed only while gadget is not bound.
+ * @param f Pointer to UVC function
+ * @param formats Formats to be created or NULL to only remove old ones
+ * @param n_formats Number of formats
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_uvc_formats(usbg_function *f,
+				const usbg_uvc_format *formats, int n_formats);
+
+/**
+ * @brief Get formats and frames of UVC function
+ * @details Frames of each format are in order of creation and intervals
+ * start with the default one, like usbg_set_uvc_formats() takes them.
+ * @param f Pointer to UVC function
+ * @param formats Filled with array of formats, which has to be released
+ * with usbg_free_uvc_formats()
+ * @param n_formats Filled with number of formats
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_uvc_formats(usbg_function *f, usbg_uvc_format **formats,
+				int *n_formats);
+
+/**
+ * @brief Release formats returned by usbg_get_uvc_formats()
+ * @param formats Array of formats
+ * @param n_formats Number of formats
+ */
+extern void usbg_free_uvc_formats(usbg_uvc_format *formats, int n_formats);
+
+/**
+ * @brief Create UVC function with its formats in a single call
+ * @details Function is removed if any of the steps fails.
+ * @param g Pointer to gadget
+ * @param instance Function instance name
+ * @param attrs Streaming endpoint attributes or NULL for defaults
+ * @param formats Formats to be created
+ * @param n_formats Number of formats
+ * @param f Pointer to be filled with created function
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_create_uvc_function(usbg_gadget *g, const char *instance,
+				    usbg_f_uvc_attrs *attrs,
+				    const usbg_uvc_format *formats,
+				    int n_formats, usbg_function **f);
+
+/**
+ * @typedef usbg_uac_bandwidth
+ * @brief Packet sizes needed by audio function
+ * @details Sizes are in bytes per isochronous packet sent each
+ * millisecond, 0 for disabled direction.
+ */
+typedef struct {
+	int playback;
+	int capture;
+	int max_packet;
+} usbg_uac_bandwidth;
+
+/**
+ * @brief Check whether audio streams fit into endpoints of UDC
+ * @details Computes packet sizes in the same way as kernel does while
+ * binding: one sample per channel more than the nominal rate needs,
+ * plus fb_max for async capture. Limit is 1023 bytes for full speed
+ * and 1024 bytes for faster controllers according to their
+ * maximum_speed. Call it before usbg_enable_gadget() to get a clear
+ * error instead of failed bind.
+ * @param f Pointer to UAC1 or UAC2 function
+ * @param udc Name of UDC or NULL for the one gadget is bound to, or the
+ * first one if gadget is not bound
+ * @param bw Filled with computed sizes, may be NULL
+ * @return 0 if streams fit, USBG_ERROR_INVALID_VALUE if they don't,
+ * other usbg_error if error occurred
+ */
+extern int usbg_check_uac_bandwidth(usbg_function *f, const char *udc,
+				    usbg_uac_bandwidth *bw);
+
+/* HID */
+
+/**
+ * @def USBG_MAX_HID_REPORT_DESC_LENGTH
+ * @brief Maximal size of report descriptor accepted by f_hid
+ */
+#define USBG_MAX_HID_REPORT_DESC_LENGTH 4096
+
+/**
+ * @brief Set report descriptor of HID function
+ * @details Function must not be bound, kernel copies descriptor while
+ * binding.
+ * @param f Pointer to HID function
+ * @param desc Report descriptor as defined by HID specification
+ * @param len Size of descriptor in bytes
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_hid_report_desc(usbg_function *f, const void *desc,
+				    size_t len);
+
+/**
+ * @brief Get report descriptor of HID function
+ * @param f Pointer to HID function
+ * @param buf Buffer for descriptor
+ * @param len Size of buffer, USBG_MAX_HID_REPORT_DESC_LENGTH is enough
+ * @return Size of descriptor or usbg_error if error occurred
+ */
+extern int usbg_get_hid_report_desc(usbg_function *f, void *buf,
+				    size_t len);
+
+/**
+ * @brief Get path of character device of HID function
+ * @details Resolves "dev" attribute to /dev/hidgN. Device exists only
+ * while gadget is bound.
+ * @param f Pointer to HID function
+ * @param buf Buffer for path
+ * @param len Size of buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_hid_dev_path(usbg_function *f, char *buf, size_t len);
+
+/* Network interface tuning */
+
+/**
+ * @typedef usbg_net_profile
+ * @brief Tuning of network interface of ECM, subset, NCM, EEM or RNDIS
+ * @details Interface exists only while gadget is bound, so profile is
+ * applied after bind. Zero or empty field keeps current setting. CPU
+ * masks are hexadecimal as in sysfs ("f" for CPUs 0-3), irq_cpus is a
+ * list like "2" or "2-3" for interrupts of UDC gadget is bound to.
+ * They are found in sysfs attributes of UDC device and its parents or,
+ * for platform devices, by handler named after UDC device. Drivers
+ * which name handlers differently need irq, a list like "45" or
+ * "dwc3,45" of IRQ numbers and handler names. gro and irq_cpus are
+ * supported only by file system backend.
+ */
+typedef struct {
+	int tx_queue_len;		/**< Packets queued for transmission */
+	char rps_cpus[USBG_MAX_STR_LENGTH];	/**< Receive steering mask */
+	char xps_cpus[USBG_MAX_STR_LENGTH];	/**< Transmit steering mask */
+	int gro;			/**< 1 to enable, -1 to disable GRO */
+	int gro_flush_timeout;		/**< Nanoseconds GRO may hold packets */
+	int napi_defer_hard_irqs;	/**< Polls before IRQ is reenabled */
+	char irq_cpus[USBG_MAX_STR_LENGTH];	/**< CPUs handling UDC IRQ */
+	char irq[USBG_MAX_STR_LENGTH];	/**< IRQs of UDC, empty to look up */
+} usbg_net_profile;
+
+/**
+ * @brief Set profile applied each time gadget is bound
+ * @details Profile is kept in usbg_function and exported to gadget
+ * scheme, it is not stored in configfs. usbg_enable_gadget() applies it
+ * after successful bind and only logs its failure.
+ * @param f Pointer to network function
+ * @param profile Profile to be copied or NULL to remove it
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_net_profile(usbg_function *f,
+				const usbg_net_profile *profile);
+
+/**
+ * @brief Get profile set with usbg_set_net_profile()
+ * @param f Pointer to network function
+ * @param profile Structure to be filled
+ * @return 0 on success, USBG_ERROR_NOT_FOUND if function has no profile,
+ * other usbg_error if error occurred
+ */
+extern int usbg_get_net_profile(usbg_function *f, usbg_net_profile *profile);
+
+/**
+ * @brief Apply profile to interface of bound network function now
+ * @details Interface is the one named by ifname attribute. Settings are
+ * applied in order of usbg_net_profile fields and the first failure
+ * stops it.
+ * @param f Pointer to network function
+ * @param profile Profile to be applied, NULL for the one set with
+ * usbg_set_net_profile()
+ * @return 0 on success, USBG_ERROR_NOT_FOUND if interface or IRQ of UDC
+ * doesn't exist, USBG_ERROR_NOT_SUPPORTED if backend can't set GRO,
+ * other usbg_error if error occurred
+ */
+extern int usbg_apply_net_profile(usbg_function *f,
+				  const usbg_net_profile *profile);
+
+/* Microsoft OS descriptors */
+
+/**
+ * @def USBG_OS_DESC_QW_SIGN_LENGTH
+ * @brief Number of characters of OS string signature, "MSFT100"
+ */
+#define USBG_OS_DESC_QW_SIGN_LENGTH 7
+
+/**
+ * @def USBG_OS_DESC_ID_LENGTH
+ * @brief Size of compatible and subcompatible ID, shorter are padded
+ */
+#define USBG_OS_DESC_ID_LENGTH 8
+
+/**
+ * @def USBG_MAX_OS_DESC_PROP_LENGTH
+ * @brief Maximal size of extended property data handled by library
+ */
+#define USBG_MAX_OS_DESC_PROP_LENGTH 1024
+
+/**
+ * @typedef usbg_gadget_os_desc
+ * @brief OS descriptor settings of gadget
+ * @details Windows asks for string descriptor 0xEE during first
+ * enumeration. If gadget answers it, compatible IDs and extended
+ * properties of functions are fetched with vendor request
+ * b_vendor_code and the matching driver is bound right away instead
+ * of searching for it. Only one configuration, selected with
+ * usbg_set_os_desc_config(), is reported this way.
+ */
+typedef struct {
+	int use;		/**< Answer OS string descriptor request */
+	int b_vendor_code;	/**< bMS_VendorCode of vendor request */
+	char qw_sign[USBG_OS_DESC_QW_SIGN_LENGTH + 1]; /**< Signature */
+} usbg_gadget_os_desc;
+
+/**
+ * @typedef usbg_function_os_desc
+ * @brief Compatible ID of interface of function, e.g. "RNDIS" and
+ * "5162001" for RNDIS or "WINNCM" for NCM
+ */
+typedef struct {
+	char compatible_id[USBG_OS_DESC_ID_LENGTH + 1];
+	char sub_compatible_id[USBG_OS_DESC_ID_LENGTH + 1];
+} usbg_function_os_desc;
+
+/**
+ * @typedef usbg_os_desc_prop_type
+ * @brief Type of extended property, as REG_* value types of registry
+ */
+typedef enum {
+	USBG_OS_DESC_PROP_SZ = 1,	/**< String */
+	USBG_OS_DESC_PROP_EXPAND_SZ,	/**< String with %VARIABLES% */
+	USBG_OS_DESC_PROP_BINARY,	/**< Raw bytes */
+	USBG_OS_DESC_PROP_DWORD_LE,	/**< 32 bit little endian number */
+	USBG_OS_DESC_PROP_DWORD_BE,	/**< 32 bit big endian number */
+	USBG_OS_DESC_PROP_LINK,		/**< String with symbolic link */
+	USBG_OS_DESC_PROP_MULTI_SZ,	/**< UTF-16 strings */
+} usbg_os_desc_prop_type;
+
+/**
+ * @typedef usbg_os_desc_prop
+ * @brief Extended property of function interface
+ * @details Data of SZ, EXPAND_SZ and LINK types is UTF-8 string
+ * without terminating zero, kernel converts it to UTF-16. Data of
+ * other types is sent to host as it is.
+ */
+typedef struct {
+	char name[USBG_MAX_STR_LENGTH];
+	usbg_os_desc_prop_type type;
+	int len;
+	unsigned char data[USBG_MAX_OS_DESC_PROP_LENGTH];
+} usbg_os_desc_prop;
+
+/**
+ * @brief Get OS descriptor settings of gadget
+ * @param g Pointer to gadget
+ * @param os_desc Structure to be filled
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_gadget_os_desc(usbg_gadget *g,
+				   usbg_gadget_os_desc *os_desc);
+
+/**
+ * @brief Set OS descriptor settings of gadget
+ * @details Settings are used by kernel when gadget gets bound.
+ * @param g Pointer to gadget
+ * @param os_desc Settings to be written
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_gadget_os_desc(usbg_gadget *g,
+				   const usbg_gadget_os_desc *os_desc);
+
+/**
+ * @brief Get configuration reported in OS descriptors
+ * @param g Pointer to gadget
+ * @return Pointer to configuration or NULL if there is none
+ */
+extern usbg_config *usbg_get_os_desc_config(usbg_gadget *g);
+
+/**
+ * @brief Select configuration reported in OS descriptors
+ * @details Link in os_desc directory of gadget is replaced. Kernel
+ * unbinds gadget when the link is removed.
+ * @param g Pointer to gadget
+ * @param c Pointer to configuration of this gadget or NULL to remove
+ * the link
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_os_desc_config(usbg_gadget *g, usbg_config *c);
+
+/**
+ * @brief Get compatible ID of function
+ * @param f Pointer to function with os_desc interface, RNDIS or NCM
+ * @param os_desc Structure to be filled
+ * @return 0 on success, USBG_ERROR_NOT_SUPPORTED if function has no
+ * os_desc interface, other usbg_error if error occurred
+ */
+extern int usbg_get_function_os_desc(usbg_function *f,
+				     usbg_function_os_desc *os_desc);
+
+/**
+ * @brief Set compatible ID of function
+ * @param f Pointer to function with os_desc interface, RNDIS or NCM
+ * @param os_desc IDs to be written, empty string clears ID
+ * @return 0 on success, USBG_ERROR_NOT_SUPPORTED if function has no
+ * os_desc interface, other usbg_error if error occurred
+ */
+extern int usbg_set_function_os_desc(usbg_function *f,
+				     const usbg_function_os_desc *os_desc);
+
+/**
+ * @brief Create or replace extended property of function
+ * @param f Pointer to function with os_desc interface
+ * @param prop Property to be written
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_os_desc_prop(usbg_function *f,
+				 const usbg_os_desc_prop *prop);
+
+/**
+ * @brief Remove extended property of function
+ * @param f Pointer to function with os_desc interface
+ * @param name Name of property
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_rm_os_desc_prop(usbg_function *f, const char *name);
+
+/**
+ * @brief Get extended properties of function
+ * @param f Pointer to function with os_desc interface
+ * @param props Filled with array of properties sorted by name, which
+ * should be released with free()
+ * @param n_props Filled with number of properties
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_os_desc_props(usbg_function *f, usbg_os_desc_prop **props,
+				  int *n_props);
+
 /**
  * @def usbg_for_each_gadget(g, s)
  * Iterates over each gadget
@@ -1008,4 +1796,8 @@ extern int usbg_get_gadget_import_error_line(usbg_state *s);
 /**
  * @}
  */
+
+#ifdef __cplusplus
+}
+#endif
 #endif /* __USBG_H__ */
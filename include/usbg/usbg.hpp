@@ -0,0 +1,614 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_HPP__
+#define __USBG_HPP__
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <usbg/usbg.h>
+
+/**
+ * @file include/usbg/usbg.hpp
+ * @brief C++17 interface of libusbg
+ * @details Header only layer over usbg.h:
+ *
+ *	usbg::state s("/sys/kernel/config");
+ *
+ *	for (usbg::gadget_ref g : s.gadgets())
+ *		for (usbg::function_ref f : g.functions())
+ *			std::cout << g.name() << ": " << f.type_name()
+ *				  << "." << f.instance() << "\n";
+ *
+ * state and gadget are move only owners which release the library
+ * object in destructor. Everything reached from them is returned as
+ * *_ref view: trivially copyable wrapper of single pointer which is
+ * valid as long as the object exists in the library. Iteration and name
+ * accessors neither allocate nor copy strings, they compile to the same
+ * calls as usbg_for_each_*() loops. Operations which may fail throw
+ * usbg::error carrying usbg_error code.
+ */
+
+namespace usbg {
+
+/**
+ * @brief Failure of libusbg call
+ */
+class error : public std::runtime_error {
+public:
+	explicit error(int code)
+		: std::runtime_error(usbg_strerror((usbg_error)code)),
+		  code_(code) {}
+
+	/**
+	 * @return usbg_error code
+	 */
+	int code() const noexcept { return code_; }
+
+private:
+	int code_;
+};
+
+/**
+ * @brief Names of function types indexed by usbg_function_type
+ * @details Mirrors function_names[] in src/usbg.c
+ */
+constexpr std::string_view function_type_names[] = {
+	"gser",
+	"acm",
+	"obex",
+	"ecm",
+	"geth",
+	"ncm",
+	"eem",
+	"rndis",
+	"phonet",
+	"ffs",
+	"Loopback",
+	"SourceSink",
+	"mass_storage",
+	"uvc",
+	"uac2",
+	"uac1",
+	"hid",
+	"printer",
+	"midi",
+};
+
+static_assert(std::size(function_type_names) == USBG_FUNCTION_TYPE_MAX,
+	      "function_type_names does not match usbg_function_type");
+
+/**
+ * @return Name of function type or empty view if type is unknown
+ */
+constexpr std::string_view function_type_name(usbg_function_type type) noexcept
+{
+	return type >= 0 && type < USBG_FUNCTION_TYPE_MAX ?
+		function_type_names[type] : std::string_view();
+}
+
+/**
+ * @return Function type of given name if there is such
+ */
+constexpr std::optional<usbg_function_type>
+function_type_from_name(std::string_view name) noexcept
+{
+	for (int i = 0; i < USBG_FUNCTION_TYPE_MAX; ++i)
+		if (function_type_names[i] == name)
+			return (usbg_function_type)i;
+
+	return std::nullopt;
+}
+
+namespace detail {
+
+inline void check(int ret)
+{
+	if (ret < 0)
+		throw error(ret);
+}
+
+inline std::string_view view(const char *s) noexcept
+{
+	return s ? std::string_view(s) : std::string_view();
+}
+
+/* Walks one of the library lists, yields views of its elements */
+template<typename Ref, typename T, T *(*Next)(T *)>
+class list_iterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = Ref;
+	using difference_type = std::ptrdiff_t;
+	using pointer = void;
+	using reference = Ref;
+
+	constexpr list_iterator(T *p = nullptr) noexcept : p_(p) {}
+
+	Ref operator*() const noexcept { return Ref(p_); }
+
+	list_iterator &operator++() noexcept
+	{
+		p_ = Next(p_);
+		return *this;
+	}
+
+	list_iterator operator++(int) noexcept
+	{
+		list_iterator old = *this;
+
+		p_ = Next(p_);
+		return old;
+	}
+
+	bool operator==(const list_iterator &o) const noexcept
+	{
+		return p_ == o.p_;
+	}
+
+	bool operator!=(const list_iterator &o) const noexcept
+	{
+		return p_ != o.p_;
+	}
+
+private:
+	T *p_;
+};
+
+template<typename Ref, typename P, typename T, T *(*First)(P *),
+	 T *(*Next)(T *)>
+class list_range {
+public:
+	using iterator = list_iterator<Ref, T, Next>;
+
+	constexpr explicit list_range(P *parent) noexcept : parent_(parent) {}
+
+	iterator begin() const noexcept { return iterator(First(parent_)); }
+	iterator end() const noexcept { return iterator(); }
+	bool empty() const noexcept { return !First(parent_); }
+
+private:
+	P *parent_;
+};
+
+} /* namespace detail */
+
+/**
+ * @brief View of function
+ */
+class function_ref {
+public:
+	constexpr explicit function_ref(usbg_function *f = nullptr) noexcept
+		: f_(f) {}
+
+	usbg_function *get() const noexcept { return f_; }
+	explicit operator bool() const noexcept { return f_; }
+
+	std::string_view instance() const noexcept
+	{
+		return detail::view(usbg_get_function_instance_str(f_));
+	}
+
+	usbg_function_type type() const noexcept
+	{
+		return usbg_get_function_type(f_);
+	}
+
+	std::string_view type_name() const noexcept
+	{
+		return function_type_name(type());
+	}
+
+	usbg_function_attrs attrs() const
+	{
+		usbg_function_attrs f_attrs;
+
+		detail::check(usbg_get_function_attrs(f_, &f_attrs));
+		return f_attrs;
+	}
+
+	void set_attrs(usbg_function_attrs f_attrs) const
+	{
+		detail::check(usbg_set_function_attrs(f_, &f_attrs));
+	}
+
+	/**
+	 * @brief Remove function, view becomes dangling
+	 */
+	void remove(int opts = 0) const
+	{
+		detail::check(usbg_rm_function(f_, opts));
+	}
+
+private:
+	usbg_function *f_;
+};
+
+/**
+ * @brief View of binding of function to config
+ */
+class binding_ref {
+public:
+	constexpr explicit binding_ref(usbg_binding *b = nullptr) noexcept
+		: b_(b) {}
+
+	usbg_binding *get() const noexcept { return b_; }
+	explicit operator bool() const noexcept { return b_; }
+
+	std::string_view name() const noexcept
+	{
+		return detail::view(usbg_get_binding_name_str(b_));
+	}
+
+	function_ref target() const noexcept
+	{
+		return function_ref(usbg_get_binding_target(b_));
+	}
+
+	/**
+	 * @brief Remove binding, view becomes dangling
+	 */
+	void remove() const
+	{
+		detail::check(usbg_rm_binding(b_));
+	}
+
+private:
+	usbg_binding *b_;
+};
+
+/**
+ * @brief View of config
+ */
+class config_ref {
+public:
+	using binding_range = detail::list_range<binding_ref, usbg_config,
+			usbg_binding, usbg_get_first_binding,
+			usbg_get_next_binding>;
+
+	constexpr explicit config_ref(usbg_config *c = nullptr) noexcept
+		: c_(c) {}
+
+	usbg_config *get() const noexcept { return c_; }
+	explicit operator bool() const noexcept { return c_; }
+
+	int id() const noexcept { return usbg_get_config_id(c_); }
+
+	std::string_view label() const noexcept
+	{
+		return detail::view(usbg_get_config_label_str(c_));
+	}
+
+	binding_range bindings() const noexcept { return binding_range(c_); }
+
+	usbg_config_attrs attrs() const
+	{
+		usbg_config_attrs c_attrs;
+
+		detail::check(usbg_get_config_attrs(c_, &c_attrs));
+		return c_attrs;
+	}
+
+	void set_attrs(usbg_config_attrs c_attrs) const
+	{
+		detail::check(usbg_set_config_attrs(c_, &c_attrs));
+	}
+
+	usbg_config_strs strs(int lang = LANG_US_ENG) const
+	{
+		usbg_config_strs c_strs;
+
+		detail::check(usbg_get_config_strs(c_, lang, &c_strs));
+		return c_strs;
+	}
+
+	void set_string(const char *string, int lang = LANG_US_ENG) const
+	{
+		detail::check(usbg_set_config_string(c_, lang, string));
+	}
+
+	/**
+	 * @brief Bind function to this config under given name
+	 */
+	void add_function(const char *name, function_ref f) const
+	{
+		detail::check(usbg_add_config_function(c_, name, f.get()));
+	}
+
+	/**
+	 * @brief Remove config, view becomes dangling
+	 */
+	void remove(int opts = 0) const
+	{
+		detail::check(usbg_rm_config(c_, opts));
+	}
+
+private:
+	usbg_config *c_;
+};
+
+/**
+ * @brief View of gadget
+ */
+class gadget_ref {
+public:
+	using function_range = detail::list_range<function_ref, usbg_gadget,
+			usbg_function, usbg_get_first_function,
+			usbg_get_next_function>;
+	using config_range = detail::list_range<config_ref, usbg_gadget,
+			usbg_config, usbg_get_first_config,
+			usbg_get_next_config>;
+
+	constexpr explicit gadget_ref(usbg_gadget *g = nullptr) noexcept
+		: g_(g) {}
+
+	usbg_gadget *get() const noexcept { return g_; }
+	explicit operator bool() const noexcept { return g_; }
+
+	std::string_view name() const noexcept
+	{
+		return detail::view(usbg_get_gadget_name_str(g_));
+	}
+
+	function_range functions() const noexcept { return function_range(g_); }
+	config_range configs() const noexcept { return config_range(g_); }
+
+	/**
+	 * @return Function or empty view if there is no such
+	 */
+	function_ref function(usbg_function_type type,
+			      const char *instance) const noexcept
+	{
+		return function_ref(usbg_get_function(g_, type, instance));
+	}
+
+	/**
+	 * @return Config or empty view if there is no such
+	 */
+	config_ref config(int id, const char *label = nullptr) const noexcept
+	{
+		return config_ref(usbg_get_config(g_, id, label));
+	}
+
+	function_ref create_function(usbg_function_type type,
+				     const char *instance,
+				     usbg_function_attrs *f_attrs = nullptr) const
+	{
+		usbg_function *f;
+
+		detail::check(usbg_create_function(g_, type, instance, f_attrs,
+						   &f));
+		return function_ref(f);
+	}
+
+	config_ref create_config(int id, const char *label = nullptr,
+				 usbg_config_attrs *c_attrs = nullptr,
+				 usbg_config_strs *c_strs = nullptr) const
+	{
+		usbg_config *c;
+
+		detail::check(usbg_create_config(g_, id, label, c_attrs, c_strs,
+						 &c));
+		return config_ref(c);
+	}
+
+	usbg_gadget_attrs attrs() const
+	{
+		usbg_gadget_attrs g_attrs;
+
+		detail::check(usbg_get_gadget_attrs(g_, &g_attrs));
+		return g_attrs;
+	}
+
+	void set_attrs(usbg_gadget_attrs g_attrs) const
+	{
+		detail::check(usbg_set_gadget_attrs(g_, &g_attrs));
+	}
+
+	usbg_gadget_strs strs(int lang = LANG_US_ENG) const
+	{
+		usbg_gadget_strs g_strs;
+
+		detail::check(usbg_get_gadget_strs(g_, lang, &g_strs));
+		return g_strs;
+	}
+
+	void set_strs(usbg_gadget_strs g_strs, int lang = LANG_US_ENG) const
+	{
+		detail::check(usbg_set_gadget_strs(g_, lang, &g_strs));
+	}
+
+	/**
+	 * @return Name of UDC or empty string if gadget is not enabled
+	 */
+	std::string udc() const
+	{
+		char buf[USBG_MAX_STR_LENGTH];
+
+		detail::check(usbg_get_gadget_udc(g_, buf, sizeof(buf)));
+		buf[sizeof(buf) - 1] = '\0';
+		return buf;
+	}
+
+	void enable(const char *udc = DEFAULT_UDC) const
+	{
+		detail::check(usbg_enable_gadget(g_, udc));
+	}
+
+	void disable() const
+	{
+		detail::check(usbg_disable_gadget(g_));
+	}
+
+protected:
+	usbg_gadget *g_;
+};
+
+static_assert(std::is_trivially_copyable_v<function_ref> &&
+	      std::is_trivially_copyable_v<binding_ref> &&
+	      std::is_trivially_copyable_v<config_ref> &&
+	      std::is_trivially_copyable_v<gadget_ref> &&
+	      sizeof(gadget_ref) == sizeof(usbg_gadget *),
+	      "views must stay as cheap as raw pointers");
+
+/**
+ * @brief Owner of gadget
+ * @details Gadget is disabled and removed recursively from configfs when
+ * handle is destroyed, which suits gadgets living only as long as the
+ * program, e.g. in tests. Call release() to leave it in place.
+ */
+class gadget : public gadget_ref {
+public:
+	gadget() noexcept = default;
+	explicit gadget(gadget_ref g) noexcept : gadget_ref(g) {}
+
+	gadget(gadget &&o) noexcept : gadget_ref(o.release()) {}
+
+	gadget &operator=(gadget &&o) noexcept
+	{
+		if (this != &o) {
+			reset();
+			g_ = o.release().get();
+		}
+		return *this;
+	}
+
+	gadget(const gadget &) = delete;
+	gadget &operator=(const gadget &) = delete;
+
+	~gadget() { reset(); }
+
+	/**
+	 * @brief Stop owning gadget without removing it
+	 */
+	gadget_ref release() noexcept
+	{
+		return gadget_ref(std::exchange(g_, nullptr));
+	}
+
+	/**
+	 * @brief Remove owned gadget now, errors are ignored
+	 */
+	void reset() noexcept
+	{
+		if (!g_)
+			return;
+
+		usbg_disable_gadget(g_);
+		usbg_rm_gadget(g_, USBG_RM_RECURSE);
+		g_ = nullptr;
+	}
+};
+
+/**
+ * @brief Owner of library state
+ */
+class state {
+public:
+	using gadget_range = detail::list_range<gadget_ref, usbg_state,
+			usbg_gadget, usbg_get_first_gadget,
+			usbg_get_next_gadget>;
+
+	/**
+	 * @brief Parse gadgets from configfs mounted at given path
+	 */
+	explicit state(const char *configfs_path)
+	{
+		detail::check(usbg_init(configfs_path, &s_));
+	}
+
+	/**
+	 * @brief Take ownership of state created by usbg_init()
+	 */
+	explicit state(usbg_state *s) noexcept : s_(s) {}
+
+	state(state &&o) noexcept : s_(std::exchange(o.s_, nullptr)) {}
+
+	state &operator=(state &&o) noexcept
+	{
+		if (this != &o) {
+			if (s_)
+				usbg_cleanup(s_);
+			s_ = std::exchange(o.s_, nullptr);
+		}
+		return *this;
+	}
+
+	state(const state &) = delete;
+	state &operator=(const state &) = delete;
+
+	/**
+	 * @details Owned gadgets must be released or destroyed before
+	 */
+	~state()
+	{
+		if (s_)
+			usbg_cleanup(s_);
+	}
+
+	usbg_state *get() const noexcept { return s_; }
+
+	usbg_state *release() noexcept { return std::exchange(s_, nullptr); }
+
+	std::string_view configfs_path() const noexcept
+	{
+		return detail::view(usbg_get_configfs_path_str(s_));
+	}
+
+	gadget_range gadgets() const noexcept { return gadget_range(s_); }
+
+	/**
+	 * @return Gadget or empty view if there is no such
+	 */
+	gadget_ref gadget(const char *name) const noexcept
+	{
+		return gadget_ref(usbg_get_gadget(s_, name));
+	}
+
+	/**
+	 * @brief Create gadget which stays in configfs
+	 */
+	gadget_ref create_gadget(const char *name,
+				 usbg_gadget_attrs *g_attrs = nullptr,
+				 usbg_gadget_strs *g_strs = nullptr) const
+	{
+		usbg_gadget *g;
+
+		detail::check(usbg_create_gadget(s_, name, g_attrs, g_strs, &g));
+		return gadget_ref(g);
+	}
+
+	/**
+	 * @brief Create gadget removed together with returned handle
+	 */
+	usbg::gadget create_owned_gadget(const char *name,
+					 usbg_gadget_attrs *g_attrs = nullptr,
+					 usbg_gadget_strs *g_strs = nullptr) const
+	{
+		return usbg::gadget(create_gadget(name, g_attrs, g_strs));
+	}
+
+private:
+	usbg_state *s_ = nullptr;
+};
+
+} /* namespace usbg */
+
+#endif /* __USBG_HPP__ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_ASYNC_H__
+#define __USBG_ASYNC_H__
+
+#include <stdio.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_async.h
+ * @brief Asynchronous variants of slow operations
+ * @details Operations are executed by a pool of worker threads. Operations
+ * on different gadgets run concurrently, while operations on the same
+ * gadget are executed one by one in order of submission. Gadgets are
+ * told apart by name, so import waits for earlier removal of gadget
+ * with the same name.
+ *
+ * Completion is reported by calling the callback given on submission:
+ * - directly from worker thread, which is the default, or
+ * - from usbg_async_dispatch() if pool was created with
+ *   USBG_ASYNC_EVENTFD. Descriptor returned by usbg_async_get_fd() becomes
+ *   readable when there are completions to dispatch, so it can be added to
+ *   caller's poll()/epoll loop.
+ *
+ * Objects and buffers passed to submitted operation must stay valid until
+ * its completion.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_async
+ * @brief Pool of threads executing asynchronous operations
+ */
+typedef struct usbg_async usbg_async;
+
+/**
+ * @brief Callback reporting completion of asynchronous operation
+ * @param ret Return value of synchronous variant of operation
+ * @param data Pointer given on submission
+ */
+typedef void (*usbg_async_cb)(int ret, void *data);
+
+/**
+ * @brief Flags of usbg_async_create()
+ */
+enum {
+	USBG_ASYNC_EVENTFD = 1 << 0, /**< Deliver from usbg_async_dispatch() */
+};
+
+/**
+ * @brief Default number of worker threads
+ */
+#define USBG_ASYNC_DEFAULT_WORKERS 4
+
+/**
+ * @brief Create pool of worker threads
+ * @param n_workers Number of threads or 0 for USBG_ASYNC_DEFAULT_WORKERS
+ * @param flags Bitmask of USBG_ASYNC_* flags
+ * @param a Pointer to be filled with created pool
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_async_create(int n_workers, int flags, usbg_async **a);
+
+/**
+ * @brief Finish all submitted operations and destroy pool
+ * @details Completions which were not dispatched yet are dispatched
+ * from this function.
+ * @param a Pool to be destroyed
+ */
+extern void usbg_async_destroy(usbg_async *a);
+
+/**
+ * @brief Get descriptor signaling pending completions
+ * @param a Pool created with USBG_ASYNC_EVENTFD
+ * @return File descriptor or usbg_error if error occurred
+ */
+extern int usbg_async_get_fd(usbg_async *a);
+
+/**
+ * @brief Call callbacks of all finished operations
+ * @details Does not block if there are no finished operations.
+ * @param a Pool created with USBG_ASYNC_EVENTFD
+ * @return Number of dispatched completions or usbg_error if error occurred
+ */
+extern int usbg_async_dispatch(usbg_async *a);
+
+/**
+ * @brief Enable a USB gadget device asynchronously
+ * @param a Pool which executes operation
+ * @param g Pointer to gadget
+ * @param udc Name of UDC to enable gadget, copied on submission
+ * @param cb Callback called on completion, may be NULL
+ * @param data Passed to cb
+ * @return 0 if operation was submitted, usbg_error otherwise
+ * @see usbg_enable_gadget()
+ */
+extern int usbg_enable_gadget_async(usbg_async *a, usbg_gadget *g,
+				    const char *udc, usbg_async_cb cb,
+				    void *data);
+
+/**
+ * @brief Disable a USB gadget device asynchronously
+ * @param a Pool which executes operation
+ * @param g Pointer to gadget
+ * @param cb Callback called on completion, may be NULL
+ * @param data Passed to cb
+ * @return 0 if operation was submitted, usbg_error otherwise
+ * @see usbg_disable_gadget()
+ */
+extern int usbg_disable_gadget_async(usbg_async *a, usbg_gadget *g,
+				     usbg_async_cb cb, void *data);
+
+/**
+ * @brief Remove existing USB gadget asynchronously
+ * @param a Pool which executes operation
+ * @param g Gadget to be removed, must not be used after submission
+ * @param opts Additional options for removal
+ * @param cb Callback called on completion, may be NULL
+ * @param data Passed to cb
+ * @return 0 if operation was submitted, usbg_error otherwise
+ * @see usbg_rm_gadget()
+ */
+extern int usbg_rm_gadget_async(usbg_async *a, usbg_gadget *g, int opts,
+				usbg_async_cb cb, void *data);
+
+/**
+ * @brief Import usb gadget from file asynchronously
+ * @param a Pool which executes operation
+ * @param s Current state of library
+ * @param stream From which gadget should be imported, owned by operation
+ * until its completion
+ * @param name Name of new gadget, copied on submission
+ * @param g Place for pointer to imported gadget, filled before cb is
+ * called. If NULL this param will be ignored.
+ * @param cb Callback called on completion, may be NULL
+ * @param data Passed to cb
+ * @return 0 if operation was submitted, usbg_error otherwise
+ * @see usbg_import_gadget()
+ */
+extern int usbg_import_gadget_async(usbg_async *a, usbg_state *s,
+				    FILE *stream, const char *name,
+				    usbg_gadget **g, usbg_async_cb cb,
+				    void *data);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_ASYNC_H__ */
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_BACKEND_H__
+#define __USBG_BACKEND_H__
+
+#include <stddef.h>
+#include <dirent.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_backend.h
+ * @brief Pluggable storage used by libusbg instead of configfs
+ * @details By default all library I/O goes directly to the file system.
+ * Backend replaces it for the whole process, so it should be selected
+ * before usbg_init() and must not be changed while any usbg_state exists.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_backend_ops
+ * @brief Operations implemented by backend
+ * @details All paths are absolute. Each operation returns non-negative
+ * value on success and negative errno value on failure.
+ */
+typedef struct {
+	/**
+	 * Read at most len bytes of attribute, returns number of bytes read
+	 */
+	int (*read)(void *priv, const char *path, char *buf, size_t len);
+	/**
+	 * Replace content of attribute, returns number of bytes written
+	 */
+	int (*write)(void *priv, const char *path, const char *buf,
+		     size_t len);
+	int (*mkdir)(void *priv, const char *path);
+	int (*rmdir)(void *priv, const char *path);
+	int (*unlink)(void *priv, const char *path);
+	int (*symlink)(void *priv, const char *target, const char *path);
+	/**
+	 * Fill buf with target of link, returns its length (without '\0')
+	 */
+	int (*readlink)(void *priv, const char *path, char *buf, size_t len);
+	/**
+	 * List directory in alphabetical order, entries rejected by filter
+	 * are skipped. Array and each entry are released with free().
+	 * Returns number of entries.
+	 */
+	int (*scandir)(void *priv, const char *path,
+		       int (*filter)(const struct dirent *),
+		       struct dirent ***list);
+	/**
+	 * Check whether path exists and is a directory
+	 */
+	int (*check_dir)(void *priv, const char *path);
+	/**
+	 * Release backend private data, may be NULL
+	 */
+	void (*release)(void *priv);
+} usbg_backend_ops;
+
+struct usbg_backend;
+
+/**
+ * @brief Instance of backend
+ */
+typedef struct usbg_backend usbg_backend;
+
+/**
+ * @brief Create backend from operations table
+ * @param ops Operations, must stay valid until backend is destroyed
+ * @param priv Private data passed to each operation
+ * @param b Pointer to be filled with created backend
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_backend_create(const usbg_backend_ops *ops, void *priv,
+			       usbg_backend **b);
+
+/**
+ * @brief Destroy backend and call its release operation
+ * @param b Backend, must not be currently in use
+ */
+extern void usbg_backend_destroy(usbg_backend *b);
+
+/**
+ * @brief Select backend used by library
+ * @param b Backend or NULL to go back to file system
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_backend(usbg_backend *b);
+
+/**
+ * @brief Get backend currently used by library
+ * @return Backend or NULL if file system is used directly
+ */
+extern usbg_backend *usbg_get_backend(void);
+
+/* In-memory configfs emulation */
+
+/**
+ * @brief Create backend which emulates configfs in memory
+ * @details Emulation follows configfs semantics: attributes are
+ * created by mkdir of gadget, config, function and strings
+ * directories and can be neither created nor removed by user,
+ * only symlinks from config to function can be made and directory
+ * can be removed with rmdir only when it contains nothing created
+ * by user. Writing UDC checks that given controller has been added
+ * with usbg_backend_mem_add_udc() and is not used by other gadget.
+ * @param configfs_path Path under which usb_gadget directory is created
+ * @param b Pointer to be filled with created backend
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_backend_mem_create(const char *configfs_path,
+				   usbg_backend **b);
+
+/**
+ * @brief Add emulated USB device controller to /sys/class/udc
+ * @param b Backend created by usbg_backend_mem_create()
+ * @param name Name of controller
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_backend_mem_add_udc(usbg_backend *b, const char *name);
+
+/* Client of usbg daemon */
+
+/**
+ * @brief Create backend served by usbg daemon
+ * @details Reads are served from image of configfs which daemon keeps
+ * in shared memory, without any system call. Each modification is sent
+ * to daemon and returns when daemon has applied it and published new
+ * image, unless batch is open.
+ * @param socket_path Path of socket given to usbg_daemon_create()
+ * @param b Pointer to be filled with created backend
+ * @return 0 on success, usbg_error if error occurred
+ * @see include/usbg/usbg_daemon.h
+ */
+extern int usbg_backend_client_create(const char *socket_path,
+				      usbg_backend **b);
+
+/**
+ * @brief Start collecting modifications instead of sending them at once
+ * @details Modifications made by any thread are queued and reported as
+ * successful. Image is not updated until the batch is sent, so batch
+ * should contain only writes which are not read back, e.g. attributes
+ * set by usbg_set_gadget_attrs().
+ * @param b Backend created by usbg_backend_client_create()
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_backend_client_batch_begin(usbg_backend *b);
+
+/**
+ * @brief Send queued modifications and wait until they are applied
+ * @details Daemon stops processing of the batch on the first failure.
+ * @param b Backend created by usbg_backend_client_create()
+ * @return 0 on success, usbg_error of the first failed modification
+ */
+extern int usbg_backend_client_batch_end(usbg_backend *b);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_BACKEND_H__ */
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_CORO_HPP__
+#define __USBG_CORO_HPP__
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <linux/aio_abi.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_async.h>
+
+/**
+ * @file include/usbg/usbg_coro.hpp
+ * @brief C++20 coroutines over slow configfs operations and FFS endpoints
+ * @details Executor multiplexes any number of coroutines on the thread
+ * which calls executor::run():
+ *
+ *	usbg::coro::task<> setup(usbg::coro::executor &ex, usbg_gadget *g,
+ *				 int ep_fd)
+ *	{
+ *		char buf[512];
+ *
+ *		if (co_await ex.enable_gadget(g, "musb-hdrc.0") == 0)
+ *			co_await ex.read(ep_fd, buf, sizeof(buf));
+ *	}
+ *
+ *	usbg::coro::executor ex;
+ *	ex.spawn(setup(ex, g, ep_fd));
+ *	ex.run();
+ *
+ * Configfs operations run on usbg_async pool owned by executor, so
+ * operations on one gadget keep their order. Endpoint transfers use
+ * native AIO, which is the asynchronous interface FunctionFS implements,
+ * with completions delivered through eventfd. Both are polled with epoll.
+ *
+ * Awaitables return the same values as their synchronous counterparts:
+ * usbg_error for configfs operations and number of bytes or negative
+ * errno for transfers. Executor is not thread safe, use one per thread.
+ */
+
+namespace usbg {
+namespace coro {
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+template<typename T>
+struct promise;
+
+/* Resumes whoever awaited the task when it finishes */
+struct final_awaiter {
+	bool await_ready() const noexcept { return false; }
+
+	template<typename P>
+	std::coroutine_handle<>
+	await_suspend(std::coroutine_handle<P> h) const noexcept
+	{
+		auto cont = h.promise().cont;
+		return cont ? cont : std::noop_coroutine();
+	}
+
+	void await_resume() const noexcept {}
+};
+
+struct promise_base {
+	std::coroutine_handle<> cont;
+	std::exception_ptr exc;
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	final_awaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() { exc = std::current_exception(); }
+
+	void rethrow() const
+	{
+		if (exc)
+			std::rethrow_exception(exc);
+	}
+};
+
+template<typename T>
+struct promise : promise_base {
+	T value{};
+
+	task<T> get_return_object();
+	void return_value(T v) { value = std::move(v); }
+	T result() { rethrow(); return std::move(value); }
+};
+
+template<>
+struct promise<void> : promise_base {
+	task<void> get_return_object();
+	void return_void() const noexcept {}
+	void result() const { rethrow(); }
+};
+
+/* glibc provides no wrappers for native AIO */
+inline int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+inline int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Lazily started coroutine producing T
+ * @details Body runs when task is awaited or given to executor::spawn().
+ */
+template<typename T>
+class task {
+public:
+	using promise_type = detail::promise<T>;
+
+	task(task &&t) noexcept : h(std::exchange(t.h, nullptr)) {}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task() { if (h) h.destroy(); }
+
+	bool await_ready() const noexcept { return !h || h.done(); }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont)
+	{
+		h.promise().cont = cont;
+		return h;
+	}
+
+	T await_resume() { return h.promise().result(); }
+
+private:
+	friend promise_type;
+	explicit task(std::coroutine_handle<promise_type> h) : h(h) {}
+
+	std::coroutine_handle<promise_type> h;
+};
+
+namespace detail {
+
+template<typename T>
+task<T> promise<T>::get_return_object()
+{
+	return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object()
+{
+	return task<void>(
+		std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Event loop resuming coroutines when their operations complete
+ */
+class executor {
+public:
+	/**
+	 * @param workers Threads of configfs pool, 0 for default
+	 * @param io_depth Transfers in flight, more are queued in executor
+	 */
+	explicit executor(int workers = 0, unsigned io_depth = 256)
+		: depth(io_depth)
+	{
+		struct epoll_event ev = {};
+		int ret;
+
+		ep_fd = epoll_create1(EPOLL_CLOEXEC);
+		io_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (ep_fd < 0 || io_fd < 0 || detail::io_setup(depth, &aio))
+			fail_errno();
+
+		ret = usbg_async_create(workers, USBG_ASYNC_EVENTFD, &pool);
+		if (ret != USBG_SUCCESS) {
+			pool = nullptr;
+			cleanup();
+			throw std::runtime_error(usbg_strerror(
+					static_cast<usbg_error>(ret)));
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = &pool;
+		if (epoll_ctl(ep_fd, EPOLL_CTL_ADD, usbg_async_get_fd(pool),
+			      &ev))
+			fail_errno();
+
+		ev.data.ptr = &aio;
+		if (epoll_ctl(ep_fd, EPOLL_CTL_ADD, io_fd, &ev))
+			fail_errno();
+	}
+
+	executor(const executor &) = delete;
+	executor &operator=(const executor &) = delete;
+
+	/* Operations still in flight are finished by usbg_async_destroy() */
+	~executor() { cleanup(); }
+
+	/**
+	 * @brief Start coroutine which is owned by executor from now on
+	 * @details Exception escaping from the task terminates the program.
+	 */
+	void spawn(task<void> t)
+	{
+		++live;
+		start(this, std::move(t));
+	}
+
+	/**
+	 * @brief Run until all spawned coroutines have finished
+	 */
+	void run()
+	{
+		struct epoll_event ev[64];
+		int i, n;
+
+		while (true) {
+			while (!ready.empty()) {
+				auto h = ready.front();
+
+				ready.pop_front();
+				h.resume();
+			}
+
+			if (!live)
+				break;
+
+			n = epoll_wait(ep_fd, ev, 64, -1);
+			if (n < 0 && errno != EINTR)
+				fail_errno();
+
+			for (i = 0; i < n; ++i) {
+				if (ev[i].data.ptr == &pool)
+					usbg_async_dispatch(pool);
+				else if (ev[i].data.ptr == &aio)
+					reap();
+				else
+					static_cast<fd_awaiter *>(
+						ev[i].data.ptr)->fire(ev[i].events);
+			}
+		}
+	}
+
+	/* Awaitable of operation executed by usbg_async pool */
+	template<typename Submit>
+	class async_awaiter {
+	public:
+		async_awaiter(executor &ex, Submit submit)
+			: ex(ex), submit(std::move(submit)) {}
+
+		bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			this->h = h;
+			ret = submit(ex.pool, &complete, this);
+			return ret == USBG_SUCCESS;
+		}
+
+		int await_resume() const noexcept { return ret; }
+
+	private:
+		static void complete(int ret, void *data)
+		{
+			auto *a = static_cast<async_awaiter *>(data);
+
+			a->ret = ret;
+			a->ex.ready.push_back(a->h);
+		}
+
+		executor &ex;
+		Submit submit;
+		std::coroutine_handle<> h;
+		int ret = 0;
+	};
+
+	/** @brief Awaitable usbg_enable_gadget(), udc is copied */
+	auto enable_gadget(usbg_gadget *g, const char *udc)
+	{
+		return make_async([=](usbg_async *a, usbg_async_cb cb, void *d) {
+			return usbg_enable_gadget_async(a, g, udc, cb, d);
+		});
+	}
+
+	/** @brief Awaitable usbg_disable_gadget() */
+	auto disable_gadget(usbg_gadget *g)
+	{
+		return make_async([=](usbg_async *a, usbg_async_cb cb, void *d) {
+			return usbg_disable_gadget_async(a, g, cb, d);
+		});
+	}
+
+	/** @brief Awaitable usbg_rm_gadget() */
+	auto rm_gadget(usbg_gadget *g, int opts)
+	{
+		return make_async([=](usbg_async *a, usbg_async_cb cb, void *d) {
+			return usbg_rm_gadget_async(a, g, opts, cb, d);
+		});
+	}
+
+	/** @brief Awaitable usbg_import_gadget(), name is copied */
+	auto import_gadget(usbg_state *s, FILE *stream, const char *name,
+			   usbg_gadget **g)
+	{
+		return make_async([=](usbg_async *a, usbg_async_cb cb, void *d) {
+			return usbg_import_gadget_async(a, s, stream, name, g,
+							cb, d);
+		});
+	}
+
+	/* Awaitable transfer on FunctionFS endpoint */
+	class io_awaiter {
+	public:
+		io_awaiter(executor &ex, int fd, uint16_t opcode, void *buf,
+			   std::size_t len) : ex(ex)
+		{
+			cb.aio_data = reinterpret_cast<uintptr_t>(this);
+			cb.aio_lio_opcode = opcode;
+			cb.aio_fildes = fd;
+			cb.aio_buf = reinterpret_cast<uintptr_t>(buf);
+			cb.aio_nbytes = len;
+			cb.aio_flags = IOCB_FLAG_RESFD;
+			cb.aio_resfd = ex.io_fd;
+		}
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			this->h = h;
+			ex.submit_io(this);
+		}
+
+		/* Number of bytes or negative errno */
+		long await_resume() const noexcept { return ret; }
+
+	private:
+		friend class executor;
+
+		executor &ex;
+		struct iocb cb = {};
+		std::coroutine_handle<> h;
+		long ret = 0;
+	};
+
+	/** @brief Read from OUT endpoint */
+	io_awaiter read(int fd, void *buf, std::size_t len)
+	{
+		return io_awaiter(*this, fd, IOCB_CMD_PREAD, buf, len);
+	}
+
+	/** @brief Write to IN endpoint */
+	io_awaiter write(int fd, const void *buf, std::size_t len)
+	{
+		return io_awaiter(*this, fd, IOCB_CMD_PWRITE,
+				  const_cast<void *>(buf), len);
+	}
+
+	/* Awaitable readiness of descriptor, e.g. events on ep0 */
+	class fd_awaiter {
+	public:
+		fd_awaiter(executor &ex, int fd, uint32_t events)
+			: ex(ex), fd(fd), events(events) {}
+
+		bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			struct epoll_event ev = {};
+
+			this->h = h;
+			ev.events = events | EPOLLONESHOT;
+			ev.data.ptr = this;
+			if (epoll_ctl(ex.ep_fd, EPOLL_CTL_ADD, fd, &ev)) {
+				revents = -errno;
+				return false;
+			}
+			return true;
+		}
+
+		/* Returned epoll events or negative errno */
+		int await_resume() const noexcept { return revents; }
+
+	private:
+		friend class executor;
+
+		void fire(uint32_t ev)
+		{
+			epoll_ctl(ex.ep_fd, EPOLL_CTL_DEL, fd, nullptr);
+			revents = ev;
+			ex.ready.push_back(h);
+		}
+
+		executor &ex;
+		int fd;
+		uint32_t events;
+		std::coroutine_handle<> h;
+		int revents = 0;
+	};
+
+	/** @brief Wait until descriptor is readable */
+	fd_awaiter readable(int fd) { return fd_awaiter(*this, fd, EPOLLIN); }
+
+	/** @brief Wait until descriptor is writable */
+	fd_awaiter writable(int fd) { return fd_awaiter(*this, fd, EPOLLOUT); }
+
+private:
+	struct detached {
+		struct promise_type {
+			detached get_return_object() const noexcept { return {}; }
+			std::suspend_never initial_suspend() const noexcept
+			{
+				return {};
+			}
+			std::suspend_never final_suspend() const noexcept
+			{
+				return {};
+			}
+			void return_void() const noexcept {}
+			void unhandled_exception() const noexcept
+			{
+				std::terminate();
+			}
+		};
+	};
+
+	static detached start(executor *ex, task<void> t)
+	{
+		co_await t;
+		--ex->live;
+	}
+
+	template<typename Submit>
+	async_awaiter<Submit> make_async(Submit submit)
+	{
+		return async_awaiter<Submit>(*this, std::move(submit));
+	}
+
+	/*
+	 * Returns false if kernel has no room for request now. It is
+	 * retried after completion of other one, so with nothing in flight
+	 * it fails with -EAGAIN instead of waiting forever.
+	 */
+	bool try_submit(io_awaiter *a)
+	{
+		struct iocb *cb = &a->cb;
+
+		if (detail::io_submit(aio, 1, &cb) == 1) {
+			++inflight;
+			return true;
+		}
+
+		if (errno == EAGAIN && inflight > 0)
+			return false;
+
+		a->ret = -errno;
+		ready.push_back(a->h);
+		return true;
+	}
+
+	void submit_io(io_awaiter *a)
+	{
+		if (inflight >= depth || !try_submit(a))
+			pending.push_back(a);
+	}
+
+	void reap()
+	{
+		struct io_event ev[64];
+		struct timespec zero = {};
+		uint64_t cnt;
+		int i, n;
+
+		if (::read(io_fd, &cnt, sizeof(cnt)) < 0)
+			return;
+
+		do {
+			n = detail::io_getevents(aio, 0, 64, ev, &zero);
+			for (i = 0; i < n; ++i) {
+				auto *a = reinterpret_cast<io_awaiter *>(
+						ev[i].data);
+
+				a->ret = ev[i].res;
+				ready.push_back(a->h);
+				--inflight;
+			}
+		} while (n == 64);
+
+		/* Stop on first EAGAIN, next completion will retry */
+		while (!pending.empty() && inflight < depth) {
+			if (!try_submit(pending.front()))
+				break;
+			pending.pop_front();
+		}
+	}
+
+	[[noreturn]] void fail_errno()
+	{
+		int err = errno;
+
+		cleanup();
+		throw std::system_error(err, std::generic_category());
+	}
+
+	void cleanup()
+	{
+		if (pool)
+			usbg_async_destroy(pool);
+		if (aio)
+			detail::io_destroy(aio);
+		if (io_fd >= 0)
+			close(io_fd);
+		if (ep_fd >= 0)
+			close(ep_fd);
+
+		pool = nullptr;
+		aio = 0;
+		io_fd = ep_fd = -1;
+	}
+
+	int ep_fd = -1;
+	int io_fd = -1;
+	aio_context_t aio = 0;
+	unsigned depth;
+	unsigned inflight = 0;
+	usbg_async *pool = nullptr;
+	std::size_t live = 0;
+	std::deque<std::coroutine_handle<>> ready;
+	std::deque<io_awaiter *> pending;
+};
+
+} /* namespace coro */
+} /* namespace usbg */
+
+#endif /* __USBG_CORO_HPP__ */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_DAEMON_H__
+#define __USBG_DAEMON_H__
+
+#include <stddef.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_daemon.h
+ * @brief Server side of shared gadget state
+ * @details Daemon is the only process which accesses configfs. It keeps
+ * image of the gadget tree in shared memory, which clients map read only,
+ * and applies their changes received over unix socket. Image is refreshed
+ * after each batch of changes and whenever configfs or UDC class is
+ * modified by someone else (inotify and kobject uevents).
+ *
+ * Clients use the library as usual after selecting backend created with
+ * usbg_backend_client_create(), so all usbg_get_*() calls are served from
+ * shared memory without any system call.
+ *
+ * Daemon does not run any thread on its own. Caller polls descriptor
+ * returned by usbg_daemon_get_fd() and calls usbg_daemon_process().
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_daemon
+ * @brief Server of shared gadget state
+ */
+typedef struct usbg_daemon usbg_daemon;
+
+/**
+ * @brief Default size of shared memory
+ */
+#define USBG_DAEMON_DEFAULT_SHM_SIZE (1024 * 1024)
+
+/**
+ * @brief Start serving configfs to clients
+ * @details Only paths under usb_gadget directory of configfs can be
+ * modified by clients. Access to the daemon is controlled by permissions
+ * of socket, which is created according to umask, and only clients
+ * running as root or as owner of the daemon are accepted. Shared memory
+ * is sealed, so clients can't modify it even by reopening its
+ * descriptor.
+ * @param configfs_path Path where configfs is mounted
+ * @param socket_path Path of unix socket to be created
+ * @param shm_size Size of shared memory or 0 for default
+ * @param d Pointer to be filled with created daemon
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_daemon_create(const char *configfs_path,
+			      const char *socket_path, size_t shm_size,
+			      usbg_daemon **d);
+
+/**
+ * @brief Stop serving, disconnect clients and remove socket
+ * @param d Daemon
+ */
+extern void usbg_daemon_destroy(usbg_daemon *d);
+
+/**
+ * @brief Get descriptor which becomes readable when daemon has work
+ * @param d Daemon
+ * @return File descriptor or usbg_error if error occurred
+ */
+extern int usbg_daemon_get_fd(usbg_daemon *d);
+
+/**
+ * @brief Handle pending connections, requests and change notifications
+ * @details Does not block.
+ * @param d Daemon
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_daemon_process(usbg_daemon *d);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_DAEMON_H__ */
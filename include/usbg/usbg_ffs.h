@@ -0,0 +1,571 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_FFS_H__
+#define __USBG_FFS_H__
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/usb/functionfs.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_ffs.h
+ * @brief FunctionFS data path helpers
+ * @details libusbg creates F_FFS functions in configfs but endpoint I/O
+ * is done by the daemon which owns the mounted functionfs instance.
+ * Routines declared here operate on endpoint file descriptors opened
+ * by such a daemon (e.g. /path/to/mount/ep1).
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_ffs_ep_dir
+ * @brief Direction of FunctionFS endpoint
+ */
+typedef enum {
+	USBG_FFS_EP_IN,		/**< Device to host */
+	USBG_FFS_EP_OUT,	/**< Host to device */
+} usbg_ffs_ep_dir;
+
+/* DMA-BUF transfers */
+
+struct usbg_ffs_dmabuf;
+
+/**
+ * @brief Buffer which may be transferred without copying through userspace
+ * @details Buffer is allocated from dma-heap or udmabuf. If none of them
+ * is available or endpoint does not support DMA-BUF ioctls, transfers
+ * fall back to ordinary read()/write() on endpoint file.
+ */
+typedef struct usbg_ffs_dmabuf usbg_ffs_dmabuf;
+
+/**
+ * @brief Returned by usbg_ffs_dmabuf_wait() for zero-copy OUT transfer
+ * @details Kernel signals its completion by dma-buf fence which carries
+ * no byte count, so short packet cannot be told from full transfer.
+ * Protocols which need it have to put length into data or use copy mode.
+ */
+#define USBG_FFS_DMABUF_LEN_UNKNOWN INT_MAX
+
+/**
+ * @brief Allocate a new DMA-BUF for FunctionFS transfers
+ * @param size Size of buffer in bytes, less than
+ * USBG_FFS_DMABUF_LEN_UNKNOWN
+ * @param buf Pointer to be filled with pointer to buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_alloc(size_t size, usbg_ffs_dmabuf **buf);
+
+/**
+ * @brief Free buffer allocated with usbg_ffs_dmabuf_alloc()
+ * @details Buffer is detached from endpoint if needed.
+ * Pending transfer is waited for before releasing memory.
+ * @param buf Pointer to buffer
+ */
+extern void usbg_ffs_dmabuf_free(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Get CPU mapping of buffer
+ * @param buf Pointer to buffer
+ * @return Pointer to buffer memory or NULL if error occurred
+ * @note Access to this memory should be bracketed with
+ * usbg_ffs_dmabuf_sync_start() and usbg_ffs_dmabuf_sync_end()
+ */
+extern void *usbg_ffs_dmabuf_data(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Get size of buffer
+ * @param buf Pointer to buffer
+ * @return Size of buffer in bytes
+ */
+extern size_t usbg_ffs_dmabuf_size(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Get file descriptor of underlying dma-buf
+ * @param buf Pointer to buffer
+ * @return dma-buf file descriptor or -1 if buffer is not dma-buf backed
+ */
+extern int usbg_ffs_dmabuf_fd(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Attach buffer to FunctionFS endpoint
+ * @details If kernel does not support FUNCTIONFS_DMABUF_ATTACH
+ * buffer is attached in copy mode and all further transfers
+ * are done using read()/write() on endpoint file.
+ * @param buf Pointer to buffer
+ * @param ep_fd File descriptor of opened endpoint file
+ * @param dir Direction of given endpoint
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_attach(usbg_ffs_dmabuf *buf, int ep_fd,
+				  usbg_ffs_ep_dir dir);
+
+/**
+ * @brief Detach buffer from endpoint
+ * @param buf Pointer to buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_detach(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Check if buffer transfers are done without copying
+ * @param buf Pointer to buffer
+ * @return 1 if zero-copy is used, 0 if copy fallback is active
+ */
+extern int usbg_ffs_dmabuf_is_zero_copy(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Queue transfer of buffer content
+ * @details In zero-copy mode this function returns immediately
+ * and completion should be waited using usbg_ffs_dmabuf_wait().
+ * In copy mode transfer is done synchronously.
+ * @param buf Pointer to attached buffer
+ * @param len Number of bytes to be transferred
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_transfer(usbg_ffs_dmabuf *buf, size_t len);
+
+/**
+ * @brief Wait for completion of queued transfer
+ * @param buf Pointer to buffer
+ * @param timeout_ms Timeout in milliseconds, negative means infinity
+ * @return Number of bytes transferred by last transfer (0 or above),
+ * USBG_FFS_DMABUF_LEN_UNKNOWN for zero-copy OUT transfer or usbg_error
+ * if error occurred. USBG_ERROR_BUSY is returned if transfer has not
+ * been completed before timeout.
+ */
+extern int usbg_ffs_dmabuf_wait(usbg_ffs_dmabuf *buf, int timeout_ms);
+
+/**
+ * @brief Prepare buffer for CPU access
+ * @param buf Pointer to buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_sync_start(usbg_ffs_dmabuf *buf);
+
+/**
+ * @brief Finish CPU access to buffer
+ * @param buf Pointer to buffer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_dmabuf_sync_end(usbg_ffs_dmabuf *buf);
+
+/* File to endpoint streaming */
+
+/**
+ * @brief Default size of single transfer used by streaming helpers
+ */
+#define USBG_FFS_STREAM_CHUNK (64 * 1024)
+
+/**
+ * @typedef usbg_ffs_stream_method
+ * @brief Method which has been used to move data
+ */
+typedef enum {
+	USBG_FFS_STREAM_SPLICE,	/**< splice() through pipe, no user copy */
+	USBG_FFS_STREAM_MMAP,	/**< write() from mapped file */
+	USBG_FFS_STREAM_COPY,	/**< read() into buffer and write() */
+	USBG_FFS_STREAM_AIO,	/**< Multiple requests queued using AIO */
+} usbg_ffs_stream_method;
+
+/**
+ * @typedef usbg_ffs_stream_stats
+ * @brief Result of streaming operation
+ */
+typedef struct {
+	uint64_t bytes;		/**< Number of bytes transferred */
+	uint64_t elapsed_ns;	/**< Time spent on transfer */
+	uint64_t bytes_per_sec;	/**< Achieved throughput */
+	usbg_ffs_stream_method method;
+} usbg_ffs_stream_stats;
+
+/**
+ * @brief Stream data from file to FunctionFS IN endpoint
+ * @details Data is read from current position of file_fd. splice()
+ * through a pipe is tried first, then write() from mapped file and
+ * finally plain read()/write() loop.
+ * @param ep_fd File descriptor of opened IN endpoint
+ * @param file_fd Source file descriptor
+ * @param len Number of bytes to be sent, 0 means until end of file
+ * @param chunk Size of single transfer, 0 means USBG_FFS_STREAM_CHUNK
+ * @param stats Structure to be filled with throughput data,
+ * if NULL this param will be ignored.
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_stream_to_ep(int ep_fd, int file_fd, size_t len,
+				 size_t chunk, usbg_ffs_stream_stats *stats);
+
+/**
+ * @brief Stream data from FunctionFS OUT endpoint to file
+ * @details splice() through a pipe is tried first and plain
+ * read()/write() loop is used if endpoint does not support it.
+ * @param ep_fd File descriptor of opened OUT endpoint
+ * @param file_fd Destination file descriptor
+ * @param len Number of bytes to be received, 0 means until first
+ * transfer shorter than chunk (end of USB transfer)
+ * @param chunk Size of single transfer, 0 means USBG_FFS_STREAM_CHUNK
+ * @param stats Structure to be filled with throughput data,
+ * if NULL this param will be ignored.
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_stream_from_ep(int ep_fd, int file_fd, size_t len,
+				   size_t chunk, usbg_ffs_stream_stats *stats);
+
+/* Queued transfers and autotuning */
+
+/**
+ * @brief Default location of stored autotuning results
+ */
+#define USBG_FFS_TUNING_FILE "/var/lib/libusbg/ffs-tuning"
+
+/**
+ * @typedef usbg_ffs_tuning
+ * @brief Data path parameters of FunctionFS endpoint
+ */
+typedef struct {
+	int queue_depth;	/**< Number of requests in flight */
+	size_t transfer_size;	/**< Size of each request in bytes */
+} usbg_ffs_tuning;
+
+/**
+ * @typedef usbg_ffs_autotune_opts
+ * @brief Calibration parameters. Zero in any field selects default.
+ */
+typedef struct {
+	int max_depth;		/**< Largest queue depth tried (16) */
+	size_t min_size;	/**< Smallest transfer size tried (4 KiB) */
+	size_t max_size;	/**< Largest transfer size tried (1 MiB) */
+	int window_ms;		/**< Calibration time of each point (200) */
+	int force;		/**< Ignore stored result and calibrate */
+	const char *store_path;	/**< Results file (USBG_FFS_TUNING_FILE) */
+} usbg_ffs_autotune_opts;
+
+/**
+ * @brief Move data between endpoint and file with multiple requests queued
+ * @details Requests are queued on endpoint using kernel AIO. If AIO is not
+ * available a single request at a time is used.
+ * @param ep_fd File descriptor of opened endpoint
+ * @param dir Direction of given endpoint
+ * @param file_fd Source (IN) or destination (OUT) of data. If below 0,
+ * zeros are sent on IN endpoint and received data is dropped on OUT.
+ * @param tuning Queue depth and transfer size to be used
+ * @param len Number of bytes to be transferred, 0 means until end of
+ * file for IN endpoint or until short transfer for OUT endpoint.
+ * It cannot be 0 if file_fd is below 0.
+ * @param stats Structure to be filled with throughput data,
+ * if NULL this param will be ignored.
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_pump(int ep_fd, usbg_ffs_ep_dir dir, int file_fd,
+			 const usbg_ffs_tuning *tuning, size_t len,
+			 usbg_ffs_stream_stats *stats);
+
+/**
+ * @brief Find best queue depth and transfer size for endpoint
+ * @details If result for given udc, its current speed and endpoint has
+ * been stored earlier it is returned without calibration. Otherwise
+ * queue depth and transfer size are swept, each point being run with
+ * usbg_ffs_pump() for a calibration window. Among points which reach at
+ * least 90% of best throughput the one with most bytes per CPU second
+ * is chosen and stored. Host has to keep sinking (IN) or sourcing (OUT)
+ * data during calibration.
+ * @param ep_fd File descriptor of opened endpoint
+ * @param dir Direction of given endpoint
+ * @param udc Name of UDC to which gadget is bound, if NULL result
+ * is neither loaded nor stored
+ * @param ep_name Name of endpoint file used as a part of key (e.g. "ep1")
+ * @param opts Calibration parameters, if NULL defaults are used
+ * @param tuning Structure to be filled with chosen parameters
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_autotune(int ep_fd, usbg_ffs_ep_dir dir, const char *udc,
+			     const char *ep_name,
+			     const usbg_ffs_autotune_opts *opts,
+			     usbg_ffs_tuning *tuning);
+
+/**
+ * @brief Load stored tuning for given UDC and endpoint
+ * @param path Results file, if NULL USBG_FFS_TUNING_FILE is used
+ * @param udc Name of UDC
+ * @param ep_name Name of endpoint file
+ * @param tuning Structure to be filled
+ * @return 0 on success, USBG_ERROR_NOT_FOUND if there is no such entry
+ * or other usbg_error if error occurred
+ */
+extern int usbg_ffs_tuning_load(const char *path, const char *udc,
+				const char *ep_name, usbg_ffs_tuning *tuning);
+
+/**
+ * @brief Store tuning for given UDC and endpoint
+ * @details Previous entry with the same key is replaced.
+ * @param path Results file, if NULL USBG_FFS_TUNING_FILE is used
+ * @param udc Name of UDC
+ * @param ep_name Name of endpoint file
+ * @param tuning Parameters to be stored
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_tuning_store(const char *path, const char *udc,
+				 const char *ep_name,
+				 const usbg_ffs_tuning *tuning);
+
+/* Small message batching */
+
+struct usbg_ffs_batch;
+
+/**
+ * @brief Framing layer which coalesces small messages into large transfers
+ * @details Each message is preceded by its length encoded as 16 bit
+ * little endian value. Frame of length 0 is a padding and terminates
+ * parsing of transfer. Peer has to use transfers not longer than
+ * max_batch bytes.
+ */
+typedef struct usbg_ffs_batch usbg_ffs_batch;
+
+/**
+ * @typedef usbg_ffs_batch_opts
+ * @brief Batching parameters. Zero in any field selects default.
+ */
+typedef struct {
+	size_t max_batch;	/**< Max size of single transfer (16 KiB) */
+	int flush_deadline_us;	/**< Max time message may wait (1000 us) */
+	int max_packet;		/**< wMaxPacketSize of endpoint (512) */
+} usbg_ffs_batch_opts;
+
+/**
+ * @typedef usbg_ffs_batch_stats
+ * @brief Batching counters
+ * @details Fill ratio of batches is bytes / capacity and average
+ * latency added by batching is latency_ns / messages.
+ */
+typedef struct {
+	uint64_t messages;	/**< Number of messages sent or received */
+	uint64_t batches;	/**< Number of transfers */
+	uint64_t bytes;		/**< Bytes transferred including headers */
+	uint64_t capacity;	/**< Sum of max_batch over all transfers */
+	uint64_t full_flushes;	/**< Batches flushed because of size */
+	uint64_t deadline_flushes; /**< Batches flushed because of deadline */
+	uint64_t latency_ns;	/**< Sum of time messages spent queued */
+	uint64_t max_latency_ns; /**< Longest time message spent queued */
+} usbg_ffs_batch_stats;
+
+/**
+ * @brief Create batching layer over FunctionFS endpoint
+ * @param ep_fd File descriptor of opened bulk endpoint
+ * @param dir Direction of given endpoint. Messages are sent on IN
+ * and received on OUT endpoint.
+ * @param opts Batching parameters, if NULL defaults are used
+ * @param batch Pointer to be filled with pointer to batching layer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_batch_create(int ep_fd, usbg_ffs_ep_dir dir,
+				 const usbg_ffs_batch_opts *opts,
+				 usbg_ffs_batch **batch);
+
+/**
+ * @brief Flush pending messages and free batching layer
+ * @param batch Pointer to batching layer
+ */
+extern void usbg_ffs_batch_destroy(usbg_ffs_batch *batch);
+
+/**
+ * @brief Queue message to be sent
+ * @details Batch is flushed when message does not fit in it or
+ * flush deadline of the oldest queued message has passed.
+ * @param batch Pointer to batching layer on IN endpoint
+ * @param msg Message to be sent
+ * @param len Length of message, from 1 to max_batch - 4 and at most 65535
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_batch_send(usbg_ffs_batch *batch, const void *msg,
+			       size_t len);
+
+/**
+ * @brief Send all queued messages now
+ * @param batch Pointer to batching layer on IN endpoint
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_batch_flush(usbg_ffs_batch *batch);
+
+/**
+ * @brief Get time left to flush deadline
+ * @details Should be used as poll() timeout in application event loop.
+ * usbg_ffs_batch_poll() should be called when it expires.
+ * @param batch Pointer to batching layer
+ * @return Milliseconds to deadline (rounded up) or -1 if nothing is queued
+ */
+extern int usbg_ffs_batch_timeout(usbg_ffs_batch *batch);
+
+/**
+ * @brief Flush batch if its deadline has passed
+ * @param batch Pointer to batching layer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_batch_poll(usbg_ffs_batch *batch);
+
+/**
+ * @brief Receive next message
+ * @details New transfer is read from endpoint only when all messages
+ * from previous one have been consumed.
+ * @param batch Pointer to batching layer on OUT endpoint
+ * @param buf Buffer where message should be copied
+ * @param len Length of given buffer
+ * @return Length of message (above 0) or usbg_error if error occurred.
+ * USBG_ERROR_INVALID_FORMAT is returned for malformed transfer and
+ * USBG_ERROR_INVALID_PARAM if message does not fit in buffer.
+ */
+extern int usbg_ffs_batch_recv(usbg_ffs_batch *batch, void *buf, size_t len);
+
+/**
+ * @brief Get batching counters
+ * @param batch Pointer to batching layer
+ * @param stats Structure to be filled
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_batch_get_stats(usbg_ffs_batch *batch,
+				    usbg_ffs_batch_stats *stats);
+
+/**
+ * @brief Reset batching counters
+ * @param batch Pointer to batching layer
+ */
+extern void usbg_ffs_batch_reset_stats(usbg_ffs_batch *batch);
+
+/* Descriptors and strings */
+
+/**
+ * @typedef usbg_ffs_ep_spec
+ * @brief Declarative description of FunctionFS endpoint
+ * @details Zero in any max packet field selects maximum allowed for
+ * given speed and transfer type.
+ */
+typedef struct {
+	uint8_t bEndpointAddress;	/**< Number with USB_DIR_IN/OUT bit */
+	uint8_t bmAttributes;		/**< USB_ENDPOINT_XFER_* */
+	uint16_t fs_maxpacket;
+	uint16_t hs_maxpacket;
+	uint16_t ss_maxpacket;
+	uint8_t bInterval;		/**< Full speed polling interval */
+	uint8_t hs_interval;		/**< HS/SS interval, 0 means bInterval */
+	uint8_t ss_max_burst;		/**< SS companion bMaxBurst */
+	uint8_t ss_attributes;		/**< SS companion bmAttributes */
+	uint16_t ss_bytes_per_interval;	/**< SS companion wBytesPerInterval */
+} usbg_ffs_ep_spec;
+
+/**
+ * @typedef usbg_ffs_intf_spec
+ * @brief Declarative description of FunctionFS interface
+ */
+typedef struct {
+	uint8_t bInterfaceClass;
+	uint8_t bInterfaceSubClass;
+	uint8_t bInterfaceProtocol;
+	uint8_t iInterface;		/**< Index in strings, starting from 1 */
+	int n_eps;
+	const usbg_ffs_ep_spec *eps;
+} usbg_ffs_intf_spec;
+
+/**
+ * @typedef usbg_ffs_os_compat_spec
+ * @brief MS OS extended compat ID of interface
+ */
+typedef struct {
+	uint8_t bFirstInterfaceNumber;
+	char CompatibleID[8];
+	char SubCompatibleID[8];
+} usbg_ffs_os_compat_spec;
+
+/**
+ * @typedef usbg_ffs_descs_spec
+ * @brief Declarative description of FunctionFS function
+ */
+typedef struct {
+	/**
+	 * Combination of functionfs_flags. FUNCTIONFS_HAS_FS_DESC,
+	 * FUNCTIONFS_HAS_HS_DESC and FUNCTIONFS_HAS_SS_DESC select speeds,
+	 * FUNCTIONFS_HAS_MS_OS_DESC is set when os_compat is not empty.
+	 * FUNCTIONFS_EVENTFD is not supported.
+	 */
+	uint32_t flags;
+	int n_intfs;
+	const usbg_ffs_intf_spec *intfs;
+	int n_os_compat;
+	const usbg_ffs_os_compat_spec *os_compat;
+} usbg_ffs_descs_spec;
+
+/**
+ * @typedef usbg_ffs_strings_lang
+ * @brief Strings of FunctionFS function in one language
+ */
+typedef struct {
+	uint16_t lang;
+	const char *const *strs;	/**< Index 0 is string 1 */
+} usbg_ffs_strings_lang;
+
+/**
+ * @brief Build descriptors blob to be written to ep0
+ * @details Interfaces are numbered in order of appearance. Endpoint
+ * limits of each speed are checked.
+ * @param spec Description of function
+ * @param blob Pointer to be filled with blob, should be freed with free()
+ * @param len Pointer to be filled with length of blob
+ * @return 0 on success, usbg_error if error occurred.
+ * USBG_ERROR_INVALID_VALUE is returned if any endpoint is out of spec.
+ */
+extern int usbg_ffs_build_descs(const usbg_ffs_descs_spec *spec,
+				void **blob, size_t *len);
+
+/**
+ * @brief Build strings blob to be written to ep0
+ * @param langs Array of languages
+ * @param n_langs Number of languages
+ * @param n_strs Number of strings in each language
+ * @param blob Pointer to be filled with blob, should be freed with free()
+ * @param len Pointer to be filled with length of blob
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_build_strings(const usbg_ffs_strings_lang *langs,
+				  int n_langs, int n_strs,
+				  void **blob, size_t *len);
+
+/**
+ * @brief Write descriptors and strings to ep0 of FunctionFS instance
+ * @param ep0_fd File descriptor of opened ep0
+ * @param descs Descriptors blob
+ * @param descs_len Length of descriptors blob
+ * @param strs Strings blob
+ * @param strs_len Length of strings blob
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_ffs_write_descs(int ep0_fd, const void *descs,
+				size_t descs_len, const void *strs,
+				size_t strs_len);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_FFS_H__ */
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_FFS_HPP__
+#define __USBG_FFS_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <linux/usb/functionfs.h>
+
+/**
+ * @file include/usbg/usbg_ffs.hpp
+ * @brief Compile time builder of FunctionFS descriptors and strings
+ * @details Same layout as produced by usbg_ffs_build_descs() and
+ * usbg_ffs_build_strings(), but evaluated by the compiler:
+ *
+ *	constexpr usbg::ffs::endpoint eps[] = {
+ *		usbg::ffs::bulk(1 | USB_DIR_IN), usbg::ffs::bulk(2),
+ *	};
+ *	constexpr usbg::ffs::interface intfs[] = {
+ *		{ USB_CLASS_VENDOR_SPEC, 0, 0, 1, 0, 2 },
+ *	};
+ *	constexpr auto descs = usbg::ffs::make_descs<
+ *		FUNCTIONFS_HAS_FS_DESC | FUNCTIONFS_HAS_HS_DESC>(intfs, eps);
+ *	constexpr auto strs = usbg::ffs::make_strings(0x0409, "Source");
+ *
+ * Endpoint out of spec makes the initializer ill-formed, so error is
+ * reported at build time.
+ */
+
+namespace usbg {
+namespace ffs {
+
+/**
+ * @brief Endpoint description, see usbg_ffs_ep_spec
+ */
+struct endpoint {
+	uint8_t bEndpointAddress;
+	uint8_t bmAttributes;
+	uint16_t fs_maxpacket;
+	uint16_t hs_maxpacket;
+	uint16_t ss_maxpacket;
+	uint8_t bInterval;
+	uint8_t hs_interval;
+	uint8_t ss_max_burst;
+	uint8_t ss_attributes;
+	uint16_t ss_bytes_per_interval;
+};
+
+/**
+ * @brief Interface description, see usbg_ffs_intf_spec
+ * @details Endpoints are given as range of endpoint array passed to
+ * make_descs().
+ */
+struct interface {
+	uint8_t bInterfaceClass;
+	uint8_t bInterfaceSubClass;
+	uint8_t bInterfaceProtocol;
+	uint8_t iInterface;
+	std::size_t first_ep;
+	std::size_t n_eps;
+};
+
+/**
+ * @brief Extended compat ID, see usbg_ffs_os_compat_spec
+ */
+struct os_compat {
+	uint8_t bFirstInterfaceNumber;
+	char CompatibleID[8];
+	char SubCompatibleID[8];
+};
+
+constexpr endpoint bulk(uint8_t addr)
+{
+	return { addr, USB_ENDPOINT_XFER_BULK, 0, 0, 0, 0, 0, 0, 0, 0 };
+}
+
+constexpr endpoint interrupt(uint8_t addr, uint16_t maxpacket,
+			     uint8_t interval)
+{
+	return { addr, USB_ENDPOINT_XFER_INT, maxpacket, maxpacket, maxpacket,
+		 interval, 0, 0, 0, maxpacket };
+}
+
+namespace detail {
+
+enum speed { FS, HS, SS };
+
+constexpr int speed_flags[] = {
+	FUNCTIONFS_HAS_FS_DESC, FUNCTIONFS_HAS_HS_DESC, FUNCTIONFS_HAS_SS_DESC,
+};
+
+/* Mirrors usbg_ffs_ep_maxpacket() in src/usbg_ffs.c */
+constexpr uint16_t maxpacket(const endpoint &ep, speed s)
+{
+	int type = ep.bmAttributes & USB_ENDPOINT_XFERTYPE_MASK;
+	uint16_t mps = 0;
+
+	switch (s) {
+	case FS:
+		mps = ep.fs_maxpacket;
+		if (type == USB_ENDPOINT_XFER_ISOC)
+			return mps ? (mps <= 1023 ? mps : 0) : 1023;
+		if (!mps)
+			return 64;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return mps == 8 || mps == 16 || mps == 32 || mps == 64 ?
+				mps : 0;
+		return mps <= 64 ? mps : 0;
+	case HS:
+		mps = ep.hs_maxpacket;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return !mps || mps == 512 ? 512 : 0;
+		return !mps ? 1024 : ((mps & 0x7ff) <= 1024
+				      && (mps >> 11) <= 2 ? mps : 0);
+	case SS:
+		mps = ep.ss_maxpacket;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return !mps || mps == 1024 ? 1024 : 0;
+		return mps <= 1024 ? (mps ? mps : 1024) : 0;
+	}
+
+	return 0;
+}
+
+template<std::size_t NI>
+constexpr std::size_t n_eps(const interface (&intfs)[NI])
+{
+	std::size_t n = 0;
+
+	for (std::size_t i = 0; i < NI; ++i)
+		n += intfs[i].n_eps;
+
+	return n;
+}
+
+/* Header of each OS descriptor, 11 packed bytes */
+constexpr std::size_t os_desc_hdr_len = sizeof(usb_os_desc_header);
+
+constexpr std::size_t speed_count(int flags)
+{
+	std::size_t n = 0;
+
+	for (int f : speed_flags)
+		n += (flags & f) ? 1 : 0;
+
+	return n;
+}
+
+/* Length of blob with NI interfaces, NE endpoints and NO compat IDs */
+constexpr std::size_t descs_len(int flags, std::size_t ni, std::size_t ne,
+				std::size_t no)
+{
+	std::size_t len = 12 + 4 * speed_count(flags);
+
+	for (int i = 0; i < 3; ++i)
+		if (flags & speed_flags[i])
+			len += ni * 9 + ne * (i == SS ? 7 + 6 : 7);
+
+	return no ? len + 4 + os_desc_hdr_len + no * 24 : len;
+}
+
+template<std::size_t N>
+struct writer {
+	std::array<uint8_t, N> buf{};
+	std::size_t pos = 0;
+
+	constexpr void u8(unsigned v) { buf[pos++] = v & 0xff; }
+	constexpr void le16(unsigned v) { u8(v); u8(v >> 8); }
+	constexpr void le32(unsigned long v) { le16(v & 0xffff); le16(v >> 16); }
+};
+
+template<std::size_t N, std::size_t NI, std::size_t NE>
+constexpr void put_descs(writer<N> &w, speed s,
+			 const interface (&intfs)[NI],
+			 const endpoint (&eps)[NE])
+{
+	for (std::size_t i = 0; i < NI; ++i) {
+		w.u8(9);
+		w.u8(USB_DT_INTERFACE);
+		w.u8(i);
+		w.u8(0);
+		w.u8(intfs[i].n_eps);
+		w.u8(intfs[i].bInterfaceClass);
+		w.u8(intfs[i].bInterfaceSubClass);
+		w.u8(intfs[i].bInterfaceProtocol);
+		w.u8(intfs[i].iInterface);
+
+		for (std::size_t j = 0; j < intfs[i].n_eps; ++j) {
+			const endpoint &ep = eps[intfs[i].first_ep + j];
+			uint16_t mps = maxpacket(ep, s);
+
+			if (!mps)
+				throw std::invalid_argument(
+					"endpoint out of spec");
+
+			w.u8(7);
+			w.u8(USB_DT_ENDPOINT);
+			w.u8(ep.bEndpointAddress);
+			w.u8(ep.bmAttributes);
+			w.le16(mps);
+			w.u8(s != FS && ep.hs_interval ?
+			     ep.hs_interval : ep.bInterval);
+
+			if (s != SS)
+				continue;
+
+			w.u8(6);
+			w.u8(USB_DT_SS_ENDPOINT_COMP);
+			w.u8(ep.ss_max_burst);
+			w.u8(ep.ss_attributes);
+			w.le16(ep.ss_bytes_per_interval);
+		}
+	}
+}
+
+template<int Flags, std::size_t NI, std::size_t NE, std::size_t NO>
+constexpr auto build_descs(const interface (&intfs)[NI],
+			   const endpoint (&eps)[NE],
+			   const os_compat *compat)
+{
+	constexpr int flags = NO ? Flags | FUNCTIONFS_HAS_MS_OS_DESC
+		: Flags & ~FUNCTIONFS_HAS_MS_OS_DESC;
+	constexpr std::size_t len = descs_len(flags, NI, NE, NO);
+	static_assert(speed_count(flags) > 0, "no speed selected");
+	static_assert(!(flags & FUNCTIONFS_EVENTFD), "eventfd not supported");
+	writer<len> w;
+
+	if (n_eps(intfs) != NE)
+		throw std::invalid_argument("endpoints not used exactly once");
+
+	for (std::size_t i = 0; i < NI; ++i)
+		if (intfs[i].first_ep + intfs[i].n_eps > NE)
+			throw std::out_of_range("interface endpoint range");
+
+	w.le32(FUNCTIONFS_DESCRIPTORS_MAGIC_V2);
+	w.le32(len);
+	w.le32(flags);
+
+	for (int i = 0; i < 3; ++i)
+		if (flags & speed_flags[i])
+			w.le32(NI + NE + (i == SS ? NE : 0));
+
+	if (NO)
+		w.le32(1);
+
+	for (int i = 0; i < 3; ++i)
+		if (flags & speed_flags[i])
+			put_descs(w, static_cast<speed>(i), intfs, eps);
+
+	if (NO) {
+		w.u8(compat[0].bFirstInterfaceNumber);
+		w.le32(os_desc_hdr_len + NO * 24);
+		w.le16(0x0100);
+		w.le16(0x0004);
+		w.u8(NO);
+		w.u8(0);
+
+		for (std::size_t i = 0; i < NO; ++i) {
+			w.u8(compat[i].bFirstInterfaceNumber);
+			w.u8(1);
+			for (char c : compat[i].CompatibleID)
+				w.u8(c);
+			for (char c : compat[i].SubCompatibleID)
+				w.u8(c);
+			w.pos += 6;
+		}
+	}
+
+	if (w.pos != len)
+		throw std::logic_error("descriptors length mismatch");
+
+	return w.buf;
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Build descriptors blob at compile time
+ * @tparam Flags Combination of functionfs_flags
+ * @param intfs Interfaces, numbered in order of appearance
+ * @param eps Endpoints, each of them used by exactly one interface
+ * @return std::array ready to be written to ep0
+ */
+template<int Flags, std::size_t NI, std::size_t NE>
+constexpr auto make_descs(const interface (&intfs)[NI],
+			  const endpoint (&eps)[NE])
+{
+	return detail::build_descs<Flags, NI, NE, 0>(intfs, eps, nullptr);
+}
+
+/**
+ * @brief Build descriptors blob with MS OS extended compat IDs
+ */
+template<int Flags, std::size_t NI, std::size_t NE, std::size_t NO>
+constexpr auto make_descs(const interface (&intfs)[NI],
+			  const endpoint (&eps)[NE],
+			  const os_compat (&compat)[NO])
+{
+	return detail::build_descs<Flags, NI, NE, NO>(intfs, eps, compat);
+}
+
+/**
+ * @brief Build strings blob in single language at compile time
+ * @param lang Language code, for example 0x0409
+ * @param strs String literals, first of them has index 1
+ * @return std::array ready to be written to ep0
+ */
+template<std::size_t... Ns>
+constexpr auto make_strings(uint16_t lang, const char (&...strs)[Ns])
+{
+	constexpr std::size_t len = 16 + 2 + (Ns + ... + 0);
+	detail::writer<len> w;
+
+	w.le32(FUNCTIONFS_STRINGS_MAGIC);
+	w.le32(len);
+	w.le32(sizeof...(Ns));
+	w.le32(1);
+	w.le16(lang);
+	(([&] {
+		for (std::size_t i = 0; i < Ns; ++i)
+			w.u8(strs[i]);
+	})(), ...);
+
+	return w.buf;
+}
+
+} /* namespace ffs */
+} /* namespace usbg */
+
+#endif /* __USBG_FFS_HPP__ */
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_HID_H__
+#define __USBG_HID_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_hid.h
+ * @brief Report writer for /dev/hidgN of HID function
+ * @details f_hid takes exactly one report per write() and blocks it
+ * until the previous report has been fetched by host, so return of
+ * write() for report N marks completion of report N - 1. Writer queues
+ * reports in preallocated memory, writes them in one go and records
+ * when each of them was queued, handed to controller and fetched by
+ * host. These timestamps give device side part of input latency.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @brief Default number of reports queued before writer flushes itself
+ */
+#define USBG_HID_WRITER_BATCH 64
+
+struct usbg_hid_writer;
+
+/**
+ * @typedef usbg_hid_writer
+ * @brief Queue of reports for single /dev/hidgN
+ */
+typedef struct usbg_hid_writer usbg_hid_writer;
+
+/**
+ * @typedef usbg_hid_timestamp
+ * @brief Life of single report, CLOCK_MONOTONIC in nanoseconds
+ * @details done_ns is 0 if host has not fetched the last report of
+ * flush within timeout.
+ */
+typedef struct {
+	uint64_t queued_ns;	/**< Report has been queued in writer */
+	uint64_t written_ns;	/**< write() has returned */
+	uint64_t done_ns;	/**< Host has fetched report */
+} usbg_hid_timestamp;
+
+/**
+ * @typedef usbg_hid_writer_stats
+ * @brief Writer counters
+ * @details Average device side latency is latency_ns / reports.
+ */
+typedef struct {
+	uint64_t reports;	/**< Reports fetched by host */
+	uint64_t flushes;	/**< Calls which wrote queued reports */
+	uint64_t bytes;		/**< Bytes written */
+	uint64_t timeouts;	/**< Reports not fetched within timeout */
+	uint64_t latency_ns;	/**< Sum of time from queue to host */
+	uint64_t max_latency_ns; /**< Longest time from queue to host */
+} usbg_hid_writer_stats;
+
+/**
+ * @brief Open writer on HID character device
+ * @param dev_path Path of device, e.g. /dev/hidg0
+ * @param report_length Size of single report, as report_length of
+ * function
+ * @param max_batch Number of reports queued before automatic flush,
+ * 0 means USBG_HID_WRITER_BATCH
+ * @param w Pointer to be filled with pointer to writer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_hid_writer_open(const char *dev_path, int report_length,
+				int max_batch, usbg_hid_writer **w);
+
+/**
+ * @brief Open writer on device of bound HID function
+ * @details Device path and report length are taken from function.
+ * @param f Pointer to HID function
+ * @param max_batch Number of reports queued before automatic flush,
+ * 0 means USBG_HID_WRITER_BATCH
+ * @param w Pointer to be filled with pointer to writer
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_hid_writer_open_function(usbg_function *f, int max_batch,
+					 usbg_hid_writer **w);
+
+/**
+ * @brief Flush queued reports and close writer
+ * @param w Pointer to writer
+ */
+extern void usbg_hid_writer_close(usbg_hid_writer *w);
+
+/**
+ * @brief Get file descriptor of device
+ * @details May be used to read output reports, like keyboard LEDs.
+ * @param w Pointer to writer
+ * @return File descriptor or -1 if w is NULL
+ */
+extern int usbg_hid_writer_fd(usbg_hid_writer *w);
+
+/**
+ * @brief Set how long flush waits for host to fetch last report
+ * @param w Pointer to writer
+ * @param timeout_ms Timeout in milliseconds, 0 disables waiting and
+ * done_ns of last report stays 0. Default is 1000.
+ */
+extern void usbg_hid_writer_set_timeout(usbg_hid_writer *w, int timeout_ms);
+
+/**
+ * @brief Queue report
+ * @details Writer is flushed without timestamps when it is full.
+ * @param w Pointer to writer
+ * @param report Report of report_length bytes
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_hid_writer_queue(usbg_hid_writer *w, const void *report);
+
+/**
+ * @brief Write all queued reports
+ * @param w Pointer to writer
+ * @param ts Array filled with timestamps of written reports in queue
+ * order, may be NULL
+ * @param n_ts Size of ts array, timestamps of reports above are dropped
+ * @return Number of reports written or usbg_error if error occurred.
+ * Report which failed and those after it stay queued.
+ */
+extern int usbg_hid_writer_flush(usbg_hid_writer *w, usbg_hid_timestamp *ts,
+				 int n_ts);
+
+/**
+ * @brief Write single report now
+ * @details Reports queued before are written first.
+ * @param w Pointer to writer
+ * @param report Report of report_length bytes
+ * @param ts Filled with timestamps of this report, may be NULL
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_hid_writer_send(usbg_hid_writer *w, const void *report,
+				usbg_hid_timestamp *ts);
+
+/**
+ * @brief Get writer counters
+ * @param w Pointer to writer
+ * @param stats Structure to be filled
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_hid_writer_get_stats(usbg_hid_writer *w,
+				     usbg_hid_writer_stats *stats);
+
+/**
+ * @brief Reset writer counters
+ * @param w Pointer to writer
+ */
+extern void usbg_hid_writer_reset_stats(usbg_hid_writer *w);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_HID_H__ */
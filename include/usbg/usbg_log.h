@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_LOG_H__
+#define __USBG_LOG_H__
+
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_log.h
+ * @brief Routing of library diagnostic messages
+ * @details By default messages of level USBG_LOG_ERROR and more severe
+ * are written to stderr. Both the sink and the threshold can be changed
+ * for whole process and overridden for a single usbg_state.
+ *
+ * Messages less severe than USBG_LOG_MAX_LEVEL at library build time
+ * (USBG_LOG_DEBUG if not defined, e.g. CPPFLAGS=-DUSBG_LOG_MAX_LEVEL=1)
+ * are not compiled in at all. Message which is compiled in but filtered
+ * out at runtime costs a single comparison and is never formatted.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_log_level
+ * @brief Severity of message
+ */
+typedef enum {
+	USBG_LOG_NONE = 0,	/**< Used only as threshold, disables logging */
+	USBG_LOG_ERROR,		/**< Operation failed unexpectedly */
+	USBG_LOG_WARNING,
+	USBG_LOG_INFO,
+	USBG_LOG_DEBUG,		/**< Also expected failures, e.g. name clash */
+} usbg_log_level;
+
+/**
+ * @brief Callback receiving log messages
+ * @param level Severity of message
+ * @param func Name of library function which produced message
+ * @param msg Formatted message without trailing new line, valid only
+ * during the call
+ * @param data Pointer given when callback was set
+ * @note Callback is called synchronously from the library call which
+ * failed and it must not call library functions for the same state.
+ */
+typedef void (*usbg_log_cb)(usbg_log_level level, const char *func,
+			    const char *msg, void *data);
+
+/**
+ * @brief Set process wide log callback
+ * @param cb Callback or NULL to restore logging to stderr
+ * @param data Passed to each call of cb
+ */
+extern void usbg_set_log_callback(usbg_log_cb cb, void *data);
+
+/**
+ * @brief Set process wide log threshold
+ * @param level Most verbose level which is reported
+ */
+extern void usbg_set_log_level(usbg_log_level level);
+
+/**
+ * @brief Get process wide log threshold
+ * @return Most verbose level which is reported
+ */
+extern usbg_log_level usbg_get_log_level(void);
+
+/**
+ * @brief Route messages related to given state to its own callback
+ * @details Messages produced by operations on the state and on all its
+ * gadgets, configs and functions are passed to cb if their level is not
+ * above given threshold. Process wide settings are not used for them.
+ * @param s State to be configured
+ * @param cb Callback or NULL to use process wide settings again
+ * @param data Passed to each call of cb
+ * @param level Most verbose level which is reported to cb
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_set_state_log_callback(usbg_state *s, usbg_log_cb cb,
+				       void *data, usbg_log_level level);
+
+/**
+ * @brief Get name of log level
+ * @param level Level
+ * @return Name of level, e.g. "error", or NULL if level is not valid
+ */
+extern const char *usbg_log_level_str(usbg_log_level level);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_LOG_H__ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_SNAPSHOT_H__
+#define __USBG_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_snapshot.h
+ * @brief Immutable views of whole gadget tree
+ * @details Snapshot is a read only copy of all gadgets, configs, functions
+ * and bindings of usbg_state together with their attributes and strings
+ * (in LANG_US_ENG). Once taken it never changes, so it may be iterated by
+ * any number of threads without locks and stays valid until released,
+ * even if the gadgets are removed meanwhile.
+ *
+ * Each change done through the library marks only the touched gadget as
+ * out of date. The next usbg_snapshot_take() publishes a new version
+ * which shares all other gadgets with the previous one and rereads from
+ * configfs only the modified ones. When nothing has changed the current
+ * version is returned without any configfs access.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+typedef struct usbg_snap_function usbg_snap_function;
+
+/**
+ * @typedef usbg_snap_binding
+ * @brief Binding of function to config in snapshot
+ */
+typedef struct {
+	const char *name;
+	const usbg_snap_function *target; /**< Points into functions of gadget */
+} usbg_snap_binding;
+
+/**
+ * @brief Function in snapshot
+ */
+struct usbg_snap_function {
+	const char *name;	/**< Directory name, e.g. "acm.usb0" */
+	const char *instance;
+	usbg_function_type type;
+	usbg_function_attrs attrs;
+};
+
+/**
+ * @typedef usbg_snap_config
+ * @brief Configuration in snapshot
+ */
+typedef struct {
+	const char *label;
+	int id;
+	usbg_config_attrs attrs;
+	usbg_config_strs strs;
+	int n_bindings;
+	const usbg_snap_binding *bindings;
+} usbg_snap_config;
+
+/**
+ * @typedef usbg_snap_gadget
+ * @brief Gadget in snapshot
+ * @details Functions and configs are sorted in the same order as
+ * returned by iteration functions of usbg.h.
+ */
+typedef struct {
+	const char *name;
+	const char *udc;	/**< Empty if gadget is not enabled */
+	usbg_gadget_attrs attrs;
+	usbg_gadget_strs strs;
+	int n_functions;
+	const usbg_snap_function *functions;
+	int n_configs;
+	const usbg_snap_config *configs;
+} usbg_snap_gadget;
+
+/**
+ * @typedef usbg_snapshot
+ * @brief Immutable view of all gadgets
+ */
+typedef struct {
+	uint64_t version;	/**< Grows with each published change */
+	int n_gadgets;
+	const usbg_snap_gadget *const *gadgets;
+} usbg_snapshot;
+
+/**
+ * @brief Get current snapshot of state
+ * @details Caller gets its own reference which has to be dropped with
+ * usbg_snapshot_release(). Snapshots taken without changes in between
+ * are the same object.
+ * @param s State
+ * @param snap Pointer to be filled with snapshot
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_snapshot_take(usbg_state *s, const usbg_snapshot **snap);
+
+/**
+ * @brief Drop reference to snapshot
+ * @param snap Snapshot returned by usbg_snapshot_take() or NULL
+ */
+extern void usbg_snapshot_release(const usbg_snapshot *snap);
+
+/**
+ * @brief Find gadget in snapshot
+ * @param snap Snapshot
+ * @param name Name of gadget
+ * @return Gadget or NULL if there is no such gadget
+ */
+extern const usbg_snap_gadget *usbg_snapshot_get_gadget(
+		const usbg_snapshot *snap, const char *name);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_SNAPSHOT_H__ */
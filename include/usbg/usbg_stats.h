@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_STATS_H__
+#define __USBG_STATS_H__
+
+#include <stdint.h>
+#include <usbg/usbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_stats.h
+ * @brief Counters and latency histograms of library operations
+ * @details Collection is disabled by default and costs a single
+ * branch per operation until usbg_enable_stats() is called.
+ * Statistics are process wide and shared by all usbg_state instances.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_stat_op
+ * @brief Operations being measured
+ * @details Configfs I/O operations are counted for each call of
+ * backend. API entry points are measured including I/O they do, so
+ * time of nested API calls (e.g. usbg_create_gadget() called by
+ * usbg_import_gadget()) is accounted for both of them.
+ */
+typedef enum {
+	/* Configfs and sysfs I/O */
+	USBG_STAT_READ = 0,
+	USBG_STAT_WRITE,
+	USBG_STAT_MKDIR,
+	USBG_STAT_RMDIR,
+	USBG_STAT_UNLINK,
+	USBG_STAT_SYMLINK,
+	USBG_STAT_READLINK,
+	USBG_STAT_SCANDIR,
+	USBG_STAT_CHECK_DIR,
+	/* API entry points */
+	USBG_STAT_INIT,
+	USBG_STAT_CREATE_GADGET,
+	USBG_STAT_RM_GADGET,
+	USBG_STAT_SET_GADGET_ATTRS,
+	USBG_STAT_SET_GADGET_STRS,
+	USBG_STAT_CREATE_FUNCTION,
+	USBG_STAT_RM_FUNCTION,
+	USBG_STAT_SET_FUNCTION_ATTRS,
+	USBG_STAT_CREATE_CONFIG,
+	USBG_STAT_RM_CONFIG,
+	USBG_STAT_ADD_CONFIG_FUNCTION,
+	USBG_STAT_GET_UDCS,
+	USBG_STAT_ENABLE_GADGET,
+	USBG_STAT_DISABLE_GADGET,
+	USBG_STAT_EXPORT_GADGET,
+	USBG_STAT_IMPORT_GADGET,
+	USBG_STAT_OP_MAX,
+} usbg_stat_op;
+
+/**
+ * @brief Number of latency histogram buckets
+ * @details Bucket i counts operations which took less than 2^(i + 1)
+ * nanoseconds (and at least 2^i for i > 0). Last bucket counts also
+ * all slower ones.
+ */
+#define USBG_STATS_HIST_BUCKETS 32
+
+/**
+ * @typedef usbg_op_stats
+ * @brief Statistics of single operation
+ */
+typedef struct {
+	uint64_t count;
+	uint64_t errors;	/**< Calls which returned error */
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t hist[USBG_STATS_HIST_BUCKETS];
+} usbg_op_stats;
+
+/**
+ * @typedef usbg_stats
+ * @brief Statistics of all operations, indexed by usbg_stat_op
+ */
+typedef struct {
+	usbg_op_stats ops[USBG_STAT_OP_MAX];
+} usbg_stats;
+
+/**
+ * @brief Start or stop collecting statistics
+ * @param enable Non zero to start, zero to stop
+ * @details Statistics collected so far are kept
+ */
+extern void usbg_enable_stats(int enable);
+
+/**
+ * @brief Copy current statistics
+ * @param stats Structure to be filled
+ * @return 0 on success, usbg_error if error occurred
+ */
+extern int usbg_get_stats(usbg_stats *stats);
+
+/**
+ * @brief Zero all statistics
+ */
+extern void usbg_reset_stats(void);
+
+/**
+ * @brief Get name of measured operation
+ * @param op Operation
+ * @return Name of operation or NULL if op is not valid
+ */
+extern const char *usbg_stat_op_name(usbg_stat_op op);
+
+/**
+ * @brief Get approximate percentile of latency from histogram
+ * @param s Statistics of operation
+ * @param pct Percentile from 0 to 100
+ * @return Upper bound of bucket containing percentile in nanoseconds
+ * (limited by max_ns)
+ * or 0 if there were no calls
+ */
+extern uint64_t usbg_stats_percentile(const usbg_op_stats *s, double pct);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_STATS_H__ */
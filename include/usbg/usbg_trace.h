@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_TRACE_H__
+#define __USBG_TRACE_H__
+
+#include <stdint.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_stats.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file include/usbg/usbg_trace.h
+ * @brief Tracing of configfs operations done by library
+ * @details Each configfs/sysfs operation is reported twice: before and
+ * after it is executed. Reports are delivered to callback set with
+ * usbg_set_trace_callback() and, when library is built with
+ * sys/sdt.h available, to USDT probes:
+ *
+ *	libusbg:io_start(op, path, attr, target)
+ *	libusbg:io_done(op, path, attr, ret, duration_ns)
+ *
+ * op is operation name as returned by usbg_stat_op_name(), path is full
+ * path of file, attr its last component and target is link target for
+ * symlink or NULL. ret is the backend result (negative errno value on
+ * failure). For example:
+ *
+ *	bpftrace -e 'usdt:/usr/lib/libusbg.so:libusbg:io_done
+ *		{ printf("%s %s %d\n", str(arg0), str(arg1), arg4); }'
+ *
+ * Probes and callback cost nothing but a branch while nobody listens.
+ */
+
+/**
+ * @addtogroup libusbg
+ * @{
+ */
+
+/**
+ * @typedef usbg_trace_phase
+ * @brief Moment at which event is reported
+ */
+typedef enum {
+	USBG_TRACE_BEGIN,	/**< Before operation */
+	USBG_TRACE_END,		/**< After operation */
+} usbg_trace_phase;
+
+/**
+ * @typedef usbg_trace_event
+ * @brief Single configfs operation
+ */
+typedef struct {
+	usbg_trace_phase phase;
+	usbg_stat_op op;	/**< One of configfs I/O operations */
+	const char *object;	/**< Directory, e.g. path of gadget */
+	const char *attr;	/**< Name of attribute or entry in object */
+	const char *target;	/**< Target of symlink, NULL otherwise */
+	int ret;		/**< Result (USBG_TRACE_END only) */
+	uint64_t duration_ns;	/**< Time taken (USBG_TRACE_END only) */
+} usbg_trace_event;
+
+/**
+ * @brief Callback receiving trace events
+ * @param ev Event, valid only during the call
+ * @param data Pointer given to usbg_set_trace_callback()
+ */
+typedef void (*usbg_trace_cb)(const usbg_trace_event *ev, void *data);
+
+/**
+ * @brief Set callback receiving trace events
+ * @details Callback is process wide. It should be set before the library
+ * is used by other threads and must not call the library itself.
+ * @param cb Callback or NULL to disable tracing
+ * @param data Passed to each call of cb
+ */
+extern void usbg_set_trace_callback(usbg_trace_cb cb, void *data);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBG_TRACE_H__ */
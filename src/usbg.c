@@ -27,72 +27,28 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <libconfig.h>
+#include <pthread.h>
+
+#include "usbg_internal.h"
 
 #define STRINGS_DIR "strings"
 #define CONFIGS_DIR "configs"
 #define FUNCTIONS_DIR "functions"
 
+/* Evaluate call modifying gadget g (if not NULL) and mark it as changed */
+#define USBG_CHANGE(g, call) \
+	({ \
+		int _ret = (call); \
+		if (g) \
+			usbg_gadget_changed(g); \
+		_ret; \
+	})
+
 /**
  * @file usbg.c
  * @todo Handle buffer overflows
  */
 
-struct usbg_state
-{
-	char *path;
-
-	TAILQ_HEAD(ghead, usbg_gadget) gadgets;
-	config_t *last_failed_import;
-};
-
-struct usbg_gadget
-{
-	char *name;
-	char *path;
-	char udc[USBG_MAX_STR_LENGTH];
-
-	TAILQ_ENTRY(usbg_gadget) gnode;
-	TAILQ_HEAD(chead, usbg_config) configs;
-	TAILQ_HEAD(fhead, usbg_function) functions;
-	usbg_state *parent;
-	config_t *last_failed_import;
-};
-
-struct usbg_config
-{
-	TAILQ_ENTRY(usbg_config) cnode;
-	TAILQ_HEAD(bhead, usbg_binding) bindings;
-	usbg_gadget *parent;
-
-	char *name;
-	char *path;
-	char *label;
-	int id;
-};
-
-struct usbg_function
-{
-	TAILQ_ENTRY(usbg_function) fnode;
-	usbg_gadget *parent;
-
-	char *name;
-	char *path;
-	char *instance;
-	/* Only for internal library usage */
-	char *label;
-	usbg_function_type type;
-};
-
-struct usbg_binding
-{
-	TAILQ_ENTRY(usbg_binding) bnode;
-	usbg_config *parent;
-	usbg_function *target;
-
-	char *name;
-	char *path;
-};
-
 /**
  * @var function_names
  * @brief Name strings for supported USB function types
@@ -109,20 +65,17 @@ const char *function_names[] =
 	"rndis",
 	"phonet",
 	"ffs",
+	"Loopback",
+	"SourceSink",
+	"mass_storage",
+	"uvc",
+	"uac2",
+	"uac1",
+	"hid",
+	"printer",
+	"midi",
 };
 
-#define ERROR(msg, ...) do {\
-                        fprintf(stderr, "%s()  "msg" \n", \
-                                __func__, ##__VA_ARGS__);\
-                        fflush(stderr);\
-                    } while (0)
-
-#define ERRORNO(msg, ...) do {\
-                        fprintf(stderr, "%s()  %s: "msg" \n", \
-                                __func__, strerror(errno), ##__VA_ARGS__);\
-                        fflush(stderr);\
-                    } while (0)
-
 /* Insert in string order */
 #define INSERT_TAILQ_STRING_ORDER(HeadPtr, HeadType, NameField, ToInsert, NodeField) \
 	do { \
@@ -137,11 +90,12 @@ const char *function_names[] =
 				if (strcmp((ToInsert)->NameField, _cur->NameField) > 0) \
 					continue; \
 				TAILQ_INSERT_BEFORE(_cur, (ToInsert), NodeField); \
+				break; \
 			} \
 		} \
 	} while (0)
 
-static int usbg_translate_error(int error)
+int usbg_translate_error(int error)
 {
 	int ret;
 
@@ -319,7 +273,7 @@ static int usbg_lookup_function_type(const char *name)
 
 const const char *usbg_get_function_type_str(usbg_function_type type)
 {
-	return type > 0 && type < sizeof(function_names)/sizeof(char *) ?
+	return type >= 0 && type < sizeof(function_names)/sizeof(char *) ?
 			function_names[type] : NULL;
 }
 
@@ -410,21 +364,17 @@ static int usbg_read_buf(const char *path, const char *name, const char *file,
 			 char *buf)
 {
 	char p[USBG_MAX_PATH_LENGTH];
-	FILE *fp;
 	int nmb;
 	int ret = USBG_SUCCESS;
 
 	nmb = snprintf(p, sizeof(p), "%s/%s/%s", path, name, file);
 	if (nmb < sizeof(p)) {
-		fp = fopen(p, "r");
-		if (fp) {
-			/* Successfully opened */
-			if (!fgets(buf, USBG_MAX_STR_LENGTH, fp)) {
-				ERROR("read error");
-				ret = USBG_ERROR_IO;
-			}
-
-			fclose(fp);
+		nmb = usbg_sys_read(p, buf, USBG_MAX_STR_LENGTH - 1);
+		if (nmb > 0) {
+			buf[nmb] = '\0';
+		} else if (nmb == 0) {
+			ERROR(NULL, "read error");
+			ret = USBG_ERROR_IO;
 		} else {
 			/* Set error correctly */
 			ret = usbg_translate_error(errno);
@@ -479,26 +429,14 @@ static int usbg_write_buf(const char *path, const char *name, const char *file,
 			  const char *buf)
 {
 	char p[USBG_MAX_PATH_LENGTH];
-	FILE *fp;
 	int nmb;
 	int ret = USBG_SUCCESS;
 
 	nmb = snprintf(p, sizeof(p), "%s/%s/%s", path, name, file);
 	if (nmb < sizeof(p)) {
-		fp = fopen(p, "w");
-		if (fp) {
-			fputs(buf, fp);
-			fflush(fp);
-
-			ret = ferror(fp);
-			if (ret)
-				ret = usbg_translate_error(errno);
-
-			fclose(fp);
-		} else {
-			/* Set error correctly */
+		nmb = usbg_sys_write(p, buf, strlen(buf));
+		if (nmb < 0)
 			ret = usbg_translate_error(errno);
-		}
 	} else {
 		ret = USBG_ERROR_PATH_TOO_LONG;
 	}
@@ -540,6 +478,7 @@ static inline void usbg_free_function(usbg_function *f)
 	free(f->path);
 	free(f->name);
 	free(f->label);
+	free(f->net_profile);
 	free(f);
 }
 
@@ -577,6 +516,7 @@ static void usbg_free_gadget(usbg_gadget *g)
 		TAILQ_REMOVE(&g->functions, f, fnode);
 		usbg_free_function(f);
 	}
+	pthread_rwlock_destroy(&g->lock);
 	free(g->path);
 	free(g->name);
 	free(g);
@@ -596,6 +536,9 @@ static void usbg_free_state(usbg_state *s)
 		free(s->last_failed_import);
 	}
 
+	usbg_snapshot_cleanup(s);
+	pthread_mutex_destroy(&s->snap_lock);
+	pthread_rwlock_destroy(&s->lock);
 	free(s->path);
 	free(s);
 }
@@ -613,8 +556,11 @@ static usbg_gadget *usbg_allocate_gadget(const char *path, const char *name,
 		g->name = strdup(name);
 		g->path = strdup(path);
 		g->parent = parent;
+		/* Fresh generation, so snapshots never mistake it for old one */
+		usbg_gadget_changed(g);
 
-		if (!(g->name) || !(g->path)) {
+		if (!(g->name) || !(g->path)
+		    || pthread_rwlock_init(&g->lock, NULL)) {
 			free(g->name);
 			free(g->path);
 			free(g);
@@ -673,6 +619,7 @@ static usbg_function *usbg_allocate_function(const char *path,
 		goto out;
 
 	f->label = NULL;
+	f->net_profile = NULL;
 	type_name = usbg_get_function_type_str(type);
 	if (!type_name) {
 		free(f);
@@ -732,7 +679,7 @@ static int ubsg_rm_file(const char *path, const char *name)
 
 	nmb = snprintf(buf, sizeof(buf), "%s/%s", path, name);
 	if (nmb < sizeof(buf)) {
-		nmb = unlink(buf);
+		nmb = usbg_sys_unlink(buf);
 		if (nmb != 0)
 			ret = usbg_translate_error(errno);
 	} else {
@@ -750,7 +697,7 @@ static int usbg_rm_dir(const char *path, const char *name)
 
 	nmb = snprintf(buf, sizeof(buf), "%s/%s", path, name);
 	if (nmb < sizeof(buf)) {
-		nmb = rmdir(buf);
+		nmb = usbg_sys_rmdir(buf);
 		if (nmb != 0)
 			ret = usbg_translate_error(errno);
 	} else {
@@ -766,7 +713,7 @@ static int usbg_rm_all_dirs(const char *path)
 	int n, i;
 	struct dirent **dent;
 
-	n = scandir(path, &dent, file_select, alphasort);
+	n = usbg_sys_scandir(path, &dent, file_select);
 	if (n >= 0) {
 		for (i = 0; i < n; ++i) {
 			if (ret == USBG_SUCCESS)
@@ -782,83 +729,18 @@ static int usbg_rm_all_dirs(const char *path)
 	return ret;
 }
 
-static int usbg_parse_function_net_attrs(usbg_function *f,
-		usbg_function_attrs *f_attrs)
-{
-	struct ether_addr *addr;
-	struct ether_addr addr_buf;
-	char str_addr[USBG_MAX_STR_LENGTH];
-	int ret;
-
-	ret = usbg_read_string(f->path, f->name, "dev_addr", str_addr);
-	if (ret != USBG_SUCCESS)
-		goto out;
-
-	addr = ether_aton_r(str_addr, &addr_buf);
-	if (addr) {
-		f_attrs->net.dev_addr = *addr;
-	} else {
-		ret = USBG_ERROR_IO;
-		goto out;
-	}
-
-	ret = usbg_read_string(f->path, f->name, "host_addr", str_addr);
-	if (ret != USBG_SUCCESS)
-		goto out;
-
-	addr = ether_aton_r(str_addr, &addr_buf);
-	if (addr) {
-		f_attrs->net.host_addr = *addr;
-	} else {
-		ret = USBG_ERROR_IO;
-		goto out;
-	}
-
-	ret = usbg_read_string(f->path, f->name, "ifname", f_attrs->net.ifname);
-	if (ret != USBG_SUCCESS)
-		goto out;
-
-	ret = usbg_read_dec(f->path, f->name, "qmult", &(f_attrs->net.qmult));
-
-out:
-	return ret;
-}
-
 static int usbg_parse_function_attrs(usbg_function *f,
 		usbg_function_attrs *f_attrs)
 {
-	int ret;
-
-	switch (f->type) {
-	case F_SERIAL:
-	case F_ACM:
-	case F_OBEX:
-		ret = usbg_read_dec(f->path, f->name, "port_num",
-				&(f_attrs->serial.port_num));
-		break;
-	case F_ECM:
-	case F_SUBSET:
-	case F_NCM:
-	case F_EEM:
-	case F_RNDIS:
-		ret = usbg_parse_function_net_attrs(f, f_attrs);
-		break;
-	case F_PHONET:
-		ret = usbg_read_string(f->path, f->name, "ifname",
-				f_attrs->phonet.ifname);
-		break;
-	case F_FFS:
+	/* dev_name of ffs is not present in configfs, it is instance name */
+	if (f->type == F_FFS) {
 		strncpy(f_attrs->ffs.dev_name, f->instance,
 			sizeof(f_attrs->ffs.dev_name) - 1);
 		f_attrs->ffs.dev_name[sizeof(f_attrs->ffs.dev_name) - 1] = '\0';
-		ret = 0;
-		break;
-	default:
-		ERROR("Unsupported function type\n");
-		ret = USBG_ERROR_NOT_SUPPORTED;
+		return USBG_SUCCESS;
 	}
 
-	return ret;
+	return usbg_read_function_attrs(f, f_attrs);
 }
 
 static int usbg_parse_functions(const char *path, usbg_gadget *g)
@@ -877,7 +759,7 @@ static int usbg_parse_functions(const char *path, usbg_gadget *g)
 		goto out;
 	}
 
-	n = scandir(fpath, &dent, file_select, alphasort);
+	n = usbg_sys_scandir(fpath, &dent, file_select);
 	if (n < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -926,7 +808,6 @@ static int usbg_parse_config_attrs(const char *path, const char *name,
 static int usbg_parse_config_strs(const char *path, const char *name,
 		int lang, usbg_config_strs *c_strs)
 {
-	DIR *dir;
 	int ret;
 	int nmb;
 	char spath[USBG_MAX_PATH_LENGTH];
@@ -935,9 +816,7 @@ static int usbg_parse_config_strs(const char *path, const char *name,
 			STRINGS_DIR, lang);
 	if (nmb < sizeof(spath)) {
 		/* Check if directory exist */
-		dir = opendir(spath);
-		if (dir) {
-			closedir(dir);
+		if (usbg_sys_check_dir(spath) == 0) {
 			ret = usbg_read_string(spath, "", "configuration",
 					c_strs->configuration);
 		} else {
@@ -950,6 +829,64 @@ static int usbg_parse_config_strs(const char *path, const char *name,
 	return ret;
 }
 
+static usbg_gadget *usbg_find_gadget(usbg_state *s, const char *name)
+{
+	usbg_gadget *g;
+
+	TAILQ_FOREACH(g, &s->gadgets, gnode)
+		if (!strcmp(g->name, name))
+			return g;
+
+	return NULL;
+}
+
+static usbg_function *usbg_find_function(usbg_gadget *g,
+		usbg_function_type type, const char *instance)
+{
+	usbg_function *f = NULL;
+
+	TAILQ_FOREACH(f, &g->functions, fnode)
+		if (f->type == type && (!strcmp(f->instance, instance)))
+			break;
+
+	return f;
+}
+
+static usbg_config *usbg_find_config(usbg_gadget *g, int id,
+				     const char *label)
+{
+	usbg_config *c = NULL;
+
+	TAILQ_FOREACH(c, &g->configs, cnode)
+		if (c->id == id && (!label || !strcmp(c->label, label)))
+			break;
+
+	return c;
+}
+
+static usbg_binding *usbg_find_binding(usbg_config *c, const char *name)
+{
+	usbg_binding *b;
+
+	TAILQ_FOREACH(b, &c->bindings, bnode)
+		if (!strcmp(b->name, name))
+			return b;
+
+	return NULL;
+}
+
+static usbg_binding *usbg_find_link_binding(usbg_config *c,
+					    usbg_function *f)
+{
+	usbg_binding *b;
+
+	TAILQ_FOREACH(b, &c->bindings, bnode)
+		if (b->target == f)
+			return b;
+
+	return NULL;
+}
+
 static int usbg_parse_config_binding(usbg_config *c, char *bpath, int path_size)
 {
 	int nmb;
@@ -961,7 +898,7 @@ static int usbg_parse_config_binding(usbg_config *c, char *bpath, int path_size)
 	usbg_function *f;
 	usbg_binding *b;
 
-	nmb = readlink(bpath, target, sizeof(target) - 1 );
+	nmb = usbg_sys_readlink(bpath, target, sizeof(target) - 1);
 	if (nmb < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -978,7 +915,7 @@ static int usbg_parse_config_binding(usbg_config *c, char *bpath, int path_size)
 	if (ret != USBG_SUCCESS)
 		goto out;
 
-	f = usbg_get_function(c->parent, type, instance);
+	f = usbg_find_function(c->parent, type, instance);
 	if (!f) {
 		ret = USBG_ERROR_OTHER_ERROR;
 		goto out;
@@ -1013,7 +950,7 @@ static int usbg_parse_config_bindings(usbg_config *c)
 		goto out;
 	}
 
-	n = scandir(bpath, &dent, bindings_select, alphasort);
+	n = usbg_sys_scandir(bpath, &dent, bindings_select);
 	if (n < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -1078,7 +1015,7 @@ static int usbg_parse_configs(const char *path, usbg_gadget *g)
 		goto out;
 	}
 
-	n = scandir(cpath, &dent, file_select, alphasort);
+	n = usbg_sys_scandir(cpath, &dent, file_select);
 	if (n < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -1160,7 +1097,6 @@ static int usbg_parse_gadget_strs(const char *path, const char *name, int lang,
 {
 	int ret;
 	int nmb;
-	DIR *dir;
 	char spath[USBG_MAX_PATH_LENGTH];
 
 	nmb = snprintf(spath, sizeof(spath), "%s/%s/%s/0x%x", path, name,
@@ -1171,9 +1107,7 @@ static int usbg_parse_gadget_strs(const char *path, const char *name, int lang,
 	}
 
 	/* Check if directory exist */
-	dir = opendir(spath);
-	if (dir) {
-		closedir(dir);
+	if (usbg_sys_check_dir(spath) == 0) {
 		ret = usbg_read_string(spath, "", "serialnumber", g_strs->str_ser);
 		if (ret != USBG_SUCCESS)
 			goto out;
@@ -1218,7 +1152,7 @@ static int usbg_parse_gadgets(const char *path, usbg_state *s)
 	int ret = USBG_SUCCESS;
 	struct dirent **dent;
 
-	n = scandir(path, &dent, file_select, alphasort);
+	n = usbg_sys_scandir(path, &dent, file_select);
 	if (n >= 0) {
 		for (i = 0; i < n; i++) {
 			/* Check if earlier gadgets
@@ -1253,11 +1187,12 @@ static int usbg_init_state(char *path, usbg_state *s)
 	/* State takes the ownership of path and should free it */
 	s->path = path;
 	s->last_failed_import = NULL;
+	memset(&s->log, 0, sizeof(s->log));
 	TAILQ_INIT(&s->gadgets);
 
 	ret = usbg_parse_gadgets(path, s);
 	if (ret != USBG_SUCCESS)
-		ERRORNO("unable to parse %s\n", path);
+		ERRORNO(&s->log, "unable to parse %s", path);
 
 	return ret;
 }
@@ -1266,10 +1201,9 @@ static int usbg_init_state(char *path, usbg_state *s)
  * User API
  */
 
-int usbg_init(const char *configfs_path, usbg_state **state)
+static int usbg_do_init(const char *configfs_path, usbg_state **state)
 {
 	int ret = USBG_SUCCESS;
-	DIR *dir;
 	char *path;
 	usbg_state *s;
 
@@ -1280,23 +1214,37 @@ int usbg_init(const char *configfs_path, usbg_state **state)
 		ret = USBG_SUCCESS;
 
 	/* Check if directory exist */
-	dir = opendir(path);
-	if (!dir) {
-		ERRORNO("couldn't init gadget state\n");
+	if (usbg_sys_check_dir(path) != 0) {
+		ERRORNO(NULL, "couldn't init gadget state");
 		ret = usbg_translate_error(errno);
 		goto err;
 	}
 
-	closedir(dir);
 	s = malloc(sizeof(usbg_state));
 	if (!s) {
 		ret = USBG_ERROR_NO_MEM;
 		goto err;
 	}
 
+	if (pthread_rwlock_init(&s->lock, NULL)) {
+		free(s);
+		ret = USBG_ERROR_NO_MEM;
+		goto err;
+	}
+
+	if (pthread_mutex_init(&s->snap_lock, NULL)) {
+		pthread_rwlock_destroy(&s->lock);
+		free(s);
+		ret = USBG_ERROR_NO_MEM;
+		goto err;
+	}
+
+	s->snap = NULL;
+	s->gen = 0;
+
 	ret = usbg_init_state(path, s);
 	if (ret != USBG_SUCCESS) {
-		ERRORNO("couldn't init gadget state\n");
+		ERRORNO(&s->log, "couldn't init gadget state");
 		usbg_free_state(s);
 		goto out;
 	}
@@ -1311,11 +1259,30 @@ out:
 	return ret;
 }
 
+int usbg_init(const char *configfs_path, usbg_state **state)
+{
+	return USBG_STATS_CALL(USBG_STAT_INIT,
+			usbg_do_init(configfs_path, state));
+}
+
 void usbg_cleanup(usbg_state *s)
 {
 	usbg_free_state(s);
 }
 
+int usbg_set_state_log_callback(usbg_state *s, usbg_log_cb cb, void *data,
+				usbg_log_level level)
+{
+	if (!s)
+		return USBG_ERROR_INVALID_PARAM;
+
+	s->log.data = data;
+	s->log.level = level;
+	s->log.cb = cb;
+
+	return USBG_SUCCESS;
+}
+
 size_t usbg_get_configfs_path_len(usbg_state *s)
 {
 	return s ? strlen(s->path) : USBG_ERROR_INVALID_PARAM;
@@ -1332,36 +1299,41 @@ int usbg_get_configfs_path(usbg_state *s, char *buf, size_t len)
 	return ret;
 }
 
+const char *usbg_get_configfs_path_str(usbg_state *s)
+{
+	return s ? s->path : NULL;
+}
+
 usbg_gadget *usbg_get_gadget(usbg_state *s, const char *name)
 {
 	usbg_gadget *g;
 
-	TAILQ_FOREACH(g, &s->gadgets, gnode)
-		if (!strcmp(g->name, name))
-			return g;
+	usbg_rdlock(s);
+	g = usbg_find_gadget(s, name);
+	usbg_unlock(s);
 
-	return NULL;
+	return g;
 }
 
 usbg_function *usbg_get_function(usbg_gadget *g,
 		usbg_function_type type, const char *instance)
 {
-	usbg_function *f = NULL;
+	usbg_function *f;
 
-	TAILQ_FOREACH(f, &g->functions, fnode)
-		if (f->type == type && (!strcmp(f->instance, instance)))
-			break;
+	usbg_rdlock(g);
+	f = usbg_find_function(g, type, instance);
+	usbg_unlock(g);
 
 	return f;
 }
 
 usbg_config *usbg_get_config(usbg_gadget *g, int id, const char *label)
 {
-	usbg_config *c = NULL;
+	usbg_config *c;
 
-	TAILQ_FOREACH(c, &g->configs, cnode)
-		if (c->id == id && (!label || !strcmp(c->label, label)))
-			break;
+	usbg_rdlock(g);
+	c = usbg_find_config(g, id, label);
+	usbg_unlock(g);
 
 	return c;
 }
@@ -1370,32 +1342,29 @@ usbg_binding *usbg_get_binding(usbg_config *c, const char *name)
 {
 	usbg_binding *b;
 
-	TAILQ_FOREACH(b, &c->bindings, bnode)
-		if (!strcmp(b->name, name))
-			return b;
+	usbg_rdlock(c->parent);
+	b = usbg_find_binding(c, name);
+	usbg_unlock(c->parent);
 
-	return NULL;
+	return b;
 }
 
 usbg_binding *usbg_get_link_binding(usbg_config *c, usbg_function *f)
 {
 	usbg_binding *b;
 
-	TAILQ_FOREACH(b, &c->bindings, bnode)
-		if (b->target == f)
-			return b;
+	usbg_rdlock(c->parent);
+	b = usbg_find_link_binding(c, f);
+	usbg_unlock(c->parent);
 
-	return NULL;
+	return b;
 }
 
-int usbg_rm_binding(usbg_binding *b)
+static int usbg_do_rm_binding(usbg_binding *b)
 {
 	int ret = USBG_SUCCESS;
 	usbg_config *c;
 
-	if (!b)
-		return USBG_ERROR_INVALID_PARAM;
-
 	c = b->parent;
 
 	ret = ubsg_rm_file(b->path, b->name);
@@ -1407,7 +1376,24 @@ int usbg_rm_binding(usbg_binding *b)
 	return ret;
 }
 
-int usbg_rm_config(usbg_config *c, int opts)
+int usbg_rm_binding(usbg_binding *b)
+{
+	usbg_gadget *g;
+	int ret;
+
+	if (!b)
+		return USBG_ERROR_INVALID_PARAM;
+
+	g = b->parent->parent;
+	usbg_wrlock(g);
+	ret = usbg_do_rm_binding(b);
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_rm_config(usbg_config *c, int opts)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
 	usbg_gadget *g;
@@ -1426,7 +1412,7 @@ int usbg_rm_config(usbg_config *c, int opts)
 
 		while (!TAILQ_EMPTY(&c->bindings)) {
 			b = TAILQ_FIRST(&c->bindings);
-			ret = usbg_rm_binding(b);
+			ret = usbg_do_rm_binding(b);
 			if (ret != USBG_SUCCESS)
 				goto out;
 		}
@@ -1441,6 +1427,11 @@ int usbg_rm_config(usbg_config *c, int opts)
 		ret = usbg_rm_all_dirs(spath);
 		if (ret != USBG_SUCCESS)
 			goto out;
+
+		/* Link in os_desc of gadget would keep it busy */
+		ret = usbg_unlink_os_desc_config(c);
+		if (ret != USBG_SUCCESS)
+			goto out;
 	}
 
 	ret = usbg_rm_dir(c->path, c->name);
@@ -1453,7 +1444,24 @@ out:
 	return ret;
 }
 
-int usbg_rm_function(usbg_function *f, int opts)
+int usbg_rm_config(usbg_config *c, int opts)
+{
+	usbg_gadget *g;
+	int ret;
+
+	if (!c)
+		return USBG_ERROR_INVALID_PARAM;
+
+	g = c->parent;
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_RM_CONFIG, usbg_do_rm_config(c, opts));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_rm_function(usbg_function *f, int opts)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
 	usbg_gadget *g;
@@ -1474,7 +1482,7 @@ int usbg_rm_function(usbg_function *f, int opts)
 			while (b != NULL) {
 				if (b->target == f) {
 					usbg_binding *b_next = TAILQ_NEXT(b, bnode);
-					ret = usbg_rm_binding(b);
+					ret = usbg_do_rm_binding(b);
 					if (ret != USBG_SUCCESS)
 						return ret;
 
@@ -1486,6 +1494,25 @@ int usbg_rm_function(usbg_function *f, int opts)
 		} /* TAILQ_FOREACH */
 	}
 
+	/* Additional units have to be removed before function itself */
+	if (f->type == F_MASS_STORAGE) {
+		ret = usbg_rm_ms_luns(f);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	/* Same for formats, frames and headers of video function */
+	if (f->type == F_UVC) {
+		ret = usbg_rm_uvc_tree(f);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	/* And for extended properties of OS descriptors */
+	ret = usbg_rm_os_desc_props(f);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
 	ret = usbg_rm_dir(f->path, f->name);
 	if (ret == USBG_SUCCESS) {
 		TAILQ_REMOVE(&(g->functions), f, fnode);
@@ -1495,14 +1522,28 @@ int usbg_rm_function(usbg_function *f, int opts)
 	return ret;
 }
 
-int usbg_rm_gadget(usbg_gadget *g, int opts)
+int usbg_rm_function(usbg_function *f, int opts)
 {
-	int ret = USBG_ERROR_INVALID_PARAM;
-	usbg_state *s;
-	if (!g)
-		goto out;
+	usbg_gadget *g;
+	int ret;
 
-	s = g->parent;
+	if (!f)
+		return USBG_ERROR_INVALID_PARAM;
+
+	g = f->parent;
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_RM_FUNCTION,
+			      usbg_do_rm_function(f, opts));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+/* Removes gadget from configfs only, caller unlinks it from state */
+static int usbg_do_rm_gadget(usbg_gadget *g, int opts)
+{
+	int ret = USBG_ERROR_INVALID_PARAM;
 
 	if (opts & USBG_RM_RECURSE) {
 		/* Recursive flag was given
@@ -1515,14 +1556,16 @@ int usbg_rm_gadget(usbg_gadget *g, int opts)
 
 		while (!TAILQ_EMPTY(&g->configs)) {
 			c = TAILQ_FIRST(&g->configs);
-			ret = usbg_rm_config(c, opts);
+			ret = USBG_STATS_CALL(USBG_STAT_RM_CONFIG,
+					      usbg_do_rm_config(c, opts));
 			if (ret != USBG_SUCCESS)
 				goto out;
 		}
 
 		while (!TAILQ_EMPTY(&g->functions)) {
 			f = TAILQ_FIRST(&g->functions);
-			ret = usbg_rm_function(f, opts);
+			ret = USBG_STATS_CALL(USBG_STAT_RM_FUNCTION,
+					      usbg_do_rm_function(f, opts));
 			if (ret != USBG_SUCCESS)
 				goto out;
 		}
@@ -1540,28 +1583,51 @@ int usbg_rm_gadget(usbg_gadget *g, int opts)
 	}
 
 	ret = usbg_rm_dir(g->path, g->name);
-	if (ret == USBG_SUCCESS) {
-		TAILQ_REMOVE(&(s->gadgets), g, gnode);
-		usbg_free_gadget(g);
-	}
 
 out:
 	return ret;
 }
 
-int usbg_rm_config_strs(usbg_config *c, int lang)
+int usbg_rm_gadget(usbg_gadget *g, int opts)
 {
-	int ret = USBG_SUCCESS;
-	int nmb;
-	char path[USBG_MAX_PATH_LENGTH];
+	usbg_state *s;
+	int ret;
 
-	if (!c)
+	if (!g)
 		return USBG_ERROR_INVALID_PARAM;
 
-	nmb = snprintf(path, sizeof(path), "%s/%s/%s/0x%x", c->path, c->name,
-			STRINGS_DIR, lang);
+	s = g->parent;
+
+	/* Other gadgets may be queried while this one is being removed */
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_RM_GADGET, usbg_do_rm_gadget(g, opts));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	if (ret == USBG_SUCCESS) {
+		usbg_wrlock(s);
+		TAILQ_REMOVE(&(s->gadgets), g, gnode);
+		usbg_state_changed(s);
+		usbg_unlock(s);
+		usbg_free_gadget(g);
+	}
+
+	return ret;
+}
+
+int usbg_rm_config_strs(usbg_config *c, int lang)
+{
+	int ret = USBG_SUCCESS;
+	int nmb;
+	char path[USBG_MAX_PATH_LENGTH];
+
+	if (!c)
+		return USBG_ERROR_INVALID_PARAM;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s/%s/0x%x", c->path, c->name,
+			STRINGS_DIR, lang);
 	if (nmb < sizeof(path))
-		ret = usbg_rm_dir(path, "");
+		ret = USBG_CHANGE(c->parent, usbg_rm_dir(path, ""));
 	else
 		ret = USBG_ERROR_PATH_TOO_LONG;
 
@@ -1580,7 +1646,7 @@ int usbg_rm_gadget_strs(usbg_gadget *g, int lang)
 	nmb = snprintf(path, sizeof(path), "%s/%s/%s/0x%x", g->path, g->name,
 			STRINGS_DIR, lang);
 	if (nmb < sizeof(path))
-		ret = usbg_rm_dir(path, "");
+		ret = USBG_CHANGE(g, usbg_rm_dir(path, ""));
 	else
 		ret = USBG_ERROR_PATH_TOO_LONG;
 
@@ -1605,13 +1671,13 @@ static int usbg_create_empty_gadget(usbg_state *s, const char *name,
 	if (*g) {
 		usbg_gadget *gad = *g; /* alias only */
 
-		ret = mkdir(gpath, S_IRWXU|S_IRWXG|S_IRWXO);
+		ret = usbg_sys_mkdir(gpath);
 		if (ret == 0) {
 			/* Should be empty but read the default */
 			ret = usbg_read_string(gad->path, gad->name, "UDC",
 				 gad->udc);
 			if (ret != USBG_SUCCESS)
-				rmdir(gpath);
+				usbg_sys_rmdir(gpath);
 		} else {
 			ret = usbg_translate_error(errno);
 		}
@@ -1639,7 +1705,7 @@ int usbg_create_gadget_vid_pid(usbg_state *s, const char *name,
 
 	gad = usbg_get_gadget(s, name);
 	if (gad) {
-		ERROR("duplicate gadget name\n");
+		DEBUG(&s->log, "duplicate gadget name %s", name);
 		return USBG_ERROR_EXIST;
 	}
 
@@ -1651,20 +1717,24 @@ int usbg_create_gadget_vid_pid(usbg_state *s, const char *name,
 		ret = usbg_write_hex16(s->path, name, "idVendor", idVendor);
 		if (ret == USBG_SUCCESS) {
 			ret = usbg_write_hex16(s->path, name, "idProduct", idProduct);
-			if (ret == USBG_SUCCESS)
+			if (ret == USBG_SUCCESS) {
+				usbg_wrlock(s);
 				INSERT_TAILQ_STRING_ORDER(&s->gadgets, ghead, name,
 						gad, gnode);
-			else
+				usbg_state_changed(s);
+				usbg_unlock(s);
+			} else {
 				usbg_free_gadget(gad);
+			}
 		}
 	}
 
 	return ret;
 }
 
-int usbg_create_gadget(usbg_state *s, const char *name,
-		       usbg_gadget_attrs *g_attrs, usbg_gadget_strs *g_strs,
-		       usbg_gadget **g)
+static int usbg_do_create_gadget(usbg_state *s, const char *name,
+				 usbg_gadget_attrs *g_attrs,
+				 usbg_gadget_strs *g_strs, usbg_gadget **g)
 {
 	usbg_gadget *gad;
 	int ret;
@@ -1674,7 +1744,7 @@ int usbg_create_gadget(usbg_state *s, const char *name,
 
 	gad = usbg_get_gadget(s, name);
 	if (gad) {
-		ERROR("duplicate gadget name\n");
+		DEBUG(&s->log, "duplicate gadget name %s", name);
 		return USBG_ERROR_EXIST;
 	}
 
@@ -1689,15 +1759,31 @@ int usbg_create_gadget(usbg_state *s, const char *name,
 		if (g_strs)
 			ret = usbg_set_gadget_strs(gad, LANG_US_ENG, g_strs);
 
-		if (ret == USBG_SUCCESS)
+		/*
+		 * State is locked only for insertion, configfs doesn't allow
+		 * to create gadget with the same name twice anyway
+		 */
+		if (ret == USBG_SUCCESS) {
+			usbg_wrlock(s);
 			INSERT_TAILQ_STRING_ORDER(&s->gadgets, ghead, name,
 				gad, gnode);
-		else
+			usbg_state_changed(s);
+			usbg_unlock(s);
+		} else {
 			usbg_free_gadget(gad);
+		}
 	}
 	return ret;
 }
 
+int usbg_create_gadget(usbg_state *s, const char *name,
+		       usbg_gadget_attrs *g_attrs, usbg_gadget_strs *g_strs,
+		       usbg_gadget **g)
+{
+	return USBG_STATS_CALL(USBG_STAT_CREATE_GADGET,
+			usbg_do_create_gadget(s, name, g_attrs, g_strs, g));
+}
+
 int usbg_get_gadget_attrs(usbg_gadget *g, usbg_gadget_attrs *g_attrs)
 {
 	return g && g_attrs ? usbg_parse_gadget_attrs(g->path, g->name, g_attrs)
@@ -1720,23 +1806,62 @@ int usbg_get_gadget_name(usbg_gadget *g, char *buf, size_t len)
 	return ret;
 }
 
+const char *usbg_get_gadget_name_str(usbg_gadget *g)
+{
+	return g ? g->name : NULL;
+}
+
 size_t usbg_get_gadget_udc_len(usbg_gadget *g)
 {
-	return g ? strlen(g->udc) : USBG_ERROR_INVALID_PARAM;
+	size_t len;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_rdlock(g);
+	len = strlen(g->udc);
+	usbg_unlock(g);
+
+	return len;
 }
 
 int usbg_get_gadget_udc(usbg_gadget *g, char *buf, size_t len)
 {
 	int ret = USBG_SUCCESS;
-	if (g && buf)
+	if (g && buf) {
+		usbg_rdlock(g);
 		strncpy(buf, g->udc, len);
-	else
+		usbg_unlock(g);
+	} else {
 		ret = USBG_ERROR_INVALID_PARAM;
+	}
 
 	return ret;
 }
 
-int usbg_set_gadget_attrs(usbg_gadget *g, usbg_gadget_attrs *g_attrs)
+int usbg_get_gadget_udc_state(usbg_gadget *g, char *buf, size_t len)
+{
+	char udc[USBG_MAX_STR_LENGTH];
+	char state[USBG_MAX_STR_LENGTH];
+	int ret;
+
+	if (!g || !buf || !len)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_get_gadget_udc(g, udc, sizeof(udc));
+	if (!udc[0])
+		return USBG_ERROR_NOT_FOUND;
+
+	/* Not cached, it changes as host enumerates device */
+	ret = usbg_read_string("/sys/class/udc", udc, "state", state);
+	if (ret == USBG_SUCCESS)
+		snprintf(buf, len, "%s", state);
+
+	return ret;
+}
+
+static int usbg_do_set_gadget_attrs(usbg_gadget *g,
+				    usbg_gadget_attrs *g_attrs)
 {
 	int ret;
 	if (!g || !g_attrs)
@@ -1783,51 +1908,65 @@ out:
 	return ret;
 }
 
+int usbg_set_gadget_attrs(usbg_gadget *g, usbg_gadget_attrs *g_attrs)
+{
+	return USBG_STATS_CALL(USBG_STAT_SET_GADGET_ATTRS,
+			USBG_CHANGE(g, usbg_do_set_gadget_attrs(g, g_attrs)));
+}
+
 int usbg_set_gadget_vendor_id(usbg_gadget *g, uint16_t idVendor)
 {
-	return g ? usbg_write_hex16(g->path, g->name, "idVendor", idVendor)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex16(g->path, g->name, "idVendor", idVendor))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_product_id(usbg_gadget *g, uint16_t idProduct)
 {
-	return g ? usbg_write_hex16(g->path, g->name, "idProduct", idProduct)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex16(g->path, g->name, "idProduct", idProduct))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_class(usbg_gadget *g, uint8_t bDeviceClass)
 {
-	return g ? usbg_write_hex8(g->path, g->name, "bDeviceClass", bDeviceClass)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex8(g->path, g->name, "bDeviceClass", bDeviceClass))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_protocol(usbg_gadget *g, uint8_t bDeviceProtocol)
 {
-	return g ? usbg_write_hex8(g->path, g->name, "bDeviceProtocol", bDeviceProtocol)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex8(g->path, g->name, "bDeviceProtocol", bDeviceProtocol))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_subclass(usbg_gadget *g, uint8_t bDeviceSubClass)
 {
-	return g ? usbg_write_hex8(g->path, g->name, "bDeviceSubClass", bDeviceSubClass)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex8(g->path, g->name, "bDeviceSubClass", bDeviceSubClass))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_max_packet(usbg_gadget *g, uint8_t bMaxPacketSize0)
 {
-	return g ? usbg_write_hex8(g->path, g->name, "bMaxPacketSize0", bMaxPacketSize0)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex8(g->path, g->name, "bMaxPacketSize0", bMaxPacketSize0))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_bcd_device(usbg_gadget *g, uint16_t bcdDevice)
 {
-	return g ? usbg_write_hex16(g->path, g->name, "bcdDevice", bcdDevice)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex16(g->path, g->name, "bcdDevice", bcdDevice))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_gadget_device_bcd_usb(usbg_gadget *g, uint16_t bcdUSB)
 {
-	return g ? usbg_write_hex16(g->path, g->name, "bcdUSB", bcdUSB)
+	return g ? USBG_CHANGE(g,
+			usbg_write_hex16(g->path, g->name, "bcdUSB", bcdUSB))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
@@ -1841,19 +1980,16 @@ int usbg_get_gadget_strs(usbg_gadget *g, int lang,
 static int usbg_check_dir(const char *path)
 {
 	int ret = USBG_SUCCESS;
-	DIR *dir;
 
 	/* Assume that user will always have read access to this directory */
-	dir = opendir(path);
-	if (dir)
-		closedir(dir);
-	else if (errno != ENOENT || mkdir(path, S_IRWXU|S_IRWXG|S_IRWXO) != 0)
+	if (usbg_sys_check_dir(path) != 0
+	    && (errno != ENOENT || usbg_sys_mkdir(path) != 0))
 		ret = usbg_translate_error(errno);
 
 	return ret;
 }
 
-int usbg_set_gadget_strs(usbg_gadget *g, int lang,
+static int usbg_do_set_gadget_strs(usbg_gadget *g, int lang,
 		usbg_gadget_strs *g_strs)
 {
 	char path[USBG_MAX_PATH_LENGTH];
@@ -1887,6 +2023,13 @@ out:
 	return ret;
 }
 
+int usbg_set_gadget_strs(usbg_gadget *g, int lang,
+		usbg_gadget_strs *g_strs)
+{
+	return USBG_STATS_CALL(USBG_STAT_SET_GADGET_STRS,
+			USBG_CHANGE(g, usbg_do_set_gadget_strs(g, lang, g_strs)));
+}
+
 int usbg_set_gadget_serial_number(usbg_gadget *g, int lang, const char *serno)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
@@ -1899,7 +2042,8 @@ int usbg_set_gadget_serial_number(usbg_gadget *g, int lang, const char *serno)
 		if (nmb < sizeof(path)) {
 			ret = usbg_check_dir(path);
 			if (ret == USBG_SUCCESS)
-				ret = usbg_write_string(path, "", "serialnumber", serno);
+				ret = USBG_CHANGE(g, usbg_write_string(path, "",
+						"serialnumber", serno));
 		} else {
 			ret = USBG_ERROR_PATH_TOO_LONG;
 		}
@@ -1920,7 +2064,8 @@ int usbg_set_gadget_manufacturer(usbg_gadget *g, int lang, const char *mnf)
 		if (nmb < sizeof(path)) {
 			ret = usbg_check_dir(path);
 			if (ret == USBG_SUCCESS)
-				ret = usbg_write_string(path, "", "manufacturer", mnf);
+				ret = USBG_CHANGE(g, usbg_write_string(path, "",
+						"manufacturer", mnf));
 		} else {
 			ret = USBG_ERROR_PATH_TOO_LONG;
 		}
@@ -1941,7 +2086,8 @@ int usbg_set_gadget_product(usbg_gadget *g, int lang, const char *prd)
 		if (nmb < sizeof(path)) {
 			ret = usbg_check_dir(path);
 			if (ret == USBG_SUCCESS)
-				ret = usbg_write_string(path, "", "product", prd);
+				ret = USBG_CHANGE(g, usbg_write_string(path, "",
+						"product", prd));
 		} else {
 			ret = USBG_ERROR_PATH_TOO_LONG;
 		}
@@ -1950,9 +2096,10 @@ int usbg_set_gadget_product(usbg_gadget *g, int lang, const char *prd)
 	return ret;
 }
 
-int usbg_create_function(usbg_gadget *g, usbg_function_type type,
-			 const char *instance, usbg_function_attrs *f_attrs,
-			 usbg_function **f)
+static int usbg_do_create_function(usbg_gadget *g, usbg_function_type type,
+				   const char *instance,
+				   usbg_function_attrs *f_attrs,
+				   usbg_function **f)
 {
 	char fpath[USBG_MAX_PATH_LENGTH];
 	usbg_function *func;
@@ -1973,9 +2120,9 @@ int usbg_create_function(usbg_gadget *g, usbg_function_type type,
 		}
 	}
 
-	func = usbg_get_function(g, type, instance);
+	func = usbg_find_function(g, type, instance);
 	if (func) {
-		ERROR("duplicate function name\n");
+		DEBUG(&g->parent->log, "duplicate function name %s", instance);
 		ret = USBG_ERROR_EXIST;
 		goto out;
 	}
@@ -1990,7 +2137,7 @@ int usbg_create_function(usbg_gadget *g, usbg_function_type type,
 	*f = usbg_allocate_function(fpath, type, instance, g);
 	func = *f;
 	if (!func) {
-		ERRORNO("allocating function\n");
+		ERRORNO(&g->parent->log, "allocating function");
 		ret = USBG_ERROR_NO_MEM;
 		goto out;
 	}
@@ -1998,7 +2145,7 @@ int usbg_create_function(usbg_gadget *g, usbg_function_type type,
 	free_space = sizeof(fpath) - n;
 	n = snprintf(&(fpath[n]), free_space, "/%s", func->name);
 	if (n < free_space) {
-		ret = mkdir(fpath, S_IRWXU | S_IRWXG | S_IRWXO);
+		ret = usbg_sys_mkdir(fpath);
 		if (!ret) {
 			/* Success */
 			ret = USBG_SUCCESS;
@@ -2019,7 +2166,25 @@ out:
 	return ret;
 }
 
-int usbg_create_config(usbg_gadget *g, int id, const char *label,
+int usbg_create_function(usbg_gadget *g, usbg_function_type type,
+			 const char *instance, usbg_function_attrs *f_attrs,
+			 usbg_function **f)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_CREATE_FUNCTION,
+			usbg_do_create_function(g, type, instance, f_attrs, f));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_create_config(usbg_gadget *g, int id, const char *label,
 		usbg_config_attrs *c_attrs, usbg_config_strs *c_strs, usbg_config **c)
 {
 	char cpath[USBG_MAX_PATH_LENGTH];
@@ -2033,9 +2198,9 @@ int usbg_create_config(usbg_gadget *g, int id, const char *label,
 	if (!label)
 		label = DEFAULT_CONFIG_LABEL;
 
-	conf = usbg_get_config(g, id, NULL);
+	conf = usbg_find_config(g, id, NULL);
 	if (conf) {
-		ERROR("duplicate configuration id\n");
+		DEBUG(&g->parent->log, "duplicate configuration id %d", id);
 		ret = USBG_ERROR_EXIST;
 		goto out;
 	}
@@ -2050,7 +2215,7 @@ int usbg_create_config(usbg_gadget *g, int id, const char *label,
 	*c = usbg_allocate_config(cpath, label, id, g);
 	conf = *c;
 	if (!conf) {
-		ERRORNO("allocating configuration\n");
+		ERRORNO(&g->parent->log, "allocating configuration");
 		ret = USBG_ERROR_NO_MEM;
 		goto out;
 	}
@@ -2062,7 +2227,7 @@ int usbg_create_config(usbg_gadget *g, int id, const char *label,
 		ret = USBG_ERROR_PATH_TOO_LONG;
 	}
 
-	ret = mkdir(cpath, S_IRWXU | S_IRWXG | S_IRWXO);
+	ret = usbg_sys_mkdir(cpath);
 	if (!ret) {
 		ret = USBG_SUCCESS;
 		if (c_attrs)
@@ -2085,6 +2250,23 @@ out:
 	return ret;
 }
 
+int usbg_create_config(usbg_gadget *g, int id, const char *label,
+		usbg_config_attrs *c_attrs, usbg_config_strs *c_strs, usbg_config **c)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_CREATE_CONFIG,
+			usbg_do_create_config(g, id, label, c_attrs, c_strs, c));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
 size_t usbg_get_config_label_len(usbg_config *c)
 {
 	return c ? strlen(c->label) : USBG_ERROR_INVALID_PARAM;
@@ -2101,6 +2283,11 @@ int usbg_get_config_label(usbg_config *c, char *buf, size_t len)
 	return ret;
 }
 
+const char *usbg_get_config_label_str(usbg_config *c)
+{
+	return c ? c->label : NULL;
+}
+
 int usbg_get_config_id(usbg_config *c)
 {
 	return c ? c->id : USBG_ERROR_INVALID_PARAM;
@@ -2122,6 +2309,11 @@ int usbg_get_function_instance(usbg_function *f, char *buf, size_t len)
 	return ret;
 }
 
+const char *usbg_get_function_instance_str(usbg_function *f)
+{
+	return f ? f->instance : NULL;
+}
+
 int usbg_set_config_attrs(usbg_config *c, usbg_config_attrs *c_attrs)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
@@ -2131,6 +2323,7 @@ int usbg_set_config_attrs(usbg_config *c, usbg_config_attrs *c_attrs)
 		if (ret == USBG_SUCCESS)
 			ret = usbg_write_hex8(c->path, c->name, "bmAttributes",
 					c_attrs->bmAttributes);
+		usbg_gadget_changed(c->parent);
 	}
 
 	return ret;
@@ -2145,13 +2338,15 @@ int usbg_get_config_attrs(usbg_config *c,
 
 int usbg_set_config_max_power(usbg_config *c, int bMaxPower)
 {
-	return c ? usbg_write_dec(c->path, c->name, "MaxPower", bMaxPower)
+	return c ? USBG_CHANGE(c->parent,
+			usbg_write_dec(c->path, c->name, "MaxPower", bMaxPower))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
 int usbg_set_config_bm_attrs(usbg_config *c, int bmAttributes)
 {
-	return c ? usbg_write_hex8(c->path, c->name, "bmAttributes", bmAttributes)
+	return c ? USBG_CHANGE(c->parent,
+			usbg_write_hex8(c->path, c->name, "bmAttributes", bmAttributes))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
@@ -2179,7 +2374,8 @@ int usbg_set_config_string(usbg_config *c, int lang, const char *str)
 		if (nmb < sizeof(path)) {
 			ret = usbg_check_dir(path);
 			if (ret == USBG_SUCCESS)
-				ret = usbg_write_string(path, "", "configuration", str);
+				ret = USBG_CHANGE(c->parent, usbg_write_string(path,
+						"", "configuration", str));
 		} else {
 			ret = USBG_ERROR_PATH_TOO_LONG;
 		}
@@ -2188,7 +2384,8 @@ int usbg_set_config_string(usbg_config *c, int lang, const char *str)
 	return ret;
 }
 
-int usbg_add_config_function(usbg_config *c, const char *name, usbg_function *f)
+static int usbg_do_add_config_function(usbg_config *c, const char *name,
+				       usbg_function *f)
 {
 	char bpath[USBG_MAX_PATH_LENGTH];
 	char fpath[USBG_MAX_PATH_LENGTH];
@@ -2201,16 +2398,17 @@ int usbg_add_config_function(usbg_config *c, const char *name, usbg_function *f)
 		goto out;
 	}
 
-	b = usbg_get_binding(c, name);
+	b = usbg_find_binding(c, name);
 	if (b) {
-		ERROR("duplicate binding name\n");
+		DEBUG(&c->parent->parent->log, "duplicate binding name %s",
+		      name);
 		ret = USBG_ERROR_EXIST;
 		goto out;
 	}
 
-	b = usbg_get_link_binding(c, f);
+	b = usbg_find_link_binding(c, f);
 	if (b) {
-		ERROR("duplicate binding link\n");
+		DEBUG(&c->parent->parent->log, "duplicate binding link");
 		ret = USBG_ERROR_EXIST;
 		goto out;
 	}
@@ -2235,13 +2433,14 @@ int usbg_add_config_function(usbg_config *c, const char *name, usbg_function *f)
 		nmb = snprintf(&(bpath[nmb]), free_space, "/%s", name);
 		if (nmb < free_space) {
 
-			ret = symlink(fpath, bpath);
+			ret = usbg_sys_symlink(fpath, bpath);
 			if (ret == 0) {
 				b->target = f;
 				INSERT_TAILQ_STRING_ORDER(&c->bindings, bhead,
 						name, b, bnode);
 			} else {
-				ERRORNO("%s -> %s\n", bpath, fpath);
+				ERRORNO(&c->parent->parent->log, "%s -> %s",
+					bpath, fpath);
 				ret = usbg_translate_error(errno);
 			}
 		} else {
@@ -2260,9 +2459,36 @@ out:
 	return ret;
 }
 
+int usbg_add_config_function(usbg_config *c, const char *name, usbg_function *f)
+{
+	usbg_gadget *g;
+	int ret;
+
+	if (!c)
+		return USBG_ERROR_INVALID_PARAM;
+
+	g = c->parent;
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_ADD_CONFIG_FUNCTION,
+			usbg_do_add_config_function(c, name, f));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
 usbg_function *usbg_get_binding_target(usbg_binding *b)
 {
-	return b ? b->target : NULL;
+	usbg_function *f;
+
+	if (!b)
+		return NULL;
+
+	usbg_rdlock(b->parent->parent);
+	f = b->target;
+	usbg_unlock(b->parent->parent);
+
+	return f;
 }
 
 size_t usbg_get_binding_name_len(usbg_binding *b)
@@ -2281,12 +2507,17 @@ int usbg_get_binding_name(usbg_binding *b, char *buf, size_t len)
 	return ret;
 }
 
-int usbg_get_udcs(struct dirent ***udc_list)
+const char *usbg_get_binding_name_str(usbg_binding *b)
+{
+	return b ? b->name : NULL;
+}
+
+static int usbg_do_get_udcs(struct dirent ***udc_list)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
 
 	if (udc_list) {
-		ret = scandir("/sys/class/udc", udc_list, file_select, alphasort);
+		ret = usbg_sys_scandir("/sys/class/udc", udc_list, file_select);
 		if (ret < 0)
 			ret = usbg_translate_error(errno);
 	}
@@ -2294,7 +2525,13 @@ int usbg_get_udcs(struct dirent ***udc_list)
 	return ret;
 }
 
-int usbg_enable_gadget(usbg_gadget *g, const char *udc)
+int usbg_get_udcs(struct dirent ***udc_list)
+{
+	return USBG_STATS_CALL(USBG_STAT_GET_UDCS,
+			usbg_do_get_udcs(udc_list));
+}
+
+static int usbg_do_enable_gadget(usbg_gadget *g, const char *udc)
 {
 	char gudc[USBG_MAX_STR_LENGTH];
 	struct dirent **udc_list;
@@ -2322,13 +2559,32 @@ int usbg_enable_gadget(usbg_gadget *g, const char *udc)
 
 	ret = usbg_write_string(g->path, g->name, "UDC", udc);
 
-	if (ret == USBG_SUCCESS)
+	if (ret == USBG_SUCCESS) {
 		strcpy(g->udc, udc);
+		/* Gadget is bound and works even if tuning failed */
+		usbg_apply_net_profiles(g);
+	}
 
 	return ret;
 }
 
-int usbg_disable_gadget(usbg_gadget *g)
+int usbg_enable_gadget(usbg_gadget *g, const char *udc)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_ENABLE_GADGET,
+			usbg_do_enable_gadget(g, udc));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_disable_gadget(usbg_gadget *g)
 {
 	int ret = USBG_ERROR_INVALID_PARAM;
 
@@ -2340,6 +2596,22 @@ int usbg_disable_gadget(usbg_gadget *g)
 	return ret;
 }
 
+int usbg_disable_gadget(usbg_gadget *g)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = USBG_STATS_CALL(USBG_STAT_DISABLE_GADGET,
+			usbg_do_disable_gadget(g));
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
 /*
  * USB function-specific attribute configuration
  */
@@ -2355,75 +2627,27 @@ int usbg_get_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs)
 			: USBG_ERROR_INVALID_PARAM;
 }
 
-int usbg_set_function_net_attrs(usbg_function *f, usbg_f_net_attrs *attrs)
-{
-	int ret = USBG_SUCCESS;
-	char addr_buf[USBG_MAX_STR_LENGTH];
-	char *addr;
-
-	/* ifname is read only so we accept only empty string for this param */
-	if (attrs->ifname[0]) {
-		ret = USBG_ERROR_INVALID_PARAM;
-		goto out;
-	}
-
-	addr = ether_ntoa_r(&attrs->dev_addr, addr_buf);
-	ret = usbg_write_string(f->path, f->name, "dev_addr", addr);
-	if (ret != USBG_SUCCESS)
-		goto out;
-
-	addr = ether_ntoa_r(&attrs->host_addr, addr_buf);
-	ret = usbg_write_string(f->path, f->name, "host_addr", addr);
-	if (ret != USBG_SUCCESS)
-		goto out;
-
-	ret = usbg_write_dec(f->path, f->name, "qmult", attrs->qmult);
-
-out:
-	return ret;
-}
-
-int  usbg_set_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs)
+static int usbg_do_set_function_attrs(usbg_function *f,
+				      usbg_function_attrs *f_attrs)
 {
-	int ret = USBG_ERROR_INVALID_PARAM;
-
 	if (!f || !f_attrs)
 		return USBG_ERROR_INVALID_PARAM;
 
-	switch (f->type) {
-	case F_SERIAL:
-	case F_ACM:
-	case F_OBEX:
-		/* port_num attribute is read only so we accept only 0
-		 * and do nothing with it */
-		ret = f_attrs->serial.port_num ? USBG_ERROR_INVALID_PARAM
-			: USBG_SUCCESS;
-		break;
-	case F_ECM:
-	case F_SUBSET:
-	case F_NCM:
-	case F_EEM:
-	case F_RNDIS:
-		ret = usbg_set_function_net_attrs(f, &f_attrs->net);
-		break;
-	case F_PHONET:
-		/* ifname attribute is read only
-		 * so we accept only empty string */
-		ret = f_attrs->phonet.ifname[0] ? USBG_ERROR_INVALID_PARAM
-			: USBG_SUCCESS;
-		break;
-	case F_FFS:
-		/* dev_name is a virtual atribute so allow only to use empty
-		 * empty string which means nop */
-		ret = f_attrs->ffs.dev_name[0] ? USBG_ERROR_INVALID_PARAM
+	/* dev_name is a virtual atribute so allow only to use empty
+	 * empty string which means nop */
+	if (f->type == F_FFS)
+		return f_attrs->ffs.dev_name[0] ? USBG_ERROR_INVALID_PARAM
 			: USBG_SUCCESS;
-		break;
-	default:
-		ERROR("Unsupported function type\n");
-		ret = USBG_ERROR_NOT_SUPPORTED;
-	}
 
-	return ret;
+	/* Read only attributes are accepted only when left empty */
+	return usbg_write_function_attrs(f, f_attrs);
+}
+
+int usbg_set_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs)
+{
+	return USBG_STATS_CALL(USBG_STAT_SET_FUNCTION_ATTRS,
+			USBG_CHANGE(f ? f->parent : NULL,
+				usbg_do_set_function_attrs(f, f_attrs)));
 }
 
 int usbg_set_net_dev_addr(usbg_function *f, struct ether_addr *dev_addr)
@@ -2433,7 +2657,8 @@ int usbg_set_net_dev_addr(usbg_function *f, struct ether_addr *dev_addr)
 	if (f && dev_addr) {
 		char str_buf[USBG_MAX_STR_LENGTH];
 		char *str_addr = ether_ntoa_r(dev_addr, str_buf);
-		ret = usbg_write_string(f->path, f->name, "dev_addr", str_addr);
+		ret = USBG_CHANGE(f->parent, usbg_write_string(f->path,
+					f->name, "dev_addr", str_addr));
 	} else {
 		ret = USBG_ERROR_INVALID_PARAM;
 	}
@@ -2448,7 +2673,8 @@ int usbg_set_net_host_addr(usbg_function *f, struct ether_addr *host_addr)
 	if (f && host_addr) {
 		char str_buf[USBG_MAX_STR_LENGTH];
 		char *str_addr = ether_ntoa_r(host_addr, str_buf);
-		ret = usbg_write_string(f->path, f->name, "host_addr", str_addr);
+		ret = USBG_CHANGE(f->parent, usbg_write_string(f->path,
+					f->name, "host_addr", str_addr));
 	} else {
 		ret = USBG_ERROR_INVALID_PARAM;
 	}
@@ -2458,48 +2684,61 @@ int usbg_set_net_host_addr(usbg_function *f, struct ether_addr *host_addr)
 
 int usbg_set_net_qmult(usbg_function *f, int qmult)
 {
-	return f ? usbg_write_dec(f->path, f->name, "qmult", qmult)
+	return f ? USBG_CHANGE(f->parent,
+			usbg_write_dec(f->path, f->name, "qmult", qmult))
 			: USBG_ERROR_INVALID_PARAM;
 }
 
+/* Read single link of list under lock of its owner */
+#define USBG_LOCKED_GET(owner, expr) \
+	({ \
+		typeof(expr) _ret; \
+		usbg_rdlock(owner); \
+		_ret = (expr); \
+		usbg_unlock(owner); \
+		_ret; \
+	})
+
 usbg_gadget *usbg_get_first_gadget(usbg_state *s)
 {
-	return s ? TAILQ_FIRST(&s->gadgets) : NULL;
+	return s ? USBG_LOCKED_GET(s, TAILQ_FIRST(&s->gadgets)) : NULL;
 }
 
 usbg_function *usbg_get_first_function(usbg_gadget *g)
 {
-	return g ? TAILQ_FIRST(&g->functions) : NULL;
+	return g ? USBG_LOCKED_GET(g, TAILQ_FIRST(&g->functions)) : NULL;
 }
 
 usbg_config *usbg_get_first_config(usbg_gadget *g)
 {
-	return g ? TAILQ_FIRST(&g->configs) : NULL;
+	return g ? USBG_LOCKED_GET(g, TAILQ_FIRST(&g->configs)) : NULL;
 }
 
 usbg_binding *usbg_get_first_binding(usbg_config *c)
 {
-	return c ? TAILQ_FIRST(&c->bindings) : NULL;
+	return c ? USBG_LOCKED_GET(c->parent, TAILQ_FIRST(&c->bindings))
+		: NULL;
 }
 
 usbg_gadget *usbg_get_next_gadget(usbg_gadget *g)
 {
-	return g ? TAILQ_NEXT(g, gnode) : NULL;
+	return g ? USBG_LOCKED_GET(g->parent, TAILQ_NEXT(g, gnode)) : NULL;
 }
 
 usbg_function *usbg_get_next_function(usbg_function *f)
 {
-	return f ? TAILQ_NEXT(f, fnode) : NULL;
+	return f ? USBG_LOCKED_GET(f->parent, TAILQ_NEXT(f, fnode)) : NULL;
 }
 
 usbg_config *usbg_get_next_config(usbg_config *c)
 {
-	return c ? TAILQ_NEXT(c, cnode) : NULL;
+	return c ? USBG_LOCKED_GET(c->parent, TAILQ_NEXT(c, cnode)) : NULL;
 }
 
 usbg_binding *usbg_get_next_binding(usbg_binding *b)
 {
-	return b ? TAILQ_NEXT(b, bnode) : NULL;
+	return b ? USBG_LOCKED_GET(b->parent->parent, TAILQ_NEXT(b, bnode))
+		: NULL;
 }
 
 #define USBG_NAME_TAG "name"
@@ -2512,6 +2751,23 @@ usbg_binding *usbg_get_next_binding(usbg_binding *b)
 #define USBG_INSTANCE_TAG "instance"
 #define USBG_ID_TAG "id"
 #define USBG_FUNCTION_TAG "function"
+#define USBG_LUNS_TAG "luns"
+#define USBG_FORMATS_TAG "formats"
+#define USBG_FRAMES_TAG "frames"
+#define USBG_WIDTH_TAG "width"
+#define USBG_HEIGHT_TAG "height"
+#define USBG_INTERVALS_TAG "intervals"
+#define USBG_REPORT_DESC_TAG "report_desc"
+#define USBG_NET_PROFILE_TAG "net_profile"
+#define USBG_OS_DESC_TAG "os_desc"
+#define USBG_USE_TAG "use"
+#define USBG_VENDOR_CODE_TAG "b_vendor_code"
+#define USBG_QW_SIGN_TAG "qw_sign"
+#define USBG_CONFIG_TAG "config"
+#define USBG_COMPATIBLE_ID_TAG "compatible_id"
+#define USBG_SUB_COMPATIBLE_ID_TAG "sub_compatible_id"
+#define USBG_PROPERTIES_TAG "properties"
+#define USBG_DATA_TAG "data"
 #define USBG_TAB_WIDTH 4
 
 static inline int generate_function_label(usbg_function *f, char *buf, int size)
@@ -2645,7 +2901,7 @@ static int usbg_export_config_strings(usbg_config *c, config_setting_t *root)
 		goto out;
 	}
 
-	nmb = scandir(spath, &dent, file_select, alphasort);
+	nmb = usbg_sys_scandir(spath, &dent, file_select);
 	if (nmb < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -2798,94 +3054,393 @@ static int usbg_export_gadget_configs(usbg_gadget *g, config_setting_t *root)
 	return ret;
 }
 
-static int usbg_export_f_net_attrs(usbg_f_net_attrs *attrs,
-				      config_setting_t *root)
+static int usbg_export_attr_group(config_setting_t *root,
+				  const usbg_attr_desc *descs, int n,
+				  const void *base)
 {
 	config_setting_t *node;
-	char *addr;
 	char addr_buf[USBG_MAX_STR_LENGTH];
-	int cfg_ret;
-	int ret = USBG_ERROR_NO_MEM;
+	const void *val;
+	int i, cfg_ret;
 
-	node = config_setting_add(root, "dev_addr", CONFIG_TYPE_STRING);
-	if (!node)
-		goto out;
+	/*
+	 * Read only attributes are not exported because they cannot be
+	 * imported. We also don't need to export ffs attributes due to
+	 * instance name export.
+	 */
+	for (i = 0; i < n; ++i) {
+		if (!descs[i].writable)
+			continue;
 
-	addr = ether_ntoa_r(&attrs->dev_addr, addr_buf);
-	cfg_ret = config_setting_set_string(node, addr);
-	if (cfg_ret != CONFIG_TRUE) {
-		ret = USBG_ERROR_OTHER_ERROR;
-		goto out;
-	}
+		val = (const char *)base + descs[i].offset;
 
-	node = config_setting_add(root, "host_addr", CONFIG_TYPE_STRING);
-	if (!node)
-		goto out;
+		/* Missing in kernel, don't make scheme fail on such kernels */
+		if (descs[i].optional && (descs[i].type == USBG_ATTR_INT ?
+					  !*(const int *)val : !*(const char *)val))
+			continue;
 
-	addr = ether_ntoa_r(&attrs->host_addr, addr_buf);
-	cfg_ret = config_setting_set_string(node, addr);
-	if (cfg_ret != CONFIG_TRUE) {
-		ret = USBG_ERROR_OTHER_ERROR;
-		goto out;
+		node = config_setting_add(root, descs[i].name,
+					  descs[i].type == USBG_ATTR_INT ?
+					  CONFIG_TYPE_INT : CONFIG_TYPE_STRING);
+		if (!node)
+			return USBG_ERROR_NO_MEM;
+
+		switch (descs[i].type) {
+		case USBG_ATTR_INT:
+			cfg_ret = config_setting_set_int(node,
+							 *(const int *)val);
+			if (cfg_ret == CONFIG_TRUE && descs[i].base == 16)
+				cfg_ret = config_setting_set_format(node,
+						CONFIG_FORMAT_HEX);
+			break;
+		case USBG_ATTR_ETHER_ADDR:
+			cfg_ret = config_setting_set_string(node,
+					ether_ntoa_r(val, addr_buf));
+			break;
+		default:
+			cfg_ret = config_setting_set_string(node, val);
+		}
+
+		if (cfg_ret != CONFIG_TRUE)
+			return USBG_ERROR_OTHER_ERROR;
 	}
 
-	node = config_setting_add(root, "qmult", CONFIG_TYPE_INT);
-	if (!node)
-		goto out;
+	return USBG_SUCCESS;
+}
 
-	cfg_ret = config_setting_set_int(node, attrs->qmult);
-	ret = cfg_ret == CONFIG_TRUE ? 0 : USBG_ERROR_OTHER_ERROR;
+static int usbg_export_ms_luns(usbg_function *f, config_setting_t *root)
+{
+	config_setting_t *list, *group, *node;
+	usbg_f_ms_lun_attrs lun_attrs;
+	const usbg_attr_desc *descs;
+	unsigned int luns;
+	int lun, n;
+	int ret;
 
-	/* if name is read only so we don't export it */
-out:
-	return ret;
+	ret = usbg_get_ms_luns(f, &luns);
+	if (ret != USBG_SUCCESS)
+		return ret;
 
-}
+	list = config_setting_add(root, USBG_LUNS_TAG, CONFIG_TYPE_LIST);
+	if (!list)
+		return USBG_ERROR_NO_MEM;
 
-static int usbg_export_function_attrs(usbg_function *f, config_setting_t *root)
-{
-	config_setting_t *node;
-	usbg_function_attrs f_attrs;
-	int usbg_ret, cfg_ret;
-	int ret = USBG_ERROR_NO_MEM;
+	n = usbg_get_ms_lun_attr_descs(&descs);
+	for (lun = 0; lun < USBG_MAX_MS_LUNS; ++lun) {
+		if (!(luns & (1U << lun)))
+			continue;
 
-	usbg_ret = usbg_get_function_attrs(f, &f_attrs);
-	if (usbg_ret) {
-		ret = usbg_ret;
-		goto out;
-	}
+		ret = usbg_get_ms_lun_attrs(f, lun, &lun_attrs);
+		if (ret != USBG_SUCCESS)
+			return ret;
 
-	switch (f->type) {
-	case F_SERIAL:
-	case F_ACM:
-	case F_OBEX:
-		node = config_setting_add(root, "port_num", CONFIG_TYPE_INT);
+		group = config_setting_add(list, NULL, CONFIG_TYPE_GROUP);
+		if (!group)
+			return USBG_ERROR_NO_MEM;
+
+		node = config_setting_add(group, USBG_ID_TAG, CONFIG_TYPE_INT);
 		if (!node)
-			goto out;
+			return USBG_ERROR_NO_MEM;
 
-		cfg_ret = config_setting_set_int(node, f_attrs.serial.port_num);
-		ret = cfg_ret == CONFIG_TRUE ? 0 : USBG_ERROR_OTHER_ERROR;
-		break;
-	case F_ECM:
-	case F_SUBSET:
-	case F_NCM:
-	case F_EEM:
-	case F_RNDIS:
-		ret = usbg_export_f_net_attrs(&f_attrs.net, root);
-		break;
-	case F_PHONET:
-		/* Don't export ifname because it is read only */
-		break;
-	case F_FFS:
-		/* We don't need to export ffs attributes
-		 * due to instance name export */
-		ret = USBG_SUCCESS;
-		break;
-	default:
-		ERROR("Unsupported function type\n");
-		ret = USBG_ERROR_NOT_SUPPORTED;
+		if (config_setting_set_int(node, lun) != CONFIG_TRUE)
+			return USBG_ERROR_OTHER_ERROR;
+
+		ret = usbg_export_attr_group(group, descs, n, &lun_attrs);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_export_int(config_setting_t *root, const char *name, int val)
+{
+	config_setting_t *node;
+
+	node = config_setting_add(root, name, CONFIG_TYPE_INT);
+	if (!node)
+		return USBG_ERROR_NO_MEM;
+
+	return config_setting_set_int(node, val) == CONFIG_TRUE ?
+		USBG_SUCCESS : USBG_ERROR_OTHER_ERROR;
+}
+
+static int usbg_export_uvc_frame(const usbg_uvc_frame *frame,
+				 config_setting_t *root)
+{
+	config_setting_t *array, *node;
+	int i, ret;
+
+	ret = usbg_export_int(root, USBG_WIDTH_TAG, frame->width);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_export_int(root, USBG_HEIGHT_TAG, frame->height);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	array = config_setting_add(root, USBG_INTERVALS_TAG, CONFIG_TYPE_ARRAY);
+	if (!array)
+		return USBG_ERROR_NO_MEM;
+
+	for (i = 0; i < frame->n_intervals; ++i) {
+		node = config_setting_add(array, NULL, CONFIG_TYPE_INT);
+		if (!node)
+			return USBG_ERROR_NO_MEM;
+
+		if (config_setting_set_int(node, frame->intervals[i])
+		    != CONFIG_TRUE)
+			return USBG_ERROR_OTHER_ERROR;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_export_uvc_formats(usbg_function *f, config_setting_t *root)
+{
+	config_setting_t *list, *group, *frames, *node;
+	usbg_uvc_format *formats;
+	int i, j, n;
+	int ret;
+
+	ret = usbg_get_uvc_formats(f, &formats, &n);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	list = config_setting_add(root, USBG_FORMATS_TAG, CONFIG_TYPE_LIST);
+	if (!list) {
+		ret = USBG_ERROR_NO_MEM;
+		goto out;
+	}
+
+	for (i = 0; i < n; ++i) {
+		group = config_setting_add(list, NULL, CONFIG_TYPE_GROUP);
+		if (!group) {
+			ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		node = config_setting_add(group, USBG_TYPE_TAG,
+					  CONFIG_TYPE_STRING);
+		if (!node) {
+			ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		if (config_setting_set_string(node,
+				usbg_get_uvc_format_dir(formats[i].type))
+		    != CONFIG_TRUE) {
+			ret = USBG_ERROR_OTHER_ERROR;
+			goto out;
+		}
+
+		node = config_setting_add(group, USBG_NAME_TAG,
+					  CONFIG_TYPE_STRING);
+		if (!node) {
+			ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		if (config_setting_set_string(node, formats[i].name)
+		    != CONFIG_TRUE) {
+			ret = USBG_ERROR_OTHER_ERROR;
+			goto out;
+		}
+
+		frames = config_setting_add(group, USBG_FRAMES_TAG,
+					    CONFIG_TYPE_LIST);
+		if (!frames) {
+			ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		for (j = 0; j < formats[i].n_frames; ++j) {
+			node = config_setting_add(frames, NULL,
+						  CONFIG_TYPE_GROUP);
+			if (!node) {
+				ret = USBG_ERROR_NO_MEM;
+				goto out;
+			}
+
+			ret = usbg_export_uvc_frame(formats[i].frames + j,
+						    node);
+			if (ret != USBG_SUCCESS)
+				goto out;
+		}
 	}
 
+out:
+	usbg_free_uvc_formats(formats, n);
+	return ret;
+}
+
+static int usbg_export_hid_report_desc(usbg_function *f,
+				       config_setting_t *root)
+{
+	unsigned char desc[USBG_MAX_HID_REPORT_DESC_LENGTH];
+	config_setting_t *array, *node;
+	int i, len;
+
+	len = usbg_get_hid_report_desc(f, desc, sizeof(desc));
+	if (len <= 0)
+		return len;
+
+	array = config_setting_add(root, USBG_REPORT_DESC_TAG,
+				   CONFIG_TYPE_ARRAY);
+	if (!array)
+		return USBG_ERROR_NO_MEM;
+
+	for (i = 0; i < len; ++i) {
+		node = config_setting_add(array, NULL, CONFIG_TYPE_INT);
+		if (!node)
+			return USBG_ERROR_NO_MEM;
+
+		if (config_setting_set_int(node, desc[i]) != CONFIG_TRUE ||
+		    config_setting_set_format(node, CONFIG_FORMAT_HEX)
+		    != CONFIG_TRUE)
+			return USBG_ERROR_OTHER_ERROR;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_export_string(config_setting_t *root, const char *name,
+			      const char *val)
+{
+	config_setting_t *node;
+
+	node = config_setting_add(root, name, CONFIG_TYPE_STRING);
+	if (!node)
+		return USBG_ERROR_NO_MEM;
+
+	return config_setting_set_string(node, val) == CONFIG_TRUE ?
+		USBG_SUCCESS : USBG_ERROR_OTHER_ERROR;
+}
+
+/* Kernel converts these from UTF-8, others are sent as they are */
+static inline int usbg_os_desc_prop_is_string(int type)
+{
+	return type == USBG_OS_DESC_PROP_SZ
+		|| type == USBG_OS_DESC_PROP_EXPAND_SZ
+		|| type == USBG_OS_DESC_PROP_LINK;
+}
+
+static int usbg_export_os_desc_prop(const usbg_os_desc_prop *prop,
+				    config_setting_t *root)
+{
+	char str[USBG_MAX_OS_DESC_PROP_LENGTH + 1];
+	config_setting_t *array, *node;
+	int i, ret;
+
+	ret = usbg_export_string(root, USBG_NAME_TAG, prop->name);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_export_int(root, USBG_TYPE_TAG, prop->type);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_os_desc_prop_is_string(prop->type)) {
+		memcpy(str, prop->data, prop->len);
+		str[prop->len] = '\0';
+		return usbg_export_string(root, USBG_DATA_TAG, str);
+	}
+
+	array = config_setting_add(root, USBG_DATA_TAG, CONFIG_TYPE_ARRAY);
+	if (!array)
+		return USBG_ERROR_NO_MEM;
+
+	for (i = 0; i < prop->len; ++i) {
+		node = config_setting_add(array, NULL, CONFIG_TYPE_INT);
+		if (!node)
+			return USBG_ERROR_NO_MEM;
+
+		if (config_setting_set_int(node, prop->data[i]) != CONFIG_TRUE
+		    || config_setting_set_format(node, CONFIG_FORMAT_HEX)
+		    != CONFIG_TRUE)
+			return USBG_ERROR_OTHER_ERROR;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/* Only functions with os_desc interface which is in use are exported */
+static int usbg_export_function_os_desc(usbg_function *f,
+					config_setting_t *root)
+{
+	usbg_function_os_desc os_desc;
+	usbg_os_desc_prop *props;
+	config_setting_t *group, *list, *node;
+	int i, n;
+	int ret;
+
+	ret = usbg_get_function_os_desc(f, &os_desc);
+	if (ret != USBG_SUCCESS)
+		return ret == USBG_ERROR_NOT_SUPPORTED ? USBG_SUCCESS : ret;
+
+	ret = usbg_get_os_desc_props(f, &props, &n);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (!os_desc.compatible_id[0] && !os_desc.sub_compatible_id[0] && !n)
+		goto out;
+
+	ret = USBG_ERROR_NO_MEM;
+	group = config_setting_add(root, USBG_OS_DESC_TAG, CONFIG_TYPE_GROUP);
+	if (!group)
+		goto out;
+
+	ret = usbg_export_string(group, USBG_COMPATIBLE_ID_TAG,
+				 os_desc.compatible_id);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_export_string(group, USBG_SUB_COMPATIBLE_ID_TAG,
+					 os_desc.sub_compatible_id);
+	if (ret != USBG_SUCCESS || !n)
+		goto out;
+
+	ret = USBG_ERROR_NO_MEM;
+	list = config_setting_add(group, USBG_PROPERTIES_TAG, CONFIG_TYPE_LIST);
+	if (!list)
+		goto out;
+
+	for (i = 0; i < n; ++i) {
+		ret = USBG_ERROR_NO_MEM;
+		node = config_setting_add(list, NULL, CONFIG_TYPE_GROUP);
+		if (!node)
+			goto out;
+
+		ret = usbg_export_os_desc_prop(props + i, node);
+		if (ret != USBG_SUCCESS)
+			goto out;
+	}
+out:
+	free(props);
+	return ret;
+}
+
+static int usbg_export_function_attrs(usbg_function *f, config_setting_t *root)
+{
+	usbg_function_attrs f_attrs;
+	const usbg_attr_desc *descs;
+	int n;
+	int ret;
+
+	ret = usbg_get_function_attrs(f, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	n = usbg_get_function_attr_descs(f->type, &descs);
+	if (n < 0) {
+		ret = n;
+		goto out;
+	}
+
+	ret = usbg_export_attr_group(root, descs, n, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	if (f->type == F_MASS_STORAGE)
+		ret = usbg_export_ms_luns(f, root);
+	else if (f->type == F_UVC)
+		ret = usbg_export_uvc_formats(f, root);
+	else if (f->type == F_HID)
+		ret = usbg_export_hid_report_desc(f, root);
 out:
 	return ret;
 }
@@ -2895,8 +3450,9 @@ out:
 static int usbg_export_function_prep(usbg_function *f, config_setting_t *root)
 {
 	config_setting_t *node;
+	const usbg_attr_desc *descs;
 	int ret = USBG_ERROR_NO_MEM;
-	int cfg_ret;
+	int cfg_ret, n;
 
 	node = config_setting_add(root, USBG_TYPE_TAG, CONFIG_TYPE_STRING);
 	if (!node)
@@ -2914,6 +3470,24 @@ static int usbg_export_function_prep(usbg_function *f, config_setting_t *root)
 		goto out;
 
 	ret = usbg_export_function_attrs(f, node);
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	if (f->net_profile) {
+		node = config_setting_add(root, USBG_NET_PROFILE_TAG,
+					  CONFIG_TYPE_GROUP);
+		if (!node) {
+			ret = USBG_ERROR_NO_MEM;
+			goto out;
+		}
+
+		n = usbg_get_net_profile_descs(&descs);
+		ret = usbg_export_attr_group(node, descs, n, f->net_profile);
+		if (ret != USBG_SUCCESS)
+			goto out;
+	}
+
+	ret = usbg_export_function_os_desc(f, root);
 out:
 	return ret;
 }
@@ -3044,7 +3618,7 @@ static int usbg_export_gadget_strings(usbg_gadget *g, config_setting_t *root)
 		goto out;
 	}
 
-	nmb = scandir(spath, &dent, file_select, alphasort);
+	nmb = usbg_sys_scandir(spath, &dent, file_select);
 	if (nmb < 0) {
 		ret = usbg_translate_error(errno);
 		goto out;
@@ -3118,6 +3692,46 @@ out:
 	return ret;
 }
 
+/* Exported only when in use, so older kernels can import the scheme */
+static int usbg_export_gadget_os_desc(usbg_gadget *g, config_setting_t *root)
+{
+	usbg_gadget_os_desc os_desc;
+	config_setting_t *group, *node;
+	usbg_config *c;
+	int ret;
+
+	ret = usbg_get_gadget_os_desc(g, &os_desc);
+	if (ret != USBG_SUCCESS)
+		return ret == USBG_ERROR_NOT_FOUND ? USBG_SUCCESS : ret;
+
+	c = usbg_find_os_desc_config(g);
+	if (!os_desc.use && !c)
+		return USBG_SUCCESS;
+
+	group = config_setting_add(root, USBG_OS_DESC_TAG, CONFIG_TYPE_GROUP);
+	if (!group)
+		return USBG_ERROR_NO_MEM;
+
+	ret = usbg_export_int(group, USBG_USE_TAG, os_desc.use);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	node = config_setting_add(group, USBG_VENDOR_CODE_TAG, CONFIG_TYPE_INT);
+	if (!node)
+		return USBG_ERROR_NO_MEM;
+
+	if (config_setting_set_int(node, os_desc.b_vendor_code) != CONFIG_TRUE
+	    || config_setting_set_format(node, CONFIG_FORMAT_HEX)
+	    != CONFIG_TRUE)
+		return USBG_ERROR_OTHER_ERROR;
+
+	ret = usbg_export_string(group, USBG_QW_SIGN_TAG, os_desc.qw_sign);
+	if (ret == USBG_SUCCESS && c)
+		ret = usbg_export_int(group, USBG_CONFIG_TAG, c->id);
+
+	return ret;
+}
+
 static int usbg_export_gadget_prep(usbg_gadget *g, config_setting_t *root)
 {
 	config_setting_t *node;
@@ -3166,7 +3780,12 @@ static int usbg_export_gadget_prep(usbg_gadget *g, config_setting_t *root)
 		goto out;
 
 	usbg_ret = usbg_export_gadget_configs(g, node);
-	ret = usbg_ret;
+	if (usbg_ret) {
+		ret = usbg_ret;
+		goto out;
+	}
+
+	ret = usbg_export_gadget_os_desc(g, root);
 out:
 	return ret;
 }
@@ -3217,7 +3836,9 @@ int usbg_export_config(usbg_config *c, FILE *stream)
 	/* Allways successful */
 	root = config_root_setting(&cfg);
 
+	usbg_rdlock(c->parent);
 	ret = usbg_export_config_prep(c, root);
+	usbg_unlock(c->parent);
 	if (ret != USBG_SUCCESS)
 		goto out;
 
@@ -3227,7 +3848,7 @@ out:
 	return ret;
 }
 
-int usbg_export_gadget(usbg_gadget *g, FILE *stream)
+static int usbg_do_export_gadget(usbg_gadget *g, FILE *stream)
 {
 	config_t cfg;
 	config_setting_t *root;
@@ -3244,7 +3865,9 @@ int usbg_export_gadget(usbg_gadget *g, FILE *stream)
 	/* Allways successful */
 	root = config_root_setting(&cfg);
 
+	usbg_rdlock(g);
 	ret = usbg_export_gadget_prep(g, root);
+	usbg_unlock(g);
 	if (ret != USBG_SUCCESS)
 		goto out;
 
@@ -3254,6 +3877,12 @@ out:
 	return ret;
 }
 
+int usbg_export_gadget(usbg_gadget *g, FILE *stream)
+{
+	return USBG_STATS_CALL(USBG_STAT_EXPORT_GADGET,
+			usbg_do_export_gadget(g, stream));
+}
+
 #define usbg_config_is_int(node) (config_setting_type(node) == CONFIG_TYPE_INT)
 #define usbg_config_is_string(node) \
 	(config_setting_type(node) == CONFIG_TYPE_STRING)
@@ -3300,87 +3929,477 @@ static void usbg_set_failed_import(config_t **to_set, config_t *failed)
 	*to_set = failed;
 }
 
-static int usbg_import_f_net_attrs(config_setting_t *root, usbg_function *f)
+/* Parse value of single attribute, val is laid out as for schema access */
+static int usbg_import_attr(config_setting_t *node, const usbg_attr_desc *d,
+			    void *val)
 {
-	config_setting_t *node;
-	int ret = USBG_SUCCESS;
-	int qmult;
-	struct ether_addr *addr;
-	struct ether_addr addr_buf;
 	const char *str;
 
-#define GET_OPTIONAL_ADDR(NAME)					\
-	do {							\
-		node = config_setting_get_member(root, #NAME);	\
-		if (node) {					\
-			str = config_setting_get_string(node);	\
-			if (!str) {				\
-				ret = USBG_ERROR_INVALID_TYPE;	\
-				goto out;			\
-			}					\
-								\
-			addr = ether_aton_r(str, &addr_buf);	\
-			if (!addr) {				\
-				ret = USBG_ERROR_INVALID_VALUE;	\
-				goto out;			\
-			}					\
-			ret = usbg_set_net_##NAME(f, addr);	\
-			if (ret != USBG_SUCCESS)		\
-				goto out;			\
-		}						\
-	} while (0)
+	if (d->type == USBG_ATTR_INT) {
+		if (!usbg_config_is_int(node))
+			return USBG_ERROR_INVALID_TYPE;
 
-	GET_OPTIONAL_ADDR(host_addr);
-	GET_OPTIONAL_ADDR(dev_addr);
+		*(int *)val = config_setting_get_int(node);
+		return USBG_SUCCESS;
+	}
 
-#undef GET_OPTIONAL_ADDR
+	str = config_setting_get_string(node);
+	if (!str)
+		return USBG_ERROR_INVALID_TYPE;
 
-	node = config_setting_get_member(root, "qmult");
-	if (node) {
-		if (!usbg_config_is_int(node)) {
+	return usbg_attr_parse(d, str, val);
+}
+
+static int usbg_import_ms_luns(config_setting_t *root, usbg_function *f)
+{
+	config_setting_t *group, *node;
+	usbg_f_ms_lun_attrs lun_attrs;
+	const usbg_attr_desc *descs;
+	unsigned int luns;
+	int i, j, n, lun, count;
+	int ret;
+
+	n = usbg_get_ms_lun_attr_descs(&descs);
+	count = config_setting_length(root);
+
+	ret = usbg_get_ms_luns(f, &luns);
+	for (i = 0; i < count && ret == USBG_SUCCESS; ++i) {
+		group = config_setting_get_elem(root, i);
+		if (!config_setting_is_group(group)) {
 			ret = USBG_ERROR_INVALID_TYPE;
-			goto out;
+			break;
+		}
+
+		/* Position in list is used if id is not given */
+		lun = i;
+		node = config_setting_get_member(group, USBG_ID_TAG);
+		if (node) {
+			if (!usbg_config_is_int(node)) {
+				ret = USBG_ERROR_INVALID_TYPE;
+				break;
+			}
+			lun = config_setting_get_int(node);
+		}
+
+		if (lun < 0 || lun >= USBG_MAX_MS_LUNS) {
+			ret = USBG_ERROR_INVALID_VALUE;
+			break;
 		}
-		qmult = config_setting_get_int(node);
-		ret = usbg_set_net_qmult(f, qmult);
+
+		if (!(luns & (1U << lun))) {
+			ret = usbg_create_ms_lun(f, lun, NULL);
+			if (ret != USBG_SUCCESS)
+				break;
+			luns |= 1U << lun;
+		}
+
+		/* Values which are not given are left untouched */
+		ret = usbg_get_ms_lun_attrs(f, lun, &lun_attrs);
+		for (j = 0; j < n && ret == USBG_SUCCESS; ++j) {
+			node = config_setting_get_member(group, descs[j].name);
+			if (node)
+				ret = usbg_import_attr(node, descs + j,
+					(char *)&lun_attrs + descs[j].offset);
+		}
+
+		if (ret == USBG_SUCCESS)
+			ret = usbg_set_ms_lun_attrs(f, lun, &lun_attrs);
 	}
 
-out:
 	return ret;
 }
 
+static int usbg_import_uvc_frame(config_setting_t *root, usbg_uvc_frame *frame)
+{
+	config_setting_t *node, *elem;
+	int i;
+
+	if (!config_setting_is_group(root))
+		return USBG_ERROR_INVALID_TYPE;
+
+	node = config_setting_get_member(root, USBG_WIDTH_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+	if (!usbg_config_is_int(node))
+		return USBG_ERROR_INVALID_TYPE;
+	frame->width = config_setting_get_int(node);
+
+	node = config_setting_get_member(root, USBG_HEIGHT_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+	if (!usbg_config_is_int(node))
+		return USBG_ERROR_INVALID_TYPE;
+	frame->height = config_setting_get_int(node);
+
+	node = config_setting_get_member(root, USBG_INTERVALS_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+	if (!config_setting_is_array(node))
+		return USBG_ERROR_INVALID_TYPE;
+
+	frame->n_intervals = config_setting_length(node);
+	if (frame->n_intervals > USBG_UVC_MAX_INTERVALS)
+		return USBG_ERROR_INVALID_VALUE;
+
+	for (i = 0; i < frame->n_intervals; ++i) {
+		elem = config_setting_get_elem(node, i);
+		if (!usbg_config_is_int(elem))
+			return USBG_ERROR_INVALID_TYPE;
+		frame->intervals[i] = config_setting_get_int(elem);
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_import_uvc_format(config_setting_t *root,
+				  usbg_uvc_format *fmt)
+{
+	config_setting_t *node;
+	usbg_uvc_frame *frames;
+	const char *str;
+	int type, i;
+	int ret = USBG_SUCCESS;
+
+	if (!config_setting_is_group(root))
+		return USBG_ERROR_INVALID_TYPE;
+
+	node = config_setting_get_member(root, USBG_TYPE_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+
+	str = config_setting_get_string(node);
+	if (!str)
+		return USBG_ERROR_INVALID_TYPE;
+
+	type = usbg_lookup_uvc_format_type(str);
+	if (type < 0)
+		return USBG_ERROR_NOT_SUPPORTED;
+	fmt->type = type;
+
+	/* Name is optional, default one is used for given type */
+	node = config_setting_get_member(root, USBG_NAME_TAG);
+	if (node) {
+		fmt->name = config_setting_get_string(node);
+		if (!fmt->name)
+			return USBG_ERROR_INVALID_TYPE;
+	}
+
+	node = config_setting_get_member(root, USBG_FRAMES_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+	if (!config_setting_is_list(node))
+		return USBG_ERROR_INVALID_TYPE;
+
+	fmt->n_frames = config_setting_length(node);
+	frames = calloc(fmt->n_frames ? fmt->n_frames : 1, sizeof(*frames));
+	if (!frames)
+		return USBG_ERROR_NO_MEM;
+	fmt->frames = frames;
+
+	for (i = 0; i < fmt->n_frames && ret == USBG_SUCCESS; ++i)
+		ret = usbg_import_uvc_frame(config_setting_get_elem(node, i),
+					    frames + i);
+
+	return ret;
+}
+
+static int usbg_import_uvc_formats(config_setting_t *root, usbg_function *f)
+{
+	usbg_uvc_format *formats;
+	int i, n;
+	int ret = USBG_SUCCESS;
+
+	n = config_setting_length(root);
+	formats = calloc(n ? n : 1, sizeof(*formats));
+	if (!formats)
+		return USBG_ERROR_NO_MEM;
+
+	for (i = 0; i < n && ret == USBG_SUCCESS; ++i)
+		ret = usbg_import_uvc_format(config_setting_get_elem(root, i),
+					     formats + i);
+
+	if (ret == USBG_SUCCESS)
+		ret = usbg_set_uvc_formats(f, formats, n);
+
+	/* Names belong to config, only frames were allocated here */
+	for (i = 0; i < n; ++i)
+		free((usbg_uvc_frame *)formats[i].frames);
+	free(formats);
+
+	return ret;
+}
+
+static int usbg_import_hid_report_desc(config_setting_t *root,
+				       usbg_function *f)
+{
+	unsigned char desc[USBG_MAX_HID_REPORT_DESC_LENGTH];
+	config_setting_t *elem;
+	int i, len, val;
+
+	len = config_setting_length(root);
+	if (!len || len > sizeof(desc))
+		return USBG_ERROR_INVALID_VALUE;
+
+	for (i = 0; i < len; ++i) {
+		elem = config_setting_get_elem(root, i);
+		if (!usbg_config_is_int(elem))
+			return USBG_ERROR_INVALID_TYPE;
+
+		val = config_setting_get_int(elem);
+		if (val < 0 || val > 0xff)
+			return USBG_ERROR_INVALID_VALUE;
+		desc[i] = val;
+	}
+
+	return usbg_set_hid_report_desc(f, desc, len);
+}
+
 static int usbg_import_function_attrs(config_setting_t *root, usbg_function *f)
 {
+	config_setting_t *node;
+	const usbg_attr_desc *descs;
+	union {
+		int num;
+		char str[USBG_MAX_PATH_LENGTH];
+		struct ether_addr addr;
+	} val;
+	int i, n;
 	int ret = USBG_SUCCESS;
 
-	switch (f->type) {
-	case F_SERIAL:
-	case F_ACM:
-	case F_OBEX:
-		/* Don't import port_num because it is read only */
-		break;
-	case F_ECM:
-	case F_SUBSET:
-	case F_NCM:
-	case F_EEM:
-	case F_RNDIS:
-		ret = usbg_import_f_net_attrs(root, f);
-		break;
-	case F_PHONET:
-		/* Don't import ifname because it is read only */
-		break;
-	case F_FFS:
-		/* We don't need to export ffs attributes
-		 * due to instance name export */
-		break;
-	default:
-		ERROR("Unsupported function type\n");
-		ret = USBG_ERROR_NOT_SUPPORTED;
+	n = usbg_get_function_attr_descs(f->type, &descs);
+	if (n < 0)
+		return n;
+
+	/* Don't import read only attributes like port_num or ifname */
+	for (i = 0; i < n; ++i) {
+		if (!descs[i].writable)
+			continue;
+
+		node = config_setting_get_member(root, descs[i].name);
+		if (!node)
+			continue;
+
+		ret = usbg_import_attr(node, descs + i, &val);
+		if (ret != USBG_SUCCESS)
+			goto out;
+
+		ret = usbg_write_function_attr(f, NULL, descs + i, &val);
+		if (ret != USBG_SUCCESS)
+			goto out;
 	}
 
+	if (f->type == F_MASS_STORAGE) {
+		node = config_setting_get_member(root, USBG_LUNS_TAG);
+		if (!node)
+			goto out;
+
+		if (!config_setting_is_list(node)) {
+			ret = USBG_ERROR_INVALID_TYPE;
+			goto out;
+		}
+
+		ret = usbg_import_ms_luns(node, f);
+	} else if (f->type == F_UVC) {
+		node = config_setting_get_member(root, USBG_FORMATS_TAG);
+		if (!node)
+			goto out;
+
+		if (!config_setting_is_list(node)) {
+			ret = USBG_ERROR_INVALID_TYPE;
+			goto out;
+		}
+
+		ret = usbg_import_uvc_formats(node, f);
+	} else if (f->type == F_HID) {
+		node = config_setting_get_member(root, USBG_REPORT_DESC_TAG);
+		if (!node)
+			goto out;
+
+		if (!config_setting_is_array(node)) {
+			ret = USBG_ERROR_INVALID_TYPE;
+			goto out;
+		}
+
+		ret = usbg_import_hid_report_desc(node, f);
+	}
+out:
 	return ret;
 }
 
+static int usbg_import_net_profile(config_setting_t *root, usbg_function *f)
+{
+	config_setting_t *node;
+	const usbg_attr_desc *descs;
+	usbg_net_profile profile;
+	int i, n;
+	int ret;
+
+	if (!config_setting_is_group(root))
+		return USBG_ERROR_INVALID_TYPE;
+
+	if (!usbg_is_net_function(f))
+		return USBG_ERROR_NOT_SUPPORTED;
+
+	memset(&profile, 0, sizeof(profile));
+	n = usbg_get_net_profile_descs(&descs);
+	for (i = 0; i < n; ++i) {
+		node = config_setting_get_member(root, descs[i].name);
+		if (!node)
+			continue;
+
+		ret = usbg_import_attr(node, descs + i,
+				       (char *)&profile + descs[i].offset);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	/* Gadget is locked by import, usbg_set_net_profile() would block */
+	free(f->net_profile);
+	f->net_profile = malloc(sizeof(profile));
+	if (!f->net_profile)
+		return USBG_ERROR_NO_MEM;
+
+	*f->net_profile = profile;
+	return USBG_SUCCESS;
+}
+
+/* Missing string is left as it is, id has room for ID and '\0' */
+static int usbg_import_os_desc_id(config_setting_t *root, const char *tag,
+				  char *id)
+{
+	config_setting_t *node;
+	const char *str;
+
+	node = config_setting_get_member(root, tag);
+	if (!node)
+		return USBG_SUCCESS;
+
+	str = config_setting_get_string(node);
+	if (!str)
+		return USBG_ERROR_INVALID_TYPE;
+
+	if (strlen(str) > USBG_OS_DESC_ID_LENGTH)
+		return USBG_ERROR_INVALID_VALUE;
+
+	strcpy(id, str);
+	return USBG_SUCCESS;
+}
+
+static int usbg_import_os_desc_prop(config_setting_t *root,
+				    usbg_os_desc_prop *prop)
+{
+	config_setting_t *node, *elem;
+	const char *str;
+	int i, val;
+
+	if (!config_setting_is_group(root))
+		return USBG_ERROR_INVALID_TYPE;
+
+	memset(prop, 0, sizeof(*prop));
+
+	node = config_setting_get_member(root, USBG_NAME_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+
+	str = config_setting_get_string(node);
+	if (!str)
+		return USBG_ERROR_INVALID_TYPE;
+
+	if (strlen(str) >= sizeof(prop->name))
+		return USBG_ERROR_INVALID_VALUE;
+	strcpy(prop->name, str);
+
+	node = config_setting_get_member(root, USBG_TYPE_TAG);
+	if (!node)
+		return USBG_ERROR_MISSING_TAG;
+
+	if (!usbg_config_is_int(node))
+		return USBG_ERROR_INVALID_TYPE;
+	prop->type = config_setting_get_int(node);
+
+	/* Property without data is valid */
+	node = config_setting_get_member(root, USBG_DATA_TAG);
+	if (!node)
+		return USBG_SUCCESS;
+
+	if (usbg_os_desc_prop_is_string(prop->type)) {
+		str = config_setting_get_string(node);
+		if (!str)
+			return USBG_ERROR_INVALID_TYPE;
+
+		prop->len = strlen(str);
+		if (prop->len > sizeof(prop->data))
+			return USBG_ERROR_INVALID_VALUE;
+
+		memcpy(prop->data, str, prop->len);
+		return USBG_SUCCESS;
+	}
+
+	if (!config_setting_is_array(node))
+		return USBG_ERROR_INVALID_TYPE;
+
+	prop->len = config_setting_length(node);
+	if (prop->len > sizeof(prop->data))
+		return USBG_ERROR_INVALID_VALUE;
+
+	for (i = 0; i < prop->len; ++i) {
+		elem = config_setting_get_elem(node, i);
+		if (!usbg_config_is_int(elem))
+			return USBG_ERROR_INVALID_TYPE;
+
+		val = config_setting_get_int(elem);
+		if (val < 0 || val > 0xff)
+			return USBG_ERROR_INVALID_VALUE;
+		prop->data[i] = val;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_import_function_os_desc(config_setting_t *root,
+					usbg_function *f)
+{
+	usbg_function_os_desc os_desc;
+	usbg_os_desc_prop prop;
+	config_setting_t *list;
+	int i, n;
+	int ret;
+
+	if (!config_setting_is_group(root))
+		return USBG_ERROR_INVALID_TYPE;
+
+	memset(&os_desc, 0, sizeof(os_desc));
+	ret = usbg_import_os_desc_id(root, USBG_COMPATIBLE_ID_TAG,
+				     os_desc.compatible_id);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_import_os_desc_id(root, USBG_SUB_COMPATIBLE_ID_TAG,
+					     os_desc.sub_compatible_id);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_set_function_os_desc(f, &os_desc);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Properties are optional */
+	list = config_setting_get_member(root, USBG_PROPERTIES_TAG);
+	if (!list)
+		return USBG_SUCCESS;
+
+	if (!config_setting_is_list(list))
+		return USBG_ERROR_INVALID_TYPE;
+
+	n = config_setting_length(list);
+	for (i = 0; i < n; ++i) {
+		ret = usbg_import_os_desc_prop(config_setting_get_elem(list, i),
+					       &prop);
+		if (ret == USBG_SUCCESS)
+			ret = usbg_set_os_desc_prop(f, &prop);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	return USBG_SUCCESS;
+}
+
 static int usbg_import_function_run(usbg_gadget *g, config_setting_t *root,
 				    const char *instance, usbg_function **f)
 {
@@ -3409,8 +4428,10 @@ static int usbg_import_function_run(usbg_gadget *g, config_setting_t *root,
 	}
 
 	/* All data collected, let's get to work and create this function */
-	ret = usbg_create_function(g, (usbg_function_type)function_type,
-				   instance, NULL, f);
+	ret = USBG_STATS_CALL(USBG_STAT_CREATE_FUNCTION,
+			usbg_do_create_function(g,
+				(usbg_function_type)function_type,
+				instance, NULL, f));
 
 	if (ret != USBG_SUCCESS)
 		goto out;
@@ -3424,6 +4445,19 @@ static int usbg_import_function_run(usbg_gadget *g, config_setting_t *root,
 			goto out;
 		}
 	}
+
+	/* So is profile, which is applied when gadget gets bound */
+	node = config_setting_get_member(root, USBG_NET_PROFILE_TAG);
+	if (node) {
+		ret = usbg_import_net_profile(node, *f);
+		if (ret != USBG_SUCCESS)
+			goto out;
+	}
+
+	/* And OS descriptors of function interface */
+	node = config_setting_get_member(root, USBG_OS_DESC_TAG);
+	if (node)
+		ret = usbg_import_function_os_desc(node, *f);
 out:
 	return ret;
 }
@@ -3449,7 +4483,7 @@ static usbg_function *usbg_lookup_function(usbg_gadget *g, const char *label)
 			goto out;
 
 		/* check if such function exist */
-		f = usbg_get_function(g, type, instance);
+		f = usbg_find_function(g, type, instance);
 	}
 
 out:
@@ -3475,7 +4509,8 @@ static int usbg_import_binding_string(config_setting_t *root, usbg_config *c)
 		goto out;
 	}
 
-	ret = usbg_add_config_function(c, target->name, target);
+	ret = USBG_STATS_CALL(USBG_STAT_ADD_CONFIG_FUNCTION,
+			usbg_do_add_config_function(c, target->name, target));
 out:
 	return ret;
 }
@@ -3549,7 +4584,8 @@ static int usbg_import_binding_group(config_setting_t *root, usbg_config *c)
 		name = target->name;
 	}
 
-	ret = usbg_add_config_function(c, name, target);
+	ret = USBG_STATS_CALL(USBG_STAT_ADD_CONFIG_FUNCTION,
+			usbg_do_add_config_function(c, name, target));
 out:
 	return ret;
 }
@@ -3708,7 +4744,8 @@ static int usbg_import_config_run(usbg_gadget *g, config_setting_t *root,
 	}
 
 	/* Required data collected, let's create our config */
-	usbg_ret = usbg_create_config(g, id, name, NULL, NULL, &newc);
+	usbg_ret = USBG_STATS_CALL(USBG_STAT_CREATE_CONFIG,
+			usbg_do_create_config(g, id, name, NULL, NULL, &newc));
 	if (usbg_ret != USBG_SUCCESS) {
 		ret = usbg_ret;
 		goto out;
@@ -3764,7 +4801,8 @@ error:
 error2:
 	/* We ignore returned value, if function fails
 	 * there is no way to handle it */
-	usbg_rm_config(newc, USBG_RM_RECURSE);
+	USBG_STATS_CALL(USBG_STAT_RM_CONFIG,
+			usbg_do_rm_config(newc, USBG_RM_RECURSE));
 	return ret;
 }
 
@@ -3990,6 +5028,60 @@ out:
 
 }
 
+static int usbg_import_gadget_os_desc(config_setting_t *root, usbg_gadget *g)
+{
+	usbg_gadget_os_desc os_desc;
+	config_setting_t *node;
+	usbg_config *c;
+	const char *str;
+	int ret;
+
+	memset(&os_desc, 0, sizeof(os_desc));
+
+	node = config_setting_get_member(root, USBG_USE_TAG);
+	if (node) {
+		if (!usbg_config_is_int(node))
+			return USBG_ERROR_INVALID_TYPE;
+		os_desc.use = config_setting_get_int(node);
+	}
+
+	node = config_setting_get_member(root, USBG_VENDOR_CODE_TAG);
+	if (node) {
+		if (!usbg_config_is_int(node))
+			return USBG_ERROR_INVALID_TYPE;
+		os_desc.b_vendor_code = config_setting_get_int(node);
+	}
+
+	node = config_setting_get_member(root, USBG_QW_SIGN_TAG);
+	if (node) {
+		str = config_setting_get_string(node);
+		if (!str)
+			return USBG_ERROR_INVALID_TYPE;
+
+		if (strlen(str) > USBG_OS_DESC_QW_SIGN_LENGTH)
+			return USBG_ERROR_INVALID_VALUE;
+		strcpy(os_desc.qw_sign, str);
+	}
+
+	ret = usbg_set_gadget_os_desc(g, &os_desc);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Configuration is given by its id */
+	node = config_setting_get_member(root, USBG_CONFIG_TAG);
+	if (!node)
+		return USBG_SUCCESS;
+
+	if (!usbg_config_is_int(node))
+		return USBG_ERROR_INVALID_TYPE;
+
+	c = usbg_find_config(g, config_setting_get_int(node), NULL);
+	if (!c)
+		return USBG_ERROR_NOT_FOUND;
+
+	return usbg_set_os_desc_config(g, c);
+}
+
 static int usbg_import_gadget_run(usbg_state *s, config_setting_t *root,
 				  const char *name, usbg_gadget **g)
 {
@@ -4006,6 +5098,9 @@ static int usbg_import_gadget_run(usbg_state *s, config_setting_t *root,
 		goto out;
 	}
 
+	/* Gadget is already visible for other threads */
+	usbg_wrlock(newg);
+
 	/* Attrs are optional */
 	node = config_setting_get_member(root, USBG_ATTRS_TAG);
 	if (node) {
@@ -4059,6 +5154,20 @@ static int usbg_import_gadget_run(usbg_state *s, config_setting_t *root,
 			goto error;
 	}
 
+	/* OS descriptors refer to configuration, so they go last */
+	node = config_setting_get_member(root, USBG_OS_DESC_TAG);
+	if (node) {
+		if (!config_setting_is_group(node)) {
+			ret = USBG_ERROR_INVALID_TYPE;
+			goto error2;
+		}
+		usbg_ret = usbg_import_gadget_os_desc(node, newg);
+		if (usbg_ret != USBG_SUCCESS)
+			goto error;
+	}
+
+	usbg_gadget_changed(newg);
+	usbg_unlock(newg);
 	*g = newg;
 	ret = USBG_SUCCESS;
 out:
@@ -4067,14 +5176,15 @@ out:
 error:
 	ret = usbg_ret;
 error2:
+	usbg_unlock(newg);
 	/* We ignore returned value, if function fails
 	 * there is no way to handle it */
 	usbg_rm_gadget(newg, USBG_RM_RECURSE);
 	return ret;
 }
 
-int usbg_import_function(usbg_gadget *g, FILE *stream, const char *instance,
-			 usbg_function **f)
+static int usbg_do_import_function(usbg_gadget *g, FILE *stream,
+				   const char *instance, usbg_function **f)
 {
 	config_t *cfg;
 	config_setting_t *root;
@@ -4118,7 +5228,24 @@ out:
 
 }
 
-int usbg_import_config(usbg_gadget *g, FILE *stream, int id,  usbg_config **c)
+int usbg_import_function(usbg_gadget *g, FILE *stream, const char *instance,
+			 usbg_function **f)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = usbg_do_import_function(g, stream, instance, f);
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_import_config(usbg_gadget *g, FILE *stream, int id,
+				 usbg_config **c)
 {
 	config_t *cfg;
 	config_setting_t *root;
@@ -4161,8 +5288,23 @@ out:
 	return ret;
 }
 
-int usbg_import_gadget(usbg_state *s, FILE *stream, const char *name,
-		       usbg_gadget **g)
+int usbg_import_config(usbg_gadget *g, FILE *stream, int id,  usbg_config **c)
+{
+	int ret;
+
+	if (!g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_wrlock(g);
+	ret = usbg_do_import_config(g, stream, id, c);
+	usbg_gadget_changed(g);
+	usbg_unlock(g);
+
+	return ret;
+}
+
+static int usbg_do_import_gadget(usbg_state *s, FILE *stream,
+				 const char *name, usbg_gadget **g)
 {
 	config_t *cfg;
 	config_setting_t *root;
@@ -4180,7 +5322,9 @@ int usbg_import_gadget(usbg_state *s, FILE *stream, const char *name,
 
 	cfg_ret = config_read(cfg, stream);
 	if (cfg_ret != CONFIG_TRUE) {
+		usbg_wrlock(s);
 		usbg_set_failed_import(&s->last_failed_import, cfg);
+		usbg_unlock(s);
 		ret = USBG_ERROR_INVALID_FORMAT;
 		goto out;
 	}
@@ -4190,7 +5334,9 @@ int usbg_import_gadget(usbg_state *s, FILE *stream, const char *name,
 
 	ret = usbg_import_gadget_run(s, root, name, &newg);
 	if (ret != USBG_SUCCESS) {
+		usbg_wrlock(s);
 		usbg_set_failed_import(&s->last_failed_import, cfg);
+		usbg_unlock(s);
 		goto out;
 	}
 
@@ -4200,11 +5346,20 @@ int usbg_import_gadget(usbg_state *s, FILE *stream, const char *name,
 	config_destroy(cfg);
 	free(cfg);
 	/* Clean last error */
+	usbg_wrlock(s);
 	usbg_set_failed_import(&s->last_failed_import, NULL);
+	usbg_unlock(s);
 out:
 	return ret;
 }
 
+int usbg_import_gadget(usbg_state *s, FILE *stream, const char *name,
+		       usbg_gadget **g)
+{
+	return USBG_STATS_CALL(USBG_STAT_IMPORT_GADGET,
+			usbg_do_import_gadget(s, stream, name, g));
+}
+
 const char *usbg_get_func_import_error_text(usbg_gadget *g)
 {
 	if (!g || !g->last_failed_import)
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/queue.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_async.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_async.c
+ * @brief Worker pool executing library operations asynchronously
+ */
+
+typedef enum {
+	USBG_ASYNC_ENABLE,
+	USBG_ASYNC_DISABLE,
+	USBG_ASYNC_RM,
+	USBG_ASYNC_IMPORT,
+} usbg_async_op;
+
+/*
+ * Jobs with equal key are executed in order of submission. Key is the
+ * state together with name of gadget, so import of gadget waits for
+ * removal of previous one with the same name.
+ */
+struct usbg_async_job
+{
+	TAILQ_ENTRY(usbg_async_job) jnode;
+	usbg_async_op op;
+	const usbg_state *key;
+	char *gadget;
+	/* Name of udc or of imported gadget */
+	char *name;
+
+	usbg_state *s;
+	usbg_gadget *g;
+	usbg_gadget **out;
+	FILE *stream;
+	int opts;
+
+	usbg_async_cb cb;
+	void *data;
+	int ret;
+};
+
+struct usbg_async
+{
+	pthread_mutex_t lock;
+	/* Signaled when job is queued or key becomes free */
+	pthread_cond_t cond;
+	TAILQ_HEAD(jhead, usbg_async_job) jobs;
+	TAILQ_HEAD(dhead, usbg_async_job) done;
+
+	int n_workers;
+	pthread_t *workers;
+	/* Job currently executed by each worker */
+	struct usbg_async_job **running;
+	int stop;
+
+	int flags;
+	int efd;
+};
+
+static int usbg_async_same_key(const struct usbg_async_job *a,
+			       const struct usbg_async_job *b)
+{
+	return a->key == b->key && !strcmp(a->gadget, b->gadget);
+}
+
+/* Caller has to hold lock of pool */
+static struct usbg_async_job *usbg_async_next_job(usbg_async *a)
+{
+	struct usbg_async_job *j, *prev;
+	int i;
+
+	TAILQ_FOREACH(j, &a->jobs, jnode) {
+		for (i = 0; i < a->n_workers; ++i)
+			if (a->running[i] && usbg_async_same_key(a->running[i], j))
+				break;
+		if (i < a->n_workers)
+			continue;
+
+		/* Earlier job for the same gadget has to be executed first */
+		for (prev = TAILQ_FIRST(&a->jobs); prev != j;
+		     prev = TAILQ_NEXT(prev, jnode))
+			if (usbg_async_same_key(prev, j))
+				break;
+		if (prev == j)
+			return j;
+	}
+
+	return NULL;
+}
+
+static void usbg_async_free_job(struct usbg_async_job *j)
+{
+	free(j->gadget);
+	free(j->name);
+	free(j);
+}
+
+static int usbg_async_run(struct usbg_async_job *j)
+{
+	int ret = USBG_ERROR_INVALID_PARAM;
+
+	switch (j->op) {
+	case USBG_ASYNC_ENABLE:
+		ret = usbg_enable_gadget(j->g, j->name);
+		break;
+	case USBG_ASYNC_DISABLE:
+		ret = usbg_disable_gadget(j->g);
+		break;
+	case USBG_ASYNC_RM:
+		ret = usbg_rm_gadget(j->g, j->opts);
+		break;
+	case USBG_ASYNC_IMPORT:
+		ret = usbg_import_gadget(j->s, j->stream, j->name, j->out);
+		break;
+	}
+
+	return ret;
+}
+
+static void *usbg_async_worker(void *arg)
+{
+	usbg_async *a = arg;
+	struct usbg_async_job *j;
+	uint64_t one = 1;
+	int idx;
+
+	pthread_mutex_lock(&a->lock);
+	for (idx = 0; !pthread_equal(a->workers[idx], pthread_self()); ++idx)
+		;
+
+	while (1) {
+		j = usbg_async_next_job(a);
+		if (!j) {
+			if (a->stop && TAILQ_EMPTY(&a->jobs))
+				break;
+			pthread_cond_wait(&a->cond, &a->lock);
+			continue;
+		}
+
+		TAILQ_REMOVE(&a->jobs, j, jnode);
+		a->running[idx] = j;
+		pthread_mutex_unlock(&a->lock);
+
+		j->ret = usbg_async_run(j);
+
+		pthread_mutex_lock(&a->lock);
+		a->running[idx] = NULL;
+		/* Other workers may wait for key of this job */
+		pthread_cond_broadcast(&a->cond);
+
+		if (a->flags & USBG_ASYNC_EVENTFD) {
+			TAILQ_INSERT_TAIL(&a->done, j, jnode);
+			if (write(a->efd, &one, sizeof(one)) < 0)
+				ERRORNO(NULL, "couldn't signal completion");
+		} else {
+			pthread_mutex_unlock(&a->lock);
+			if (j->cb)
+				j->cb(j->ret, j->data);
+			usbg_async_free_job(j);
+			pthread_mutex_lock(&a->lock);
+		}
+	}
+	pthread_mutex_unlock(&a->lock);
+
+	return NULL;
+}
+
+static int usbg_async_submit(usbg_async *a, struct usbg_async_job *j)
+{
+	pthread_mutex_lock(&a->lock);
+	TAILQ_INSERT_TAIL(&a->jobs, j, jnode);
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->lock);
+
+	return USBG_SUCCESS;
+}
+
+static struct usbg_async_job *usbg_async_alloc_job(usbg_async_op op,
+		usbg_state *s, const char *gadget, const char *name,
+		usbg_async_cb cb, void *data)
+{
+	struct usbg_async_job *j;
+
+	j = calloc(1, sizeof(*j));
+	if (!j)
+		return NULL;
+
+	j->gadget = strdup(gadget);
+	if (name)
+		j->name = strdup(name);
+	if (!j->gadget || (name && !j->name)) {
+		usbg_async_free_job(j);
+		return NULL;
+	}
+
+	j->op = op;
+	j->key = s;
+	j->cb = cb;
+	j->data = data;
+
+	return j;
+}
+
+int usbg_async_create(int n_workers, int flags, usbg_async **a)
+{
+	usbg_async *ap;
+	int ret = USBG_ERROR_NO_MEM;
+	int i;
+
+	if (!a || n_workers < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!n_workers)
+		n_workers = USBG_ASYNC_DEFAULT_WORKERS;
+
+	ap = calloc(1, sizeof(*ap));
+	if (!ap)
+		goto out;
+
+	ap->flags = flags;
+	ap->n_workers = n_workers;
+	ap->efd = -1;
+	TAILQ_INIT(&ap->jobs);
+	TAILQ_INIT(&ap->done);
+
+	ap->workers = calloc(n_workers, sizeof(*ap->workers));
+	ap->running = calloc(n_workers, sizeof(*ap->running));
+	if (!ap->workers || !ap->running)
+		goto err_free;
+
+	if (flags & USBG_ASYNC_EVENTFD) {
+		ap->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (ap->efd < 0) {
+			ret = usbg_translate_error(errno);
+			goto err_free;
+		}
+	}
+
+	if (pthread_mutex_init(&ap->lock, NULL))
+		goto err_close;
+
+	if (pthread_cond_init(&ap->cond, NULL))
+		goto err_mutex;
+
+	/* Workers look up their index, so keep them waiting for the lock */
+	pthread_mutex_lock(&ap->lock);
+	for (i = 0; i < n_workers; ++i) {
+		if (pthread_create(&ap->workers[i], NULL, usbg_async_worker,
+				   ap)) {
+			ERROR(NULL, "couldn't create worker thread");
+			ret = USBG_ERROR_OTHER_ERROR;
+			break;
+		}
+	}
+
+	if (i < n_workers) {
+		ap->n_workers = i;
+		ap->stop = 1;
+		pthread_mutex_unlock(&ap->lock);
+		while (i--)
+			pthread_join(ap->workers[i], NULL);
+		goto err_cond;
+	}
+	pthread_mutex_unlock(&ap->lock);
+
+	*a = ap;
+	ret = USBG_SUCCESS;
+	goto out;
+
+err_cond:
+	pthread_cond_destroy(&ap->cond);
+err_mutex:
+	pthread_mutex_destroy(&ap->lock);
+err_close:
+	if (ap->efd >= 0)
+		close(ap->efd);
+err_free:
+	free(ap->workers);
+	free(ap->running);
+	free(ap);
+out:
+	return ret;
+}
+
+void usbg_async_destroy(usbg_async *a)
+{
+	int i;
+
+	if (!a)
+		return;
+
+	pthread_mutex_lock(&a->lock);
+	a->stop = 1;
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->lock);
+
+	for (i = 0; i < a->n_workers; ++i)
+		pthread_join(a->workers[i], NULL);
+
+	if (a->flags & USBG_ASYNC_EVENTFD) {
+		usbg_async_dispatch(a);
+		close(a->efd);
+	}
+
+	pthread_cond_destroy(&a->cond);
+	pthread_mutex_destroy(&a->lock);
+	free(a->workers);
+	free(a->running);
+	free(a);
+}
+
+int usbg_async_get_fd(usbg_async *a)
+{
+	return a && a->efd >= 0 ? a->efd : USBG_ERROR_INVALID_PARAM;
+}
+
+int usbg_async_dispatch(usbg_async *a)
+{
+	struct dhead done;
+	struct usbg_async_job *j;
+	uint64_t cnt;
+	int n = 0;
+
+	if (!a || a->efd < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	TAILQ_INIT(&done);
+
+	/* Reset counter before taking jobs, so no completion is missed */
+	if (read(a->efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		return usbg_translate_error(errno);
+
+	pthread_mutex_lock(&a->lock);
+	TAILQ_CONCAT(&done, &a->done, jnode);
+	pthread_mutex_unlock(&a->lock);
+
+	/* Callbacks may submit new operations */
+	while ((j = TAILQ_FIRST(&done))) {
+		TAILQ_REMOVE(&done, j, jnode);
+		if (j->cb)
+			j->cb(j->ret, j->data);
+		usbg_async_free_job(j);
+		++n;
+	}
+
+	return n;
+}
+
+int usbg_enable_gadget_async(usbg_async *a, usbg_gadget *g,
+			     const char *udc, usbg_async_cb cb, void *data)
+{
+	struct usbg_async_job *j;
+
+	if (!a || !g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	j = usbg_async_alloc_job(USBG_ASYNC_ENABLE, g->parent, g->name, udc,
+				 cb, data);
+	if (!j)
+		return USBG_ERROR_NO_MEM;
+
+	j->g = g;
+
+	return usbg_async_submit(a, j);
+}
+
+int usbg_disable_gadget_async(usbg_async *a, usbg_gadget *g,
+			      usbg_async_cb cb, void *data)
+{
+	struct usbg_async_job *j;
+
+	if (!a || !g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	j = usbg_async_alloc_job(USBG_ASYNC_DISABLE, g->parent, g->name,
+				 NULL, cb, data);
+	if (!j)
+		return USBG_ERROR_NO_MEM;
+
+	j->g = g;
+
+	return usbg_async_submit(a, j);
+}
+
+int usbg_rm_gadget_async(usbg_async *a, usbg_gadget *g, int opts,
+			 usbg_async_cb cb, void *data)
+{
+	struct usbg_async_job *j;
+
+	if (!a || !g)
+		return USBG_ERROR_INVALID_PARAM;
+
+	j = usbg_async_alloc_job(USBG_ASYNC_RM, g->parent, g->name, NULL,
+				 cb, data);
+	if (!j)
+		return USBG_ERROR_NO_MEM;
+
+	j->g = g;
+	j->opts = opts;
+
+	return usbg_async_submit(a, j);
+}
+
+int usbg_import_gadget_async(usbg_async *a, usbg_state *s, FILE *stream,
+			     const char *name, usbg_gadget **g,
+			     usbg_async_cb cb, void *data)
+{
+	struct usbg_async_job *j;
+
+	if (!a || !s || !stream || !name)
+		return USBG_ERROR_INVALID_PARAM;
+
+	j = usbg_async_alloc_job(USBG_ASYNC_IMPORT, s, name, name, cb,
+				 data);
+	if (!j)
+		return USBG_ERROR_NO_MEM;
+
+	j->s = s;
+	j->stream = stream;
+	j->out = g;
+
+	return usbg_async_submit(a, j);
+}
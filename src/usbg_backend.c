@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_backend.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_backend.c
+ * @brief Dispatching of library I/O to selected backend
+ */
+
+struct usbg_backend
+{
+	const usbg_backend_ops *ops;
+	void *priv;
+};
+
+static int usbg_fs_read(void *priv, const char *path, char *buf, size_t len)
+{
+	int fd;
+	ssize_t nmb;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	do {
+		nmb = read(fd, buf, len);
+	} while (nmb < 0 && errno == EINTR);
+
+	if (nmb < 0)
+		nmb = -errno;
+
+	close(fd);
+	return nmb;
+}
+
+static int usbg_fs_write(void *priv, const char *path, const char *buf,
+			 size_t len)
+{
+	int fd;
+	ssize_t nmb;
+	size_t done = 0;
+	int ret;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return -errno;
+
+	while (done < len) {
+		nmb = write(fd, buf + done, len - done);
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		done += nmb;
+	}
+
+	ret = done < len ? -errno : (int)done;
+	if (close(fd) != 0 && ret >= 0)
+		ret = -errno;
+
+	return ret;
+}
+
+static int usbg_fs_mkdir(void *priv, const char *path)
+{
+	return mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO) ? -errno : 0;
+}
+
+static int usbg_fs_rmdir(void *priv, const char *path)
+{
+	return rmdir(path) ? -errno : 0;
+}
+
+static int usbg_fs_unlink(void *priv, const char *path)
+{
+	return unlink(path) ? -errno : 0;
+}
+
+static int usbg_fs_symlink(void *priv, const char *target, const char *path)
+{
+	return symlink(target, path) ? -errno : 0;
+}
+
+static int usbg_fs_readlink(void *priv, const char *path, char *buf,
+			    size_t len)
+{
+	ssize_t nmb;
+
+	nmb = readlink(path, buf, len);
+	return nmb < 0 ? -errno : nmb;
+}
+
+static int usbg_fs_scandir(void *priv, const char *path,
+			   int (*filter)(const struct dirent *),
+			   struct dirent ***list)
+{
+	int n;
+
+	n = scandir(path, list, filter, alphasort);
+	return n < 0 ? -errno : n;
+}
+
+static int usbg_fs_check_dir(void *priv, const char *path)
+{
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return -errno;
+
+	closedir(dir);
+	return 0;
+}
+
+static const usbg_backend_ops usbg_fs_ops = {
+	.read = usbg_fs_read,
+	.write = usbg_fs_write,
+	.mkdir = usbg_fs_mkdir,
+	.rmdir = usbg_fs_rmdir,
+	.unlink = usbg_fs_unlink,
+	.symlink = usbg_fs_symlink,
+	.readlink = usbg_fs_readlink,
+	.scandir = usbg_fs_scandir,
+	.check_dir = usbg_fs_check_dir,
+};
+
+static usbg_backend usbg_fs_backend = {
+	.ops = &usbg_fs_ops,
+};
+
+static usbg_backend *usbg_cur_backend;
+
+static inline usbg_backend *usbg_backend_cur(void)
+{
+	return usbg_cur_backend ? usbg_cur_backend : &usbg_fs_backend;
+}
+
+/* Convert backend convention into syscall one */
+static inline int usbg_sys_ret(int ret)
+{
+	if (ret < 0) {
+		errno = -ret;
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/* Call backend operation, account it and report to tracers */
+#define USBG_SYS_CALL(op, stat, path, target, ...) \
+	({ \
+		usbg_backend *_b = usbg_backend_cur(); \
+		struct usbg_trace_ctx _t; \
+		int _ret; \
+		usbg_trace_begin(&_t, stat, path, target); \
+		_ret = _b->ops->op(_b->priv, ##__VA_ARGS__); \
+		usbg_trace_end(&_t, _ret); \
+		usbg_sys_ret(_ret); \
+	})
+
+int usbg_sys_read(const char *path, char *buf, size_t len)
+{
+	return USBG_SYS_CALL(read, USBG_STAT_READ, path, NULL,
+			     path, buf, len);
+}
+
+int usbg_sys_write(const char *path, const char *buf, size_t len)
+{
+	return USBG_SYS_CALL(write, USBG_STAT_WRITE, path, NULL,
+			     path, buf, len);
+}
+
+int usbg_sys_mkdir(const char *path)
+{
+	return USBG_SYS_CALL(mkdir, USBG_STAT_MKDIR, path, NULL, path);
+}
+
+int usbg_sys_rmdir(const char *path)
+{
+	return USBG_SYS_CALL(rmdir, USBG_STAT_RMDIR, path, NULL, path);
+}
+
+int usbg_sys_unlink(const char *path)
+{
+	return USBG_SYS_CALL(unlink, USBG_STAT_UNLINK, path, NULL, path);
+}
+
+int usbg_sys_symlink(const char *target, const char *path)
+{
+	return USBG_SYS_CALL(symlink, USBG_STAT_SYMLINK, path, target,
+			     target, path);
+}
+
+int usbg_sys_readlink(const char *path, char *buf, size_t len)
+{
+	return USBG_SYS_CALL(readlink, USBG_STAT_READLINK, path, NULL,
+			     path, buf, len);
+}
+
+int usbg_sys_scandir(const char *path, struct dirent ***list,
+		     int (*filter)(const struct dirent *))
+{
+	return USBG_SYS_CALL(scandir, USBG_STAT_SCANDIR, path, NULL,
+			     path, filter, list);
+}
+
+int usbg_sys_check_dir(const char *path)
+{
+	return USBG_SYS_CALL(check_dir, USBG_STAT_CHECK_DIR, path, NULL, path);
+}
+
+int usbg_sys_is_fs(void)
+{
+	return usbg_backend_cur()->ops == &usbg_fs_ops;
+}
+
+/*
+ * User API
+ */
+
+int usbg_backend_create(const usbg_backend_ops *ops, void *priv,
+			usbg_backend **b)
+{
+	if (!ops || !b || !ops->read || !ops->write || !ops->mkdir
+	    || !ops->rmdir || !ops->unlink || !ops->symlink || !ops->readlink
+	    || !ops->scandir || !ops->check_dir)
+		return USBG_ERROR_INVALID_PARAM;
+
+	*b = malloc(sizeof(**b));
+	if (!*b)
+		return USBG_ERROR_NO_MEM;
+
+	(*b)->ops = ops;
+	(*b)->priv = priv;
+
+	return USBG_SUCCESS;
+}
+
+void usbg_backend_destroy(usbg_backend *b)
+{
+	if (!b)
+		return;
+
+	if (b == usbg_cur_backend)
+		usbg_cur_backend = NULL;
+
+	if (b->ops->release)
+		b->ops->release(b->priv);
+
+	free(b);
+}
+
+int usbg_set_backend(usbg_backend *b)
+{
+	usbg_cur_backend = b;
+	return USBG_SUCCESS;
+}
+
+usbg_backend *usbg_get_backend(void)
+{
+	return usbg_cur_backend;
+}
+
+void *usbg_backend_priv(usbg_backend *b, const usbg_backend_ops *ops)
+{
+	return b && b->ops == ops ? b->priv : NULL;
+}
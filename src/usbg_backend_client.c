@@ -0,0 +1,561 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_backend.h>
+
+#include "usbg_internal.h"
+#include "usbg_shm.h"
+
+/**
+ * @file usbg_backend_client.c
+ * @brief Backend reading shared image published by usbg daemon
+ */
+
+struct usbg_client
+{
+	int fd;
+	const struct usbg_shm_hdr *shm;
+	size_t size;
+
+	/* Serializes requests and protects batch */
+	pthread_mutex_t lock;
+	int batching;
+	char *batch;
+	size_t batch_len;
+	uint32_t batch_ops;
+	int batch_err;
+};
+
+/* Daemon rewrites image in milliseconds, give up after about a second */
+#define USBG_CLIENT_SPINS 1024
+#define USBG_CLIENT_SLEEP_US 100
+#define USBG_CLIENT_SLEEPS 10000
+
+/* Wait until daemon is not writing, 0 or -EBUSY if it takes too long */
+static int usbg_client_begin_read(struct usbg_client *c, uint64_t *seq)
+{
+	struct timespec ts = { 0, USBG_CLIENT_SLEEP_US * 1000 };
+	unsigned int i;
+
+	for (i = 0; i < USBG_CLIENT_SPINS + USBG_CLIENT_SLEEPS; ++i) {
+		*seq = __atomic_load_n(&c->shm->seq, __ATOMIC_ACQUIRE);
+		if (!(*seq & 1))
+			return 0;
+
+		if (i >= USBG_CLIENT_SPINS)
+			nanosleep(&ts, NULL);
+	}
+
+	return -EBUSY;
+}
+
+/*
+ * Readers of image. Everything what is taken from shared memory is
+ * checked against its size, as it may be modified under our hands, and
+ * copied out. Result is valid only if seq did not change meanwhile.
+ */
+#define USBG_CLIENT_READ(c, expr) \
+	({ \
+		typeof(expr) _ret; \
+		uint64_t _seq; \
+		do { \
+			if (usbg_client_begin_read(c, &_seq)) { \
+				_ret = -EBUSY; \
+				break; \
+			} \
+			_ret = (expr); \
+			__atomic_thread_fence(__ATOMIC_ACQUIRE); \
+		} while (__atomic_load_n(&(c)->shm->seq, \
+					 __ATOMIC_RELAXED) != _seq); \
+		_ret; \
+	})
+
+static const char *usbg_client_str(struct usbg_client *c, uint32_t off)
+{
+	const char *s = (const char *)c->shm + off;
+
+	if (off >= c->size || !memchr(s, '\0', c->size - off))
+		return NULL;
+
+	return s;
+}
+
+static const struct usbg_shm_node *usbg_client_nodes(struct usbg_client *c,
+		uint32_t *n)
+{
+	*n = c->shm->n_nodes;
+	if (*n > (c->size - sizeof(*c->shm)) / sizeof(struct usbg_shm_node))
+		*n = 0;
+
+	return (const struct usbg_shm_node *)(c->shm + 1);
+}
+
+/* Returns index of node or -1 if there is no such path */
+static int usbg_client_lookup(struct usbg_client *c, const char *path)
+{
+	const struct usbg_shm_node *nodes;
+	const char *npath;
+	uint32_t lo = 0, hi, mid;
+	int cmp;
+
+	nodes = usbg_client_nodes(c, &hi);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		npath = usbg_client_str(c, nodes[mid].path);
+		if (!npath)
+			return -1;
+
+		cmp = usbg_shm_path_cmp(path, npath);
+		if (!cmp)
+			return mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+static int usbg_client_do_read(struct usbg_client *c, const char *path,
+		char *buf, size_t len, usbg_shm_type type)
+{
+	const struct usbg_shm_node *nodes;
+	uint32_t n;
+	int i;
+
+	i = usbg_client_lookup(c, path);
+	if (i < 0)
+		return -ENOENT;
+
+	nodes = usbg_client_nodes(c, &n);
+	if (nodes[i].type != type)
+		return type == USBG_SHM_LINK || nodes[i].type != USBG_SHM_DIR ?
+			-EINVAL : -EISDIR;
+	if (nodes[i].err)
+		return nodes[i].err;
+	if (nodes[i].data >= c->size || nodes[i].len > c->size - nodes[i].data)
+		return -EIO;
+
+	if (len > nodes[i].len)
+		len = nodes[i].len;
+
+	memcpy(buf, (const char *)c->shm + nodes[i].data, len);
+	return len;
+}
+
+static int usbg_client_read(void *priv, const char *path, char *buf,
+			    size_t len)
+{
+	struct usbg_client *c = priv;
+
+	return USBG_CLIENT_READ(c, usbg_client_do_read(c, path, buf, len,
+						       USBG_SHM_FILE));
+}
+
+static int usbg_client_readlink(void *priv, const char *path, char *buf,
+				size_t len)
+{
+	struct usbg_client *c = priv;
+
+	return USBG_CLIENT_READ(c, usbg_client_do_read(c, path, buf, len,
+						       USBG_SHM_LINK));
+}
+
+static int usbg_client_do_check_dir(struct usbg_client *c, const char *path)
+{
+	const struct usbg_shm_node *nodes;
+	uint32_t n;
+	int i;
+
+	i = usbg_client_lookup(c, path);
+	if (i < 0)
+		return -ENOENT;
+
+	nodes = usbg_client_nodes(c, &n);
+	return nodes[i].type == USBG_SHM_DIR ? 0 : -ENOTDIR;
+}
+
+static int usbg_client_check_dir(void *priv, const char *path)
+{
+	struct usbg_client *c = priv;
+
+	return USBG_CLIENT_READ(c, usbg_client_do_check_dir(c, path));
+}
+
+static void usbg_client_free_list(struct dirent **dent, int n)
+{
+	while (n-- > 0)
+		free(dent[n]);
+	free(dent);
+}
+
+static int usbg_client_do_scandir(struct usbg_client *c, const char *path,
+		int (*filter)(const struct dirent *), struct dirent ***list)
+{
+	static const unsigned char dtypes[] = {
+		[USBG_SHM_DIR] = DT_DIR,
+		[USBG_SHM_FILE] = DT_REG,
+		[USBG_SHM_LINK] = DT_LNK,
+	};
+	const struct usbg_shm_node *nodes;
+	struct dirent **dent = NULL, **tmp;
+	struct dirent d;
+	const char *npath, *name;
+	size_t plen = strlen(path);
+	uint32_t n, j;
+	int i, cnt = 0;
+
+	i = usbg_client_lookup(c, path);
+	if (i < 0)
+		return -ENOENT;
+
+	nodes = usbg_client_nodes(c, &n);
+	if (nodes[i].type != USBG_SHM_DIR)
+		return -ENOTDIR;
+
+	/* All descendants follow directly after directory */
+	for (j = i + 1; j < n; ++j) {
+		npath = usbg_client_str(c, nodes[j].path);
+		if (!npath || strncmp(npath, path, plen) || npath[plen] != '/')
+			break;
+
+		name = npath + plen + 1;
+		if (strchr(name, '/'))
+			continue;
+
+		memset(&d, 0, sizeof(d));
+		d.d_ino = j + 1;
+		d.d_type = nodes[j].type < ARRAY_SIZE(dtypes) ?
+			dtypes[nodes[j].type] : DT_UNKNOWN;
+		d.d_reclen = sizeof(d);
+		strncpy(d.d_name, name, sizeof(d.d_name) - 1);
+
+		if (filter && !filter(&d))
+			continue;
+
+		tmp = realloc(dent, (cnt + 1) * sizeof(*dent));
+		if (!tmp)
+			goto err;
+		dent = tmp;
+
+		dent[cnt] = malloc(sizeof(d));
+		if (!dent[cnt])
+			goto err;
+
+		*dent[cnt++] = d;
+	}
+
+	/* Empty list has to be freeable as well */
+	if (!dent) {
+		dent = malloc(sizeof(*dent));
+		if (!dent)
+			return -ENOMEM;
+	}
+
+	*list = dent;
+	return cnt;
+
+err:
+	usbg_client_free_list(dent, cnt);
+	return -ENOMEM;
+}
+
+static int usbg_client_scandir(void *priv, const char *path,
+			       int (*filter)(const struct dirent *),
+			       struct dirent ***list)
+{
+	struct usbg_client *c = priv;
+	struct dirent **dent;
+	int ret;
+
+	do {
+		uint64_t seq;
+
+		while ((seq = __atomic_load_n(&c->shm->seq,
+					      __ATOMIC_ACQUIRE)) & 1)
+			;
+		ret = usbg_client_do_scandir(c, path, filter, &dent);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&c->shm->seq, __ATOMIC_RELAXED) == seq)
+			break;
+
+		/* List built from torn image is dropped */
+		if (ret >= 0)
+			usbg_client_free_list(dent, ret);
+	} while (1);
+
+	if (ret >= 0)
+		*list = dent;
+
+	return ret;
+}
+
+/* Caller has to hold lock of client */
+static int usbg_client_flush(struct usbg_client *c)
+{
+	struct usbg_shm_reply reply;
+	ssize_t len;
+
+	if (!c->batch_ops)
+		return 0;
+
+	memcpy(c->batch, &c->batch_ops, sizeof(c->batch_ops));
+	len = send(c->fd, c->batch, c->batch_len, MSG_NOSIGNAL);
+	c->batch_len = sizeof(c->batch_ops);
+	c->batch_ops = 0;
+	if (len < 0)
+		return -errno;
+
+	do {
+		len = recv(c->fd, &reply, sizeof(reply), 0);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -errno;
+	if (len != sizeof(reply))
+		return -ECONNRESET;
+
+	return reply.err;
+}
+
+static int usbg_client_queue(struct usbg_client *c, usbg_shm_op_type type,
+		const char *path, const char *arg, size_t arg_len)
+{
+	struct usbg_shm_op op = {
+		.op = type,
+		.path_len = strlen(path) + 1,
+		.arg_len = arg_len,
+	};
+	size_t len = sizeof(op) + op.path_len + op.arg_len;
+	int ret = 0;
+
+	if (len > USBG_SHM_MAX_MSG - sizeof(c->batch_ops))
+		return -EMSGSIZE;
+
+	pthread_mutex_lock(&c->lock);
+
+	if (c->batch_len + len > USBG_SHM_MAX_MSG) {
+		ret = usbg_client_flush(c);
+		if (ret && !c->batch_err)
+			c->batch_err = ret;
+	}
+
+	memcpy(c->batch + c->batch_len, &op, sizeof(op));
+	memcpy(c->batch + c->batch_len + sizeof(op), path, op.path_len);
+	memcpy(c->batch + c->batch_len + sizeof(op) + op.path_len, arg,
+	       op.arg_len);
+	c->batch_len += len;
+	c->batch_ops++;
+
+	/* Outside of batch each operation is sent and waited for at once */
+	ret = c->batching ? 0 : usbg_client_flush(c);
+
+	pthread_mutex_unlock(&c->lock);
+	return ret;
+}
+
+static int usbg_client_write(void *priv, const char *path, const char *buf,
+			     size_t len)
+{
+	int ret;
+
+	ret = usbg_client_queue(priv, USBG_SHM_OP_WRITE, path, buf, len);
+	return ret ? ret : (int)len;
+}
+
+static int usbg_client_mkdir(void *priv, const char *path)
+{
+	return usbg_client_queue(priv, USBG_SHM_OP_MKDIR, path, NULL, 0);
+}
+
+static int usbg_client_rmdir(void *priv, const char *path)
+{
+	return usbg_client_queue(priv, USBG_SHM_OP_RMDIR, path, NULL, 0);
+}
+
+static int usbg_client_unlink(void *priv, const char *path)
+{
+	return usbg_client_queue(priv, USBG_SHM_OP_UNLINK, path, NULL, 0);
+}
+
+static int usbg_client_symlink(void *priv, const char *target,
+			       const char *path)
+{
+	return usbg_client_queue(priv, USBG_SHM_OP_SYMLINK, path, target,
+				 strlen(target) + 1);
+}
+
+static void usbg_client_release(void *priv)
+{
+	struct usbg_client *c = priv;
+
+	if (c->shm)
+		munmap((void *)c->shm, c->size);
+	if (c->fd >= 0)
+		close(c->fd);
+
+	pthread_mutex_destroy(&c->lock);
+	free(c->batch);
+	free(c);
+}
+
+static const usbg_backend_ops usbg_client_ops = {
+	.read = usbg_client_read,
+	.write = usbg_client_write,
+	.mkdir = usbg_client_mkdir,
+	.rmdir = usbg_client_rmdir,
+	.unlink = usbg_client_unlink,
+	.symlink = usbg_client_symlink,
+	.readlink = usbg_client_readlink,
+	.scandir = usbg_client_scandir,
+	.check_dir = usbg_client_check_dir,
+	.release = usbg_client_release,
+};
+
+static int usbg_client_connect(struct usbg_client *c, const char *socket_path)
+{
+	struct sockaddr_un addr;
+	struct usbg_shm_hello hello;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cm;
+	void *shm;
+	int shm_fd;
+	ssize_t len;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return USBG_ERROR_PATH_TOO_LONG;
+	strcpy(addr.sun_path, socket_path);
+
+	c->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (c->fd < 0
+	    || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		ERRORNO(NULL, "couldn't connect to %s", socket_path);
+		return usbg_translate_error(errno);
+	}
+
+	do {
+		len = recvmsg(c->fd, &mh, MSG_CMSG_CLOEXEC);
+	} while (len < 0 && errno == EINTR);
+
+	cm = len == sizeof(hello) ? CMSG_FIRSTHDR(&mh) : NULL;
+	if (!cm || cm->cmsg_type != SCM_RIGHTS
+	    || cm->cmsg_len != CMSG_LEN(sizeof(int))) {
+		ERROR(NULL, "invalid greeting from daemon");
+		return USBG_ERROR_OTHER_ERROR;
+	}
+
+	memcpy(&shm_fd, CMSG_DATA(cm), sizeof(int));
+	if (hello.magic != USBG_SHM_MAGIC || hello.version != USBG_SHM_VERSION
+	    || hello.size < sizeof(struct usbg_shm_hdr)) {
+		ERROR(NULL, "unsupported daemon protocol");
+		close(shm_fd);
+		return USBG_ERROR_OTHER_ERROR;
+	}
+
+	shm = mmap(NULL, hello.size, PROT_READ, MAP_SHARED, shm_fd, 0);
+	close(shm_fd);
+	if (shm == MAP_FAILED) {
+		ERRORNO(NULL, "couldn't map shared memory");
+		return usbg_translate_error(errno);
+	}
+
+	c->shm = shm;
+	c->size = hello.size;
+
+	return USBG_SUCCESS;
+}
+
+int usbg_backend_client_create(const char *socket_path, usbg_backend **b)
+{
+	struct usbg_client *c;
+	int ret = USBG_ERROR_NO_MEM;
+
+	if (!socket_path || !b)
+		return USBG_ERROR_INVALID_PARAM;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		goto out;
+
+	c->fd = -1;
+	c->batch_len = sizeof(c->batch_ops);
+	c->batch = malloc(USBG_SHM_MAX_MSG);
+	if (!c->batch || pthread_mutex_init(&c->lock, NULL)) {
+		free(c->batch);
+		free(c);
+		goto out;
+	}
+
+	ret = usbg_client_connect(c, socket_path);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_backend_create(&usbg_client_ops, c, b);
+
+	if (ret != USBG_SUCCESS)
+		usbg_client_release(c);
+out:
+	return ret;
+}
+
+int usbg_backend_client_batch_begin(usbg_backend *b)
+{
+	struct usbg_client *c = usbg_backend_priv(b, &usbg_client_ops);
+
+	if (!c)
+		return USBG_ERROR_INVALID_PARAM;
+
+	pthread_mutex_lock(&c->lock);
+	c->batching = 1;
+	pthread_mutex_unlock(&c->lock);
+
+	return USBG_SUCCESS;
+}
+
+int usbg_backend_client_batch_end(usbg_backend *b)
+{
+	struct usbg_client *c = usbg_backend_priv(b, &usbg_client_ops);
+	int ret;
+
+	if (!c)
+		return USBG_ERROR_INVALID_PARAM;
+
+	pthread_mutex_lock(&c->lock);
+	ret = usbg_client_flush(c);
+	if (c->batch_err)
+		ret = c->batch_err;
+	c->batch_err = 0;
+	c->batching = 0;
+	pthread_mutex_unlock(&c->lock);
+
+	return ret ? usbg_translate_error(-ret) : USBG_SUCCESS;
+}
@@ -0,0 +1,1480 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_backend.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_backend_mem.c
+ * @brief In-memory emulation of usb_gadget configfs subsystem
+ */
+
+#define USBG_MEM_UDC_CLASS "/sys/class/udc"
+#define USBG_MEM_NET_CLASS "/sys/class/net"
+#define USBG_MEM_ATTR_SIZE 4096
+
+enum usbg_mem_type {
+	USBG_MEM_DIR,
+	USBG_MEM_FILE,
+	USBG_MEM_LINK,
+};
+
+/* Decides what mkdir() inside of directory creates */
+enum usbg_mem_kind {
+	USBG_MEM_PLAIN,
+	USBG_MEM_GADGETS,
+	USBG_MEM_GADGET,
+	USBG_MEM_GADGET_STRS,
+	USBG_MEM_CONFIGS,
+	USBG_MEM_CONFIG,
+	USBG_MEM_CONFIG_STRS,
+	USBG_MEM_FUNCTIONS,
+	USBG_MEM_FUNCTION,
+	USBG_MEM_FUNCTION_GROUP,
+	USBG_MEM_FUNCTION_ITEM,
+	USBG_MEM_LANG,
+	USBG_MEM_UDC_DIR,
+	USBG_MEM_OS_DESC,
+	USBG_MEM_OS_DESC_INTERFACE,
+	USBG_MEM_EXT_PROP,
+};
+
+struct usbg_mem_node
+{
+	char *name;
+	enum usbg_mem_type type;
+	enum usbg_mem_kind kind;
+	/* Created by user, not by configfs itself */
+	int user;
+	int read_only;
+	/* Content is kept as written, without adding or stripping '\n' */
+	int binary;
+	/* Value of attribute without trailing '\n' or target of link */
+	char *data;
+	size_t len;
+
+	struct usbg_mem_node *parent;
+	TAILQ_ENTRY(usbg_mem_node) node;
+	TAILQ_HEAD(usbg_mem_head, usbg_mem_node) children;
+};
+
+struct usbg_mem
+{
+	pthread_mutex_t lock;
+	struct usbg_mem_node *root;
+	struct usbg_mem_node *udcs;
+	struct usbg_mem_node *netdevs;
+	int port_num;
+	int mac_num;
+	int hid_num;
+	int net_num;
+};
+
+struct usbg_mem_attr
+{
+	const char *name;
+	const char *value;
+	int read_only;
+	int binary;
+};
+
+static const struct usbg_mem_attr usbg_mem_gadget_attrs[] = {
+	{ "bcdUSB", "0x0200" },
+	{ "bDeviceClass", "0x00" },
+	{ "bDeviceSubClass", "0x00" },
+	{ "bDeviceProtocol", "0x00" },
+	{ "bMaxPacketSize0", "0x40" },
+	{ "idVendor", "0x0000" },
+	{ "idProduct", "0x0000" },
+	{ "bcdDevice", "0x0000" },
+	{ "max_speed", "super-speed-plus" },
+	{ "UDC", "" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_os_desc_attrs[] = {
+	{ "use", "0" },
+	{ "b_vendor_code", "0x00" },
+	{ "qw_sign", "" },
+	{ NULL },
+};
+
+/* IDs are returned as all 8 bytes, without new line */
+static const struct usbg_mem_attr usbg_mem_os_desc_interface_attrs[] = {
+	{ "compatible_id", "", 0, 1 },
+	{ "sub_compatible_id", "", 0, 1 },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_ext_prop_attrs[] = {
+	{ "type", "0" },
+	{ "data", "", 0, 1 },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_gadget_str_attrs[] = {
+	{ "serialnumber", "" },
+	{ "manufacturer", "" },
+	{ "product", "" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_config_attrs[] = {
+	{ "MaxPower", "2" },
+	{ "bmAttributes", "0x80" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_config_str_attrs[] = {
+	{ "configuration", "" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_no_attrs[] = {
+	{ NULL },
+};
+
+/*
+ * Values generated per instance:
+ * %port - next serial port number, %mac - next locally administered
+ * MAC address, %hid - device number of next /dev/hidgN. Interface names
+ * are not assigned until function is bound.
+ */
+static const struct usbg_mem_attr usbg_mem_serial_attrs[] = {
+	{ "port_num", "%port", 1 },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_net_attrs[] = {
+	{ "dev_addr", "%mac" },
+	{ "host_addr", "%mac" },
+	{ "ifname", "usb%d", 1 },
+	{ "qmult", "5" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_phonet_attrs[] = {
+	{ "ifname", "upnlink%d", 1 },
+	{ NULL },
+};
+
+/* Module parameter defaults of g_zero */
+static const struct usbg_mem_attr usbg_mem_loopback_attrs[] = {
+	{ "bulk_buflen", "4096" },
+	{ "qlen", "32" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_sourcesink_attrs[] = {
+	{ "bulk_buflen", "4096" },
+	{ "bulk_qlen", "32" },
+	{ "iso_qlen", "8" },
+	{ "isoc_interval", "4" },
+	{ "isoc_maxburst", "0" },
+	{ "isoc_maxpacket", "1024" },
+	{ "isoc_mult", "0" },
+	{ "pattern", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_ms_attrs[] = {
+	{ "stall", "1" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_ms_lun_attrs[] = {
+	{ "cdrom", "0" },
+	{ "file", "" },
+	{ "forced_eject", "" },
+	{ "nofua", "0" },
+	{ "removable", "1" },
+	{ "ro", "0" },
+	{ NULL },
+};
+
+/* Defaults of f_uvc for 640x360 YUY2 frame at 15 fps */
+static const struct usbg_mem_attr usbg_mem_uvc_attrs[] = {
+	{ "streaming_interval", "1" },
+	{ "streaming_maxburst", "0" },
+	{ "streaming_maxpacket", "1024" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_interface_attrs[] = {
+	{ "bInterfaceNumber", "0", 1 },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_control_header_attrs[] = {
+	{ "bcdUVC", "0x0100" },
+	{ "dwClockFrequency", "48000000" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_streaming_header_attrs[] = {
+	{ "bStillCaptureMethod", "0" },
+	{ "bTerminalLink", "0" },
+	{ "bTriggerSupport", "0" },
+	{ "bTriggerUsage", "0" },
+	{ "bmInfo", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_uncompressed_attrs[] = {
+	{ "bAspectRatioX", "0" },
+	{ "bAspectRatioY", "0" },
+	{ "bBitsPerPixel", "16" },
+	{ "bDefaultFrameIndex", "1" },
+	{ "bmInterfaceFlags", "0" },
+	{ "bmaControls", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_mjpeg_attrs[] = {
+	{ "bAspectRatioX", "0" },
+	{ "bAspectRatioY", "0" },
+	{ "bDefaultFrameIndex", "1" },
+	{ "bmFlags", "0" },
+	{ "bmInterfaceFlags", "0" },
+	{ "bmaControls", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uvc_frame_attrs[] = {
+	{ "bFrameIndex", "1", 1 },
+	{ "bmCapabilities", "0" },
+	{ "dwDefaultFrameInterval", "666666" },
+	{ "dwFrameInterval", "666666" },
+	{ "dwMaxBitRate", "18432000" },
+	{ "dwMaxVideoFrameBufferSize", "460800" },
+	{ "dwMinBitRate", "18432000" },
+	{ "wHeight", "360" },
+	{ "wWidth", "640" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uac2_attrs[] = {
+	{ "c_chmask", "3" },
+	{ "c_srate", "64000" },
+	{ "c_ssize", "2" },
+	{ "c_sync", "async" },
+	{ "fb_max", "5" },
+	{ "p_chmask", "3" },
+	{ "p_srate", "48000" },
+	{ "p_ssize", "2" },
+	{ "req_number", "2" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_uac1_attrs[] = {
+	{ "c_chmask", "3" },
+	{ "c_srate", "48000" },
+	{ "c_ssize", "2" },
+	{ "p_chmask", "3" },
+	{ "p_srate", "48000" },
+	{ "p_ssize", "2" },
+	{ "req_number", "2" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_hid_attrs[] = {
+	{ "dev", "%hid", 1 },
+	{ "interval", "4" },
+	{ "protocol", "0" },
+	{ "report_desc", "", 0, 1 },
+	{ "report_length", "0" },
+	{ "subclass", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_printer_attrs[] = {
+	{ "pnp_string", "" },
+	{ "q_len", "10" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_midi_attrs[] = {
+	{ "buflen", "512" },
+	{ "id", "" },
+	{ "in_ports", "1" },
+	{ "index", "-1" },
+	{ "out_ports", "1" },
+	{ "qlen", "32" },
+	{ NULL },
+};
+
+/* Interface of bound network function, queue attributes are separate */
+static const struct usbg_mem_attr usbg_mem_netdev_attrs[] = {
+	{ "gro_flush_timeout", "0" },
+	{ "napi_defer_hard_irqs", "0" },
+	{ "tx_queue_len", "1000" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_rx_queue_attrs[] = {
+	{ "rps_cpus", "0" },
+	{ NULL },
+};
+
+static const struct usbg_mem_attr usbg_mem_tx_queue_attrs[] = {
+	{ "xps_cpus", "0" },
+	{ NULL },
+};
+
+/* maximum_speed is writable, so slower controllers can be emulated */
+static const struct usbg_mem_attr usbg_mem_udc_attrs[] = {
+	{ "current_speed", "UNKNOWN", 1 },
+	{ "maximum_speed", "high-speed" },
+	{ "state", "not attached", 1 },
+	{ NULL },
+};
+
+static int usbg_mem_ms_populate(struct usbg_mem *m, struct usbg_mem_node *dir);
+static int usbg_mem_ms_populate_item(struct usbg_mem *m,
+				     struct usbg_mem_node *dir);
+static int usbg_mem_uvc_populate(struct usbg_mem *m,
+				 struct usbg_mem_node *dir);
+static int usbg_mem_os_desc_populate(struct usbg_mem *m,
+				     struct usbg_mem_node *dir);
+static int usbg_mem_uvc_populate_item(struct usbg_mem *m,
+				      struct usbg_mem_node *dir);
+
+/*
+ * populate adds default groups of new instance, populate_item fills
+ * directory created by user inside of it. Functions without the latter
+ * don't allow mkdir.
+ */
+static const struct usbg_mem_function {
+	const char *name;
+	const struct usbg_mem_attr *attrs;
+	int (*populate)(struct usbg_mem *m, struct usbg_mem_node *dir);
+	int (*populate_item)(struct usbg_mem *m, struct usbg_mem_node *dir);
+} usbg_mem_functions[] = {
+	{ "gser", usbg_mem_serial_attrs },
+	{ "acm", usbg_mem_serial_attrs },
+	{ "obex", usbg_mem_serial_attrs },
+	{ "ecm", usbg_mem_net_attrs },
+	{ "geth", usbg_mem_net_attrs },
+	{ "ncm", usbg_mem_net_attrs, usbg_mem_os_desc_populate },
+	{ "eem", usbg_mem_net_attrs },
+	{ "rndis", usbg_mem_net_attrs, usbg_mem_os_desc_populate },
+	{ "phonet", usbg_mem_phonet_attrs },
+	{ "ffs", usbg_mem_no_attrs },
+	{ "Loopback", usbg_mem_loopback_attrs },
+	{ "SourceSink", usbg_mem_sourcesink_attrs },
+	{ "mass_storage", usbg_mem_ms_attrs, usbg_mem_ms_populate,
+	  usbg_mem_ms_populate_item },
+	{ "uvc", usbg_mem_uvc_attrs, usbg_mem_uvc_populate,
+	  usbg_mem_uvc_populate_item },
+	{ "uac2", usbg_mem_uac2_attrs },
+	{ "uac1", usbg_mem_uac1_attrs },
+	{ "hid", usbg_mem_hid_attrs },
+	{ "printer", usbg_mem_printer_attrs },
+	{ "midi", usbg_mem_midi_attrs },
+};
+
+static const usbg_backend_ops usbg_mem_ops;
+
+static struct usbg_mem_node *usbg_mem_alloc_node(const char *name,
+		size_t len, enum usbg_mem_type type, enum usbg_mem_kind kind)
+{
+	struct usbg_mem_node *n;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return NULL;
+
+	n->name = strndup(name, len);
+	if (!n->name) {
+		free(n);
+		return NULL;
+	}
+
+	n->type = type;
+	n->kind = kind;
+	TAILQ_INIT(&n->children);
+
+	return n;
+}
+
+static void usbg_mem_free_node(struct usbg_mem_node *n)
+{
+	struct usbg_mem_node *c;
+
+	while ((c = TAILQ_FIRST(&n->children))) {
+		TAILQ_REMOVE(&n->children, c, node);
+		usbg_mem_free_node(c);
+	}
+
+	free(n->name);
+	free(n->data);
+	free(n);
+}
+
+/* Children are kept sorted to give scandir() order for free */
+static void usbg_mem_link_node(struct usbg_mem_node *dir,
+			       struct usbg_mem_node *n)
+{
+	struct usbg_mem_node *c;
+
+	n->parent = dir;
+	TAILQ_FOREACH(c, &dir->children, node) {
+		if (strcmp(n->name, c->name) < 0) {
+			TAILQ_INSERT_BEFORE(c, n, node);
+			return;
+		}
+	}
+
+	TAILQ_INSERT_TAIL(&dir->children, n, node);
+}
+
+static struct usbg_mem_node *usbg_mem_child(struct usbg_mem_node *dir,
+					    const char *name, size_t len)
+{
+	struct usbg_mem_node *c;
+
+	TAILQ_FOREACH(c, &dir->children, node)
+		if (strlen(c->name) == len && !strncmp(c->name, name, len))
+			return c;
+
+	return NULL;
+}
+
+/*
+ * Find node of given path. If last is not NULL, parent directory is
+ * returned instead and last is set to last component of path.
+ */
+static int usbg_mem_lookup(struct usbg_mem *m, const char *path,
+			   struct usbg_mem_node **res, const char **last)
+{
+	struct usbg_mem_node *n = m->root;
+	const char *p = path;
+	const char *end;
+	size_t len;
+
+	if (*p != '/')
+		return -EINVAL;
+
+	if (last)
+		*last = NULL;
+
+	for (;;) {
+		while (*p == '/')
+			++p;
+
+		end = strchrnul(p, '/');
+		len = end - p;
+
+		if (len == 0)
+			break;
+
+		if (len == 1 && *p == '.') {
+			p = end;
+			continue;
+		}
+
+		if (last && end[strspn(end, "/")] == '\0') {
+			if (len >= sizeof(((struct dirent *)0)->d_name))
+				return -ENAMETOOLONG;
+			*last = p;
+			break;
+		}
+
+		if (n->type != USBG_MEM_DIR)
+			return -ENOTDIR;
+
+		n = usbg_mem_child(n, p, len);
+		if (!n)
+			return -ENOENT;
+
+		p = end;
+	}
+
+	if (last && !*last)
+		return -EEXIST;
+
+	if (last && n->type != USBG_MEM_DIR)
+		return -ENOTDIR;
+
+	*res = n;
+	return 0;
+}
+
+static int usbg_mem_set_data(struct usbg_mem_node *n, const char *buf,
+			     size_t len)
+{
+	char *data;
+
+	/* configfs attributes are stored without trailing new line */
+	if (!n->binary && len && buf[len - 1] == '\n')
+		--len;
+
+	data = malloc(len + 1);
+	if (!data)
+		return -ENOMEM;
+
+	memcpy(data, buf, len);
+	data[len] = '\0';
+	free(n->data);
+	n->data = data;
+	n->len = n->binary ? len : strlen(data);
+	return 0;
+}
+
+static struct usbg_mem_node *usbg_mem_add_dir(struct usbg_mem_node *dir,
+		const char *name, enum usbg_mem_kind kind)
+{
+	struct usbg_mem_node *n;
+
+	n = usbg_mem_alloc_node(name, strlen(name), USBG_MEM_DIR, kind);
+	if (n)
+		usbg_mem_link_node(dir, n);
+
+	return n;
+}
+
+static int usbg_mem_add_attrs(struct usbg_mem *m, struct usbg_mem_node *dir,
+			      const struct usbg_mem_attr *attrs)
+{
+	struct usbg_mem_node *n;
+	char val[USBG_MAX_STR_LENGTH];
+	int ret = 0;
+
+	for (; attrs->name && ret == 0; ++attrs) {
+		if (!strcmp(attrs->value, "%port")) {
+			snprintf(val, sizeof(val), "%d", m->port_num++);
+		} else if (!strcmp(attrs->value, "%mac")) {
+			snprintf(val, sizeof(val), "02:00:00:%02x:%02x:%02x",
+				 (m->mac_num >> 16) & 0xff,
+				 (m->mac_num >> 8) & 0xff, m->mac_num & 0xff);
+			++m->mac_num;
+		} else if (!strcmp(attrs->value, "%hid")) {
+			/* Major is allocated dynamically, usually this one */
+			snprintf(val, sizeof(val), "245:%d", m->hid_num++);
+		} else {
+			snprintf(val, sizeof(val), "%s", attrs->value);
+		}
+
+		n = usbg_mem_alloc_node(attrs->name, strlen(attrs->name),
+					USBG_MEM_FILE, USBG_MEM_PLAIN);
+		if (!n)
+			return -ENOMEM;
+
+		n->read_only = attrs->read_only;
+		n->binary = attrs->binary;
+		ret = usbg_mem_set_data(n, val, strlen(val));
+		usbg_mem_link_node(dir, n);
+	}
+
+	return ret;
+}
+
+/* Lookup function type by name of instance directory */
+static const struct usbg_mem_function *usbg_mem_function(
+		struct usbg_mem_node *dir)
+{
+	const char *dot;
+	int i;
+
+	dot = strchr(dir->name, '.');
+	if (!dot || dot == dir->name || !dot[1])
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(usbg_mem_functions); ++i) {
+		if (strlen(usbg_mem_functions[i].name) == dot - dir->name &&
+		    !strncmp(usbg_mem_functions[i].name, dir->name,
+			     dot - dir->name))
+			return usbg_mem_functions + i;
+	}
+
+	return NULL;
+}
+
+/* Instance directory containing given node or NULL */
+static struct usbg_mem_node *usbg_mem_function_dir(struct usbg_mem_node *n)
+{
+	for (; n; n = n->parent)
+		if (n->kind == USBG_MEM_FUNCTION)
+			return n;
+
+	return NULL;
+}
+
+/* Logical unit 0 always exists, others are created with mkdir lun.N */
+static int usbg_mem_ms_populate(struct usbg_mem *m, struct usbg_mem_node *dir)
+{
+	struct usbg_mem_node *n;
+
+	n = usbg_mem_add_dir(dir, "lun.0", USBG_MEM_PLAIN);
+	return n ? usbg_mem_add_attrs(m, n, usbg_mem_ms_lun_attrs) : -ENOMEM;
+}
+
+static int usbg_mem_ms_populate_item(struct usbg_mem *m,
+				     struct usbg_mem_node *dir)
+{
+	int lun, end = 0;
+
+	if (dir->parent->kind != USBG_MEM_FUNCTION)
+		return -EPERM;
+
+	if (sscanf(dir->name, "lun.%d%n", &lun, &end) != 1 || dir->name[end]
+	    || lun < 1 || lun >= USBG_MAX_MS_LUNS)
+		return -EINVAL;
+
+	return usbg_mem_add_attrs(m, dir, usbg_mem_ms_lun_attrs);
+}
+
+/* Create path of default groups below dir, last one gets given kind */
+static struct usbg_mem_node *usbg_mem_add_dirs(struct usbg_mem_node *dir,
+		const char *path, enum usbg_mem_kind kind)
+{
+	char buf[USBG_MAX_NAME_LENGTH];
+	struct usbg_mem_node *n;
+	char *name, *saveptr;
+
+	snprintf(buf, sizeof(buf), "%s", path);
+	for (name = strtok_r(buf, "/", &saveptr); name && dir;
+	     name = strtok_r(NULL, "/", &saveptr)) {
+		n = usbg_mem_child(dir, name, strlen(name));
+		dir = n ? n : usbg_mem_add_dir(dir, name, USBG_MEM_PLAIN);
+	}
+
+	if (dir)
+		dir->kind = kind;
+
+	return dir;
+}
+
+/* f_rndis and f_ncm have single interface named after function */
+static int usbg_mem_os_desc_populate(struct usbg_mem *m,
+				     struct usbg_mem_node *dir)
+{
+	char path[USBG_MAX_NAME_LENGTH];
+	struct usbg_mem_node *n;
+
+	snprintf(path, sizeof(path), "os_desc/interface.%s",
+		 usbg_mem_function(dir)->name);
+	n = usbg_mem_add_dirs(dir, path, USBG_MEM_OS_DESC_INTERFACE);
+	return n ? usbg_mem_add_attrs(m, n, usbg_mem_os_desc_interface_attrs)
+		: -ENOMEM;
+}
+
+/* Frames are indexed in order of creation, children are sorted by name */
+static int usbg_mem_uvc_add_frame(struct usbg_mem *m,
+				  struct usbg_mem_node *dir)
+{
+	struct usbg_mem_node *c, *attr;
+	char val[USBG_MAX_STR_LENGTH];
+	int index = 0;
+	int ret;
+
+	TAILQ_FOREACH(c, &dir->parent->children, node) {
+		if (c == dir || c->type != USBG_MEM_DIR)
+			continue;
+
+		attr = usbg_mem_child(c, "bFrameIndex", strlen("bFrameIndex"));
+		if (attr && atoi(attr->data) > index)
+			index = atoi(attr->data);
+	}
+
+	ret = usbg_mem_add_attrs(m, dir, usbg_mem_uvc_frame_attrs);
+	if (ret)
+		return ret;
+
+	attr = usbg_mem_child(dir, "bFrameIndex", strlen("bFrameIndex"));
+	snprintf(val, sizeof(val), "%d", index + 1);
+	return usbg_mem_set_data(attr, val, strlen(val));
+}
+
+static int usbg_mem_int_cmp(const void *a, const void *b)
+{
+	long va = *(const long *)a, vb = *(const long *)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+/* Like kernel, store frame intervals sorted in ascending order */
+static int usbg_mem_sort_intervals(const char *buf, size_t len,
+				   char *out, size_t size)
+{
+	long vals[USBG_MEM_ATTR_SIZE / 2];
+	char tmp[USBG_MEM_ATTR_SIZE + 1];
+	char *p, *end;
+	int i, n = 0, off = 0;
+
+	memcpy(tmp, buf, len);
+	tmp[len] = '\0';
+
+	for (p = tmp; n < ARRAY_SIZE(vals); p = end) {
+		vals[n] = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		++n;
+	}
+
+	qsort(vals, n, sizeof(vals[0]), usbg_mem_int_cmp);
+	for (i = 0; i < n && off < size; ++i)
+		off += snprintf(out + off, size - off, "%ld\n", vals[i]);
+
+	return off < size ? off : -EINVAL;
+}
+
+/* Default groups of f_uvc, items are created only in groups */
+static int usbg_mem_uvc_populate(struct usbg_mem *m,
+				 struct usbg_mem_node *dir)
+{
+	static const struct {
+		const char *path;
+		enum usbg_mem_kind kind;
+	} groups[] = {
+		{ "control/header", USBG_MEM_FUNCTION_GROUP },
+		{ "control/class/fs", USBG_MEM_PLAIN },
+		{ "control/class/ss", USBG_MEM_PLAIN },
+		{ "control/terminal/camera/default", USBG_MEM_PLAIN },
+		{ "control/terminal/output/default", USBG_MEM_PLAIN },
+		{ "control/processing/default", USBG_MEM_PLAIN },
+		{ "streaming/header", USBG_MEM_FUNCTION_GROUP },
+		{ "streaming/uncompressed", USBG_MEM_FUNCTION_GROUP },
+		{ "streaming/mjpeg", USBG_MEM_FUNCTION_GROUP },
+		{ "streaming/color_matching/default", USBG_MEM_PLAIN },
+		{ "streaming/class/fs", USBG_MEM_PLAIN },
+		{ "streaming/class/hs", USBG_MEM_PLAIN },
+		{ "streaming/class/ss", USBG_MEM_PLAIN },
+	};
+	struct usbg_mem_node *n;
+	int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(groups); ++i)
+		if (!usbg_mem_add_dirs(dir, groups[i].path, groups[i].kind))
+			return -ENOMEM;
+
+	n = usbg_mem_child(dir, "control", strlen("control"));
+	ret = usbg_mem_add_attrs(m, n, usbg_mem_uvc_interface_attrs);
+	if (ret == 0) {
+		n = usbg_mem_child(dir, "streaming", strlen("streaming"));
+		ret = usbg_mem_add_attrs(m, n, usbg_mem_uvc_interface_attrs);
+	}
+
+	return ret;
+}
+
+static int usbg_mem_uvc_populate_item(struct usbg_mem *m,
+				      struct usbg_mem_node *dir)
+{
+	struct usbg_mem_node *p = dir->parent;
+	const struct usbg_mem_attr *attrs = NULL;
+
+	if (p->kind == USBG_MEM_FUNCTION_GROUP) {
+		/* Header, format or frame depending on group */
+		if (!strcmp(p->name, "uncompressed"))
+			attrs = usbg_mem_uvc_uncompressed_attrs;
+		else if (!strcmp(p->name, "mjpeg"))
+			attrs = usbg_mem_uvc_mjpeg_attrs;
+		else if (!strcmp(p->parent->name, "control"))
+			attrs = usbg_mem_uvc_control_header_attrs;
+		else
+			attrs = usbg_mem_uvc_streaming_header_attrs;
+	} else if (p->kind == USBG_MEM_FUNCTION_ITEM &&
+		   (!strcmp(p->parent->name, "uncompressed") ||
+		    !strcmp(p->parent->name, "mjpeg"))) {
+		return usbg_mem_uvc_add_frame(m, dir);
+	}
+
+	return attrs ? usbg_mem_add_attrs(m, dir, attrs) : -EPERM;
+}
+
+/* Populate directory just created by user like configfs would do */
+static int usbg_mem_populate(struct usbg_mem *m, struct usbg_mem_node *dir)
+{
+	const struct usbg_mem_function *func;
+	struct usbg_mem_node *n;
+	int ret;
+
+	switch (dir->kind) {
+	case USBG_MEM_GADGET:
+		ret = usbg_mem_add_attrs(m, dir, usbg_mem_gadget_attrs);
+		if (ret)
+			break;
+
+		ret = -ENOMEM;
+		if (!usbg_mem_add_dir(dir, "configs", USBG_MEM_CONFIGS)
+		    || !usbg_mem_add_dir(dir, "functions", USBG_MEM_FUNCTIONS)
+		    || !usbg_mem_add_dir(dir, "strings", USBG_MEM_GADGET_STRS))
+			break;
+
+		n = usbg_mem_add_dir(dir, "os_desc", USBG_MEM_OS_DESC);
+		ret = n ? usbg_mem_add_attrs(m, n, usbg_mem_os_desc_attrs)
+			: -ENOMEM;
+		break;
+	case USBG_MEM_CONFIG:
+		ret = usbg_mem_add_attrs(m, dir, usbg_mem_config_attrs);
+		if (ret == 0 && !usbg_mem_add_dir(dir, "strings",
+						  USBG_MEM_CONFIG_STRS))
+			ret = -ENOMEM;
+		break;
+	case USBG_MEM_LANG:
+		ret = usbg_mem_add_attrs(m, dir,
+					 dir->parent->kind == USBG_MEM_CONFIG_STRS
+					 ? usbg_mem_config_str_attrs
+					 : usbg_mem_gadget_str_attrs);
+		break;
+	case USBG_MEM_FUNCTION:
+		/* Function not known to configfs cannot be created */
+		func = usbg_mem_function(dir);
+		if (!func) {
+			ret = -ENOENT;
+			break;
+		}
+
+		ret = usbg_mem_add_attrs(m, dir, func->attrs);
+		if (ret == 0 && func->populate)
+			ret = func->populate(m, dir);
+		break;
+	case USBG_MEM_EXT_PROP:
+		ret = usbg_mem_add_attrs(m, dir, usbg_mem_ext_prop_attrs);
+		break;
+	case USBG_MEM_FUNCTION_ITEM:
+		func = usbg_mem_function(usbg_mem_function_dir(dir->parent));
+		ret = func && func->populate_item ?
+			func->populate_item(m, dir) : -EPERM;
+		break;
+	default:
+		ret = 0;
+	}
+
+	return ret;
+}
+
+/* Whether directory may be removed: only configfs created items inside */
+static int usbg_mem_removable(struct usbg_mem_node *dir)
+{
+	struct usbg_mem_node *c;
+	int ret = 0;
+
+	TAILQ_FOREACH(c, &dir->children, node) {
+		if (c->user)
+			return -ENOTEMPTY;
+		if (c->type == USBG_MEM_DIR) {
+			ret = usbg_mem_removable(c);
+			if (ret)
+				break;
+		}
+	}
+
+	return ret;
+}
+
+static int usbg_mem_read(void *priv, const char *path, char *buf, size_t len)
+{
+	struct usbg_mem_node *n;
+	size_t dlen;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret;
+
+	if (n->type == USBG_MEM_DIR)
+		return -EISDIR;
+
+	if (n->type != USBG_MEM_FILE)
+		return -EINVAL;
+
+	/* Binary attributes are read as written */
+	dlen = n->len;
+	if (len > dlen + !n->binary)
+		len = dlen + !n->binary;
+
+	memcpy(buf, n->data, len > dlen ? dlen : len);
+	if (len > dlen)
+		buf[dlen] = '\n';
+
+	return len;
+}
+
+static int usbg_mem_check_udc(struct usbg_mem *m, struct usbg_mem_node *attr,
+			      const char *buf, size_t len)
+{
+	struct usbg_mem_node *g, *udc;
+
+	if (len && buf[len - 1] == '\n')
+		--len;
+
+	/* Empty value unbinds gadget */
+	if (!len)
+		return 0;
+
+	if (!usbg_mem_child(m->udcs, buf, len))
+		return -ENODEV;
+
+	TAILQ_FOREACH(g, &attr->parent->parent->children, node) {
+		udc = usbg_mem_child(g, "UDC", 3);
+		if (udc && udc != attr && strlen(udc->data) == len &&
+		    !strncmp(udc->data, buf, len))
+			return -EBUSY;
+	}
+
+	return 0;
+}
+
+/*
+ * Like u_ether, register interface of each network function in
+ * configuration when gadget is bound for the first time. It stays
+ * registered, so names of removed functions are not reused.
+ */
+static int usbg_mem_add_netdev(struct usbg_mem *m, struct usbg_mem_node *f)
+{
+	struct usbg_mem_node *ifname, *dev, *q;
+	char name[USBG_MAX_NAME_LENGTH];
+	const struct usbg_mem_function *type;
+	int ret;
+
+	type = usbg_mem_function(f);
+	ifname = usbg_mem_child(f, "ifname", 6);
+	if (!type || type->attrs != usbg_mem_net_attrs || !ifname
+	    || !strchr(ifname->data, '%'))
+		return 0;
+
+	snprintf(name, sizeof(name), "usb%d", m->net_num++);
+	ret = usbg_mem_set_data(ifname, name, strlen(name));
+	if (ret)
+		return ret;
+
+	dev = usbg_mem_add_dir(m->netdevs, name, USBG_MEM_PLAIN);
+	if (!dev)
+		return -ENOMEM;
+
+	ret = usbg_mem_add_attrs(m, dev, usbg_mem_netdev_attrs);
+	if (ret)
+		return ret;
+
+	q = usbg_mem_add_dirs(dev, "queues/rx-0", USBG_MEM_PLAIN);
+	ret = q ? usbg_mem_add_attrs(m, q, usbg_mem_rx_queue_attrs) : -ENOMEM;
+	if (ret)
+		return ret;
+
+	q = usbg_mem_add_dirs(dev, "queues/tx-0", USBG_MEM_PLAIN);
+	return q ? usbg_mem_add_attrs(m, q, usbg_mem_tx_queue_attrs) : -ENOMEM;
+}
+
+/* There is no host, so device gets configured as soon as it is bound */
+static void usbg_mem_set_udc_state(struct usbg_mem *m, const char *udc,
+				   const char *state)
+{
+	struct usbg_mem_node *dir, *n;
+
+	dir = usbg_mem_child(m->udcs, udc, strlen(udc));
+	n = dir ? usbg_mem_child(dir, "state", strlen("state")) : NULL;
+	if (n)
+		usbg_mem_set_data(n, state, strlen(state));
+}
+
+static int usbg_mem_bind(struct usbg_mem *m, struct usbg_mem_node *g)
+{
+	struct usbg_mem_node *configs, *functions, *c, *l, *f;
+	const char *name;
+	int ret = 0;
+
+	usbg_mem_set_udc_state(m, usbg_mem_child(g, "UDC", 3)->data,
+			       "configured");
+
+	configs = usbg_mem_child(g, "configs", 7);
+	functions = usbg_mem_child(g, "functions", 9);
+	if (!configs || !functions)
+		return 0;
+
+	TAILQ_FOREACH(c, &configs->children, node) {
+		TAILQ_FOREACH(l, &c->children, node) {
+			if (l->type != USBG_MEM_LINK)
+				continue;
+
+			name = strrchr(l->data, '/');
+			name = name ? name + 1 : l->data;
+			f = usbg_mem_child(functions, name, strlen(name));
+			if (f)
+				ret = usbg_mem_add_netdev(m, f);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int usbg_mem_write(void *priv, const char *path, const char *buf,
+			  size_t len)
+{
+	char sorted[USBG_MEM_ATTR_SIZE + 1];
+	struct usbg_mem_node *n, *lun_file;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret == -ENOENT ? -EACCES : ret;
+
+	if (n->type == USBG_MEM_DIR)
+		return -EISDIR;
+
+	if (n->type != USBG_MEM_FILE || n->read_only)
+		return -EACCES;
+
+	if (len > USBG_MEM_ATTR_SIZE)
+		return -EINVAL;
+
+	if (n->parent->kind == USBG_MEM_GADGET && !strcmp(n->name, "UDC")) {
+		ret = usbg_mem_check_udc(priv, n, buf, len);
+		if (ret)
+			return ret;
+
+		usbg_mem_set_udc_state(priv, n->data, "not attached");
+	}
+
+	/* Only units of mass storage have forced_eject */
+	lun_file = usbg_mem_child(n->parent, "forced_eject",
+				  strlen("forced_eject")) ?
+		usbg_mem_child(n->parent, "file", strlen("file")) : NULL;
+	if (lun_file && lun_file->len
+	    && (!strcmp(n->name, "ro") || !strcmp(n->name, "cdrom")))
+		return -EBUSY;
+
+	if (lun_file && !strcmp(n->name, "forced_eject")) {
+		ret = usbg_mem_set_data(lun_file, "", 0);
+		return ret ? ret : (int)len;
+	}
+
+	if (n->parent->kind == USBG_MEM_FUNCTION_ITEM
+	    && !strcmp(n->name, "dwFrameInterval")) {
+		ret = usbg_mem_sort_intervals(buf, len, sorted,
+					      sizeof(sorted));
+		if (ret < 0)
+			return ret;
+		ret = usbg_mem_set_data(n, sorted, ret);
+		return ret ? ret : (int)len;
+	}
+
+	/* Like kernel, drop the last new line or zero of property data */
+	if (n->parent->kind == USBG_MEM_EXT_PROP && !strcmp(n->name, "data")
+	    && len && (buf[len - 1] == '\n' || !buf[len - 1]))
+		--len;
+
+	ret = usbg_mem_set_data(n, buf, len);
+	if (!ret && n->parent->kind == USBG_MEM_GADGET
+	    && !strcmp(n->name, "UDC") && n->len)
+		ret = usbg_mem_bind(priv, n->parent);
+
+	return ret ? ret : (int)len;
+}
+
+static int usbg_mem_mkdir(void *priv, const char *path)
+{
+	static const enum usbg_mem_kind child_kind[] = {
+		[USBG_MEM_GADGETS] = USBG_MEM_GADGET,
+		[USBG_MEM_GADGET_STRS] = USBG_MEM_LANG,
+		[USBG_MEM_CONFIGS] = USBG_MEM_CONFIG,
+		[USBG_MEM_CONFIG_STRS] = USBG_MEM_LANG,
+		[USBG_MEM_FUNCTIONS] = USBG_MEM_FUNCTION,
+		[USBG_MEM_FUNCTION] = USBG_MEM_FUNCTION_ITEM,
+		[USBG_MEM_FUNCTION_GROUP] = USBG_MEM_FUNCTION_ITEM,
+		[USBG_MEM_FUNCTION_ITEM] = USBG_MEM_FUNCTION_ITEM,
+		[USBG_MEM_OS_DESC_INTERFACE] = USBG_MEM_EXT_PROP,
+	};
+	struct usbg_mem_node *dir, *n;
+	const char *name;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &dir, &name);
+	if (ret)
+		return ret;
+
+	if (usbg_mem_child(dir, name, strcspn(name, "/")))
+		return -EEXIST;
+
+	if (dir->kind >= ARRAY_SIZE(child_kind) || !child_kind[dir->kind])
+		return -EPERM;
+
+	n = usbg_mem_alloc_node(name, strcspn(name, "/"), USBG_MEM_DIR,
+				child_kind[dir->kind]);
+	if (!n)
+		return -ENOMEM;
+
+	n->user = 1;
+	n->parent = dir;
+	ret = usbg_mem_populate(priv, n);
+	if (ret) {
+		usbg_mem_free_node(n);
+		return ret;
+	}
+
+	usbg_mem_link_node(dir, n);
+	return 0;
+}
+
+static int usbg_mem_rmdir(void *priv, const char *path)
+{
+	struct usbg_mem_node *n;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret;
+
+	if (n->type != USBG_MEM_DIR)
+		return -ENOTDIR;
+
+	if (!n->user)
+		return -EPERM;
+
+	ret = usbg_mem_removable(n);
+	if (ret)
+		return ret;
+
+	TAILQ_REMOVE(&n->parent->children, n, node);
+	usbg_mem_free_node(n);
+	return 0;
+}
+
+static int usbg_mem_unlink(void *priv, const char *path)
+{
+	struct usbg_mem_node *n;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret;
+
+	if (n->type == USBG_MEM_DIR)
+		return -EISDIR;
+
+	/* Only links are created by user, attributes belong to configfs */
+	if (n->type != USBG_MEM_LINK)
+		return -EPERM;
+
+	TAILQ_REMOVE(&n->parent->children, n, node);
+	usbg_mem_free_node(n);
+	return 0;
+}
+
+static int usbg_mem_symlink(void *priv, const char *target, const char *path)
+{
+	struct usbg_mem_node *dir, *f, *n, *fdir;
+	const char *name;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &dir, &name);
+	if (ret)
+		return ret;
+
+	if (usbg_mem_child(dir, name, strcspn(name, "/")))
+		return -EEXIST;
+
+	ret = usbg_mem_lookup(priv, target, &f, NULL);
+	if (ret)
+		return ret;
+
+	/*
+	 * Bindings, configuration of OS descriptors and links between
+	 * items of function instance, like headers of f_uvc, are the only
+	 * ones allowed in usb_gadget.
+	 */
+	if (dir->kind == USBG_MEM_CONFIG) {
+		if (f->kind != USBG_MEM_FUNCTION
+		    || f->parent->parent != dir->parent->parent)
+			return -EPERM;
+	} else if (dir->kind == USBG_MEM_OS_DESC) {
+		if (f->kind != USBG_MEM_CONFIG
+		    || f->parent->parent != dir->parent)
+			return -EINVAL;
+
+		TAILQ_FOREACH(n, &dir->children, node)
+			if (n->type == USBG_MEM_LINK)
+				return -EBUSY;
+	} else {
+		fdir = usbg_mem_function_dir(dir);
+		if (!fdir || fdir == dir || fdir == f
+		    || usbg_mem_function_dir(f) != fdir
+		    || f->type != USBG_MEM_DIR)
+			return -EPERM;
+	}
+
+	n = usbg_mem_alloc_node(name, strcspn(name, "/"), USBG_MEM_LINK,
+				USBG_MEM_PLAIN);
+	if (!n)
+		return -ENOMEM;
+
+	n->data = strdup(target);
+	if (!n->data) {
+		usbg_mem_free_node(n);
+		return -ENOMEM;
+	}
+
+	n->user = 1;
+	usbg_mem_link_node(dir, n);
+	return 0;
+}
+
+static int usbg_mem_readlink(void *priv, const char *path, char *buf,
+			     size_t len)
+{
+	struct usbg_mem_node *n;
+	size_t dlen;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret;
+
+	if (n->type != USBG_MEM_LINK)
+		return -EINVAL;
+
+	dlen = strlen(n->data);
+	if (len > dlen)
+		len = dlen;
+
+	memcpy(buf, n->data, len);
+	return len;
+}
+
+static int usbg_mem_scandir(void *priv, const char *path,
+			    int (*filter)(const struct dirent *),
+			    struct dirent ***list)
+{
+	static const unsigned char dtypes[] = {
+		[USBG_MEM_DIR] = DT_DIR,
+		[USBG_MEM_FILE] = DT_REG,
+		[USBG_MEM_LINK] = DT_LNK,
+	};
+	struct usbg_mem_node *dir, *c;
+	struct dirent **dent, *d;
+	struct dirent tmp;
+	int i, n = 0;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &dir, NULL);
+	if (ret)
+		return ret;
+
+	if (dir->type != USBG_MEM_DIR)
+		return -ENOTDIR;
+
+	TAILQ_FOREACH(c, &dir->children, node)
+		++n;
+
+	dent = malloc((n ? n : 1) * sizeof(*dent));
+	if (!dent)
+		return -ENOMEM;
+
+	i = 0;
+	TAILQ_FOREACH(c, &dir->children, node) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.d_ino = (uintptr_t)c;
+		tmp.d_type = dtypes[c->type];
+		tmp.d_reclen = sizeof(tmp);
+		strncpy(tmp.d_name, c->name, sizeof(tmp.d_name) - 1);
+
+		if (filter && !filter(&tmp))
+			continue;
+
+		d = malloc(sizeof(*d));
+		if (!d) {
+			while (i--)
+				free(dent[i]);
+			free(dent);
+			return -ENOMEM;
+		}
+
+		*d = tmp;
+		dent[i++] = d;
+	}
+
+	*list = dent;
+	return i;
+}
+
+static int usbg_mem_check_dir(void *priv, const char *path)
+{
+	struct usbg_mem_node *n;
+	int ret;
+
+	ret = usbg_mem_lookup(priv, path, &n, NULL);
+	if (ret)
+		return ret;
+
+	return n->type == USBG_MEM_DIR ? 0 : -ENOTDIR;
+}
+
+static void usbg_mem_release(void *priv)
+{
+	struct usbg_mem *m = priv;
+
+	usbg_mem_free_node(m->root);
+	pthread_mutex_destroy(&m->lock);
+	free(m);
+}
+
+/* Whole tree is guarded by single mutex as library may be used by many
+ * threads at once */
+#define USBG_MEM_LOCKED_OP(op, proto, args) \
+	static int usbg_mem_locked_##op proto \
+	{ \
+		struct usbg_mem *m = priv; \
+		int ret; \
+		pthread_mutex_lock(&m->lock); \
+		ret = usbg_mem_##op args; \
+		pthread_mutex_unlock(&m->lock); \
+		return ret; \
+	}
+
+USBG_MEM_LOCKED_OP(read, (void *priv, const char *path, char *buf,
+			  size_t len), (priv, path, buf, len))
+USBG_MEM_LOCKED_OP(write, (void *priv, const char *path, const char *buf,
+			   size_t len), (priv, path, buf, len))
+USBG_MEM_LOCKED_OP(mkdir, (void *priv, const char *path), (priv, path))
+USBG_MEM_LOCKED_OP(rmdir, (void *priv, const char *path), (priv, path))
+USBG_MEM_LOCKED_OP(unlink, (void *priv, const char *path), (priv, path))
+USBG_MEM_LOCKED_OP(symlink, (void *priv, const char *target,
+			     const char *path), (priv, target, path))
+USBG_MEM_LOCKED_OP(readlink, (void *priv, const char *path, char *buf,
+			      size_t len), (priv, path, buf, len))
+USBG_MEM_LOCKED_OP(scandir, (void *priv, const char *path,
+			     int (*filter)(const struct dirent *),
+			     struct dirent ***list), (priv, path, filter, list))
+USBG_MEM_LOCKED_OP(check_dir, (void *priv, const char *path), (priv, path))
+
+static const usbg_backend_ops usbg_mem_ops = {
+	.read = usbg_mem_locked_read,
+	.write = usbg_mem_locked_write,
+	.mkdir = usbg_mem_locked_mkdir,
+	.rmdir = usbg_mem_locked_rmdir,
+	.unlink = usbg_mem_locked_unlink,
+	.symlink = usbg_mem_locked_symlink,
+	.readlink = usbg_mem_locked_readlink,
+	.scandir = usbg_mem_locked_scandir,
+	.check_dir = usbg_mem_locked_check_dir,
+	.release = usbg_mem_release,
+};
+
+/* Create all missing directories of path, last one gets given kind */
+static struct usbg_mem_node *usbg_mem_mkdir_p(struct usbg_mem *m,
+		const char *path, enum usbg_mem_kind kind)
+{
+	struct usbg_mem_node *n = m->root, *c;
+	const char *p = path, *end;
+
+	while (n) {
+		while (*p == '/')
+			++p;
+
+		if (!*p)
+			break;
+
+		end = strchrnul(p, '/');
+		c = usbg_mem_child(n, p, end - p);
+		if (!c) {
+			c = usbg_mem_alloc_node(p, end - p, USBG_MEM_DIR,
+						USBG_MEM_PLAIN);
+			if (!c)
+				return NULL;
+
+			usbg_mem_link_node(n, c);
+		}
+
+		n = c->type == USBG_MEM_DIR ? c : NULL;
+		p = end;
+	}
+
+	if (n)
+		n->kind = kind;
+
+	return n;
+}
+
+int usbg_backend_mem_create(const char *configfs_path, usbg_backend **b)
+{
+	struct usbg_mem *m;
+	char *path = NULL;
+	int ret = USBG_ERROR_NO_MEM;
+
+	if (!configfs_path || *configfs_path != '/' || !b)
+		return USBG_ERROR_INVALID_PARAM;
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		goto out;
+
+	if (pthread_mutex_init(&m->lock, NULL)) {
+		free(m);
+		goto out;
+	}
+
+	m->root = usbg_mem_alloc_node("", 0, USBG_MEM_DIR, USBG_MEM_PLAIN);
+	if (!m->root)
+		goto err;
+
+	if (asprintf(&path, "%s/usb_gadget", configfs_path) < 0) {
+		path = NULL;
+		goto err;
+	}
+
+	m->udcs = usbg_mem_mkdir_p(m, USBG_MEM_UDC_CLASS, USBG_MEM_UDC_DIR);
+	m->netdevs = usbg_mem_mkdir_p(m, USBG_MEM_NET_CLASS, USBG_MEM_PLAIN);
+	if (!m->udcs || !m->netdevs || !usbg_mem_mkdir_p(m, path,
+							  USBG_MEM_GADGETS))
+		goto err;
+
+	ret = usbg_backend_create(&usbg_mem_ops, m, b);
+	if (ret == USBG_SUCCESS)
+		goto out;
+
+err:
+	if (m->root)
+		usbg_mem_free_node(m->root);
+	pthread_mutex_destroy(&m->lock);
+	free(m);
+out:
+	free(path);
+	return ret;
+}
+
+int usbg_backend_mem_add_udc(usbg_backend *b, const char *name)
+{
+	struct usbg_mem *m;
+	struct usbg_mem_node *n;
+	int ret;
+
+	m = usbg_backend_priv(b, &usbg_mem_ops);
+	if (!m || !name || !*name || strchr(name, '/'))
+		return USBG_ERROR_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	if (usbg_mem_child(m->udcs, name, strlen(name))) {
+		ret = USBG_ERROR_EXIST;
+	} else {
+		n = usbg_mem_add_dir(m->udcs, name, USBG_MEM_PLAIN);
+		ret = n && !usbg_mem_add_attrs(m, n, usbg_mem_udc_attrs) ?
+			USBG_SUCCESS : USBG_ERROR_NO_MEM;
+	}
+	pthread_mutex_unlock(&m->lock);
+
+	return ret;
+}
@@ -0,0 +1,735 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/netlink.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_daemon.h>
+
+#include "usbg_internal.h"
+#include "usbg_shm.h"
+
+/**
+ * @file usbg_daemon.c
+ * @brief Publishing of configfs image and execution of client requests
+ */
+
+#define USBG_DAEMON_ATTR_SIZE 4096
+
+/* Present only in kernel 5.1 and newer headers */
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+#define USBG_DAEMON_INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MODIFY \
+		| IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO)
+
+struct usbg_daemon_client
+{
+	TAILQ_ENTRY(usbg_daemon_client) cnode;
+	int fd;
+};
+
+struct usbg_daemon
+{
+	/* usb_gadget directory of configfs, the only one clients may modify */
+	char *gadget_path;
+	char *socket_path;
+
+	int epoll_fd;
+	int listen_fd;
+	int inotify_fd;
+	int uevent_fd;
+	TAILQ_HEAD(clhead, usbg_daemon_client) clients;
+
+	/* Sealed against writes other than through our mapping */
+	int shm_fd;
+	struct usbg_shm_hdr *shm;
+	size_t shm_size;
+	int dirty;
+
+	char *msg;
+};
+
+/* Image is built in private memory and copied to shared one at once */
+struct usbg_daemon_img
+{
+	struct usbg_shm_node *nodes;
+	int n_nodes;
+	int cap_nodes;
+	char *pool;
+	size_t pool_len;
+	size_t pool_cap;
+};
+
+static int usbg_daemon_img_str(struct usbg_daemon_img *img, const char *str,
+		size_t len, uint32_t *off)
+{
+	char *pool;
+	size_t cap;
+
+	if (img->pool_len + len + 1 > img->pool_cap) {
+		cap = img->pool_cap ? img->pool_cap * 2 : 4096;
+		while (cap < img->pool_len + len + 1)
+			cap *= 2;
+
+		pool = realloc(img->pool, cap);
+		if (!pool)
+			return USBG_ERROR_NO_MEM;
+
+		img->pool = pool;
+		img->pool_cap = cap;
+	}
+
+	memcpy(img->pool + img->pool_len, str, len);
+	img->pool[img->pool_len + len] = '\0';
+	*off = img->pool_len;
+	img->pool_len += len + 1;
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_daemon_img_add(struct usbg_daemon_img *img, const char *path,
+		usbg_shm_type type, int err, const char *data, size_t len)
+{
+	struct usbg_shm_node *n;
+	int ret;
+
+	if (img->n_nodes == img->cap_nodes) {
+		int cap = img->cap_nodes ? img->cap_nodes * 2 : 64;
+
+		n = realloc(img->nodes, cap * sizeof(*n));
+		if (!n)
+			return USBG_ERROR_NO_MEM;
+
+		img->nodes = n;
+		img->cap_nodes = cap;
+	}
+
+	n = &img->nodes[img->n_nodes];
+	memset(n, 0, sizeof(*n));
+	n->type = type;
+	n->err = err;
+	n->len = len;
+
+	ret = usbg_daemon_img_str(img, path, strlen(path), &n->path);
+	if (ret == USBG_SUCCESS && data)
+		ret = usbg_daemon_img_str(img, data, len, &n->data);
+
+	if (ret == USBG_SUCCESS)
+		++img->n_nodes;
+
+	return ret;
+}
+
+static int usbg_daemon_skip_dots(const struct dirent *dent)
+{
+	return strcmp(dent->d_name, ".") && strcmp(dent->d_name, "..");
+}
+
+static int usbg_daemon_walk(usbg_daemon *d, struct usbg_daemon_img *img,
+		const char *path, int watch)
+{
+	char data[USBG_DAEMON_ATTR_SIZE];
+	char cpath[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	int i, n, nmb;
+	int ret;
+
+	ret = usbg_daemon_img_add(img, path, USBG_SHM_DIR, 0, NULL, 0);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (watch && d->inotify_fd >= 0
+	    && inotify_add_watch(d->inotify_fd, path,
+				 USBG_DAEMON_INOTIFY_MASK) < 0)
+		DEBUG(NULL, "couldn't watch %s", path);
+
+	n = usbg_sys_scandir(path, &dent, usbg_daemon_skip_dots);
+	if (n < 0) {
+		/* Directory may be removed while we walk */
+		DEBUG(NULL, "couldn't list %s", path);
+		return USBG_SUCCESS;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		nmb = snprintf(cpath, sizeof(cpath), "%s/%s", path,
+				dent[i]->d_name);
+		if (nmb >= sizeof(cpath)) {
+			ret = USBG_ERROR_PATH_TOO_LONG;
+			goto next;
+		}
+
+		switch (dent[i]->d_type) {
+		case DT_DIR:
+			ret = usbg_daemon_walk(d, img, cpath, watch);
+			break;
+		case DT_LNK:
+			nmb = usbg_sys_readlink(cpath, data, sizeof(data));
+			ret = usbg_daemon_img_add(img, cpath, USBG_SHM_LINK,
+					nmb < 0 ? -errno : 0, data,
+					nmb < 0 ? 0 : nmb);
+			break;
+		default:
+			nmb = usbg_sys_read(cpath, data, sizeof(data));
+			ret = usbg_daemon_img_add(img, cpath, USBG_SHM_FILE,
+					nmb < 0 ? -errno : 0, data,
+					nmb < 0 ? 0 : nmb);
+			break;
+		}
+next:
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
+
+static int usbg_daemon_node_cmp(const void *a, const void *b, void *pool)
+{
+	const struct usbg_shm_node *na = a, *nb = b;
+
+	return usbg_shm_path_cmp((char *)pool + na->path,
+				 (char *)pool + nb->path);
+}
+
+/* Drop pending notifications, they are covered by the walk which follows */
+static void usbg_daemon_drain(int fd)
+{
+	char buf[4096];
+
+	if (fd < 0)
+		return;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static int usbg_daemon_publish(usbg_daemon *d)
+{
+	struct usbg_daemon_img img;
+	struct usbg_shm_hdr *hdr = d->shm;
+	size_t nodes_len, len;
+	uint64_t seq;
+	int i;
+	int ret;
+
+	usbg_daemon_drain(d->inotify_fd);
+	usbg_daemon_drain(d->uevent_fd);
+	d->dirty = 0;
+
+	memset(&img, 0, sizeof(img));
+	ret = usbg_daemon_walk(d, &img, d->gadget_path, 1);
+	if (ret == USBG_SUCCESS && usbg_sys_check_dir(USBG_SHM_UDC_CLASS) == 0)
+		ret = usbg_daemon_walk(d, &img, USBG_SHM_UDC_CLASS, 0);
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	qsort_r(img.nodes, img.n_nodes, sizeof(*img.nodes),
+		usbg_daemon_node_cmp, img.pool);
+
+	nodes_len = img.n_nodes * sizeof(*img.nodes);
+	len = sizeof(*hdr) + nodes_len + img.pool_len;
+	if (len > d->shm_size) {
+		ERROR(NULL, "image of %zu bytes does not fit in shared memory",
+		      len);
+		ret = USBG_ERROR_NO_MEM;
+		goto out;
+	}
+
+	/* Offsets in pool become offsets in mapping */
+	for (i = 0; i < img.n_nodes; ++i) {
+		img.nodes[i].path += sizeof(*hdr) + nodes_len;
+		img.nodes[i].data += sizeof(*hdr) + nodes_len;
+	}
+
+	seq = hdr->seq;
+	__atomic_store_n(&hdr->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	hdr->n_nodes = img.n_nodes;
+	hdr->len = len;
+	memcpy(hdr + 1, img.nodes, nodes_len);
+	memcpy((char *)(hdr + 1) + nodes_len, img.pool, img.pool_len);
+
+	__atomic_store_n(&hdr->seq, seq + 2, __ATOMIC_RELEASE);
+
+out:
+	free(img.nodes);
+	free(img.pool);
+	return ret;
+}
+
+/* Clients may touch only the gadget tree */
+static int usbg_daemon_path_allowed(usbg_daemon *d, const char *path)
+{
+	size_t len = strlen(d->gadget_path);
+	const char *p;
+
+	if (strncmp(path, d->gadget_path, len) || path[len] != '/')
+		return 0;
+
+	for (p = path + len; (p = strstr(p, "/..")); p += 3)
+		if (p[3] == '/' || p[3] == '\0')
+			return 0;
+
+	return 1;
+}
+
+static int usbg_daemon_apply(usbg_daemon *d, const struct usbg_shm_op *op,
+		const char *path, const char *arg)
+{
+	int ret;
+
+	if (!usbg_daemon_path_allowed(d, path))
+		return -EACCES;
+
+	switch (op->op) {
+	case USBG_SHM_OP_WRITE:
+		ret = usbg_sys_write(path, arg, op->arg_len);
+		break;
+	case USBG_SHM_OP_MKDIR:
+		ret = usbg_sys_mkdir(path);
+		break;
+	case USBG_SHM_OP_RMDIR:
+		ret = usbg_sys_rmdir(path);
+		break;
+	case USBG_SHM_OP_UNLINK:
+		ret = usbg_sys_unlink(path);
+		break;
+	case USBG_SHM_OP_SYMLINK:
+		if (!usbg_daemon_path_allowed(d, arg))
+			return -EACCES;
+		ret = usbg_sys_symlink(arg, path);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return ret < 0 ? -errno : 0;
+}
+
+static void usbg_daemon_close_client(usbg_daemon *d,
+		struct usbg_daemon_client *c)
+{
+	epoll_ctl(d->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	TAILQ_REMOVE(&d->clients, c, cnode);
+	free(c);
+}
+
+static void usbg_daemon_request(usbg_daemon *d, struct usbg_daemon_client *c)
+{
+	struct usbg_shm_reply reply = { 0, 0 };
+	struct usbg_shm_op op;
+	struct iovec iov = { d->msg, USBG_SHM_MAX_MSG };
+	struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1 };
+	const char *path, *arg;
+	uint32_t n_ops;
+	ssize_t len;
+	size_t off;
+
+	len = recvmsg(c->fd, &mh, MSG_DONTWAIT);
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if (len <= 0) {
+		usbg_daemon_close_client(d, c);
+		return;
+	}
+
+	if (mh.msg_flags & MSG_TRUNC || len < sizeof(n_ops)) {
+		reply.err = -EMSGSIZE;
+		goto reply;
+	}
+
+	memcpy(&n_ops, d->msg, sizeof(n_ops));
+	off = sizeof(n_ops);
+
+	for (; reply.n_done < n_ops; ++reply.n_done) {
+		if (off + sizeof(op) > len)
+			goto invalid;
+		memcpy(&op, d->msg + off, sizeof(op));
+		off += sizeof(op);
+
+		if (!op.path_len || op.path_len > len - off
+		    || op.arg_len > len - off - op.path_len)
+			goto invalid;
+
+		path = d->msg + off;
+		arg = path + op.path_len;
+		off += op.path_len + op.arg_len;
+
+		if (path[op.path_len - 1] != '\0' || (op.op == USBG_SHM_OP_SYMLINK
+		    && (!op.arg_len || arg[op.arg_len - 1] != '\0')))
+			goto invalid;
+
+		reply.err = usbg_daemon_apply(d, &op, path, arg);
+		if (reply.err)
+			break;
+	}
+	goto publish;
+
+invalid:
+	reply.err = -EINVAL;
+publish:
+	/* Client expects to see its changes once it gets the reply */
+	if (reply.n_done)
+		usbg_daemon_publish(d);
+reply:
+	if (send(c->fd, &reply, sizeof(reply), MSG_NOSIGNAL) < 0) {
+		DEBUG(NULL, "client gone before reply");
+		usbg_daemon_close_client(d, c);
+	}
+}
+
+static int usbg_daemon_send_hello(usbg_daemon *d, int fd)
+{
+	struct usbg_shm_hello hello = {
+		.magic = USBG_SHM_MAGIC,
+		.version = USBG_SHM_VERSION,
+		.size = d->shm_size,
+	};
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cm;
+
+	memset(cbuf, 0, sizeof(cbuf));
+	cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &d->shm_fd, sizeof(int));
+
+	return sendmsg(fd, &mh, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+/* Only root and owner of daemon may modify configfs through it */
+static int usbg_daemon_check_peer(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)) {
+		ERRORNO(NULL, "couldn't get credentials of client");
+		return -1;
+	}
+
+	if (cred.uid != 0 && cred.uid != geteuid()) {
+		ERROR(NULL, "client of uid %u (pid %d) refused",
+		      (unsigned)cred.uid, (int)cred.pid);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void usbg_daemon_accept(usbg_daemon *d)
+{
+	struct usbg_daemon_client *c;
+	struct epoll_event ev;
+	int fd;
+
+	while ((fd = accept4(d->listen_fd, NULL, NULL,
+			     SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+		if (usbg_daemon_check_peer(fd)) {
+			close(fd);
+			continue;
+		}
+
+		c = malloc(sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+
+		c->fd = fd;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if (usbg_daemon_send_hello(d, fd)
+		    || epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+			ERRORNO(NULL, "couldn't set up client");
+			close(fd);
+			free(c);
+			continue;
+		}
+
+		TAILQ_INSERT_TAIL(&d->clients, c, cnode);
+	}
+}
+
+/* Only changes of UDC state are interesting */
+static void usbg_daemon_uevent(usbg_daemon *d)
+{
+	char buf[4096];
+	ssize_t len;
+	ssize_t i;
+
+	while ((len = recv(d->uevent_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = '\0';
+		/* Message is a sequence of '\0' terminated KEY=value */
+		for (i = 0; i < len; i += strlen(buf + i) + 1)
+			if (!strcmp(buf + i, "SUBSYSTEM=udc"))
+				d->dirty = 1;
+	}
+}
+
+static int usbg_daemon_watch(usbg_daemon *d, int *fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = fd,
+	};
+
+	return epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, *fd, &ev);
+}
+
+static int usbg_daemon_listen(usbg_daemon *d)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(d->socket_path) >= sizeof(addr.sun_path))
+		return USBG_ERROR_PATH_TOO_LONG;
+	strcpy(addr.sun_path, d->socket_path);
+
+	/* Socket left by daemon which was killed */
+	if (lstat(d->socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(d->socket_path);
+
+	d->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC
+			      | SOCK_NONBLOCK, 0);
+	if (d->listen_fd < 0
+	    || bind(d->listen_fd, (struct sockaddr *)&addr, sizeof(addr))
+	    || listen(d->listen_fd, SOMAXCONN)) {
+		ERRORNO(NULL, "couldn't listen on %s", d->socket_path);
+		return usbg_translate_error(errno);
+	}
+
+	return usbg_daemon_watch(d, &d->listen_fd) ?
+		usbg_translate_error(errno) : USBG_SUCCESS;
+}
+
+static int usbg_daemon_open_shm(usbg_daemon *d)
+{
+	d->shm_fd = memfd_create("usbg", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (d->shm_fd < 0 || ftruncate(d->shm_fd, d->shm_size)) {
+		ERRORNO(NULL, "couldn't create shared memory");
+		return usbg_translate_error(errno);
+	}
+
+	d->shm = mmap(NULL, d->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      d->shm_fd, 0);
+	if (d->shm == MAP_FAILED) {
+		d->shm = NULL;
+		ERRORNO(NULL, "couldn't map shared memory");
+		return usbg_translate_error(errno);
+	}
+
+	d->shm->magic = USBG_SHM_MAGIC;
+	d->shm->version = USBG_SHM_VERSION;
+	d->shm->size = d->shm_size;
+
+	/*
+	 * Clients could reopen even read only descriptor for writing, so
+	 * memory is sealed. Only mapping which already exists stays
+	 * writable, F_SEAL_SEAL keeps clients from adding seals of their own.
+	 */
+	if (fcntl(d->shm_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SHRINK
+		  | F_SEAL_GROW | F_SEAL_SEAL)) {
+		ERRORNO(NULL, "couldn't seal shared memory");
+		return usbg_translate_error(errno);
+	}
+
+	return USBG_SUCCESS;
+}
+
+static void usbg_daemon_open_notify(usbg_daemon *d)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,
+	};
+
+	/* Without notifications only changes made by clients are seen */
+	d->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (d->inotify_fd < 0 || usbg_daemon_watch(d, &d->inotify_fd))
+		ERRORNO(NULL, "couldn't watch configfs");
+
+	d->uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC
+			      | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (d->uevent_fd >= 0
+	    && bind(d->uevent_fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(d->uevent_fd);
+		d->uevent_fd = -1;
+	}
+
+	if (d->uevent_fd < 0 || usbg_daemon_watch(d, &d->uevent_fd))
+		ERRORNO(NULL, "couldn't listen for uevents");
+}
+
+int usbg_daemon_create(const char *configfs_path, const char *socket_path,
+		       size_t shm_size, usbg_daemon **d)
+{
+	usbg_daemon *dp;
+	int ret = USBG_ERROR_NO_MEM;
+
+	if (!configfs_path || !socket_path || !d)
+		return USBG_ERROR_INVALID_PARAM;
+
+	dp = calloc(1, sizeof(*dp));
+	if (!dp)
+		goto out;
+
+	dp->epoll_fd = dp->listen_fd = dp->inotify_fd = dp->uevent_fd = -1;
+	dp->shm_fd = -1;
+	dp->shm_size = shm_size ? shm_size : USBG_DAEMON_DEFAULT_SHM_SIZE;
+	TAILQ_INIT(&dp->clients);
+
+	dp->socket_path = strdup(socket_path);
+	dp->msg = malloc(USBG_SHM_MAX_MSG);
+	if (!dp->socket_path || !dp->msg
+	    || asprintf(&dp->gadget_path, "%s/usb_gadget", configfs_path) < 0)
+		goto err;
+
+	if (usbg_sys_check_dir(dp->gadget_path) != 0) {
+		ERRORNO(NULL, "couldn't access %s", dp->gadget_path);
+		ret = usbg_translate_error(errno);
+		goto err;
+	}
+
+	dp->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (dp->epoll_fd < 0) {
+		ret = usbg_translate_error(errno);
+		goto err;
+	}
+
+	ret = usbg_daemon_open_shm(dp);
+	if (ret != USBG_SUCCESS)
+		goto err;
+
+	usbg_daemon_open_notify(dp);
+
+	ret = usbg_daemon_publish(dp);
+	if (ret != USBG_SUCCESS)
+		goto err;
+
+	/* Accept clients only when there is something to show them */
+	ret = usbg_daemon_listen(dp);
+	if (ret != USBG_SUCCESS)
+		goto err;
+
+	*d = dp;
+	goto out;
+
+err:
+	usbg_daemon_destroy(dp);
+out:
+	return ret;
+}
+
+void usbg_daemon_destroy(usbg_daemon *d)
+{
+	if (!d)
+		return;
+
+	while (!TAILQ_EMPTY(&d->clients))
+		usbg_daemon_close_client(d, TAILQ_FIRST(&d->clients));
+
+	if (d->listen_fd >= 0) {
+		close(d->listen_fd);
+		unlink(d->socket_path);
+	}
+
+	if (d->shm)
+		munmap(d->shm, d->shm_size);
+
+	if (d->shm_fd >= 0)
+		close(d->shm_fd);
+	if (d->inotify_fd >= 0)
+		close(d->inotify_fd);
+	if (d->uevent_fd >= 0)
+		close(d->uevent_fd);
+	if (d->epoll_fd >= 0)
+		close(d->epoll_fd);
+
+	free(d->msg);
+	free(d->gadget_path);
+	free(d->socket_path);
+	free(d);
+}
+
+int usbg_daemon_get_fd(usbg_daemon *d)
+{
+	return d ? d->epoll_fd : USBG_ERROR_INVALID_PARAM;
+}
+
+int usbg_daemon_process(usbg_daemon *d)
+{
+	struct epoll_event ev[16];
+	int i, n;
+
+	if (!d)
+		return USBG_ERROR_INVALID_PARAM;
+
+	n = epoll_wait(d->epoll_fd, ev, ARRAY_SIZE(ev), 0);
+	if (n < 0)
+		return errno == EINTR ? USBG_SUCCESS
+			: usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		if (ev[i].data.ptr == &d->listen_fd) {
+			usbg_daemon_accept(d);
+		} else if (ev[i].data.ptr == &d->inotify_fd) {
+			usbg_daemon_drain(d->inotify_fd);
+			d->dirty = 1;
+		} else if (ev[i].data.ptr == &d->uevent_fd) {
+			usbg_daemon_uevent(d);
+		} else {
+			/* Client may be closed by one of earlier events */
+			struct usbg_daemon_client *c;
+
+			TAILQ_FOREACH(c, &d->clients, cnode)
+				if (c == ev[i].data.ptr)
+					break;
+			if (c)
+				usbg_daemon_request(d, c);
+		}
+	}
+
+	return d->dirty ? usbg_daemon_publish(d) : USBG_SUCCESS;
+}
@@ -0,0 +1,1700 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <linux/aio_abi.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
+#include <linux/usb/functionfs.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_ffs.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_ffs.c
+ */
+
+#define USBG_DMA_HEAP_PATH "/dev/dma_heap/system"
+#define USBG_UDMABUF_PATH "/dev/udmabuf"
+#define USBG_UDC_CLASS_PATH "/sys/class/udc"
+
+#define USBG_AUTOTUNE_DEPTH 16
+#define USBG_AUTOTUNE_MIN_SIZE (4 * 1024)
+#define USBG_AUTOTUNE_MAX_SIZE (1024 * 1024)
+#define USBG_AUTOTUNE_WINDOW_MS 200
+/* Points below this percent of best throughput are not considered */
+#define USBG_AUTOTUNE_THRESHOLD 90
+
+#define USBG_BATCH_SIZE (16 * 1024)
+#define USBG_BATCH_DEADLINE_US 1000
+#define USBG_BATCH_MAX_PACKET 512
+#define USBG_BATCH_HDR_LEN 2
+
+#define USBG_INTF_DESC_LEN 9
+#define USBG_EP_DESC_LEN 7
+#define USBG_SS_COMP_DESC_LEN 6
+#define USBG_OS_DESC_HDR_LEN sizeof(struct usb_os_desc_header)
+#define USBG_OS_COMPAT_LEN 24
+
+/* Those are present only in kernel 6.9 and newer headers */
+#ifndef FUNCTIONFS_DMABUF_TRANSFER
+struct usb_ffs_dmabuf_transfer_req {
+	int fd;
+	__u32 flags;
+	__u64 length;
+} __attribute__((packed));
+
+#define FUNCTIONFS_DMABUF_ATTACH	_IOW('g', 131, int)
+#define FUNCTIONFS_DMABUF_DETACH	_IOW('g', 132, int)
+#define FUNCTIONFS_DMABUF_TRANSFER	_IOW('g', 133, \
+					     struct usb_ffs_dmabuf_transfer_req)
+#endif
+
+struct usbg_ffs_dmabuf
+{
+	void *data;
+	size_t size;
+	/* -1 if buffer is backed only by anonymous memory */
+	int dmabuf_fd;
+
+	int ep_fd;
+	usbg_ffs_ep_dir dir;
+	int zero_copy;
+	int pending;
+	size_t last_len;
+};
+
+static size_t usbg_page_align(size_t size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) & ~((size_t)page - 1);
+}
+
+static int usbg_dmabuf_from_heap(size_t size)
+{
+	struct dma_heap_allocation_data data = {
+		.len = size,
+		.fd_flags = O_RDWR | O_CLOEXEC,
+	};
+	int heap;
+	int ret;
+
+	heap = open(USBG_DMA_HEAP_PATH, O_RDONLY | O_CLOEXEC);
+	if (heap < 0)
+		return -1;
+
+	ret = ioctl(heap, DMA_HEAP_IOCTL_ALLOC, &data);
+	close(heap);
+
+	return ret < 0 ? -1 : (int)data.fd;
+}
+
+static int usbg_dmabuf_from_udmabuf(size_t size)
+{
+	struct udmabuf_create create = {
+		.flags = UDMABUF_FLAGS_CLOEXEC,
+		.offset = 0,
+		.size = size,
+	};
+	int memfd, dev;
+	int ret = -1;
+
+	memfd = memfd_create("usbg-ffs-dmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd < 0)
+		goto out;
+
+	/* udmabuf requires backing memfd to be sealed against shrinking */
+	if (ftruncate(memfd, size) < 0 ||
+	    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0)
+		goto out_memfd;
+
+	dev = open(USBG_UDMABUF_PATH, O_RDWR | O_CLOEXEC);
+	if (dev < 0)
+		goto out_memfd;
+
+	create.memfd = memfd;
+	ret = ioctl(dev, UDMABUF_CREATE, &create);
+	close(dev);
+
+out_memfd:
+	/* dma-buf holds its own reference to pages */
+	close(memfd);
+out:
+	return ret;
+}
+
+int usbg_ffs_dmabuf_alloc(size_t size, usbg_ffs_dmabuf **buf)
+{
+	usbg_ffs_dmabuf *b;
+	int ret = USBG_SUCCESS;
+
+	/* Length of transfer has to fit into return value of wait */
+	if (!size || !buf || usbg_page_align(size) < size
+	    || usbg_page_align(size) >= USBG_FFS_DMABUF_LEN_UNKNOWN)
+		return USBG_ERROR_INVALID_PARAM;
+
+	b = malloc(sizeof(*b));
+	if (!b)
+		return USBG_ERROR_NO_MEM;
+
+	b->size = usbg_page_align(size);
+	b->ep_fd = -1;
+	b->dir = USBG_FFS_EP_IN;
+	b->zero_copy = 0;
+	b->pending = 0;
+	b->last_len = 0;
+
+	b->dmabuf_fd = usbg_dmabuf_from_heap(b->size);
+	if (b->dmabuf_fd < 0)
+		b->dmabuf_fd = usbg_dmabuf_from_udmabuf(b->size);
+
+	if (b->dmabuf_fd >= 0) {
+		b->data = mmap(NULL, b->size, PROT_READ | PROT_WRITE,
+			       MAP_SHARED, b->dmabuf_fd, 0);
+		if (b->data == MAP_FAILED) {
+			/* Exporter does not allow CPU mapping */
+			close(b->dmabuf_fd);
+			b->dmabuf_fd = -1;
+		}
+	}
+
+	/* Neither dma-heap nor udmabuf, only copy mode will be possible */
+	if (b->dmabuf_fd < 0) {
+		b->data = mmap(NULL, b->size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (b->data == MAP_FAILED) {
+			ret = usbg_translate_error(errno);
+			free(b);
+			goto out;
+		}
+	}
+
+	*buf = b;
+out:
+	return ret;
+}
+
+void usbg_ffs_dmabuf_free(usbg_ffs_dmabuf *buf)
+{
+	if (!buf)
+		return;
+
+	if (buf->ep_fd >= 0)
+		usbg_ffs_dmabuf_detach(buf);
+
+	munmap(buf->data, buf->size);
+	if (buf->dmabuf_fd >= 0)
+		close(buf->dmabuf_fd);
+	free(buf);
+}
+
+void *usbg_ffs_dmabuf_data(usbg_ffs_dmabuf *buf)
+{
+	return buf ? buf->data : NULL;
+}
+
+size_t usbg_ffs_dmabuf_size(usbg_ffs_dmabuf *buf)
+{
+	return buf ? buf->size : 0;
+}
+
+int usbg_ffs_dmabuf_fd(usbg_ffs_dmabuf *buf)
+{
+	return buf ? buf->dmabuf_fd : -1;
+}
+
+int usbg_ffs_dmabuf_is_zero_copy(usbg_ffs_dmabuf *buf)
+{
+	return buf ? buf->zero_copy : 0;
+}
+
+int usbg_ffs_dmabuf_attach(usbg_ffs_dmabuf *buf, int ep_fd,
+			   usbg_ffs_ep_dir dir)
+{
+	int ret = USBG_SUCCESS;
+
+	if (!buf || ep_fd < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (buf->ep_fd >= 0)
+		return USBG_ERROR_BUSY;
+
+	buf->zero_copy = 0;
+	if (buf->dmabuf_fd >= 0) {
+		if (ioctl(ep_fd, FUNCTIONFS_DMABUF_ATTACH,
+			  &buf->dmabuf_fd) == 0) {
+			buf->zero_copy = 1;
+		} else if (errno != ENOTTY && errno != EOPNOTSUPP
+			   && errno != EINVAL) {
+			ret = usbg_translate_error(errno);
+			goto out;
+		}
+		/* else kernel or UDC doesn't support it so use copy mode */
+	}
+
+	buf->ep_fd = ep_fd;
+	buf->dir = dir;
+out:
+	return ret;
+}
+
+int usbg_ffs_dmabuf_detach(usbg_ffs_dmabuf *buf)
+{
+	int ret = USBG_SUCCESS;
+
+	if (!buf || buf->ep_fd < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (buf->pending)
+		usbg_ffs_dmabuf_wait(buf, -1);
+
+	if (buf->zero_copy &&
+	    ioctl(buf->ep_fd, FUNCTIONFS_DMABUF_DETACH, &buf->dmabuf_fd) != 0)
+		ret = usbg_translate_error(errno);
+
+	buf->ep_fd = -1;
+	buf->zero_copy = 0;
+
+	return ret;
+}
+
+static int usbg_ffs_copy_transfer(usbg_ffs_dmabuf *buf, size_t len)
+{
+	char *pos = buf->data;
+	size_t left = len;
+	ssize_t nmb;
+
+	if (buf->dir == USBG_FFS_EP_OUT) {
+		/* Host may send short packet so single read is enough */
+		do {
+			nmb = read(buf->ep_fd, pos, len);
+		} while (nmb < 0 && errno == EINTR);
+
+		if (nmb < 0)
+			return usbg_translate_error(errno);
+
+		buf->last_len = nmb;
+		return USBG_SUCCESS;
+	}
+
+	while (left) {
+		nmb = write(buf->ep_fd, pos, left);
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			return usbg_translate_error(errno);
+		}
+
+		pos += nmb;
+		left -= nmb;
+	}
+
+	buf->last_len = len;
+	return USBG_SUCCESS;
+}
+
+int usbg_ffs_dmabuf_transfer(usbg_ffs_dmabuf *buf, size_t len)
+{
+	struct usb_ffs_dmabuf_transfer_req req;
+	int ret = USBG_SUCCESS;
+
+	if (!buf || buf->ep_fd < 0 || !len || len > buf->size)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (buf->pending)
+		return USBG_ERROR_BUSY;
+
+	if (!buf->zero_copy)
+		return usbg_ffs_copy_transfer(buf, len);
+
+	memset(&req, 0, sizeof(req));
+	req.fd = buf->dmabuf_fd;
+	req.length = len;
+
+	if (ioctl(buf->ep_fd, FUNCTIONFS_DMABUF_TRANSFER, &req) == 0) {
+		buf->pending = 1;
+		/* Fence tells nothing about short packet from host */
+		buf->last_len = buf->dir == USBG_FFS_EP_OUT ?
+			USBG_FFS_DMABUF_LEN_UNKNOWN : len;
+	} else {
+		ret = usbg_translate_error(errno);
+	}
+
+	return ret;
+}
+
+int usbg_ffs_dmabuf_wait(usbg_ffs_dmabuf *buf, int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	if (!buf)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!buf->pending)
+		return buf->last_len;
+
+	/* POLLOUT on dma-buf waits for all fences, both read and write */
+	pfd.fd = buf->dmabuf_fd;
+	pfd.events = POLLOUT;
+
+	do {
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return usbg_translate_error(errno);
+	if (ret == 0)
+		return USBG_ERROR_BUSY;
+
+	buf->pending = 0;
+	return buf->last_len;
+}
+
+static int usbg_ffs_dmabuf_sync(usbg_ffs_dmabuf *buf, __u64 flags)
+{
+	struct dma_buf_sync sync = {
+		.flags = flags | DMA_BUF_SYNC_RW,
+	};
+
+	if (!buf)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (buf->dmabuf_fd < 0)
+		return USBG_SUCCESS;
+
+	return ioctl(buf->dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync) == 0 ?
+			USBG_SUCCESS : usbg_translate_error(errno);
+}
+
+int usbg_ffs_dmabuf_sync_start(usbg_ffs_dmabuf *buf)
+{
+	return usbg_ffs_dmabuf_sync(buf, DMA_BUF_SYNC_START);
+}
+
+int usbg_ffs_dmabuf_sync_end(usbg_ffs_dmabuf *buf)
+{
+	return usbg_ffs_dmabuf_sync(buf, DMA_BUF_SYNC_END);
+}
+
+static uint64_t usbg_ffs_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usbg_ffs_fill_stream_stats(usbg_ffs_stream_stats *stats,
+				       uint64_t bytes, uint64_t start,
+				       usbg_ffs_stream_method method)
+{
+	if (!stats)
+		return;
+
+	stats->bytes = bytes;
+	stats->elapsed_ns = usbg_ffs_now_ns() - start;
+	stats->bytes_per_sec = stats->elapsed_ns ?
+		bytes * 1000000000ULL / stats->elapsed_ns : 0;
+	stats->method = method;
+}
+
+static int usbg_ffs_write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t nmb;
+
+	while (len) {
+		nmb = write(fd, buf, len);
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			return usbg_translate_error(errno);
+		}
+
+		buf += nmb;
+		len -= nmb;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/*
+ * Output does not support splice(), but data has already been moved from
+ * input to pipe. Put it back to input if possible or pass it on by plain
+ * read()/write(), so the caller may continue by other method.
+ */
+static int usbg_ffs_unsplice(int in, int p, int out, size_t len,
+			     uint64_t *done)
+{
+	char buf[4096];
+	ssize_t nmb;
+	int ret;
+
+	if (lseek(in, -(off_t)len, SEEK_CUR) >= 0)
+		return USBG_SUCCESS;
+
+	while (len) {
+		nmb = read(p, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			return usbg_translate_error(errno);
+		}
+
+		ret = usbg_ffs_write_all(out, buf, nmb);
+		if (ret != USBG_SUCCESS)
+			return ret;
+
+		*done += nmb;
+		len -= nmb;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/*
+ * Move data from in to out through a pipe.
+ * USBG_ERROR_NOT_SUPPORTED is returned only if input or output does not
+ * support splice() and nothing has been moved yet. Data which already
+ * is in the pipe then is not lost, see usbg_ffs_unsplice().
+ */
+static int usbg_ffs_splice(int in, int out, size_t len, size_t chunk,
+			   int stop_on_short, uint64_t *done)
+{
+	int p[2];
+	size_t want;
+	ssize_t nmb, moved;
+	int ret = USBG_SUCCESS;
+
+	if (pipe2(p, O_CLOEXEC) < 0)
+		return usbg_translate_error(errno);
+
+	/* Pipe capacity limits size of single transfer */
+	fcntl(p[1], F_SETPIPE_SZ, chunk);
+
+	while (!len || *done < len) {
+		want = len && len - *done < chunk ? len - *done : chunk;
+
+		nmb = splice(in, NULL, p[1], NULL, want, SPLICE_F_MOVE);
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = *done == 0 && (errno == EINVAL || errno == ENOSYS) ?
+				USBG_ERROR_NOT_SUPPORTED
+				: usbg_translate_error(errno);
+			break;
+		}
+
+		/* End of file */
+		if (nmb == 0)
+			break;
+
+		for (moved = 0; moved < nmb; ) {
+			ssize_t m = splice(p[0], NULL, out, NULL, nmb - moved,
+					   SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (m < 0) {
+				if (errno == EINTR)
+					continue;
+				/* FunctionFS endpoints have no splice_write */
+				if (*done == 0 && !moved && errno == EINVAL) {
+					ret = usbg_ffs_unsplice(in, p[0], out,
+								nmb, done);
+					if (ret == USBG_SUCCESS)
+						ret = USBG_ERROR_NOT_SUPPORTED;
+				} else {
+					ret = usbg_translate_error(errno);
+				}
+				goto out;
+			}
+			moved += m;
+		}
+
+		*done += nmb;
+		if (stop_on_short && nmb < want)
+			break;
+	}
+
+out:
+	close(p[0]);
+	close(p[1]);
+	return ret;
+}
+
+static int usbg_ffs_mmap_to_ep(int ep_fd, int file_fd, size_t len,
+			       size_t chunk, uint64_t *done)
+{
+	struct stat st;
+	off_t pos, map_off;
+	size_t map_len, avail, sent = 0;
+	char *map;
+	int ret = USBG_SUCCESS;
+
+	pos = lseek(file_fd, 0, SEEK_CUR);
+	if (pos < 0 || fstat(file_fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return USBG_ERROR_NOT_SUPPORTED;
+
+	if (pos >= st.st_size || (len && *done >= len))
+		return USBG_SUCCESS;
+
+	/* Part of data may have already been sent by other method */
+	avail = st.st_size - pos;
+	if (len && len - *done < avail)
+		avail = len - *done;
+
+	/* mmap() offset has to be page aligned */
+	map_off = pos & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+	map_len = avail + (pos - map_off);
+
+	map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, file_fd, map_off);
+	if (map == MAP_FAILED)
+		return USBG_ERROR_NOT_SUPPORTED;
+
+	madvise(map, map_len, MADV_SEQUENTIAL);
+
+	while (sent < avail) {
+		size_t n = avail - sent < chunk ? avail - sent : chunk;
+
+		ret = usbg_ffs_write_all(ep_fd, map + (pos - map_off) + sent,
+					 n);
+		if (ret != USBG_SUCCESS)
+			break;
+		sent += n;
+	}
+
+	munmap(map, map_len);
+	lseek(file_fd, pos + sent, SEEK_SET);
+	*done += sent;
+
+	return ret;
+}
+
+static int usbg_ffs_copy(int in, int out, size_t len, size_t chunk,
+			 int stop_on_short, uint64_t *done)
+{
+	char *buf;
+	size_t want;
+	ssize_t nmb;
+	int ret = USBG_SUCCESS;
+
+	buf = malloc(chunk);
+	if (!buf)
+		return USBG_ERROR_NO_MEM;
+
+	while (!len || *done < len) {
+		want = len && len - *done < chunk ? len - *done : chunk;
+
+		nmb = read(in, buf, want);
+		if (nmb < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = usbg_translate_error(errno);
+			break;
+		}
+
+		if (nmb == 0)
+			break;
+
+		ret = usbg_ffs_write_all(out, buf, nmb);
+		if (ret != USBG_SUCCESS)
+			break;
+
+		*done += nmb;
+		if (stop_on_short && nmb < want)
+			break;
+	}
+
+	free(buf);
+	return ret;
+}
+
+int usbg_ffs_stream_to_ep(int ep_fd, int file_fd, size_t len,
+			  size_t chunk, usbg_ffs_stream_stats *stats)
+{
+	usbg_ffs_stream_method method = USBG_FFS_STREAM_SPLICE;
+	uint64_t start, done = 0;
+	int ret;
+
+	if (ep_fd < 0 || file_fd < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!chunk)
+		chunk = USBG_FFS_STREAM_CHUNK;
+
+	start = usbg_ffs_now_ns();
+
+	ret = usbg_ffs_splice(file_fd, ep_fd, len, chunk, 0, &done);
+	if (ret == USBG_ERROR_NOT_SUPPORTED) {
+		method = USBG_FFS_STREAM_MMAP;
+		ret = usbg_ffs_mmap_to_ep(ep_fd, file_fd, len, chunk, &done);
+	}
+
+	if (ret == USBG_ERROR_NOT_SUPPORTED) {
+		method = USBG_FFS_STREAM_COPY;
+		ret = usbg_ffs_copy(file_fd, ep_fd, len, chunk, 0, &done);
+	}
+
+	usbg_ffs_fill_stream_stats(stats, done, start, method);
+	return ret;
+}
+
+int usbg_ffs_stream_from_ep(int ep_fd, int file_fd, size_t len,
+			    size_t chunk, usbg_ffs_stream_stats *stats)
+{
+	usbg_ffs_stream_method method = USBG_FFS_STREAM_SPLICE;
+	uint64_t start, done = 0;
+	int stop_on_short = !len;
+	int ret;
+
+	if (ep_fd < 0 || file_fd < 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!chunk)
+		chunk = USBG_FFS_STREAM_CHUNK;
+
+	start = usbg_ffs_now_ns();
+
+	ret = usbg_ffs_splice(ep_fd, file_fd, len, chunk, stop_on_short,
+			      &done);
+	if (ret == USBG_ERROR_NOT_SUPPORTED) {
+		method = USBG_FFS_STREAM_COPY;
+		ret = usbg_ffs_copy(ep_fd, file_fd, len, chunk, stop_on_short,
+				    &done);
+	}
+
+	usbg_ffs_fill_stream_stats(stats, done, start, method);
+	return ret;
+}
+
+/* glibc provides no wrappers for native AIO */
+static inline int usbg_io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline int usbg_io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int usbg_io_submit(aio_context_t ctx, long nr,
+				 struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int usbg_io_getevents(aio_context_t ctx, long min_nr, long nr,
+				    struct io_event *events,
+				    struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static uint64_t usbg_ffs_cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_THREAD, &ru);
+	return ((uint64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+		* 1000000000ULL
+		+ ((uint64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+struct usbg_ffs_pump_ctx
+{
+	aio_context_t aio;
+	int ep_fd;
+	usbg_ffs_ep_dir dir;
+	int file_fd;
+	size_t size;
+	uint64_t len;
+	uint64_t queued;
+	int inflight;
+	int eof;
+	struct iocb *iocbs;
+	char *bufs;
+};
+
+/* Returns 1 if request has been queued, 0 if there is nothing to queue */
+static int usbg_ffs_pump_submit(struct usbg_ffs_pump_ctx *ctx, int slot)
+{
+	struct iocb *iocb = &ctx->iocbs[slot];
+	char *buf = ctx->bufs + slot * ctx->size;
+	size_t nbytes = ctx->size;
+	ssize_t nmb;
+
+	if (ctx->eof)
+		return 0;
+
+	if (ctx->len) {
+		if (ctx->queued >= ctx->len)
+			return 0;
+		if (ctx->len - ctx->queued < nbytes)
+			nbytes = ctx->len - ctx->queued;
+	}
+
+	if (ctx->dir == USBG_FFS_EP_IN && ctx->file_fd >= 0) {
+		do {
+			nmb = read(ctx->file_fd, buf, nbytes);
+		} while (nmb < 0 && errno == EINTR);
+
+		if (nmb < 0)
+			return usbg_translate_error(errno);
+		if (nmb == 0) {
+			ctx->eof = 1;
+			return 0;
+		}
+		nbytes = nmb;
+	}
+
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_data = slot;
+	iocb->aio_fildes = ctx->ep_fd;
+	iocb->aio_lio_opcode = ctx->dir == USBG_FFS_EP_IN ?
+		IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	iocb->aio_buf = (uintptr_t)buf;
+	iocb->aio_nbytes = nbytes;
+
+	if (usbg_io_submit(ctx->aio, 1, &iocb) != 1)
+		return usbg_translate_error(errno);
+
+	ctx->queued += nbytes;
+	ctx->inflight++;
+	return 1;
+}
+
+/*
+ * Keep up to depth requests queued on endpoint until len bytes has been
+ * transferred or deadline (if not 0) passes. Requests still in flight
+ * when pump stops are cancelled.
+ */
+static int usbg_ffs_pump_run(int ep_fd, usbg_ffs_ep_dir dir, int file_fd,
+			     int depth, size_t size, uint64_t len,
+			     uint64_t deadline, uint64_t *done)
+{
+	struct usbg_ffs_pump_ctx ctx = {
+		.aio = 0,
+		.ep_fd = ep_fd,
+		.dir = dir,
+		.file_fd = file_fd,
+		.size = size,
+		.len = len,
+	};
+	struct io_event *events;
+	struct timespec ts, *timeout;
+	int stop = 0;
+	int i, n;
+	int ret = USBG_SUCCESS;
+
+	if (usbg_io_setup(depth, &ctx.aio) < 0)
+		return USBG_ERROR_NOT_SUPPORTED;
+
+	ctx.iocbs = calloc(depth, sizeof(*ctx.iocbs));
+	events = calloc(depth, sizeof(*events));
+	if (!ctx.iocbs || !events ||
+	    posix_memalign((void **)&ctx.bufs, sysconf(_SC_PAGESIZE),
+			   depth * size)) {
+		ctx.bufs = NULL;
+		ret = USBG_ERROR_NO_MEM;
+		goto out;
+	}
+
+	if (dir == USBG_FFS_EP_IN && file_fd < 0)
+		memset(ctx.bufs, 0, depth * size);
+
+	for (i = 0; i < depth; ++i) {
+		ret = usbg_ffs_pump_submit(&ctx, i);
+		if (ret <= 0)
+			break;
+	}
+	ret = ret < 0 ? ret : USBG_SUCCESS;
+
+	while (ret == USBG_SUCCESS && !stop && ctx.inflight) {
+		timeout = NULL;
+		if (deadline) {
+			uint64_t now = usbg_ffs_now_ns();
+			uint64_t left = deadline > now ? deadline - now : 0;
+
+			ts.tv_sec = left / 1000000000ULL;
+			ts.tv_nsec = left % 1000000000ULL;
+			timeout = &ts;
+		}
+
+		n = usbg_io_getevents(ctx.aio, 1, depth, events, timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = usbg_translate_error(errno);
+			break;
+		}
+
+		for (i = 0; i < n; ++i) {
+			struct iocb *iocb = (struct iocb *)(uintptr_t)events[i].obj;
+			long long res = events[i].res;
+			int slot = events[i].data;
+
+			ctx.inflight--;
+			if (res < 0) {
+				ret = usbg_translate_error(-res);
+				break;
+			}
+
+			if (dir == USBG_FFS_EP_OUT && file_fd >= 0) {
+				ret = usbg_ffs_write_all(file_fd,
+					ctx.bufs + slot * size, res);
+				if (ret != USBG_SUCCESS)
+					break;
+			}
+
+			*done += res;
+			/* Short packet terminates transfer on OUT endpoint */
+			if (dir == USBG_FFS_EP_OUT && res < iocb->aio_nbytes
+			    && !len)
+				stop = 1;
+
+			if (stop || (deadline && usbg_ffs_now_ns() >= deadline))
+				continue;
+
+			ret = usbg_ffs_pump_submit(&ctx, slot);
+			ret = ret < 0 ? ret : USBG_SUCCESS;
+			if (ret != USBG_SUCCESS)
+				break;
+		}
+
+		if (deadline && usbg_ffs_now_ns() >= deadline)
+			stop = 1;
+	}
+
+out:
+	/* This cancels all requests which are still queued */
+	usbg_io_destroy(ctx.aio);
+	free(ctx.bufs);
+	free(ctx.iocbs);
+	free(events);
+	return ret;
+}
+
+int usbg_ffs_pump(int ep_fd, usbg_ffs_ep_dir dir, int file_fd,
+		  const usbg_ffs_tuning *tuning, size_t len,
+		  usbg_ffs_stream_stats *stats)
+{
+	usbg_ffs_stream_method method = USBG_FFS_STREAM_AIO;
+	uint64_t start, done = 0;
+	int ret;
+
+	if (ep_fd < 0 || !tuning || tuning->queue_depth <= 0
+	    || !tuning->transfer_size || (file_fd < 0 && !len))
+		return USBG_ERROR_INVALID_PARAM;
+
+	start = usbg_ffs_now_ns();
+
+	ret = usbg_ffs_pump_run(ep_fd, dir, file_fd, tuning->queue_depth,
+				tuning->transfer_size, len, 0, &done);
+	if (ret == USBG_ERROR_NOT_SUPPORTED && file_fd >= 0) {
+		method = USBG_FFS_STREAM_COPY;
+		ret = dir == USBG_FFS_EP_IN ?
+			usbg_ffs_copy(file_fd, ep_fd, len,
+				      tuning->transfer_size, 0, &done)
+			: usbg_ffs_copy(ep_fd, file_fd, len,
+					tuning->transfer_size, !len, &done);
+	}
+
+	usbg_ffs_fill_stream_stats(stats, done, start, method);
+	return ret;
+}
+
+static void usbg_ffs_read_udc_speed(const char *udc, char *buf, size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	FILE *fp;
+	char *nl;
+
+	snprintf(buf, len, "unknown");
+
+	if (snprintf(path, sizeof(path), "%s/%s/current_speed",
+		     USBG_UDC_CLASS_PATH, udc) >= sizeof(path))
+		return;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return;
+
+	if (fgets(buf, len, fp)) {
+		nl = strchr(buf, '\n');
+		if (nl)
+			*nl = '\0';
+	}
+	fclose(fp);
+}
+
+int usbg_ffs_tuning_load(const char *path, const char *udc,
+			 const char *ep_name, usbg_ffs_tuning *tuning)
+{
+	char speed[USBG_MAX_NAME_LENGTH];
+	char line[USBG_MAX_STR_LENGTH];
+	char l_udc[USBG_MAX_STR_LENGTH], l_speed[USBG_MAX_NAME_LENGTH];
+	char l_ep[USBG_MAX_NAME_LENGTH];
+	int depth;
+	unsigned long size;
+	FILE *fp;
+	int ret = USBG_ERROR_NOT_FOUND;
+
+	if (!udc || !ep_name || !tuning)
+		return USBG_ERROR_INVALID_PARAM;
+
+	fp = fopen(path ? path : USBG_FFS_TUNING_FILE, "r");
+	if (!fp)
+		return usbg_translate_error(errno);
+
+	usbg_ffs_read_udc_speed(udc, speed, sizeof(speed));
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%255s %39s %39s %d %lu", l_udc, l_speed,
+			   l_ep, &depth, &size) != 5)
+			continue;
+
+		if (strcmp(l_udc, udc) || strcmp(l_speed, speed)
+		    || strcmp(l_ep, ep_name))
+			continue;
+
+		tuning->queue_depth = depth;
+		tuning->transfer_size = size;
+		ret = USBG_SUCCESS;
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+int usbg_ffs_tuning_store(const char *path, const char *udc,
+			  const char *ep_name, const usbg_ffs_tuning *tuning)
+{
+	char tmp[USBG_MAX_PATH_LENGTH];
+	char dir[USBG_MAX_PATH_LENGTH];
+	char speed[USBG_MAX_NAME_LENGTH];
+	char line[USBG_MAX_STR_LENGTH];
+	char l_udc[USBG_MAX_STR_LENGTH], l_speed[USBG_MAX_NAME_LENGTH];
+	char l_ep[USBG_MAX_NAME_LENGTH];
+	FILE *in, *out;
+	int ret = USBG_SUCCESS;
+
+	if (!udc || !ep_name || !tuning)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!path)
+		path = USBG_FFS_TUNING_FILE;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	/* Create directory for results if it doesn't exist yet */
+	strcpy(dir, path);
+	if (mkdir(dirname(dir), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH
+		  | S_IXOTH) && errno != EEXIST)
+		return usbg_translate_error(errno);
+
+	out = fopen(tmp, "w");
+	if (!out)
+		return usbg_translate_error(errno);
+
+	usbg_ffs_read_udc_speed(udc, speed, sizeof(speed));
+
+	/* Copy all other entries */
+	in = fopen(path, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (sscanf(line, "%255s %39s %39s", l_udc, l_speed,
+				   l_ep) == 3 && !strcmp(l_udc, udc)
+			    && !strcmp(l_speed, speed)
+			    && !strcmp(l_ep, ep_name))
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+
+	fprintf(out, "%s %s %s %d %zu\n", udc, speed, ep_name,
+		tuning->queue_depth, tuning->transfer_size);
+
+	if (fflush(out) || ferror(out))
+		ret = usbg_translate_error(errno);
+
+	fclose(out);
+
+	if (ret == USBG_SUCCESS && rename(tmp, path))
+		ret = usbg_translate_error(errno);
+
+	if (ret != USBG_SUCCESS)
+		unlink(tmp);
+
+	return ret;
+}
+
+int usbg_ffs_autotune(int ep_fd, usbg_ffs_ep_dir dir, const char *udc,
+		      const char *ep_name, const usbg_ffs_autotune_opts *opts,
+		      usbg_ffs_tuning *tuning)
+{
+	usbg_ffs_autotune_opts o = {0};
+	uint64_t best_bps = 0, best_eff = 0;
+	int npoints = 0, i;
+	int depth;
+	size_t size;
+	int ret;
+	struct {
+		int depth;
+		size_t size;
+		uint64_t bps;
+		uint64_t cpu_ns;
+	} *points;
+
+	if (ep_fd < 0 || !tuning || (udc && !ep_name))
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (opts)
+		o = *opts;
+
+	o.max_depth = o.max_depth > 0 ? o.max_depth : USBG_AUTOTUNE_DEPTH;
+	o.min_size = o.min_size ? o.min_size : USBG_AUTOTUNE_MIN_SIZE;
+	o.max_size = o.max_size ? o.max_size : USBG_AUTOTUNE_MAX_SIZE;
+	o.window_ms = o.window_ms > 0 ? o.window_ms : USBG_AUTOTUNE_WINDOW_MS;
+
+	if (o.min_size > o.max_size)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (udc && !o.force &&
+	    usbg_ffs_tuning_load(o.store_path, udc, ep_name, tuning)
+	    == USBG_SUCCESS)
+		return USBG_SUCCESS;
+
+	/* Depth and size are swept in powers of two */
+	for (depth = 1; depth <= o.max_depth; depth *= 2)
+		for (size = o.min_size; size <= o.max_size; size *= 2)
+			npoints++;
+
+	points = calloc(npoints, sizeof(*points));
+	if (!points)
+		return USBG_ERROR_NO_MEM;
+
+	i = 0;
+	for (depth = 1; depth <= o.max_depth; depth *= 2) {
+		for (size = o.min_size; size <= o.max_size; size *= 2, ++i) {
+			uint64_t start, elapsed, cpu, done = 0;
+
+			start = usbg_ffs_now_ns();
+			cpu = usbg_ffs_cpu_ns();
+
+			ret = usbg_ffs_pump_run(ep_fd, dir, -1, depth, size, 0,
+					start + o.window_ms * 1000000ULL,
+					&done);
+			if (ret != USBG_SUCCESS)
+				goto out;
+
+			elapsed = usbg_ffs_now_ns() - start;
+			points[i].depth = depth;
+			points[i].size = size;
+			points[i].cpu_ns = usbg_ffs_cpu_ns() - cpu;
+			points[i].bps = elapsed ?
+				done * 1000000000ULL / elapsed : 0;
+
+			if (points[i].bps > best_bps)
+				best_bps = points[i].bps;
+		}
+	}
+
+	/* Nothing has been transferred, probably there is no host */
+	if (!best_bps) {
+		ret = USBG_ERROR_IO;
+		goto out;
+	}
+
+	for (i = 0; i < npoints; ++i) {
+		uint64_t eff;
+
+		if (points[i].bps * 100 < best_bps * USBG_AUTOTUNE_THRESHOLD)
+			continue;
+
+		/* Bytes per CPU second, avoid division by zero */
+		eff = points[i].bps * 1000 / (points[i].cpu_ns / 1000 + 1);
+		if (eff > best_eff) {
+			best_eff = eff;
+			tuning->queue_depth = points[i].depth;
+			tuning->transfer_size = points[i].size;
+		}
+	}
+
+	ret = udc ? usbg_ffs_tuning_store(o.store_path, udc, ep_name, tuning)
+		: USBG_SUCCESS;
+out:
+	free(points);
+	return ret;
+}
+
+struct usbg_ffs_batch
+{
+	int ep_fd;
+	usbg_ffs_ep_dir dir;
+	size_t max_batch;
+	uint64_t deadline_ns;
+	int max_packet;
+
+	unsigned char *buf;
+	/* IN: bytes queued, OUT: bytes received in current transfer */
+	size_t len;
+	/* OUT: parse position in current transfer */
+	size_t pos;
+
+	/* IN: timing of queued messages */
+	int queued;
+	uint64_t first_ns;
+	uint64_t enqueue_sum_ns;
+
+	usbg_ffs_batch_stats stats;
+};
+
+int usbg_ffs_batch_create(int ep_fd, usbg_ffs_ep_dir dir,
+			  const usbg_ffs_batch_opts *opts,
+			  usbg_ffs_batch **batch)
+{
+	usbg_ffs_batch *b;
+
+	if (ep_fd < 0 || !batch)
+		return USBG_ERROR_INVALID_PARAM;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return USBG_ERROR_NO_MEM;
+
+	b->ep_fd = ep_fd;
+	b->dir = dir;
+	b->max_batch = opts && opts->max_batch ? opts->max_batch
+		: USBG_BATCH_SIZE;
+	b->deadline_ns = (opts && opts->flush_deadline_us > 0 ?
+			  opts->flush_deadline_us : USBG_BATCH_DEADLINE_US)
+		* 1000ULL;
+	b->max_packet = opts && opts->max_packet > 0 ? opts->max_packet
+		: USBG_BATCH_MAX_PACKET;
+
+	if (b->max_batch <= USBG_BATCH_HDR_LEN * 2) {
+		free(b);
+		return USBG_ERROR_INVALID_PARAM;
+	}
+
+	b->buf = malloc(b->max_batch);
+	if (!b->buf) {
+		free(b);
+		return USBG_ERROR_NO_MEM;
+	}
+
+	*batch = b;
+	return USBG_SUCCESS;
+}
+
+void usbg_ffs_batch_destroy(usbg_ffs_batch *batch)
+{
+	if (!batch)
+		return;
+
+	if (batch->dir == USBG_FFS_EP_IN)
+		usbg_ffs_batch_flush(batch);
+
+	free(batch->buf);
+	free(batch);
+}
+
+static int usbg_ffs_batch_do_flush(usbg_ffs_batch *b)
+{
+	uint64_t now;
+	int ret;
+
+	if (!b->queued)
+		return USBG_SUCCESS;
+
+	/*
+	 * Host finishes transfer on short packet. If batch is not full and
+	 * its length is a multiple of max packet, add padding frame so host
+	 * doesn't wait for more data.
+	 */
+	if (b->len < b->max_batch && b->len % b->max_packet == 0) {
+		b->buf[b->len++] = 0;
+		b->buf[b->len++] = 0;
+	}
+
+	ret = usbg_ffs_write_all(b->ep_fd, (char *)b->buf, b->len);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	now = usbg_ffs_now_ns();
+	b->stats.messages += b->queued;
+	b->stats.batches++;
+	b->stats.bytes += b->len;
+	b->stats.capacity += b->max_batch;
+	b->stats.latency_ns += now * b->queued - b->enqueue_sum_ns;
+	if (now - b->first_ns > b->stats.max_latency_ns)
+		b->stats.max_latency_ns = now - b->first_ns;
+
+	b->len = 0;
+	b->queued = 0;
+	b->enqueue_sum_ns = 0;
+
+	return USBG_SUCCESS;
+}
+
+int usbg_ffs_batch_flush(usbg_ffs_batch *batch)
+{
+	if (!batch || batch->dir != USBG_FFS_EP_IN)
+		return USBG_ERROR_INVALID_PARAM;
+
+	return usbg_ffs_batch_do_flush(batch);
+}
+
+int usbg_ffs_batch_send(usbg_ffs_batch *batch, const void *msg, size_t len)
+{
+	uint64_t now;
+	int ret;
+
+	/* Space for one padding frame is always reserved at the end */
+	if (!batch || batch->dir != USBG_FFS_EP_IN || !msg || !len
+	    || len > 0xffff || len + 2 * USBG_BATCH_HDR_LEN > batch->max_batch)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (batch->len + 2 * USBG_BATCH_HDR_LEN + len > batch->max_batch) {
+		batch->stats.full_flushes++;
+		ret = usbg_ffs_batch_do_flush(batch);
+		if (ret != USBG_SUCCESS)
+			return ret;
+	}
+
+	now = usbg_ffs_now_ns();
+	if (!batch->queued)
+		batch->first_ns = now;
+
+	batch->buf[batch->len++] = len & 0xff;
+	batch->buf[batch->len++] = len >> 8;
+	memcpy(batch->buf + batch->len, msg, len);
+	batch->len += len;
+	batch->queued++;
+	batch->enqueue_sum_ns += now;
+
+	/* Fill the rest of batch only if there is still time for it */
+	if (now - batch->first_ns >= batch->deadline_ns) {
+		batch->stats.deadline_flushes++;
+		return usbg_ffs_batch_do_flush(batch);
+	}
+
+	return USBG_SUCCESS;
+}
+
+int usbg_ffs_batch_timeout(usbg_ffs_batch *batch)
+{
+	uint64_t now, deadline;
+
+	if (!batch || !batch->queued)
+		return -1;
+
+	now = usbg_ffs_now_ns();
+	deadline = batch->first_ns + batch->deadline_ns;
+
+	return now >= deadline ? 0 : (deadline - now + 999999) / 1000000;
+}
+
+int usbg_ffs_batch_poll(usbg_ffs_batch *batch)
+{
+	if (!batch)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!batch->queued ||
+	    usbg_ffs_now_ns() - batch->first_ns < batch->deadline_ns)
+		return USBG_SUCCESS;
+
+	batch->stats.deadline_flushes++;
+	return usbg_ffs_batch_do_flush(batch);
+}
+
+int usbg_ffs_batch_recv(usbg_ffs_batch *batch, void *buf, size_t len)
+{
+	size_t msg_len;
+	ssize_t nmb;
+
+	if (!batch || batch->dir != USBG_FFS_EP_OUT || !buf)
+		return USBG_ERROR_INVALID_PARAM;
+
+	for (;;) {
+		if (batch->pos + USBG_BATCH_HDR_LEN <= batch->len) {
+			msg_len = batch->buf[batch->pos]
+				| batch->buf[batch->pos + 1] << 8;
+			/* Padding, nothing more in this transfer */
+			if (!msg_len) {
+				batch->pos = batch->len;
+				continue;
+			}
+
+			if (batch->pos + USBG_BATCH_HDR_LEN + msg_len
+			    > batch->len) {
+				batch->pos = batch->len;
+				return USBG_ERROR_INVALID_FORMAT;
+			}
+
+			if (msg_len > len)
+				return USBG_ERROR_INVALID_PARAM;
+
+			memcpy(buf, batch->buf + batch->pos
+			       + USBG_BATCH_HDR_LEN, msg_len);
+			batch->pos += USBG_BATCH_HDR_LEN + msg_len;
+			batch->stats.messages++;
+			return msg_len;
+		}
+
+		if (batch->pos != batch->len) {
+			/* Trailing garbage shorter than header */
+			batch->pos = batch->len;
+			return USBG_ERROR_INVALID_FORMAT;
+		}
+
+		do {
+			nmb = read(batch->ep_fd, batch->buf, batch->max_batch);
+		} while (nmb < 0 && errno == EINTR);
+
+		if (nmb < 0)
+			return usbg_translate_error(errno);
+
+		batch->len = nmb;
+		batch->pos = 0;
+		batch->stats.batches++;
+		batch->stats.bytes += nmb;
+		batch->stats.capacity += batch->max_batch;
+	}
+}
+
+int usbg_ffs_batch_get_stats(usbg_ffs_batch *batch,
+			     usbg_ffs_batch_stats *stats)
+{
+	if (!batch || !stats)
+		return USBG_ERROR_INVALID_PARAM;
+
+	*stats = batch->stats;
+	return USBG_SUCCESS;
+}
+
+void usbg_ffs_batch_reset_stats(usbg_ffs_batch *batch)
+{
+	if (batch)
+		memset(&batch->stats, 0, sizeof(batch->stats));
+}
+
+static unsigned char *usbg_put_le16(unsigned char *p, uint16_t v)
+{
+	*p++ = v & 0xff;
+	*p++ = v >> 8;
+	return p;
+}
+
+static unsigned char *usbg_put_le32(unsigned char *p, uint32_t v)
+{
+	p = usbg_put_le16(p, v & 0xffff);
+	return usbg_put_le16(p, v >> 16);
+}
+
+enum usbg_ffs_speed {
+	USBG_FFS_FS,
+	USBG_FFS_HS,
+	USBG_FFS_SS,
+};
+
+/* Returns wMaxPacketSize or 0 if given value is not allowed */
+static uint16_t usbg_ffs_ep_maxpacket(const usbg_ffs_ep_spec *ep,
+				      enum usbg_ffs_speed speed)
+{
+	int type = ep->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK;
+	uint16_t mps;
+
+	switch (speed) {
+	case USBG_FFS_FS:
+		mps = ep->fs_maxpacket;
+		if (type == USB_ENDPOINT_XFER_ISOC)
+			return mps ? (mps <= 1023 ? mps : 0) : 1023;
+		if (!mps)
+			return 64;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return mps == 8 || mps == 16 || mps == 32 || mps == 64 ?
+				mps : 0;
+		return mps <= 64 ? mps : 0;
+	case USBG_FFS_HS:
+		mps = ep->hs_maxpacket;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return !mps || mps == 512 ? 512 : 0;
+		/* Bits 11..12 encode additional transactions per microframe */
+		return !mps ? 1024 : ((mps & 0x7ff) <= 1024
+				      && (mps >> 11) <= 2 ? mps : 0);
+	case USBG_FFS_SS:
+		mps = ep->ss_maxpacket;
+		if (type == USB_ENDPOINT_XFER_BULK)
+			return !mps || mps == 1024 ? 1024 : 0;
+		return mps <= 1024 ? (mps ? mps : 1024) : 0;
+	}
+
+	return 0;
+}
+
+static int usbg_ffs_count_descs(const usbg_ffs_descs_spec *spec,
+				enum usbg_ffs_speed speed, size_t *len)
+{
+	int i, count = 0;
+
+	for (i = 0; i < spec->n_intfs; ++i) {
+		count += 1 + spec->intfs[i].n_eps;
+		*len += USBG_INTF_DESC_LEN
+			+ spec->intfs[i].n_eps * USBG_EP_DESC_LEN;
+
+		if (speed == USBG_FFS_SS) {
+			count += spec->intfs[i].n_eps;
+			*len += spec->intfs[i].n_eps * USBG_SS_COMP_DESC_LEN;
+		}
+	}
+
+	return count;
+}
+
+static unsigned char *usbg_ffs_put_descs(unsigned char *p,
+					 const usbg_ffs_descs_spec *spec,
+					 enum usbg_ffs_speed speed)
+{
+	const usbg_ffs_intf_spec *intf;
+	const usbg_ffs_ep_spec *ep;
+	uint8_t interval;
+	int i, j;
+
+	for (i = 0; i < spec->n_intfs; ++i) {
+		intf = &spec->intfs[i];
+
+		*p++ = USBG_INTF_DESC_LEN;
+		*p++ = USB_DT_INTERFACE;
+		*p++ = i;		/* bInterfaceNumber */
+		*p++ = 0;		/* bAlternateSetting */
+		*p++ = intf->n_eps;
+		*p++ = intf->bInterfaceClass;
+		*p++ = intf->bInterfaceSubClass;
+		*p++ = intf->bInterfaceProtocol;
+		*p++ = intf->iInterface;
+
+		for (j = 0; j < intf->n_eps; ++j) {
+			ep = &intf->eps[j];
+			interval = speed != USBG_FFS_FS && ep->hs_interval ?
+				ep->hs_interval : ep->bInterval;
+
+			*p++ = USBG_EP_DESC_LEN;
+			*p++ = USB_DT_ENDPOINT;
+			*p++ = ep->bEndpointAddress;
+			*p++ = ep->bmAttributes;
+			p = usbg_put_le16(p, usbg_ffs_ep_maxpacket(ep, speed));
+			*p++ = interval;
+
+			if (speed != USBG_FFS_SS)
+				continue;
+
+			*p++ = USBG_SS_COMP_DESC_LEN;
+			*p++ = USB_DT_SS_ENDPOINT_COMP;
+			*p++ = ep->ss_max_burst;
+			*p++ = ep->ss_attributes;
+			p = usbg_put_le16(p, ep->ss_bytes_per_interval);
+		}
+	}
+
+	return p;
+}
+
+int usbg_ffs_build_descs(const usbg_ffs_descs_spec *spec,
+			 void **blob, size_t *len)
+{
+	static const struct {
+		uint32_t flag;
+		enum usbg_ffs_speed speed;
+	} speeds[] = {
+		{ FUNCTIONFS_HAS_FS_DESC, USBG_FFS_FS },
+		{ FUNCTIONFS_HAS_HS_DESC, USBG_FFS_HS },
+		{ FUNCTIONFS_HAS_SS_DESC, USBG_FFS_SS },
+	};
+	unsigned char *buf, *p;
+	uint32_t flags;
+	size_t size;
+	int counts[3];
+	int i, j, k;
+
+	if (!spec || !blob || !len || spec->n_intfs < 0
+	    || spec->n_os_compat < 0 || (spec->n_intfs && !spec->intfs)
+	    || (spec->n_os_compat && !spec->os_compat)
+	    || (spec->flags & FUNCTIONFS_EVENTFD))
+		return USBG_ERROR_INVALID_PARAM;
+
+	flags = spec->flags & ~FUNCTIONFS_HAS_MS_OS_DESC;
+	if (spec->n_os_compat)
+		flags |= FUNCTIONFS_HAS_MS_OS_DESC;
+
+	if (!(flags & (FUNCTIONFS_HAS_FS_DESC | FUNCTIONFS_HAS_HS_DESC
+		       | FUNCTIONFS_HAS_SS_DESC)))
+		return USBG_ERROR_INVALID_PARAM;
+
+	/* Validate endpoints against limits of each requested speed */
+	for (i = 0; i < spec->n_intfs; ++i) {
+		if (spec->intfs[i].n_eps < 0 || spec->intfs[i].n_eps > 30
+		    || (spec->intfs[i].n_eps && !spec->intfs[i].eps))
+			return USBG_ERROR_INVALID_PARAM;
+
+		for (j = 0; j < spec->intfs[i].n_eps; ++j)
+			for (k = 0; k < 3; ++k)
+				if ((flags & speeds[k].flag) &&
+				    !usbg_ffs_ep_maxpacket(
+					    &spec->intfs[i].eps[j],
+					    speeds[k].speed))
+					return USBG_ERROR_INVALID_VALUE;
+	}
+
+	/* magic, length, flags */
+	size = 3 * sizeof(uint32_t);
+	for (k = 0; k < 3; ++k) {
+		if (!(flags & speeds[k].flag))
+			continue;
+		size += sizeof(uint32_t);
+		counts[k] = usbg_ffs_count_descs(spec, speeds[k].speed, &size);
+	}
+
+	if (spec->n_os_compat)
+		size += sizeof(uint32_t) + USBG_OS_DESC_HDR_LEN
+			+ spec->n_os_compat * USBG_OS_COMPAT_LEN;
+
+	buf = calloc(1, size);
+	if (!buf)
+		return USBG_ERROR_NO_MEM;
+
+	p = usbg_put_le32(buf, FUNCTIONFS_DESCRIPTORS_MAGIC_V2);
+	p = usbg_put_le32(p, size);
+	p = usbg_put_le32(p, flags);
+
+	for (k = 0; k < 3; ++k)
+		if (flags & speeds[k].flag)
+			p = usbg_put_le32(p, counts[k]);
+
+	/* All extended compat IDs are placed in a single OS descriptor */
+	if (spec->n_os_compat)
+		p = usbg_put_le32(p, 1);
+
+	for (k = 0; k < 3; ++k)
+		if (flags & speeds[k].flag)
+			p = usbg_ffs_put_descs(p, spec, speeds[k].speed);
+
+	if (spec->n_os_compat) {
+		*p++ = spec->os_compat[0].bFirstInterfaceNumber;
+		p = usbg_put_le32(p, USBG_OS_DESC_HDR_LEN
+				  + spec->n_os_compat * USBG_OS_COMPAT_LEN);
+		p = usbg_put_le16(p, 0x0100);	/* bcdVersion */
+		p = usbg_put_le16(p, 0x0004);	/* wIndex: extended compat */
+		*p++ = spec->n_os_compat;	/* bCount */
+		*p++ = 0;
+
+		for (i = 0; i < spec->n_os_compat; ++i) {
+			*p++ = spec->os_compat[i].bFirstInterfaceNumber;
+			*p++ = 1;		/* Reserved1, must be 1 */
+			memcpy(p, spec->os_compat[i].CompatibleID, 8);
+			memcpy(p + 8, spec->os_compat[i].SubCompatibleID, 8);
+			/* Reserved2 is already zeroed */
+			p += 8 + 8 + 6;
+		}
+	}
+
+	/* Kernel refuses blob with any data left after last descriptor */
+	if (p - buf != size) {
+		free(buf);
+		return USBG_ERROR_OTHER_ERROR;
+	}
+
+	*blob = buf;
+	*len = size;
+	return USBG_SUCCESS;
+}
+
+int usbg_ffs_build_strings(const usbg_ffs_strings_lang *langs, int n_langs,
+			   int n_strs, void **blob, size_t *len)
+{
+	unsigned char *buf, *p;
+	size_t size, l;
+	int i, j;
+
+	if ((n_langs && !langs) || n_langs < 0 || n_strs < 0
+	    || !blob || !len)
+		return USBG_ERROR_INVALID_PARAM;
+
+	/* magic, length, str_count, lang_count */
+	size = 4 * sizeof(uint32_t);
+	for (i = 0; i < n_langs; ++i) {
+		size += sizeof(uint16_t);
+		for (j = 0; j < n_strs; ++j) {
+			if (!langs[i].strs || !langs[i].strs[j])
+				return USBG_ERROR_INVALID_PARAM;
+			size += strlen(langs[i].strs[j]) + 1;
+		}
+	}
+
+	buf = malloc(size);
+	if (!buf)
+		return USBG_ERROR_NO_MEM;
+
+	p = usbg_put_le32(buf, FUNCTIONFS_STRINGS_MAGIC);
+	p = usbg_put_le32(p, size);
+	p = usbg_put_le32(p, n_strs);
+	p = usbg_put_le32(p, n_langs);
+
+	for (i = 0; i < n_langs; ++i) {
+		p = usbg_put_le16(p, langs[i].lang);
+		for (j = 0; j < n_strs; ++j) {
+			l = strlen(langs[i].strs[j]) + 1;
+			memcpy(p, langs[i].strs[j], l);
+			p += l;
+		}
+	}
+
+	*blob = buf;
+	*len = size;
+	return USBG_SUCCESS;
+}
+
+int usbg_ffs_write_descs(int ep0_fd, const void *descs, size_t descs_len,
+			 const void *strs, size_t strs_len)
+{
+	int ret;
+
+	if (ep0_fd < 0 || !descs || !strs)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_ffs_write_all(ep0_fd, descs, descs_len);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_ffs_write_all(ep0_fd, strs, strs_len);
+
+	return ret;
+}
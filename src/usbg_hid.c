@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_hid.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_hid.c
+ * @brief Report descriptor and report writer of HID function
+ */
+
+#define USBG_HID_DONE_TIMEOUT_MS 1000
+
+static int usbg_hid_attr_path(usbg_function *f, const char *attr,
+			      char *buf, size_t len)
+{
+	int nmb;
+
+	if (!f || f->type != F_HID)
+		return USBG_ERROR_INVALID_PARAM;
+
+	nmb = snprintf(buf, len, "%s/%s/%s", f->path, f->name, attr);
+	return nmb < len ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+int usbg_set_hid_report_desc(usbg_function *f, const void *desc, size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	if (!desc || !len || len > USBG_MAX_HID_REPORT_DESC_LENGTH)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_hid_attr_path(f, "report_desc", path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Written at once, kernel replaces descriptor on each write */
+	if (usbg_sys_write(path, desc, len) < 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+	}
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+int usbg_get_hid_report_desc(usbg_function *f, void *buf, size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	if (!buf || !len)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_hid_attr_path(f, "report_desc", path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_sys_read(path, buf, len);
+	return ret < 0 ? usbg_translate_error(errno) : ret;
+}
+
+int usbg_get_hid_dev_path(usbg_function *f, char *buf, size_t len)
+{
+	usbg_function_attrs f_attrs;
+	int major, minor;
+	int ret, nmb;
+
+	if (!buf || !len)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!f || f->type != F_HID)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_get_function_attrs(f, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (sscanf(f_attrs.hid.dev, "%d:%d", &major, &minor) != 2)
+		return USBG_ERROR_NOT_FOUND;
+
+	/* f_hid numbers its devices by minor */
+	nmb = snprintf(buf, len, "/dev/hidg%d", minor);
+	return nmb < len ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+struct usbg_hid_writer
+{
+	int fd;
+	size_t report_length;
+	int max_batch;
+	int timeout_ms;
+
+	unsigned char *buf;
+	uint64_t *queued_ns;
+	int queued;
+
+	usbg_hid_writer_stats stats;
+};
+
+static uint64_t usbg_hid_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int usbg_hid_writer_open(const char *dev_path, int report_length,
+			 int max_batch, usbg_hid_writer **w)
+{
+	usbg_hid_writer *hw;
+	int ret = USBG_ERROR_NO_MEM;
+
+	if (!dev_path || report_length <= 0 || max_batch < 0 || !w)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!max_batch)
+		max_batch = USBG_HID_WRITER_BATCH;
+
+	/* Size of queue is limited by size_t only on 32 bit */
+	if (max_batch > SIZE_MAX / report_length
+	    || max_batch > SIZE_MAX / sizeof(*hw->queued_ns))
+		return USBG_ERROR_INVALID_PARAM;
+
+	hw = calloc(1, sizeof(*hw));
+	if (!hw)
+		goto out;
+
+	hw->report_length = report_length;
+	hw->max_batch = max_batch;
+	hw->timeout_ms = USBG_HID_DONE_TIMEOUT_MS;
+
+	hw->buf = malloc(hw->report_length * hw->max_batch);
+	hw->queued_ns = malloc(sizeof(*hw->queued_ns) * hw->max_batch);
+	if (!hw->buf || !hw->queued_ns)
+		goto out;
+
+	hw->fd = open(dev_path, O_RDWR | O_CLOEXEC);
+	if (hw->fd < 0) {
+		ret = usbg_translate_error(errno);
+		goto out;
+	}
+
+	*w = hw;
+	return USBG_SUCCESS;
+
+out:
+	if (hw) {
+		free(hw->queued_ns);
+		free(hw->buf);
+		free(hw);
+	}
+	return ret;
+}
+
+int usbg_hid_writer_open_function(usbg_function *f, int max_batch,
+				  usbg_hid_writer **w)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	usbg_function_attrs f_attrs;
+	int ret;
+
+	ret = usbg_get_hid_dev_path(f, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_get_function_attrs(f, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	return usbg_hid_writer_open(path, f_attrs.hid.report_length,
+				    max_batch, w);
+}
+
+void usbg_hid_writer_close(usbg_hid_writer *w)
+{
+	if (!w)
+		return;
+
+	usbg_hid_writer_flush(w, NULL, 0);
+	close(w->fd);
+	free(w->queued_ns);
+	free(w->buf);
+	free(w);
+}
+
+int usbg_hid_writer_fd(usbg_hid_writer *w)
+{
+	return w ? w->fd : -1;
+}
+
+void usbg_hid_writer_set_timeout(usbg_hid_writer *w, int timeout_ms)
+{
+	if (w && timeout_ms >= 0)
+		w->timeout_ms = timeout_ms;
+}
+
+/* Wait until host fetches report which is being sent, 0 on timeout */
+static uint64_t usbg_hid_wait_done(usbg_hid_writer *w)
+{
+	struct pollfd pfd = { .fd = w->fd, .events = POLLOUT };
+	int ret;
+
+	if (!w->timeout_ms)
+		return 0;
+
+	do {
+		ret = poll(&pfd, 1, w->timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret > 0 && (pfd.revents & POLLOUT) ? usbg_hid_now_ns() : 0;
+}
+
+static void usbg_hid_account(usbg_hid_writer *w, uint64_t queued_ns,
+			     uint64_t done_ns)
+{
+	if (!done_ns) {
+		w->stats.timeouts++;
+		return;
+	}
+
+	w->stats.reports++;
+	w->stats.latency_ns += done_ns - queued_ns;
+	if (done_ns - queued_ns > w->stats.max_latency_ns)
+		w->stats.max_latency_ns = done_ns - queued_ns;
+}
+
+int usbg_hid_writer_flush(usbg_hid_writer *w, usbg_hid_timestamp *ts,
+			  int n_ts)
+{
+	uint64_t written_ns, prev_ns = 0;
+	ssize_t nmb;
+	int i, n, ret = USBG_SUCCESS;
+
+	if (!w || (!ts && n_ts))
+		return USBG_ERROR_INVALID_PARAM;
+
+	n = w->queued;
+	if (!n)
+		return 0;
+
+	for (i = 0; i < n; ++i) {
+		do {
+			nmb = write(w->fd, w->buf + i * w->report_length,
+				    w->report_length);
+		} while (nmb < 0 && errno == EINTR);
+
+		if (nmb < 0) {
+			ret = usbg_translate_error(errno);
+			break;
+		}
+
+		/* Write waits for previous report to be fetched */
+		written_ns = usbg_hid_now_ns();
+		if (i > 0) {
+			usbg_hid_account(w, w->queued_ns[i - 1], written_ns);
+			if (i - 1 < n_ts)
+				ts[i - 1].done_ns = written_ns;
+		}
+
+		if (i < n_ts) {
+			ts[i].queued_ns = w->queued_ns[i];
+			ts[i].written_ns = written_ns;
+			ts[i].done_ns = 0;
+		}
+
+		w->stats.bytes += nmb;
+		prev_ns = w->queued_ns[i];
+	}
+
+	if (i > 0) {
+		written_ns = usbg_hid_wait_done(w);
+		usbg_hid_account(w, prev_ns, written_ns);
+		if (i - 1 < n_ts)
+			ts[i - 1].done_ns = written_ns;
+		w->stats.flushes++;
+	}
+
+	/* Reports after failed one stay queued for next flush */
+	w->queued = n - i;
+	if (w->queued) {
+		memmove(w->buf, w->buf + i * w->report_length,
+			w->queued * w->report_length);
+		memmove(w->queued_ns, w->queued_ns + i,
+			w->queued * sizeof(*w->queued_ns));
+	}
+
+	return ret == USBG_SUCCESS ? i : ret;
+}
+
+int usbg_hid_writer_queue(usbg_hid_writer *w, const void *report)
+{
+	int ret;
+
+	if (!w || !report)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (w->queued == w->max_batch) {
+		ret = usbg_hid_writer_flush(w, NULL, 0);
+		if (ret < 0)
+			return ret;
+	}
+
+	memcpy(w->buf + w->queued * w->report_length, report,
+	       w->report_length);
+	w->queued_ns[w->queued++] = usbg_hid_now_ns();
+
+	return USBG_SUCCESS;
+}
+
+int usbg_hid_writer_send(usbg_hid_writer *w, const void *report,
+			 usbg_hid_timestamp *ts)
+{
+	int ret;
+
+	if (!w || !report)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_hid_writer_flush(w, NULL, 0);
+	if (ret >= 0)
+		ret = usbg_hid_writer_queue(w, report);
+	if (ret >= 0)
+		ret = usbg_hid_writer_flush(w, ts, ts ? 1 : 0);
+
+	return ret < 0 ? ret : USBG_SUCCESS;
+}
+
+int usbg_hid_writer_get_stats(usbg_hid_writer *w,
+			      usbg_hid_writer_stats *stats)
+{
+	if (!w || !stats)
+		return USBG_ERROR_INVALID_PARAM;
+
+	*stats = w->stats;
+	return USBG_SUCCESS;
+}
+
+void usbg_hid_writer_reset_stats(usbg_hid_writer *w)
+{
+	if (w)
+		memset(&w->stats, 0, sizeof(w->stats));
+}
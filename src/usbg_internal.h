@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_INTERNAL_H__
+#define __USBG_INTERNAL_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <libconfig.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_backend.h>
+#include <usbg/usbg_stats.h>
+#include <usbg/usbg_trace.h>
+#include <usbg/usbg_log.h>
+
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#endif
+
+/**
+ * @file usbg_internal.h
+ * @brief Helpers shared between library translation units.
+ * Nothing declared here is part of public API.
+ */
+
+/*
+ * Logging, see usbg_log.h. Sites above USBG_LOG_MAX_LEVEL are removed
+ * at compile time, others cost a single comparison until enabled.
+ */
+#ifndef USBG_LOG_MAX_LEVEL
+#define USBG_LOG_MAX_LEVEL USBG_LOG_DEBUG
+#endif
+
+struct usbg_log_target {
+	usbg_log_cb cb;		/* NULL means stderr */
+	void *data;
+	int level;
+};
+
+extern struct usbg_log_target usbg_default_log;
+
+void usbg_log(const struct usbg_log_target *t, usbg_log_level level,
+	      const char *func, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+/* Target of state is used only if it has own callback */
+static inline const struct usbg_log_target *
+usbg_log_resolve(const struct usbg_log_target *t)
+{
+	return t && t->cb ? t : &usbg_default_log;
+}
+
+/* t is log target of state or NULL if there is no state in scope */
+#define USBG_LOG(t, lvl, msg, ...) do { \
+		if ((lvl) <= USBG_LOG_MAX_LEVEL) { \
+			const struct usbg_log_target *_t = \
+				usbg_log_resolve(t); \
+			if (__builtin_expect((lvl) <= _t->level, 0)) \
+				usbg_log(_t, lvl, __func__, msg, \
+					 ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+#define ERROR(t, msg, ...) \
+	USBG_LOG(t, USBG_LOG_ERROR, msg, ##__VA_ARGS__)
+
+#define ERRORNO(t, msg, ...) \
+	USBG_LOG(t, USBG_LOG_ERROR, "%s: " msg, strerror(errno), \
+		 ##__VA_ARGS__)
+
+#define DEBUG(t, msg, ...) \
+	USBG_LOG(t, USBG_LOG_DEBUG, msg, ##__VA_ARGS__)
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * @brief Translate errno value to usbg_error
+ * @param error errno value
+ * @return usbg_error suitable for given errno
+ */
+int usbg_translate_error(int error);
+
+/*
+ * File system access through selected backend.
+ * All of them follow syscall convention: on failure -1 is returned
+ * and errno is set. scandir() entries are always sorted alphabetically.
+ */
+int usbg_sys_read(const char *path, char *buf, size_t len);
+int usbg_sys_write(const char *path, const char *buf, size_t len);
+int usbg_sys_mkdir(const char *path);
+int usbg_sys_rmdir(const char *path);
+int usbg_sys_unlink(const char *path);
+int usbg_sys_symlink(const char *target, const char *path);
+int usbg_sys_readlink(const char *path, char *buf, size_t len);
+int usbg_sys_scandir(const char *path, struct dirent ***list,
+		     int (*filter)(const struct dirent *));
+int usbg_sys_check_dir(const char *path);
+
+/**
+ * @brief Check whether paths are accessed directly in file system
+ * @details Things which have no file interface (e.g. ioctls) may be
+ * done only then, other backends would not see them.
+ */
+int usbg_sys_is_fs(void);
+
+/**
+ * @brief Get private data of backend if it has been created with given ops
+ */
+void *usbg_backend_priv(usbg_backend *b, const usbg_backend_ops *ops);
+
+extern int usbg_stats_enabled;
+
+uint64_t usbg_stats_now(void);
+void usbg_stats_account(usbg_stat_op op, uint64_t start, int failed);
+void usbg_stats_record(usbg_stat_op op, uint64_t ns, int failed);
+
+/* Returns 0 when statistics are disabled */
+static inline uint64_t usbg_stats_start(void)
+{
+	return __builtin_expect(usbg_stats_enabled, 0) ? usbg_stats_now() : 0;
+}
+
+/* Evaluate call and account it as op, negative result is an error */
+#define USBG_STATS_CALL(op, call) \
+	({ \
+		uint64_t _start = usbg_stats_start(); \
+		int _ret = (call); \
+		if (_start) \
+			usbg_stats_account(op, _start, _ret < 0); \
+		_ret; \
+	})
+
+/*
+ * USDT probes, see usbg_trace.h for their list
+ */
+#ifdef HAVE_SYS_SDT_H
+extern unsigned short libusbg_io_start_semaphore;
+extern unsigned short libusbg_io_done_semaphore;
+
+#define USBG_PROBE_ENABLED(name) (libusbg_##name##_semaphore)
+#define USBG_PROBE4(name, a1, a2, a3, a4) \
+	STAP_PROBE4(libusbg, name, a1, a2, a3, a4)
+#define USBG_PROBE5(name, a1, a2, a3, a4, a5) \
+	STAP_PROBE5(libusbg, name, a1, a2, a3, a4, a5)
+#else
+#define USBG_PROBE_ENABLED(name) 0
+#define USBG_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+#define USBG_PROBE5(name, a1, a2, a3, a4, a5) do { } while (0)
+#endif
+
+struct usbg_trace_ctx {
+	uint64_t start;
+	usbg_stat_op op;
+	const char *path;
+	const char *target;
+};
+
+extern usbg_trace_cb usbg_trace_hook;
+
+void usbg_trace_begin_slow(struct usbg_trace_ctx *t);
+void usbg_trace_end_slow(struct usbg_trace_ctx *t, int ret);
+
+/*
+ * Surround single configfs operation. Time is taken only if statistics,
+ * trace callback or any USDT probe is enabled.
+ */
+static inline void usbg_trace_begin(struct usbg_trace_ctx *t,
+				    usbg_stat_op op, const char *path,
+				    const char *target)
+{
+	t->start = 0;
+	t->op = op;
+	t->path = path;
+	t->target = target;
+
+	if (__builtin_expect(usbg_stats_enabled || usbg_trace_hook
+			     || USBG_PROBE_ENABLED(io_start)
+			     || USBG_PROBE_ENABLED(io_done), 0))
+		usbg_trace_begin_slow(t);
+}
+
+static inline void usbg_trace_end(struct usbg_trace_ctx *t, int ret)
+{
+	if (__builtin_expect(t->start != 0, 0))
+		usbg_trace_end_slow(t, ret);
+}
+
+/*
+ * Gadget tree, shared by usbg.c and usbg_snapshot.c
+ */
+
+/*
+ * Locking: state lock protects list of gadgets and last_failed_import of
+ * state. Gadget lock protects everything below the gadget: its lists of
+ * configs and functions, bindings of its configs, udc and
+ * last_failed_import. When both are needed state lock is taken first.
+ * Attributes and strings are not cached so configfs serializes them.
+ *
+ * Public functions take locks, usbg_do_*() and other static helpers
+ * expect the caller to hold them.
+ */
+#define usbg_rdlock(obj) pthread_rwlock_rdlock(&(obj)->lock)
+#define usbg_wrlock(obj) pthread_rwlock_wrlock(&(obj)->lock)
+#define usbg_unlock(obj) pthread_rwlock_unlock(&(obj)->lock)
+
+struct usbg_state
+{
+	char *path;
+	pthread_rwlock_t lock;
+
+	TAILQ_HEAD(ghead, usbg_gadget) gadgets;
+	config_t *last_failed_import;
+	struct usbg_log_target log;
+
+	/* Last published snapshot and generation of whole tree */
+	pthread_mutex_t snap_lock;
+	struct usbg_snap *snap;
+	uint64_t gen;
+};
+
+struct usbg_gadget
+{
+	char *name;
+	char *path;
+	char udc[USBG_MAX_STR_LENGTH];
+	pthread_rwlock_t lock;
+
+	TAILQ_ENTRY(usbg_gadget) gnode;
+	TAILQ_HEAD(chead, usbg_config) configs;
+	TAILQ_HEAD(fhead, usbg_function) functions;
+	usbg_state *parent;
+	config_t *last_failed_import;
+	/* Unique among all gadgets of state, changed on each modification */
+	uint64_t gen;
+};
+
+struct usbg_config
+{
+	TAILQ_ENTRY(usbg_config) cnode;
+	TAILQ_HEAD(bhead, usbg_binding) bindings;
+	usbg_gadget *parent;
+
+	char *name;
+	char *path;
+	char *label;
+	int id;
+};
+
+struct usbg_function
+{
+	TAILQ_ENTRY(usbg_function) fnode;
+	usbg_gadget *parent;
+
+	char *name;
+	char *path;
+	char *instance;
+	/* Only for internal library usage */
+	char *label;
+	usbg_function_type type;
+	/* Applied after bind, see usbg_net.c */
+	usbg_net_profile *net_profile;
+};
+
+struct usbg_binding
+{
+	TAILQ_ENTRY(usbg_binding) bnode;
+	usbg_config *parent;
+	usbg_function *target;
+
+	char *name;
+	char *path;
+};
+
+/* Mark gadget as modified so snapshots will reread it */
+static inline void usbg_gadget_changed(usbg_gadget *g)
+{
+	__atomic_store_n(&g->gen, __atomic_add_fetch(&g->parent->gen, 1,
+			__ATOMIC_RELAXED), __ATOMIC_RELEASE);
+}
+
+/* Mark list of gadgets as modified */
+static inline void usbg_state_changed(usbg_state *s)
+{
+	__atomic_add_fetch(&s->gen, 1, __ATOMIC_RELEASE);
+}
+
+void usbg_snapshot_cleanup(usbg_state *s);
+
+/*
+ * Schema driven access to function attributes, see usbg_schema.c.
+ * Single values are int, char[USBG_MAX_STR_LENGTH], struct ether_addr
+ * or char[USBG_MAX_PATH_LENGTH] according to type of attribute. Groups
+ * are read into and written from structure at offsets given by schema.
+ * subdir is relative to function directory or NULL for function itself.
+ */
+const usbg_attr_desc *usbg_find_function_attr(usbg_function_type type,
+					      const char *name);
+int usbg_attr_parse(const usbg_attr_desc *d, const char *str, void *val);
+int usbg_read_function_attr(usbg_function *f, const char *subdir,
+			    const usbg_attr_desc *d, void *val);
+int usbg_write_function_attr(usbg_function *f, const char *subdir,
+			     const usbg_attr_desc *d, const void *val);
+int usbg_read_attr_group(usbg_function *f, const char *subdir,
+			 const usbg_attr_desc *descs, int n, void *base);
+int usbg_write_attr_group(usbg_function *f, const char *subdir,
+			  const usbg_attr_desc *descs, int n,
+			  const void *base);
+int usbg_read_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs);
+int usbg_write_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs);
+
+/* Mass storage units, see usbg_ms.c */
+int usbg_get_ms_lun_attr_descs(const usbg_attr_desc **descs);
+int usbg_rm_ms_luns(usbg_function *f);
+
+/* UVC streaming tree, see usbg_uvc.c */
+int usbg_rm_uvc_tree(usbg_function *f);
+const char *usbg_get_uvc_format_dir(usbg_uvc_format_type type);
+int usbg_lookup_uvc_format_type(const char *name);
+
+/* Interface tuning of network functions, see usbg_net.c */
+int usbg_get_net_profile_descs(const usbg_attr_desc **descs);
+int usbg_is_net_function(usbg_function *f);
+void usbg_apply_net_profiles(usbg_gadget *g);
+
+/* Microsoft OS descriptors, see usbg_os_desc.c */
+usbg_config *usbg_find_os_desc_config(usbg_gadget *g);
+int usbg_unlink_os_desc_config(usbg_config *c);
+int usbg_rm_os_desc_props(usbg_function *f);
+
+#endif /* __USBG_INTERNAL_H__ */
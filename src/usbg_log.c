@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_log.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_log.c
+ * @brief Formatting and delivery of library diagnostic messages
+ */
+
+struct usbg_log_target usbg_default_log = {
+	.level = USBG_LOG_ERROR,
+};
+
+static const char *log_level_names[] = {
+	[USBG_LOG_NONE] = "none",
+	[USBG_LOG_ERROR] = "error",
+	[USBG_LOG_WARNING] = "warning",
+	[USBG_LOG_INFO] = "info",
+	[USBG_LOG_DEBUG] = "debug",
+};
+
+void usbg_log(const struct usbg_log_target *t, usbg_log_level level,
+	      const char *func, const char *fmt, ...)
+{
+	char msg[USBG_MAX_STR_LENGTH * 2];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	if (t->cb)
+		t->cb(level, func, msg, t->data);
+	else
+		/* stderr is not buffered so there is no need to flush it */
+		fprintf(stderr, "%s()  %s\n", func, msg);
+}
+
+void usbg_set_log_callback(usbg_log_cb cb, void *data)
+{
+	usbg_default_log.data = data;
+	usbg_default_log.cb = cb;
+}
+
+void usbg_set_log_level(usbg_log_level level)
+{
+	usbg_default_log.level = level;
+}
+
+usbg_log_level usbg_get_log_level(void)
+{
+	return usbg_default_log.level;
+}
+
+const char *usbg_log_level_str(usbg_log_level level)
+{
+	return level >= USBG_LOG_NONE && level <= USBG_LOG_DEBUG ?
+		log_level_names[level] : NULL;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_ms.c
+ * @brief Logical units of mass storage function
+ */
+
+#define USBG_MS_LUN_ATTR(_name, _type, _field) \
+	{ \
+		.name = _name, \
+		.type = _type, \
+		.base = 10, \
+		.writable = 1, \
+		.offset = offsetof(usbg_f_ms_lun_attrs, _field), \
+	}
+
+/* Backing file goes last, ro and cdrom cannot change while it is open */
+static const usbg_attr_desc usbg_ms_lun_attrs[] = {
+	USBG_MS_LUN_ATTR("cdrom", USBG_ATTR_INT, cdrom),
+	USBG_MS_LUN_ATTR("nofua", USBG_ATTR_INT, nofua),
+	USBG_MS_LUN_ATTR("removable", USBG_ATTR_INT, removable),
+	USBG_MS_LUN_ATTR("ro", USBG_ATTR_INT, ro),
+	USBG_MS_LUN_ATTR("file", USBG_ATTR_PATH, file),
+};
+
+#define USBG_MS_LUN_FILE (usbg_ms_lun_attrs + ARRAY_SIZE(usbg_ms_lun_attrs) - 1)
+
+/* Name of unit directory, big enough for any valid number */
+#define USBG_MS_LUN_NAME_LEN sizeof("lun.2147483647")
+
+int usbg_get_ms_lun_attr_descs(const usbg_attr_desc **descs)
+{
+	*descs = usbg_ms_lun_attrs;
+	return ARRAY_SIZE(usbg_ms_lun_attrs);
+}
+
+static int usbg_ms_check(usbg_function *f, int lun)
+{
+	return f && f->type == F_MASS_STORAGE && lun >= 0
+		&& lun < USBG_MAX_MS_LUNS ? USBG_SUCCESS
+		: USBG_ERROR_INVALID_PARAM;
+}
+
+static int usbg_ms_lun_path(usbg_function *f, int lun, const char *attr,
+			    char *buf, size_t len)
+{
+	int nmb;
+
+	if (attr)
+		nmb = snprintf(buf, len, "%s/%s/lun.%d/%s", f->path, f->name,
+			       lun, attr);
+	else
+		nmb = snprintf(buf, len, "%s/%s/lun.%d", f->path, f->name,
+			       lun);
+
+	return nmb < len ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+int usbg_create_ms_lun(usbg_function *f, int lun, usbg_f_ms_lun_attrs *attrs)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_ms_check(f, lun);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* lun.0 is default group of function */
+	if (lun == 0)
+		return USBG_ERROR_EXIST;
+
+	ret = usbg_ms_lun_path(f, lun, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_mkdir(path) != 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+		return ret;
+	}
+
+	usbg_gadget_changed(f->parent);
+
+	if (attrs) {
+		ret = usbg_set_ms_lun_attrs(f, lun, attrs);
+		if (ret != USBG_SUCCESS)
+			usbg_sys_rmdir(path);
+	}
+
+	return ret;
+}
+
+int usbg_rm_ms_lun(usbg_function *f, int lun)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_ms_check(f, lun);
+	if (ret != USBG_SUCCESS || lun == 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_ms_lun_path(f, lun, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_rmdir(path) != 0)
+		ret = usbg_translate_error(errno);
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+static int lun_select(const struct dirent *dent)
+{
+	return dent->d_type == DT_DIR && !strncmp(dent->d_name, "lun.", 4);
+}
+
+int usbg_get_ms_luns(usbg_function *f, unsigned int *luns)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	int i, n, lun, end;
+	int nmb;
+
+	if (usbg_ms_check(f, 0) != USBG_SUCCESS || !luns)
+		return USBG_ERROR_INVALID_PARAM;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s", f->path, f->name);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	n = usbg_sys_scandir(path, &dent, lun_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	*luns = 0;
+	for (i = 0; i < n; ++i) {
+		end = 0;
+		if (sscanf(dent[i]->d_name, "lun.%d%n", &lun, &end) == 1
+		    && !dent[i]->d_name[end] && lun >= 0
+		    && lun < USBG_MAX_MS_LUNS)
+			*luns |= 1U << lun;
+		free(dent[i]);
+	}
+	free(dent);
+
+	return USBG_SUCCESS;
+}
+
+int usbg_get_ms_lun_attrs(usbg_function *f, int lun,
+			  usbg_f_ms_lun_attrs *attrs)
+{
+	char subdir[USBG_MS_LUN_NAME_LEN];
+	int ret;
+
+	ret = usbg_ms_check(f, lun);
+	if (ret != USBG_SUCCESS || !attrs)
+		return USBG_ERROR_INVALID_PARAM;
+
+	sprintf(subdir, "lun.%d", lun);
+	return usbg_read_attr_group(f, subdir, usbg_ms_lun_attrs,
+				    ARRAY_SIZE(usbg_ms_lun_attrs), attrs);
+}
+
+static int usbg_ms_write_file(usbg_function *f, int lun, const char *subdir,
+			      const char *file)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_write_function_attr(f, subdir, USBG_MS_LUN_FILE, file);
+	if (ret != USBG_ERROR_BUSY)
+		return ret;
+
+	/* Host prevents medium removal, newer kernels can eject anyway */
+	if (usbg_ms_lun_path(f, lun, "forced_eject", path, sizeof(path))
+	    != USBG_SUCCESS || usbg_sys_write(path, "1\n", 2) < 0)
+		return ret;
+
+	DEBUG(&f->parent->parent->log, "forced eject of %s/%s", f->name,
+	      subdir);
+	return usbg_write_function_attr(f, subdir, USBG_MS_LUN_FILE, file);
+}
+
+int usbg_set_ms_lun_attrs(usbg_function *f, int lun,
+			  usbg_f_ms_lun_attrs *attrs)
+{
+	char subdir[USBG_MS_LUN_NAME_LEN];
+	usbg_f_ms_lun_attrs cur;
+	const usbg_attr_desc *d;
+	const char *new, *old;
+	int i, ret;
+
+	ret = usbg_ms_check(f, lun);
+	if (ret != USBG_SUCCESS || !attrs)
+		return USBG_ERROR_INVALID_PARAM;
+
+	sprintf(subdir, "lun.%d", lun);
+	ret = usbg_read_attr_group(f, subdir, usbg_ms_lun_attrs,
+				   ARRAY_SIZE(usbg_ms_lun_attrs), &cur);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Medium changes together with ro or cdrom, eject the old one first */
+	if (cur.file[0] && strcmp(attrs->file, cur.file)
+	    && (attrs->ro != cur.ro || attrs->cdrom != cur.cdrom)) {
+		ret = usbg_ms_write_file(f, lun, subdir, "");
+		if (ret != USBG_SUCCESS)
+			return ret;
+		cur.file[0] = '\0';
+	}
+
+	/* Kernel rejects some writes to unit in use even if value is same */
+	for (i = 0; i < ARRAY_SIZE(usbg_ms_lun_attrs); ++i) {
+		d = usbg_ms_lun_attrs + i;
+		new = (const char *)attrs + d->offset;
+		old = (const char *)&cur + d->offset;
+
+		if (d->type == USBG_ATTR_INT ? *(int *)new == *(int *)old
+		    : !strcmp(new, old))
+			continue;
+
+		if (d == USBG_MS_LUN_FILE)
+			ret = usbg_ms_write_file(f, lun, subdir, new);
+		else
+			ret = usbg_write_function_attr(f, subdir, d, new);
+
+		if (ret != USBG_SUCCESS)
+			break;
+	}
+
+	return ret;
+}
+
+int usbg_set_ms_lun_file(usbg_function *f, int lun, const char *file)
+{
+	char subdir[USBG_MS_LUN_NAME_LEN];
+	int ret;
+
+	ret = usbg_ms_check(f, lun);
+	if (ret != USBG_SUCCESS || !file)
+		return USBG_ERROR_INVALID_PARAM;
+
+	sprintf(subdir, "lun.%d", lun);
+	return usbg_ms_write_file(f, lun, subdir, file);
+}
+
+int usbg_rm_ms_luns(usbg_function *f)
+{
+	unsigned int luns;
+	int lun, ret;
+
+	ret = usbg_get_ms_luns(f, &luns);
+	for (lun = 1; lun < USBG_MAX_MS_LUNS && ret == USBG_SUCCESS; ++lun)
+		if (luns & (1U << lun))
+			ret = usbg_rm_ms_lun(f, lun);
+
+	return ret;
+}
@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_net.c
+ * @brief Tuning of network interfaces created by gadget functions
+ */
+
+#define USBG_NET_CLASS_PATH "/sys/class/net"
+#define USBG_NET_UDC_PATH "/sys/class/udc"
+#define USBG_NET_IRQ_PATH "/sys/kernel/irq"
+/* Levels of devices searched for IRQ of UDC, starting at its own */
+#define USBG_NET_IRQ_DEPTH 3
+
+/* Zero or empty field means "keep", so none of them is exported then */
+#define USBG_NET_PROFILE_ATTR(_name, _type, _field) \
+	{ \
+		.name = _name, \
+		.type = _type, \
+		.base = 10, \
+		.writable = 1, \
+		.optional = 1, \
+		.offset = offsetof(usbg_net_profile, _field), \
+	}
+
+static const usbg_attr_desc usbg_net_profile_attrs[] = {
+	USBG_NET_PROFILE_ATTR("tx_queue_len", USBG_ATTR_INT, tx_queue_len),
+	USBG_NET_PROFILE_ATTR("rps_cpus", USBG_ATTR_STRING, rps_cpus),
+	USBG_NET_PROFILE_ATTR("xps_cpus", USBG_ATTR_STRING, xps_cpus),
+	USBG_NET_PROFILE_ATTR("gro", USBG_ATTR_INT, gro),
+	USBG_NET_PROFILE_ATTR("gro_flush_timeout", USBG_ATTR_INT,
+			      gro_flush_timeout),
+	USBG_NET_PROFILE_ATTR("napi_defer_hard_irqs", USBG_ATTR_INT,
+			      napi_defer_hard_irqs),
+	USBG_NET_PROFILE_ATTR("irq_cpus", USBG_ATTR_STRING, irq_cpus),
+	USBG_NET_PROFILE_ATTR("irq", USBG_ATTR_STRING, irq),
+};
+
+int usbg_get_net_profile_descs(const usbg_attr_desc **descs)
+{
+	*descs = usbg_net_profile_attrs;
+	return ARRAY_SIZE(usbg_net_profile_attrs);
+}
+
+int usbg_is_net_function(usbg_function *f)
+{
+	switch (f->type) {
+	case F_ECM:
+	case F_SUBSET:
+	case F_NCM:
+	case F_EEM:
+	case F_RNDIS:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int usbg_set_net_profile(usbg_function *f, const usbg_net_profile *profile)
+{
+	usbg_net_profile *copy = NULL;
+
+	if (!f || !usbg_is_net_function(f))
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (profile) {
+		copy = malloc(sizeof(*copy));
+		if (!copy)
+			return USBG_ERROR_NO_MEM;
+		*copy = *profile;
+	}
+
+	usbg_wrlock(f->parent);
+	free(f->net_profile);
+	f->net_profile = copy;
+	usbg_unlock(f->parent);
+
+	return USBG_SUCCESS;
+}
+
+int usbg_get_net_profile(usbg_function *f, usbg_net_profile *profile)
+{
+	int ret = USBG_SUCCESS;
+
+	if (!f || !profile || !usbg_is_net_function(f))
+		return USBG_ERROR_INVALID_PARAM;
+
+	usbg_rdlock(f->parent);
+	if (f->net_profile)
+		*profile = *f->net_profile;
+	else
+		ret = USBG_ERROR_NOT_FOUND;
+	usbg_unlock(f->parent);
+
+	return ret;
+}
+
+static int usbg_net_write(usbg_function *f, const char *ifname,
+			  const char *attr, const char *val)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int nmb;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s/%s", USBG_NET_CLASS_PATH,
+		       ifname, attr);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	if (usbg_sys_write(path, val, strlen(val)) < 0) {
+		nmb = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+		return nmb;
+	}
+
+	DEBUG(&f->parent->parent->log, "%s = %s", path, val);
+	return USBG_SUCCESS;
+}
+
+static int usbg_net_write_int(usbg_function *f, const char *ifname,
+			      const char *attr, int val)
+{
+	char buf[USBG_MAX_NAME_LENGTH];
+
+	snprintf(buf, sizeof(buf), "%d\n", val);
+	return usbg_net_write(f, ifname, attr, buf);
+}
+
+static int usbg_net_rx_select(const struct dirent *dent)
+{
+	return !strncmp(dent->d_name, "rx-", 3);
+}
+
+static int usbg_net_tx_select(const struct dirent *dent)
+{
+	return !strncmp(dent->d_name, "tx-", 3);
+}
+
+/* Set attribute of each queue selected by filter */
+static int usbg_net_write_queues(usbg_function *f, const char *ifname,
+				 int (*filter)(const struct dirent *),
+				 const char *attr, const char *mask)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	int i, n, nmb;
+	int ret = USBG_SUCCESS;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s/queues", USBG_NET_CLASS_PATH,
+		       ifname);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	n = usbg_sys_scandir(path, &dent, filter);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		if (ret == USBG_SUCCESS) {
+			snprintf(path, sizeof(path), "queues/%s/%s",
+				 dent[i]->d_name, attr);
+			ret = usbg_net_write(f, ifname, path, mask);
+		}
+		free(dent[i]);
+	}
+	free(dent);
+
+	return n ? ret : USBG_ERROR_NOT_FOUND;
+}
+
+/* GRO is a netdev feature, there is no sysfs attribute for it */
+static int usbg_net_set_gro(usbg_function *f, const char *ifname, int on)
+{
+	struct ethtool_value ev = {
+		.cmd = ETHTOOL_SGRO,
+		.data = on,
+	};
+	struct ifreq ifr;
+	int fd, ret = USBG_SUCCESS;
+
+	/* ioctl would reach host interface, not the one of backend */
+	if (!usbg_sys_is_fs()) {
+		ERROR(&f->parent->parent->log, "GRO needs file system backend");
+		return USBG_ERROR_NOT_SUPPORTED;
+	}
+
+	if (strlen(ifname) >= sizeof(ifr.ifr_name))
+		return USBG_ERROR_INVALID_VALUE;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, ifname);
+	ifr.ifr_data = (void *)&ev;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return usbg_translate_error(errno);
+
+	if (ioctl(fd, SIOCETHTOOL, &ifr) < 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "GRO of %s", ifname);
+	}
+
+	close(fd);
+	return ret;
+}
+
+/* IRQ number, optionally followed by new line as in sysfs */
+static int usbg_net_parse_irq(const char *str, int *irq)
+{
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(str, &end, 10);
+	if (errno || end == str || val <= 0 || val > INT_MAX
+	    || (*end && strcmp(end, "\n")))
+		return -1;
+
+	*irq = val;
+	return 0;
+}
+
+static int usbg_net_irq_select(const struct dirent *dent)
+{
+	return isdigit(dent->d_name[0]);
+}
+
+static int usbg_net_write_irq(usbg_function *f, int irq, const char *cpus)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret = USBG_SUCCESS;
+
+	snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+	if (usbg_sys_write(path, cpus, strlen(cpus)) < 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+	} else {
+		DEBUG(&f->parent->parent->log, "%s = %s", path, cpus);
+	}
+
+	return ret;
+}
+
+/* actions is a list of handler names like "xhci_hcd, dwc3" */
+static int usbg_net_actions_have_name(const char *actions, const char *name)
+{
+	size_t len = strlen(name);
+	const char *pos;
+
+	for (pos = strstr(actions, name); pos; pos = strstr(pos + 1, name))
+		if ((pos == actions || strchr(" ,", pos[-1]))
+		    && strchr(" ,\n", pos[len]))
+			return 1;
+
+	return 0;
+}
+
+/* Set affinity of each IRQ which has handler of given name */
+static int usbg_net_set_named_irqs(usbg_function *f, const char *name,
+				   const char *cpus, int *found)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char actions[USBG_MAX_STR_LENGTH];
+	struct dirent **dent;
+	int i, n, len;
+	int ret = USBG_SUCCESS;
+
+	n = usbg_sys_scandir(USBG_NET_IRQ_PATH, &dent, usbg_net_irq_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		snprintf(path, sizeof(path), "%s/%s/actions",
+			 USBG_NET_IRQ_PATH, dent[i]->d_name);
+		len = ret == USBG_SUCCESS ?
+			usbg_sys_read(path, actions, sizeof(actions) - 1) : 0;
+		if (len > 0) {
+			actions[len] = '\0';
+			if (usbg_net_actions_have_name(actions, name)) {
+				ret = usbg_net_write_irq(f,
+						atoi(dent[i]->d_name), cpus);
+				++*found;
+			}
+		}
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
+
+/*
+ * IRQs of device from MSI list or irq attribute (PCI and some others).
+ * Both are optional, so missing ones are not an error.
+ */
+static int usbg_net_set_dev_irqs(usbg_function *f, const char *dev,
+				 const char *cpus, int *found)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char buf[USBG_MAX_NAME_LENGTH];
+	struct dirent **dent;
+	int i, n, irq, len;
+	int ret = USBG_SUCCESS;
+
+	if (snprintf(path, sizeof(path), "%s/msi_irqs", dev) >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	n = usbg_sys_scandir(path, &dent, usbg_net_irq_select);
+	for (i = 0; i < n; ++i) {
+		if (ret == USBG_SUCCESS) {
+			ret = usbg_net_write_irq(f, atoi(dent[i]->d_name),
+						 cpus);
+			++*found;
+		}
+		free(dent[i]);
+	}
+	if (n >= 0)
+		free(dent);
+
+	if (*found)
+		return ret;
+
+	/* Shorter than msi_irqs, so it fits in its place */
+	strcpy(strrchr(path, '/') + 1, "irq");
+	len = usbg_sys_read(path, buf, sizeof(buf) - 1);
+	if (len > 0) {
+		buf[len] = '\0';
+		if (!usbg_net_parse_irq(buf, &irq)) {
+			ret = usbg_net_write_irq(f, irq, cpus);
+			++*found;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Device of UDC and its parents (e.g. dwc3 core, its glue and PCI
+ * function) are searched for IRQs. Platform devices don't export them
+ * in sysfs, their handlers are looked up by name of device instead.
+ */
+static int usbg_net_set_udc_irqs(usbg_function *f, const char *udc,
+				 const char *cpus)
+{
+	char dev[USBG_MAX_PATH_LENGTH];
+	char link[USBG_MAX_PATH_LENGTH];
+	const char *name = udc;
+	int i, len, nmb, found = 0;
+	int ret = USBG_SUCCESS;
+
+	nmb = snprintf(dev, sizeof(dev), "%s/%s/device", USBG_NET_UDC_PATH,
+		       udc);
+	if (nmb >= sizeof(dev))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	len = usbg_sys_readlink(dev, link, sizeof(link) - 1);
+	if (len < 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", dev);
+		return ret;
+	}
+	link[len] = '\0';
+	if (strrchr(link, '/'))
+		name = strrchr(link, '/') + 1;
+
+	for (i = 0; i < USBG_NET_IRQ_DEPTH && !found; ++i) {
+		ret = usbg_net_set_dev_irqs(f, dev, cpus, &found);
+		if (ret != USBG_SUCCESS)
+			return ret;
+
+		nmb += snprintf(dev + nmb, sizeof(dev) - nmb, "/..");
+		if (nmb >= sizeof(dev))
+			break;
+	}
+
+	if (!found)
+		ret = usbg_net_set_named_irqs(f, name, cpus, &found);
+
+	if (ret == USBG_SUCCESS && !found) {
+		ERROR(&f->parent->parent->log,
+		      "no interrupt of %s found, name it in irq", udc);
+		ret = USBG_ERROR_NOT_FOUND;
+	}
+
+	return ret;
+}
+
+/* List of IRQ numbers or handler names given by user */
+static int usbg_net_set_listed_irqs(usbg_function *f, const char *list,
+				    const char *cpus)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+	char *tok, *save;
+	int irq, found;
+	int ret = USBG_SUCCESS;
+
+	snprintf(buf, sizeof(buf), "%s", list);
+	for (tok = strtok_r(buf, ", ", &save); tok && ret == USBG_SUCCESS;
+	     tok = strtok_r(NULL, ", ", &save)) {
+		found = 0;
+		if (!usbg_net_parse_irq(tok, &irq)) {
+			ret = usbg_net_write_irq(f, irq, cpus);
+			found = 1;
+		} else {
+			ret = usbg_net_set_named_irqs(f, tok, cpus, &found);
+		}
+
+		if (ret == USBG_SUCCESS && !found) {
+			ERROR(&f->parent->parent->log, "no interrupt %s found",
+			      tok);
+			ret = USBG_ERROR_NOT_FOUND;
+		}
+	}
+
+	return ret;
+}
+
+static int usbg_do_apply_net_profile(usbg_function *f,
+				     const usbg_net_profile *p)
+{
+	usbg_function_attrs f_attrs;
+	const char *ifname;
+	int ret;
+
+	ret = usbg_get_function_attrs(f, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Template like usb%d until interface is registered during bind */
+	ifname = f_attrs.net.ifname;
+	if (!*ifname || strchr(ifname, '%')) {
+		ERROR(&f->parent->parent->log, "%s has no interface yet",
+		      f->name);
+		return USBG_ERROR_NOT_FOUND;
+	}
+
+	if (p->tx_queue_len)
+		ret = usbg_net_write_int(f, ifname, "tx_queue_len",
+					 p->tx_queue_len);
+	if (ret == USBG_SUCCESS && p->rps_cpus[0])
+		ret = usbg_net_write_queues(f, ifname, usbg_net_rx_select,
+					    "rps_cpus", p->rps_cpus);
+	if (ret == USBG_SUCCESS && p->xps_cpus[0])
+		ret = usbg_net_write_queues(f, ifname, usbg_net_tx_select,
+					    "xps_cpus", p->xps_cpus);
+	if (ret == USBG_SUCCESS && p->gro)
+		ret = usbg_net_set_gro(f, ifname, p->gro > 0);
+	if (ret == USBG_SUCCESS && p->gro_flush_timeout)
+		ret = usbg_net_write_int(f, ifname, "gro_flush_timeout",
+					 p->gro_flush_timeout);
+	if (ret == USBG_SUCCESS && p->napi_defer_hard_irqs)
+		ret = usbg_net_write_int(f, ifname, "napi_defer_hard_irqs",
+					 p->napi_defer_hard_irqs);
+	if (ret == USBG_SUCCESS && p->irq_cpus[0]) {
+		if (p->irq[0]) {
+			ret = usbg_net_set_listed_irqs(f, p->irq, p->irq_cpus);
+		} else if (!f->parent->udc[0]) {
+			ERROR(&f->parent->parent->log, "%s is not bound",
+			      f->parent->name);
+			ret = USBG_ERROR_NOT_FOUND;
+		} else {
+			ret = usbg_net_set_udc_irqs(f, f->parent->udc,
+						    p->irq_cpus);
+		}
+	}
+
+	return ret;
+}
+
+int usbg_apply_net_profile(usbg_function *f, const usbg_net_profile *profile)
+{
+	usbg_net_profile tmp;
+	int ret;
+
+	if (!profile) {
+		ret = usbg_get_net_profile(f, &tmp);
+		if (ret != USBG_SUCCESS)
+			return ret;
+		profile = &tmp;
+	} else if (!f || !usbg_is_net_function(f)) {
+		return USBG_ERROR_INVALID_PARAM;
+	}
+
+	return usbg_do_apply_net_profile(f, profile);
+}
+
+/* Failure of one profile is logged and doesn't stop the others */
+void usbg_apply_net_profiles(usbg_gadget *g)
+{
+	usbg_function *f;
+	int ret;
+
+	TAILQ_FOREACH(f, &g->functions, fnode) {
+		if (!f->net_profile)
+			continue;
+
+		ret = usbg_do_apply_net_profile(f, f->net_profile);
+		if (ret != USBG_SUCCESS)
+			ERROR(&g->parent->log, "profile of %s not applied: %s",
+			      f->name, usbg_error_name(ret));
+	}
+}
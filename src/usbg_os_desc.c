@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_os_desc.c
+ * @brief Microsoft OS descriptors of gadget and its functions
+ */
+
+#define USBG_OS_DESC_DIR "os_desc"
+#define USBG_OS_DESC_INTERFACE "interface."
+
+static int usbg_os_desc_path(usbg_gadget *g, const char *name, char *buf,
+			     size_t len)
+{
+	int nmb;
+
+	nmb = snprintf(buf, len, "%s/%s/%s%s%s", g->path, g->name,
+		       USBG_OS_DESC_DIR, name ? "/" : "", name ? name : "");
+	return nmb < len ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+/* Read attribute as string without trailing '\n' */
+static int usbg_os_desc_read(const char *path, char *buf, size_t len)
+{
+	int nmb;
+
+	nmb = usbg_sys_read(path, buf, len - 1);
+	if (nmb < 0)
+		return usbg_translate_error(errno);
+
+	buf[nmb] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return USBG_SUCCESS;
+}
+
+static int usbg_os_desc_write(usbg_gadget *g, const char *path,
+			      const char *buf, size_t len)
+{
+	int ret;
+
+	if (usbg_sys_write(path, buf, len) < 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&g->parent->log, "%s", path);
+		return ret;
+	}
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_os_desc_read_gadget_attr(usbg_gadget *g, const char *attr,
+					 char *buf, size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_os_desc_path(g, attr, path, sizeof(path));
+	return ret == USBG_SUCCESS ? usbg_os_desc_read(path, buf, len) : ret;
+}
+
+static int usbg_os_desc_write_gadget_attr(usbg_gadget *g, const char *attr,
+					  const char *buf)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_os_desc_path(g, attr, path, sizeof(path));
+	return ret == USBG_SUCCESS ?
+		usbg_os_desc_write(g, path, buf, strlen(buf)) : ret;
+}
+
+int usbg_get_gadget_os_desc(usbg_gadget *g, usbg_gadget_os_desc *os_desc)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+	int ret;
+
+	if (!g || !os_desc)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_read_gadget_attr(g, "use", buf, sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+	os_desc->use = strtol(buf, NULL, 0);
+
+	ret = usbg_os_desc_read_gadget_attr(g, "b_vendor_code", buf,
+					    sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+	os_desc->b_vendor_code = strtol(buf, NULL, 0);
+
+	ret = usbg_os_desc_read_gadget_attr(g, "qw_sign", buf, sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+	snprintf(os_desc->qw_sign, sizeof(os_desc->qw_sign), "%.*s",
+		 USBG_OS_DESC_QW_SIGN_LENGTH, buf);
+
+	return USBG_SUCCESS;
+}
+
+int usbg_set_gadget_os_desc(usbg_gadget *g, const usbg_gadget_os_desc *os_desc)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+	int ret;
+
+	if (!g || !os_desc || os_desc->b_vendor_code < 0
+	    || os_desc->b_vendor_code > 0xff
+	    || strlen(os_desc->qw_sign) > USBG_OS_DESC_QW_SIGN_LENGTH)
+		return USBG_ERROR_INVALID_PARAM;
+
+	/* Kernel keeps the old signature if the new one is empty */
+	if (os_desc->qw_sign[0]) {
+		ret = usbg_os_desc_write_gadget_attr(g, "qw_sign",
+						     os_desc->qw_sign);
+		if (ret != USBG_SUCCESS)
+			goto out;
+	}
+
+	snprintf(buf, sizeof(buf), "0x%02x\n", os_desc->b_vendor_code);
+	ret = usbg_os_desc_write_gadget_attr(g, "b_vendor_code", buf);
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	ret = usbg_os_desc_write_gadget_attr(g, "use",
+					     os_desc->use ? "1\n" : "0\n");
+out:
+	usbg_gadget_changed(g);
+	return ret;
+}
+
+static int usbg_os_desc_link_select(const struct dirent *dent)
+{
+	return dent->d_type == DT_LNK;
+}
+
+/*
+ * Call cb for each link in os_desc directory of gadget with name of
+ * configuration it points to. Kernel allows only one, but this doesn't
+ * depend on it.
+ */
+static int usbg_os_desc_for_each_link(usbg_gadget *g,
+		int (*cb)(usbg_gadget *g, const char *path, const char *target,
+			  void *data), void *data)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char target[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	const char *name;
+	int i, n, nmb;
+	int ret = USBG_SUCCESS;
+
+	ret = usbg_os_desc_path(g, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	n = usbg_sys_scandir(path, &dent, usbg_os_desc_link_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		ret = usbg_os_desc_path(g, dent[i]->d_name, path,
+					sizeof(path));
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		nmb = usbg_sys_readlink(path, target, sizeof(target) - 1);
+		if (nmb < 0) {
+			ret = usbg_translate_error(errno);
+			goto next;
+		}
+
+		target[nmb] = '\0';
+		name = strrchr(target, '/');
+		ret = cb(g, path, name ? name + 1 : target, data);
+next:
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
+
+static int usbg_os_desc_find_cb(usbg_gadget *g, const char *path,
+				const char *target, void *data)
+{
+	usbg_config **found = data;
+	usbg_config *c;
+
+	TAILQ_FOREACH(c, &g->configs, cnode)
+		if (!*found && !strcmp(c->name, target))
+			*found = c;
+
+	return USBG_SUCCESS;
+}
+
+usbg_config *usbg_find_os_desc_config(usbg_gadget *g)
+{
+	usbg_config *c = NULL;
+
+	usbg_os_desc_for_each_link(g, usbg_os_desc_find_cb, &c);
+	return c;
+}
+
+usbg_config *usbg_get_os_desc_config(usbg_gadget *g)
+{
+	usbg_config *c;
+
+	if (!g)
+		return NULL;
+
+	usbg_rdlock(g);
+	c = usbg_find_os_desc_config(g);
+	usbg_unlock(g);
+
+	return c;
+}
+
+/* data is configuration whose link should be removed or NULL for all */
+static int usbg_os_desc_unlink_cb(usbg_gadget *g, const char *path,
+				  const char *target, void *data)
+{
+	usbg_config *c = data;
+
+	if (c && strcmp(c->name, target))
+		return USBG_SUCCESS;
+
+	if (usbg_sys_unlink(path) != 0) {
+		ERRORNO(&g->parent->log, "%s", path);
+		return usbg_translate_error(errno);
+	}
+
+	return USBG_SUCCESS;
+}
+
+int usbg_unlink_os_desc_config(usbg_config *c)
+{
+	int ret;
+
+	ret = usbg_os_desc_for_each_link(c->parent, usbg_os_desc_unlink_cb, c);
+	/* Kernel without OS descriptors support */
+	return ret == USBG_ERROR_NOT_FOUND ? USBG_SUCCESS : ret;
+}
+
+int usbg_set_os_desc_config(usbg_gadget *g, usbg_config *c)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char target[USBG_MAX_PATH_LENGTH];
+	int ret, nmb;
+
+	if (!g || (c && c->parent != g))
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_for_each_link(g, usbg_os_desc_unlink_cb, NULL);
+	if (ret != USBG_SUCCESS || !c)
+		goto out;
+
+	nmb = snprintf(target, sizeof(target), "%s/%s", c->path, c->name);
+	if (nmb >= sizeof(target)) {
+		ret = USBG_ERROR_PATH_TOO_LONG;
+		goto out;
+	}
+
+	ret = usbg_os_desc_path(g, c->name, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		goto out;
+
+	if (usbg_sys_symlink(target, path) != 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&g->parent->log, "%s", path);
+	}
+out:
+	usbg_gadget_changed(g);
+	return ret;
+}
+
+static int usbg_os_desc_interface_select(const struct dirent *dent)
+{
+	return dent->d_type == DT_DIR && !strncmp(dent->d_name,
+			USBG_OS_DESC_INTERFACE, strlen(USBG_OS_DESC_INTERFACE));
+}
+
+/*
+ * Path of interface directory of function, optionally followed by name
+ * of attribute or property. f_rndis and f_ncm have a single one named
+ * after the function, other functions have none.
+ */
+static int usbg_os_desc_interface_path(usbg_function *f, const char *name,
+				       char *buf, size_t len)
+{
+	struct dirent **dent;
+	int i, n, nmb;
+
+	if (!f)
+		return USBG_ERROR_INVALID_PARAM;
+
+	nmb = snprintf(buf, len, "%s/%s/%s", f->path, f->name,
+		       USBG_OS_DESC_DIR);
+	if (nmb >= len)
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	n = usbg_sys_scandir(buf, &dent, usbg_os_desc_interface_select);
+	if (n < 0)
+		return errno == ENOENT ? USBG_ERROR_NOT_SUPPORTED
+			: usbg_translate_error(errno);
+
+	if (n > 0)
+		nmb = snprintf(buf, len, "%s/%s/%s/%s%s%s", f->path, f->name,
+			       USBG_OS_DESC_DIR, dent[0]->d_name,
+			       name ? "/" : "", name ? name : "");
+
+	for (i = 0; i < n; ++i)
+		free(dent[i]);
+	free(dent);
+
+	if (!n)
+		return USBG_ERROR_NOT_SUPPORTED;
+
+	return nmb < len ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+/* Kernel returns all 8 bytes of ID, unused ones are zero */
+static int usbg_os_desc_read_id(usbg_function *f, const char *attr,
+				char *id)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_os_desc_interface_path(f, attr, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	memset(id, 0, USBG_OS_DESC_ID_LENGTH + 1);
+	ret = usbg_sys_read(path, id, USBG_OS_DESC_ID_LENGTH);
+	if (ret < 0)
+		return usbg_translate_error(errno);
+
+	id[strcspn(id, "\n")] = '\0';
+	return USBG_SUCCESS;
+}
+
+/* Kernel overwrites only as many bytes as written, so pad with zeros */
+static int usbg_os_desc_write_id(usbg_function *f, const char *attr,
+				 const char *id)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char buf[USBG_OS_DESC_ID_LENGTH];
+	int ret;
+
+	if (strlen(id) > USBG_OS_DESC_ID_LENGTH)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_interface_path(f, attr, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, id, strlen(id));
+	return usbg_os_desc_write(f->parent, path, buf, sizeof(buf));
+}
+
+int usbg_get_function_os_desc(usbg_function *f, usbg_function_os_desc *os_desc)
+{
+	int ret;
+
+	if (!os_desc)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_read_id(f, "compatible_id", os_desc->compatible_id);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_os_desc_read_id(f, "sub_compatible_id",
+					   os_desc->sub_compatible_id);
+
+	return ret;
+}
+
+int usbg_set_function_os_desc(usbg_function *f,
+			      const usbg_function_os_desc *os_desc)
+{
+	int ret;
+
+	if (!f || !os_desc)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_write_id(f, "compatible_id", os_desc->compatible_id);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_os_desc_write_id(f, "sub_compatible_id",
+					    os_desc->sub_compatible_id);
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+static int usbg_os_desc_prop_path(usbg_function *f, const char *name,
+				  const char *attr, char *buf, size_t len)
+{
+	char sub[USBG_MAX_PATH_LENGTH];
+	int nmb;
+
+	if (!name || !*name || strchr(name, '/') || name[0] == '.')
+		return USBG_ERROR_INVALID_PARAM;
+
+	nmb = snprintf(sub, sizeof(sub), "%s%s%s", name, attr ? "/" : "",
+		       attr ? attr : "");
+	if (nmb >= sizeof(sub))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	return usbg_os_desc_interface_path(f, sub, buf, len);
+}
+
+int usbg_set_os_desc_prop(usbg_function *f, const usbg_os_desc_prop *prop)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char buf[USBG_MAX_OS_DESC_PROP_LENGTH + 1];
+	int ret;
+
+	if (!f || !prop || prop->type < USBG_OS_DESC_PROP_SZ
+	    || prop->type > USBG_OS_DESC_PROP_MULTI_SZ || prop->len < 0
+	    || prop->len > USBG_MAX_OS_DESC_PROP_LENGTH)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_prop_path(f, prop->name, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_mkdir(path) != 0 && errno != EEXIST) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+		return ret;
+	}
+
+	usbg_gadget_changed(f->parent);
+
+	/* Type first, size of string data depends on it */
+	snprintf(buf, sizeof(buf), "%d\n", prop->type);
+	ret = usbg_os_desc_prop_path(f, prop->name, "type", path,
+				     sizeof(path));
+	if (ret == USBG_SUCCESS)
+		ret = usbg_os_desc_write(f->parent, path, buf, strlen(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/*
+	 * Kernel drops the last byte if it is '\n' or zero, so terminate
+	 * data with '\n' to keep binary data ending with either of them.
+	 */
+	memcpy(buf, prop->data, prop->len);
+	buf[prop->len] = '\n';
+	ret = usbg_os_desc_prop_path(f, prop->name, "data", path,
+				     sizeof(path));
+	if (ret == USBG_SUCCESS)
+		ret = usbg_os_desc_write(f->parent, path, buf, prop->len + 1);
+
+	return ret;
+}
+
+int usbg_rm_os_desc_prop(usbg_function *f, const char *name)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_os_desc_prop_path(f, name, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_rmdir(path) != 0) {
+		ret = usbg_translate_error(errno);
+		ERRORNO(&f->parent->parent->log, "%s", path);
+	}
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+static int usbg_os_desc_prop_select(const struct dirent *dent)
+{
+	return dent->d_type == DT_DIR && dent->d_name[0] != '.';
+}
+
+static int usbg_os_desc_read_prop(usbg_function *f, usbg_os_desc_prop *prop)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char buf[USBG_MAX_STR_LENGTH];
+	int ret;
+
+	ret = usbg_os_desc_prop_path(f, prop->name, "type", path,
+				     sizeof(path));
+	if (ret == USBG_SUCCESS)
+		ret = usbg_os_desc_read(path, buf, sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+	prop->type = strtol(buf, NULL, 10);
+
+	ret = usbg_os_desc_prop_path(f, prop->name, "data", path,
+				     sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	prop->len = usbg_sys_read(path, (char *)prop->data,
+				  sizeof(prop->data));
+	return prop->len < 0 ? usbg_translate_error(errno) : USBG_SUCCESS;
+}
+
+int usbg_get_os_desc_props(usbg_function *f, usbg_os_desc_prop **props,
+			   int *n_props)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	usbg_os_desc_prop *p = NULL;
+	int i, n;
+	int ret;
+
+	if (!props || !n_props)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_os_desc_interface_path(f, NULL, path, sizeof(path));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	n = usbg_sys_scandir(path, &dent, usbg_os_desc_prop_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	if (n > 0) {
+		p = calloc(n, sizeof(*p));
+		if (!p)
+			ret = USBG_ERROR_NO_MEM;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (ret == USBG_SUCCESS) {
+			snprintf(p[i].name, sizeof(p[i].name), "%s",
+				 dent[i]->d_name);
+			ret = usbg_os_desc_read_prop(f, p + i);
+		}
+		free(dent[i]);
+	}
+	free(dent);
+
+	if (ret != USBG_SUCCESS) {
+		free(p);
+		return ret;
+	}
+
+	*props = p;
+	*n_props = n;
+	return USBG_SUCCESS;
+}
+
+int usbg_rm_os_desc_props(usbg_function *f)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	int i, n;
+	int ret;
+
+	ret = usbg_os_desc_interface_path(f, NULL, path, sizeof(path));
+	if (ret == USBG_ERROR_NOT_SUPPORTED)
+		return USBG_SUCCESS;
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	n = usbg_sys_scandir(path, &dent, usbg_os_desc_prop_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		if (ret == USBG_SUCCESS)
+			ret = usbg_rm_os_desc_prop(f, dent[i]->d_name);
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/ether.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_schema.c
+ * @brief Attribute schema of function types and generic access to it
+ */
+
+#define USBG_ATTR(_name, _type, _base, _writable, _field) \
+	{ \
+		.name = _name, \
+		.type = _type, \
+		.base = _base, \
+		.writable = _writable, \
+		.offset = offsetof(usbg_function_attrs, _field), \
+	}
+
+/* Attribute added to kernel later than function itself */
+#define USBG_ATTR_OPT(_name, _type, _base, _writable, _field) \
+	{ \
+		.name = _name, \
+		.type = _type, \
+		.base = _base, \
+		.writable = _writable, \
+		.optional = 1, \
+		.offset = offsetof(usbg_function_attrs, _field), \
+	}
+
+static const usbg_attr_desc usbg_serial_attrs[] = {
+	USBG_ATTR("port_num", USBG_ATTR_INT, 10, 0, serial.port_num),
+};
+
+static const usbg_attr_desc usbg_net_attrs[] = {
+	USBG_ATTR("dev_addr", USBG_ATTR_ETHER_ADDR, 0, 1, net.dev_addr),
+	USBG_ATTR("host_addr", USBG_ATTR_ETHER_ADDR, 0, 1, net.host_addr),
+	USBG_ATTR("ifname", USBG_ATTR_STRING, 0, 0, net.ifname),
+	USBG_ATTR("qmult", USBG_ATTR_INT, 10, 1, net.qmult),
+};
+
+static const usbg_attr_desc usbg_phonet_attrs[] = {
+	USBG_ATTR("ifname", USBG_ATTR_STRING, 0, 0, phonet.ifname),
+};
+
+static const usbg_attr_desc usbg_loopback_attrs[] = {
+	USBG_ATTR("bulk_buflen", USBG_ATTR_INT, 10, 1, loopback.bulk_buflen),
+	USBG_ATTR("qlen", USBG_ATTR_INT, 10, 1, loopback.qlen),
+};
+
+static const usbg_attr_desc usbg_sourcesink_attrs[] = {
+	USBG_ATTR("bulk_buflen", USBG_ATTR_INT, 10, 1, sourcesink.bulk_buflen),
+	USBG_ATTR("bulk_qlen", USBG_ATTR_INT, 10, 1, sourcesink.bulk_qlen),
+	USBG_ATTR("iso_qlen", USBG_ATTR_INT, 10, 1, sourcesink.iso_qlen),
+	USBG_ATTR("isoc_interval", USBG_ATTR_INT, 10, 1,
+		  sourcesink.isoc_interval),
+	USBG_ATTR("isoc_maxburst", USBG_ATTR_INT, 10, 1,
+		  sourcesink.isoc_maxburst),
+	USBG_ATTR("isoc_maxpacket", USBG_ATTR_INT, 10, 1,
+		  sourcesink.isoc_maxpacket),
+	USBG_ATTR("isoc_mult", USBG_ATTR_INT, 10, 1, sourcesink.isoc_mult),
+	USBG_ATTR("pattern", USBG_ATTR_INT, 10, 1, sourcesink.pattern),
+};
+
+static const usbg_attr_desc usbg_ms_attrs[] = {
+	USBG_ATTR("stall", USBG_ATTR_INT, 10, 1, ms.stall),
+};
+
+static const usbg_attr_desc usbg_uvc_attrs[] = {
+	USBG_ATTR("streaming_interval", USBG_ATTR_INT, 10, 1,
+		  uvc.streaming_interval),
+	USBG_ATTR("streaming_maxburst", USBG_ATTR_INT, 10, 1,
+		  uvc.streaming_maxburst),
+	USBG_ATTR("streaming_maxpacket", USBG_ATTR_INT, 10, 1,
+		  uvc.streaming_maxpacket),
+};
+
+static const usbg_attr_desc usbg_uac2_attrs[] = {
+	USBG_ATTR("c_chmask", USBG_ATTR_INT, 10, 1, uac2.c_chmask),
+	USBG_ATTR("c_srate", USBG_ATTR_INT, 10, 1, uac2.c_srate),
+	USBG_ATTR("c_ssize", USBG_ATTR_INT, 10, 1, uac2.c_ssize),
+	USBG_ATTR("c_sync", USBG_ATTR_STRING, 0, 1, uac2.c_sync),
+	USBG_ATTR("fb_max", USBG_ATTR_INT, 10, 1, uac2.fb_max),
+	USBG_ATTR("p_chmask", USBG_ATTR_INT, 10, 1, uac2.p_chmask),
+	USBG_ATTR("p_srate", USBG_ATTR_INT, 10, 1, uac2.p_srate),
+	USBG_ATTR("p_ssize", USBG_ATTR_INT, 10, 1, uac2.p_ssize),
+	USBG_ATTR("req_number", USBG_ATTR_INT, 10, 1, uac2.req_number),
+};
+
+static const usbg_attr_desc usbg_uac1_attrs[] = {
+	USBG_ATTR("c_chmask", USBG_ATTR_INT, 10, 1, uac1.c_chmask),
+	USBG_ATTR("c_srate", USBG_ATTR_INT, 10, 1, uac1.c_srate),
+	USBG_ATTR("c_ssize", USBG_ATTR_INT, 10, 1, uac1.c_ssize),
+	USBG_ATTR("p_chmask", USBG_ATTR_INT, 10, 1, uac1.p_chmask),
+	USBG_ATTR("p_srate", USBG_ATTR_INT, 10, 1, uac1.p_srate),
+	USBG_ATTR("p_ssize", USBG_ATTR_INT, 10, 1, uac1.p_ssize),
+	USBG_ATTR("req_number", USBG_ATTR_INT, 10, 1, uac1.req_number),
+};
+
+static const usbg_attr_desc usbg_hid_attrs[] = {
+	USBG_ATTR("dev", USBG_ATTR_STRING, 0, 0, hid.dev),
+	USBG_ATTR_OPT("interval", USBG_ATTR_INT, 10, 1, hid.interval),
+	USBG_ATTR("protocol", USBG_ATTR_INT, 10, 1, hid.protocol),
+	USBG_ATTR("report_length", USBG_ATTR_INT, 10, 1, hid.report_length),
+	USBG_ATTR("subclass", USBG_ATTR_INT, 10, 1, hid.subclass),
+};
+
+static const usbg_attr_desc usbg_printer_attrs[] = {
+	USBG_ATTR("pnp_string", USBG_ATTR_STRING, 0, 1, printer.pnp_string),
+	USBG_ATTR("q_len", USBG_ATTR_INT, 10, 1, printer.q_len),
+};
+
+static const usbg_attr_desc usbg_midi_attrs[] = {
+	USBG_ATTR("buflen", USBG_ATTR_INT, 10, 1, midi.buflen),
+	USBG_ATTR("id", USBG_ATTR_STRING, 0, 1, midi.id),
+	USBG_ATTR("in_ports", USBG_ATTR_INT, 10, 1, midi.in_ports),
+	USBG_ATTR("index", USBG_ATTR_INT, 10, 1, midi.index),
+	USBG_ATTR("out_ports", USBG_ATTR_INT, 10, 1, midi.out_ports),
+	USBG_ATTR("qlen", USBG_ATTR_INT, 10, 1, midi.qlen),
+};
+
+#define USBG_SCHEMA(_attrs) { _attrs, ARRAY_SIZE(_attrs) }
+
+/* Types without entry, like F_FFS, have no attributes in configfs */
+static const struct {
+	const usbg_attr_desc *descs;
+	int n;
+} usbg_function_schemas[USBG_FUNCTION_TYPE_MAX] = {
+	[F_SERIAL] = USBG_SCHEMA(usbg_serial_attrs),
+	[F_ACM] = USBG_SCHEMA(usbg_serial_attrs),
+	[F_OBEX] = USBG_SCHEMA(usbg_serial_attrs),
+	[F_ECM] = USBG_SCHEMA(usbg_net_attrs),
+	[F_SUBSET] = USBG_SCHEMA(usbg_net_attrs),
+	[F_NCM] = USBG_SCHEMA(usbg_net_attrs),
+	[F_EEM] = USBG_SCHEMA(usbg_net_attrs),
+	[F_RNDIS] = USBG_SCHEMA(usbg_net_attrs),
+	[F_PHONET] = USBG_SCHEMA(usbg_phonet_attrs),
+	[F_LOOPBACK] = USBG_SCHEMA(usbg_loopback_attrs),
+	[F_SOURCESINK] = USBG_SCHEMA(usbg_sourcesink_attrs),
+	[F_MASS_STORAGE] = USBG_SCHEMA(usbg_ms_attrs),
+	[F_UVC] = USBG_SCHEMA(usbg_uvc_attrs),
+	[F_UAC2] = USBG_SCHEMA(usbg_uac2_attrs),
+	[F_UAC1] = USBG_SCHEMA(usbg_uac1_attrs),
+	[F_HID] = USBG_SCHEMA(usbg_hid_attrs),
+	[F_PRINTER] = USBG_SCHEMA(usbg_printer_attrs),
+	[F_MIDI] = USBG_SCHEMA(usbg_midi_attrs),
+};
+
+int usbg_get_function_attr_descs(usbg_function_type type,
+				 const usbg_attr_desc **descs)
+{
+	if (type < 0 || type >= USBG_FUNCTION_TYPE_MAX || !descs)
+		return USBG_ERROR_INVALID_PARAM;
+
+	*descs = usbg_function_schemas[type].descs;
+	return usbg_function_schemas[type].n;
+}
+
+const usbg_attr_desc *usbg_find_function_attr(usbg_function_type type,
+					      const char *name)
+{
+	const usbg_attr_desc *descs;
+	int i, n;
+
+	n = usbg_get_function_attr_descs(type, &descs);
+	for (i = 0; i < n; ++i)
+		if (!strcmp(descs[i].name, name))
+			return descs + i;
+
+	return NULL;
+}
+
+/*
+ * Fill buf with directory of function or its subdirectory followed
+ * by '/', so attribute paths are made by appending name at returned
+ * offset.
+ */
+static int usbg_attr_dir(usbg_function *f, const char *subdir, char *buf,
+			 size_t len)
+{
+	int nmb;
+
+	if (subdir)
+		nmb = snprintf(buf, len, "%s/%s/%s/", f->path, f->name,
+			       subdir);
+	else
+		nmb = snprintf(buf, len, "%s/%s/", f->path, f->name);
+
+	return nmb < len ? nmb : USBG_ERROR_PATH_TOO_LONG;
+}
+
+static int usbg_attr_name(char *buf, size_t len, int off, const char *name)
+{
+	size_t nlen = strlen(name);
+
+	if (off + nlen >= len)
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	memcpy(buf + off, name, nlen + 1);
+	return USBG_SUCCESS;
+}
+
+/* Read content of attribute without trailing newline */
+static int usbg_attr_read_raw(const char *path, char *buf, size_t len)
+{
+	int nmb;
+
+	nmb = usbg_sys_read(path, buf, len - 1);
+	if (nmb < 0)
+		return usbg_translate_error(errno);
+
+	buf[nmb] = '\0';
+	if (nmb && buf[nmb - 1] == '\n')
+		buf[nmb - 1] = '\0';
+
+	return USBG_SUCCESS;
+}
+
+/* Convert content of attribute to value stored in usbg_function_attrs */
+int usbg_attr_parse(const usbg_attr_desc *d, const char *str, void *val)
+{
+	struct ether_addr *addr;
+	char *end;
+	long num;
+
+	switch (d->type) {
+	case USBG_ATTR_INT:
+		errno = 0;
+		num = strtol(str, &end, d->base);
+		if (end == str || errno || num < INT_MIN || num > INT_MAX)
+			return USBG_ERROR_INVALID_VALUE;
+		while (*end == ' ' || *end == '\n')
+			++end;
+		if (*end)
+			return USBG_ERROR_INVALID_VALUE;
+		*(int *)val = num;
+		break;
+	case USBG_ATTR_STRING:
+		if (strlen(str) >= USBG_MAX_STR_LENGTH)
+			return USBG_ERROR_INVALID_VALUE;
+		strcpy(val, str);
+		break;
+	case USBG_ATTR_ETHER_ADDR:
+		addr = ether_aton_r(str, val);
+		if (!addr)
+			return USBG_ERROR_INVALID_VALUE;
+		break;
+	case USBG_ATTR_PATH:
+		if (strlen(str) >= USBG_MAX_PATH_LENGTH)
+			return USBG_ERROR_INVALID_VALUE;
+		strcpy(val, str);
+		break;
+	default:
+		return USBG_ERROR_INVALID_TYPE;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/* Inverse of usbg_attr_parse(), buf has USBG_MAX_PATH_LENGTH bytes */
+static int usbg_attr_format(const usbg_attr_desc *d, const void *val,
+			    char *buf)
+{
+	int nmb;
+
+	switch (d->type) {
+	case USBG_ATTR_INT:
+		nmb = snprintf(buf, USBG_MAX_STR_LENGTH,
+			       d->base == 16 ? "0x%x\n" : "%d\n",
+			       *(const int *)val);
+		break;
+	case USBG_ATTR_STRING:
+		nmb = snprintf(buf, USBG_MAX_STR_LENGTH, "%s",
+			       (const char *)val);
+		break;
+	case USBG_ATTR_ETHER_ADDR:
+		ether_ntoa_r(val, buf);
+		nmb = strlen(buf);
+		break;
+	case USBG_ATTR_PATH:
+		/* Newline lets empty path be written, kernel strips it */
+		nmb = snprintf(buf, USBG_MAX_PATH_LENGTH, "%s\n",
+			       (const char *)val);
+		return nmb < USBG_MAX_PATH_LENGTH ? nmb
+			: USBG_ERROR_INVALID_PARAM;
+	default:
+		return USBG_ERROR_INVALID_TYPE;
+	}
+
+	return nmb < USBG_MAX_STR_LENGTH ? nmb : USBG_ERROR_INVALID_PARAM;
+}
+
+/* Whether value of read only attribute is the one which means "unset" */
+static int usbg_attr_is_empty(const usbg_attr_desc *d, const void *val)
+{
+	static const struct ether_addr zero;
+
+	switch (d->type) {
+	case USBG_ATTR_INT:
+		return *(const int *)val == 0;
+	case USBG_ATTR_STRING:
+	case USBG_ATTR_PATH:
+		return *(const char *)val == '\0';
+	case USBG_ATTR_ETHER_ADDR:
+		return !memcmp(val, &zero, sizeof(zero));
+	}
+
+	return 0;
+}
+
+static int usbg_attr_read_at(char *path, size_t len, int off,
+			     const usbg_attr_desc *d, void *val)
+{
+	char buf[USBG_MAX_PATH_LENGTH];
+	int ret;
+
+	ret = usbg_attr_name(path, len, off, d->name);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_attr_read_raw(path, buf, sizeof(buf));
+	if (ret == USBG_ERROR_NOT_FOUND && d->optional)
+		return usbg_attr_parse(d, d->type == USBG_ATTR_INT ? "0" : "",
+				       val);
+
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_attr_parse(d, buf, val);
+	return ret == USBG_ERROR_INVALID_VALUE ? USBG_ERROR_IO : ret;
+}
+
+static int usbg_attr_write_at(char *path, size_t len, int off,
+			      const usbg_attr_desc *d, const void *val)
+{
+	char buf[USBG_MAX_PATH_LENGTH];
+	int ret, nmb;
+
+	ret = usbg_attr_name(path, len, off, d->name);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	nmb = usbg_attr_format(d, val, buf);
+	if (nmb < 0)
+		return nmb;
+
+	nmb = usbg_sys_write(path, buf, nmb);
+	return nmb < 0 ? usbg_translate_error(errno) : USBG_SUCCESS;
+}
+
+int usbg_read_function_attr(usbg_function *f, const char *subdir,
+			    const usbg_attr_desc *d, void *val)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int off;
+
+	off = usbg_attr_dir(f, subdir, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	return usbg_attr_read_at(path, sizeof(path), off, d, val);
+}
+
+int usbg_write_function_attr(usbg_function *f, const char *subdir,
+			     const usbg_attr_desc *d, const void *val)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int off, ret;
+
+	if (!d->writable)
+		return USBG_ERROR_NO_ACCESS;
+
+	off = usbg_attr_dir(f, subdir, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	ret = usbg_attr_write_at(path, sizeof(path), off, d, val);
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+int usbg_read_attr_group(usbg_function *f, const char *subdir,
+			 const usbg_attr_desc *descs, int n, void *base)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int i, off;
+	int ret = USBG_SUCCESS;
+
+	off = usbg_attr_dir(f, subdir, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	for (i = 0; i < n && ret == USBG_SUCCESS; ++i)
+		ret = usbg_attr_read_at(path, sizeof(path), off, descs + i,
+					(char *)base + descs[i].offset);
+
+	return ret;
+}
+
+int usbg_write_attr_group(usbg_function *f, const char *subdir,
+			  const usbg_attr_desc *descs, int n,
+			  const void *base)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	const void *val;
+	int i, off;
+	int ret = USBG_SUCCESS;
+
+	/* Read only attributes are accepted only when left unset */
+	for (i = 0; i < n; ++i) {
+		val = (const char *)base + descs[i].offset;
+		if (!descs[i].writable && !usbg_attr_is_empty(descs + i, val))
+			return USBG_ERROR_INVALID_PARAM;
+	}
+
+	off = usbg_attr_dir(f, subdir, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	for (i = 0; i < n && ret == USBG_SUCCESS; ++i) {
+		val = (const char *)base + descs[i].offset;
+		if (!descs[i].writable)
+			continue;
+
+		/* Kernel rejects empty keywords, keep its default instead */
+		if ((descs[i].type == USBG_ATTR_STRING || descs[i].optional)
+		    && usbg_attr_is_empty(descs + i, val))
+			continue;
+
+		ret = usbg_attr_write_at(path, sizeof(path), off, descs + i,
+					 val);
+	}
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+int usbg_read_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs)
+{
+	const usbg_attr_desc *descs;
+	int n;
+
+	n = usbg_get_function_attr_descs(f->type, &descs);
+	return n < 0 ? n : usbg_read_attr_group(f, NULL, descs, n, f_attrs);
+}
+
+int usbg_write_function_attrs(usbg_function *f, usbg_function_attrs *f_attrs)
+{
+	const usbg_attr_desc *descs;
+	int n;
+
+	n = usbg_get_function_attr_descs(f->type, &descs);
+	return n < 0 ? n : usbg_write_attr_group(f, NULL, descs, n, f_attrs);
+}
+
+int usbg_get_function_attr(usbg_function *f, const char *name,
+			   char *buf, size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	const usbg_attr_desc *d;
+	int off;
+
+	if (!f || !name || !buf || !len)
+		return USBG_ERROR_INVALID_PARAM;
+
+	d = usbg_find_function_attr(f->type, name);
+	if (!d)
+		return USBG_ERROR_NOT_FOUND;
+
+	off = usbg_attr_dir(f, NULL, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	off = usbg_attr_name(path, sizeof(path), off, d->name);
+	if (off < 0)
+		return off;
+
+	return usbg_attr_read_raw(path, buf, len);
+}
+
+int usbg_get_function_attr_int(usbg_function *f, const char *name, int *val)
+{
+	const usbg_attr_desc *d;
+
+	if (!f || !name || !val)
+		return USBG_ERROR_INVALID_PARAM;
+
+	d = usbg_find_function_attr(f->type, name);
+	if (!d)
+		return USBG_ERROR_NOT_FOUND;
+
+	if (d->type != USBG_ATTR_INT)
+		return USBG_ERROR_INVALID_TYPE;
+
+	return usbg_read_function_attr(f, NULL, d, val);
+}
+
+static int usbg_do_set_function_attr(usbg_function *f, const char *name,
+				     const char *val)
+{
+	union {
+		int num;
+		char str[USBG_MAX_PATH_LENGTH];
+		struct ether_addr addr;
+	} v;
+	const usbg_attr_desc *d;
+	int ret;
+
+	if (!f || !name || !val)
+		return USBG_ERROR_INVALID_PARAM;
+
+	d = usbg_find_function_attr(f->type, name);
+	if (!d)
+		return USBG_ERROR_NOT_FOUND;
+
+	ret = usbg_attr_parse(d, val, &v);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	return usbg_write_function_attr(f, NULL, d, &v);
+}
+
+int usbg_set_function_attr(usbg_function *f, const char *name,
+			   const char *val)
+{
+	return USBG_STATS_CALL(USBG_STAT_SET_FUNCTION_ATTRS,
+			usbg_do_set_function_attr(f, name, val));
+}
+
+static int usbg_do_set_function_attr_int(usbg_function *f, const char *name,
+					 int val)
+{
+	const usbg_attr_desc *d;
+
+	if (!f || !name)
+		return USBG_ERROR_INVALID_PARAM;
+
+	d = usbg_find_function_attr(f->type, name);
+	if (!d)
+		return USBG_ERROR_NOT_FOUND;
+
+	if (d->type != USBG_ATTR_INT)
+		return USBG_ERROR_INVALID_TYPE;
+
+	return usbg_write_function_attr(f, NULL, d, &val);
+}
+
+int usbg_set_function_attr_int(usbg_function *f, const char *name, int val)
+{
+	return USBG_STATS_CALL(USBG_STAT_SET_FUNCTION_ATTRS,
+			usbg_do_set_function_attr_int(f, name, val));
+}
+
+static int attr_select(const struct dirent *dent)
+{
+	return dent->d_type != DT_DIR && dent->d_type != DT_LNK &&
+		strcmp(dent->d_name, ".") && strcmp(dent->d_name, "..");
+}
+
+int usbg_for_each_function_attr(usbg_function *f, usbg_attr_cb cb,
+				void *data)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char buf[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	const usbg_attr_desc *d;
+	int i, n, off;
+	int ret = USBG_SUCCESS;
+
+	if (!f || !cb)
+		return USBG_ERROR_INVALID_PARAM;
+
+	off = usbg_attr_dir(f, NULL, path, sizeof(path));
+	if (off < 0)
+		return off;
+
+	path[off - 1] = '\0';
+	n = usbg_sys_scandir(path, &dent, attr_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+	path[off - 1] = '/';
+
+	for (i = 0; i < n; ++i) {
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		ret = usbg_attr_name(path, sizeof(path), off,
+				     dent[i]->d_name);
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		d = usbg_find_function_attr(f->type, dent[i]->d_name);
+		ret = usbg_attr_read_raw(path, buf, sizeof(buf));
+		if (ret != USBG_SUCCESS) {
+			/* Unknown entries may be write only or directories */
+			if (!d)
+				ret = USBG_SUCCESS;
+			goto next;
+		}
+
+		ret = cb(dent[i]->d_name, d, buf, data);
+next:
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
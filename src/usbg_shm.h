@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef __USBG_SHM_H__
+#define __USBG_SHM_H__
+
+#include <stdint.h>
+
+/*
+ * Format shared by usbg daemon and its clients.
+ *
+ * Shared memory holds image of configfs gadget tree and of the UDC class
+ * directory: header, array of nodes sorted by path and pool of strings
+ * and attribute values. All offsets are counted from the beginning of the
+ * mapping. Image is rewritten in place, protected by seqlock: seq is odd
+ * while daemon writes, so readers copy data out and retry if seq changed.
+ *
+ * Mutations are sent over SOCK_SEQPACKET unix socket, one batch per
+ * message. Daemon applies operations in order, stops on the first error,
+ * publishes new image and then replies, so client sees its own changes.
+ */
+
+#define USBG_SHM_MAGIC 0x55534247 /* "USBG" */
+#define USBG_SHM_VERSION 1
+
+/* Biggest message of the protocol, limits the size of single batch */
+#define USBG_SHM_MAX_MSG 65536
+
+#define USBG_SHM_UDC_CLASS "/sys/class/udc"
+
+typedef enum {
+	USBG_SHM_DIR,
+	USBG_SHM_FILE,
+	USBG_SHM_LINK,
+} usbg_shm_type;
+
+struct usbg_shm_hdr
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;		/* Size of whole mapping */
+	uint64_t seq;
+	uint32_t n_nodes;
+	uint32_t len;		/* Bytes of image in use */
+};
+
+struct usbg_shm_node
+{
+	uint32_t path;
+	uint32_t type;
+	int32_t err;		/* Negative errno if attribute was not readable */
+	uint32_t data;		/* Value of attribute or target of link */
+	uint32_t len;
+};
+
+/* Sent by daemon on connect together with descriptor of shared memory */
+struct usbg_shm_hello
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+};
+
+typedef enum {
+	USBG_SHM_OP_WRITE,
+	USBG_SHM_OP_MKDIR,
+	USBG_SHM_OP_RMDIR,
+	USBG_SHM_OP_UNLINK,
+	USBG_SHM_OP_SYMLINK,
+} usbg_shm_op_type;
+
+/* Request is n_ops followed by operations, each followed by its strings */
+struct usbg_shm_op
+{
+	uint32_t op;
+	uint32_t path_len;	/* Including '\0' */
+	uint32_t arg_len;	/* Data to write or target of link with '\0' */
+};
+
+struct usbg_shm_reply
+{
+	int32_t n_done;
+	int32_t err;		/* Negative errno of operation n_done */
+};
+
+/*
+ * Order paths by components, so each directory is directly followed
+ * by all its descendants.
+ */
+static inline int usbg_shm_path_cmp(const char *a, const char *b)
+{
+	unsigned char ca, cb;
+
+	for (;; ++a, ++b) {
+		ca = *a == '/' ? 1 : (unsigned char)*a;
+		cb = *b == '/' ? 1 : (unsigned char)*b;
+		if (ca != cb || !ca)
+			return ca - cb;
+	}
+}
+
+#endif /* __USBG_SHM_H__ */
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_snapshot.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_snapshot.c
+ * @brief Copy on write snapshots of gadget tree
+ */
+
+/*
+ * Gadget nodes are shared between consecutive snapshots as long as the
+ * gadget does not change. Both kinds of objects are freed by whoever drops
+ * the last reference, so counters are updated atomically.
+ */
+struct usbg_snap_node
+{
+	usbg_snap_gadget pub;
+	int refs;
+	const usbg_gadget *owner;
+	uint64_t gen;
+};
+
+struct usbg_snap
+{
+	usbg_snapshot pub;
+	int refs;
+	struct usbg_snap_node **nodes;
+};
+
+static void usbg_snap_node_put(struct usbg_snap_node *n)
+{
+	int i;
+
+	if (!n || __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	for (i = 0; i < n->pub.n_configs; ++i) {
+		const usbg_snap_config *c = &n->pub.configs[i];
+		int j;
+
+		for (j = 0; j < c->n_bindings; ++j)
+			free((char *)c->bindings[j].name);
+		free((usbg_snap_binding *)c->bindings);
+		free((char *)c->label);
+	}
+
+	for (i = 0; i < n->pub.n_functions; ++i) {
+		free((char *)n->pub.functions[i].name);
+		free((char *)n->pub.functions[i].instance);
+	}
+
+	free((usbg_snap_config *)n->pub.configs);
+	free((usbg_snap_function *)n->pub.functions);
+	free((char *)n->pub.udc);
+	free((char *)n->pub.name);
+	free(n);
+}
+
+static void usbg_snap_put(struct usbg_snap *snap)
+{
+	int i;
+
+	if (!snap || __atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	for (i = 0; i < snap->pub.n_gadgets; ++i)
+		usbg_snap_node_put(snap->nodes[i]);
+
+	free(snap->nodes);
+	free(snap);
+}
+
+/* Reading strings of lang which was never set is not an error here */
+static int usbg_snap_strs_ret(int ret)
+{
+	return ret == USBG_ERROR_NOT_FOUND ? USBG_SUCCESS : ret;
+}
+
+static int usbg_snap_read_config(usbg_config *c, usbg_snap_config *sc,
+		usbg_snap_function *functions, usbg_function *f_first)
+{
+	usbg_snap_binding *bindings;
+	usbg_function *f;
+	usbg_binding *b;
+	int ret;
+	int i;
+
+	sc->label = strdup(c->label);
+	if (!sc->label)
+		return USBG_ERROR_NO_MEM;
+
+	sc->id = c->id;
+
+	ret = usbg_get_config_attrs(c, &sc->attrs);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_snap_strs_ret(usbg_get_config_strs(c, LANG_US_ENG,
+					&sc->strs));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	TAILQ_FOREACH(b, &c->bindings, bnode)
+		sc->n_bindings++;
+
+	if (!sc->n_bindings)
+		return USBG_SUCCESS;
+
+	bindings = calloc(sc->n_bindings, sizeof(*bindings));
+	if (!bindings) {
+		sc->n_bindings = 0;
+		return USBG_ERROR_NO_MEM;
+	}
+
+	sc->bindings = bindings;
+	TAILQ_FOREACH(b, &c->bindings, bnode) {
+		bindings->name = strdup(b->name);
+		if (!bindings->name)
+			return USBG_ERROR_NO_MEM;
+
+		/* Functions of snapshot are in the same order as in gadget */
+		i = 0;
+		for (f = f_first; f && f != b->target; f = TAILQ_NEXT(f, fnode))
+			++i;
+		bindings->target = f ? &functions[i] : NULL;
+		++bindings;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/* Caller has to hold lock of gadget */
+static int usbg_snap_read_gadget(usbg_gadget *g, uint64_t gen,
+		struct usbg_snap_node **node)
+{
+	struct usbg_snap_node *n;
+	usbg_snap_function *functions;
+	usbg_snap_config *configs;
+	usbg_function *f;
+	usbg_config *c;
+	int ret = USBG_ERROR_NO_MEM;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		goto out;
+
+	n->refs = 1;
+	n->owner = g;
+	n->gen = gen;
+	n->pub.name = strdup(g->name);
+	n->pub.udc = strdup(g->udc);
+	if (!n->pub.name || !n->pub.udc)
+		goto err;
+
+	ret = usbg_get_gadget_attrs(g, &n->pub.attrs);
+	if (ret != USBG_SUCCESS)
+		goto err;
+
+	ret = usbg_snap_strs_ret(usbg_get_gadget_strs(g, LANG_US_ENG,
+					&n->pub.strs));
+	if (ret != USBG_SUCCESS)
+		goto err;
+
+	TAILQ_FOREACH(f, &g->functions, fnode)
+		n->pub.n_functions++;
+	TAILQ_FOREACH(c, &g->configs, cnode)
+		n->pub.n_configs++;
+
+	ret = USBG_ERROR_NO_MEM;
+	functions = calloc(n->pub.n_functions + 1, sizeof(*functions));
+	n->pub.functions = functions;
+	configs = calloc(n->pub.n_configs + 1, sizeof(*configs));
+	n->pub.configs = configs;
+	if (!functions || !configs) {
+		/* Nothing to be freed inside of arrays yet */
+		n->pub.n_functions = n->pub.n_configs = 0;
+		goto err;
+	}
+
+	TAILQ_FOREACH(f, &g->functions, fnode) {
+		functions->name = strdup(f->name);
+		functions->instance = strdup(f->instance);
+		functions->type = f->type;
+		if (!functions->name || !functions->instance) {
+			ret = USBG_ERROR_NO_MEM;
+			goto err;
+		}
+
+		ret = usbg_get_function_attrs(f, &functions->attrs);
+		if (ret != USBG_SUCCESS)
+			goto err;
+
+		++functions;
+	}
+
+	TAILQ_FOREACH(c, &g->configs, cnode) {
+		ret = usbg_snap_read_config(c, configs,
+				(usbg_snap_function *)n->pub.functions,
+				TAILQ_FIRST(&g->functions));
+		if (ret != USBG_SUCCESS)
+			goto err;
+
+		++configs;
+	}
+
+	*node = n;
+	ret = USBG_SUCCESS;
+	goto out;
+
+err:
+	usbg_snap_node_put(n);
+out:
+	return ret;
+}
+
+static struct usbg_snap_node *usbg_snap_find_node(struct usbg_snap *old,
+		const usbg_gadget *g, uint64_t gen)
+{
+	int i;
+
+	if (!old)
+		return NULL;
+
+	for (i = 0; i < old->pub.n_gadgets; ++i)
+		if (old->nodes[i]->owner == g && old->nodes[i]->gen == gen)
+			return old->nodes[i];
+
+	return NULL;
+}
+
+/* Caller has to hold snap_lock of state */
+static int usbg_snap_build(usbg_state *s, uint64_t gen,
+		struct usbg_snap **snap)
+{
+	struct usbg_snap *old = s->snap;
+	struct usbg_snap *new;
+	struct usbg_snap_node *n;
+	usbg_gadget *g;
+	uint64_t ggen;
+	int ret = USBG_ERROR_NO_MEM;
+
+	new = calloc(1, sizeof(*new));
+	if (!new)
+		goto out;
+
+	new->refs = 1;
+	new->pub.version = gen;
+
+	usbg_rdlock(s);
+
+	TAILQ_FOREACH(g, &s->gadgets, gnode)
+		new->pub.n_gadgets++;
+
+	new->nodes = calloc(new->pub.n_gadgets + 1, sizeof(*new->nodes));
+	if (!new->nodes) {
+		new->pub.n_gadgets = 0;
+		goto unlock;
+	}
+
+	new->pub.n_gadgets = 0;
+	TAILQ_FOREACH(g, &s->gadgets, gnode) {
+		usbg_rdlock(g);
+		ggen = __atomic_load_n(&g->gen, __ATOMIC_ACQUIRE);
+
+		n = usbg_snap_find_node(old, g, ggen);
+		if (n) {
+			__atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED);
+			ret = USBG_SUCCESS;
+		} else {
+			ret = usbg_snap_read_gadget(g, ggen, &n);
+		}
+
+		usbg_unlock(g);
+		/*
+		 * Gadget which is being removed is still on the list but its
+		 * directory is already gone. It is going to disappear anyway.
+		 */
+		if (ret == USBG_ERROR_NOT_FOUND)
+			continue;
+		if (ret != USBG_SUCCESS)
+			goto unlock;
+
+		new->nodes[new->pub.n_gadgets++] = n;
+	}
+
+	/* Each node begins with its public part */
+	new->pub.gadgets = (const usbg_snap_gadget *const *)new->nodes;
+	ret = USBG_SUCCESS;
+
+unlock:
+	usbg_unlock(s);
+	if (ret == USBG_SUCCESS)
+		*snap = new;
+	else
+		usbg_snap_put(new);
+out:
+	return ret;
+}
+
+int usbg_snapshot_take(usbg_state *s, const usbg_snapshot **snap)
+{
+	struct usbg_snap *old = NULL;
+	struct usbg_snap *new;
+	uint64_t gen;
+	int ret = USBG_SUCCESS;
+
+	if (!s || !snap)
+		return USBG_ERROR_INVALID_PARAM;
+
+	pthread_mutex_lock(&s->snap_lock);
+
+	/*
+	 * Read generation before the tree, so change racing with the build
+	 * at worst causes unnecessary rebuild by next caller.
+	 */
+	gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
+	if (s->snap && s->snap->pub.version == gen) {
+		new = s->snap;
+	} else {
+		ret = usbg_snap_build(s, gen, &new);
+		if (ret != USBG_SUCCESS)
+			goto out;
+
+		old = s->snap;
+		s->snap = new;
+	}
+
+	__atomic_add_fetch(&new->refs, 1, __ATOMIC_RELAXED);
+	*snap = &new->pub;
+
+out:
+	pthread_mutex_unlock(&s->snap_lock);
+	/* Drop reference of state outside of the lock */
+	usbg_snap_put(old);
+	return ret;
+}
+
+void usbg_snapshot_release(const usbg_snapshot *snap)
+{
+	/* Public part is the first member */
+	usbg_snap_put((struct usbg_snap *)snap);
+}
+
+static int usbg_snap_cmp_name(const void *name, const void *g)
+{
+	return strcmp(name, (*(const usbg_snap_gadget *const *)g)->name);
+}
+
+const usbg_snap_gadget *usbg_snapshot_get_gadget(const usbg_snapshot *snap,
+		const char *name)
+{
+	const usbg_snap_gadget *const *g;
+
+	if (!snap || !name)
+		return NULL;
+
+	/* Gadgets are kept sorted by name, same as in usbg_state */
+	g = bsearch(name, snap->gadgets, snap->n_gadgets, sizeof(*g),
+		    usbg_snap_cmp_name);
+
+	return g ? *g : NULL;
+}
+
+void usbg_snapshot_cleanup(usbg_state *s)
+{
+	usbg_snap_put(s->snap);
+	s->snap = NULL;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_stats.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_stats.c
+ * @brief Collection of operation counters and latency histograms
+ */
+
+int usbg_stats_enabled;
+
+static usbg_stats usbg_cur_stats;
+
+static const char *stat_op_names[] = {
+	[USBG_STAT_READ] = "read",
+	[USBG_STAT_WRITE] = "write",
+	[USBG_STAT_MKDIR] = "mkdir",
+	[USBG_STAT_RMDIR] = "rmdir",
+	[USBG_STAT_UNLINK] = "unlink",
+	[USBG_STAT_SYMLINK] = "symlink",
+	[USBG_STAT_READLINK] = "readlink",
+	[USBG_STAT_SCANDIR] = "scandir",
+	[USBG_STAT_CHECK_DIR] = "check_dir",
+	[USBG_STAT_INIT] = "usbg_init",
+	[USBG_STAT_CREATE_GADGET] = "usbg_create_gadget",
+	[USBG_STAT_RM_GADGET] = "usbg_rm_gadget",
+	[USBG_STAT_SET_GADGET_ATTRS] = "usbg_set_gadget_attrs",
+	[USBG_STAT_SET_GADGET_STRS] = "usbg_set_gadget_strs",
+	[USBG_STAT_CREATE_FUNCTION] = "usbg_create_function",
+	[USBG_STAT_RM_FUNCTION] = "usbg_rm_function",
+	[USBG_STAT_SET_FUNCTION_ATTRS] = "usbg_set_function_attrs",
+	[USBG_STAT_CREATE_CONFIG] = "usbg_create_config",
+	[USBG_STAT_RM_CONFIG] = "usbg_rm_config",
+	[USBG_STAT_ADD_CONFIG_FUNCTION] = "usbg_add_config_function",
+	[USBG_STAT_GET_UDCS] = "usbg_get_udcs",
+	[USBG_STAT_ENABLE_GADGET] = "usbg_enable_gadget",
+	[USBG_STAT_DISABLE_GADGET] = "usbg_disable_gadget",
+	[USBG_STAT_EXPORT_GADGET] = "usbg_export_gadget",
+	[USBG_STAT_IMPORT_GADGET] = "usbg_import_gadget",
+};
+
+uint64_t usbg_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	/* Never return 0 as it means that statistics are disabled */
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + 1;
+}
+
+void usbg_stats_account(usbg_stat_op op, uint64_t start, int failed)
+{
+	usbg_stats_record(op, usbg_stats_now() - start, failed);
+}
+
+void usbg_stats_record(usbg_stat_op op, uint64_t ns, int failed)
+{
+	usbg_op_stats *s = &usbg_cur_stats.ops[op];
+	uint64_t old;
+	int bucket;
+
+	bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+	if (bucket >= USBG_STATS_HIST_BUCKETS)
+		bucket = USBG_STATS_HIST_BUCKETS - 1;
+
+	/* Counters may be updated from many threads, relaxed order is enough */
+	__atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&s->total_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&s->hist[bucket], 1, __ATOMIC_RELAXED);
+	if (failed)
+		__atomic_add_fetch(&s->errors, 1, __ATOMIC_RELAXED);
+
+	old = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+	while (ns > old && !__atomic_compare_exchange_n(&s->max_ns, &old, ns,
+			1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	old = __atomic_load_n(&s->min_ns, __ATOMIC_RELAXED);
+	while ((!old || ns < old) && !__atomic_compare_exchange_n(&s->min_ns,
+			&old, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void usbg_enable_stats(int enable)
+{
+	__atomic_store_n(&usbg_stats_enabled, !!enable, __ATOMIC_RELAXED);
+}
+
+int usbg_get_stats(usbg_stats *stats)
+{
+	const uint64_t *src = (const uint64_t *)&usbg_cur_stats;
+	uint64_t *dst = (uint64_t *)stats;
+	size_t i;
+
+	if (!stats)
+		return USBG_ERROR_INVALID_PARAM;
+
+	/* Each counter is read atomically, but not all of them at once */
+	for (i = 0; i < sizeof(*stats) / sizeof(*dst); ++i)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+	return USBG_SUCCESS;
+}
+
+void usbg_reset_stats(void)
+{
+	uint64_t *dst = (uint64_t *)&usbg_cur_stats;
+	size_t i;
+
+	for (i = 0; i < sizeof(usbg_cur_stats) / sizeof(*dst); ++i)
+		__atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+}
+
+const char *usbg_stat_op_name(usbg_stat_op op)
+{
+	return op >= 0 && op < USBG_STAT_OP_MAX ? stat_op_names[op] : NULL;
+}
+
+uint64_t usbg_stats_percentile(const usbg_op_stats *s, double pct)
+{
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (!s || !s->count)
+		return 0;
+
+	rank = pct >= 100 ? s->count : (uint64_t)(s->count * pct / 100);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < USBG_STATS_HIST_BUCKETS; ++i) {
+		seen += s->hist[i];
+		if (seen >= rank)
+			break;
+	}
+
+	if (i >= USBG_STATS_HIST_BUCKETS - 1 || (2ULL << i) - 1 > s->max_ns)
+		return s->max_ns;
+
+	return (2ULL << i) - 1;
+}
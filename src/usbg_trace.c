@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <usbg/usbg.h>
+#include <usbg/usbg_trace.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_trace.c
+ * @brief USDT probes and trace callback around configfs operations
+ */
+
+#ifdef HAVE_SYS_SDT_H
+/* Probes are skipped cheaply unless a tracer increments semaphore */
+unsigned short libusbg_io_start_semaphore
+	__attribute__((unused, section(".probes")));
+unsigned short libusbg_io_done_semaphore
+	__attribute__((unused, section(".probes")));
+#endif
+
+usbg_trace_cb usbg_trace_hook;
+static void *usbg_trace_hook_data;
+
+static const char *usbg_trace_attr(const char *path)
+{
+	const char *attr = strrchr(path, '/');
+
+	return attr ? attr + 1 : path;
+}
+
+static void usbg_trace_call_hook(struct usbg_trace_ctx *t,
+				 usbg_trace_phase phase, int ret,
+				 uint64_t ns)
+{
+	char object[USBG_MAX_PATH_LENGTH];
+	usbg_trace_event ev;
+	const char *attr = usbg_trace_attr(t->path);
+	size_t len;
+
+	len = attr > t->path ? attr - t->path - 1 : 0;
+	if (len >= sizeof(object))
+		len = sizeof(object) - 1;
+
+	memcpy(object, t->path, len);
+	object[len] = '\0';
+
+	ev.phase = phase;
+	ev.op = t->op;
+	ev.object = object;
+	ev.attr = attr;
+	ev.target = t->target;
+	ev.ret = ret;
+	ev.duration_ns = ns;
+
+	usbg_trace_hook(&ev, usbg_trace_hook_data);
+}
+
+void usbg_trace_begin_slow(struct usbg_trace_ctx *t)
+{
+	t->start = usbg_stats_now();
+
+	USBG_PROBE4(io_start, usbg_stat_op_name(t->op), t->path,
+		    usbg_trace_attr(t->path), t->target);
+
+	if (usbg_trace_hook)
+		usbg_trace_call_hook(t, USBG_TRACE_BEGIN, 0, 0);
+}
+
+void usbg_trace_end_slow(struct usbg_trace_ctx *t, int ret)
+{
+	uint64_t ns = usbg_stats_now() - t->start;
+
+	if (usbg_stats_enabled)
+		usbg_stats_record(t->op, ns, ret < 0);
+
+	USBG_PROBE5(io_done, usbg_stat_op_name(t->op), t->path,
+		    usbg_trace_attr(t->path), ret, ns);
+
+	if (usbg_trace_hook)
+		usbg_trace_call_hook(t, USBG_TRACE_END, ret, ns);
+}
+
+void usbg_set_trace_callback(usbg_trace_cb cb, void *data)
+{
+	usbg_trace_hook_data = data;
+	usbg_trace_hook = cb;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_uac.c
+ * @brief Bandwidth check of audio functions
+ */
+
+#define USBG_UDC_CLASS_PATH "/sys/class/udc"
+
+/*
+ * f_uac1 and f_uac2 send one packet per millisecond at any speed
+ * (bInterval 1 for full speed, 4 for high speed) and don't use
+ * additional transactions, so a single packet has to carry it all.
+ */
+#define USBG_UAC_PACKETS_PER_SEC 1000
+#define USBG_UAC_FS_MAX_PACKET 1023
+#define USBG_UAC_HS_MAX_PACKET 1024
+
+static int usbg_uac_packet_size(int chmask, int srate, int ssize)
+{
+	if (!chmask)
+		return 0;
+
+	/* Extra sample covers rates which don't divide evenly */
+	return __builtin_popcount(chmask) * ssize
+		* ((srate + USBG_UAC_PACKETS_PER_SEC - 1)
+		   / USBG_UAC_PACKETS_PER_SEC + 1);
+}
+
+/* Limit of isochronous packet according to maximum speed of UDC */
+static int usbg_uac_max_packet(usbg_function *f, const char *udc)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char speed[USBG_MAX_NAME_LENGTH];
+	int nmb;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s/maximum_speed",
+		       USBG_UDC_CLASS_PATH, udc);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	nmb = usbg_sys_read(path, speed, sizeof(speed) - 1);
+	if (nmb < 0) {
+		DEBUG(&f->parent->parent->log,
+		      "speed of %s unknown, assuming high speed", udc);
+		return USBG_UAC_HS_MAX_PACKET;
+	}
+
+	speed[nmb] = '\0';
+	return !strncmp(speed, "full-speed", strlen("full-speed")) ?
+		USBG_UAC_FS_MAX_PACKET : USBG_UAC_HS_MAX_PACKET;
+}
+
+int usbg_check_uac_bandwidth(usbg_function *f, const char *udc,
+			     usbg_uac_bandwidth *bw)
+{
+	char udc_buf[USBG_MAX_STR_LENGTH];
+	struct dirent **udc_list;
+	usbg_function_attrs f_attrs;
+	usbg_uac_bandwidth tmp;
+	int c_srate;
+	int i, ret;
+
+	if (!f || (f->type != F_UAC2 && f->type != F_UAC1))
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (!bw)
+		bw = &tmp;
+
+	ret = usbg_get_function_attrs(f, &f_attrs);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	/* Same UDC as usbg_enable_gadget() would choose */
+	if (!udc) {
+		usbg_get_gadget_udc(f->parent, udc_buf, sizeof(udc_buf));
+		if (!udc_buf[0]) {
+			ret = usbg_get_udcs(&udc_list);
+			if (ret <= 0)
+				return ret < 0 ? ret : USBG_ERROR_NOT_FOUND;
+
+			snprintf(udc_buf, sizeof(udc_buf), "%s",
+				 udc_list[0]->d_name);
+			for (i = 0; i < ret; ++i)
+				free(udc_list[i]);
+			free(udc_list);
+		}
+		udc = udc_buf;
+	}
+
+	bw->max_packet = usbg_uac_max_packet(f, udc);
+	if (bw->max_packet < 0)
+		return bw->max_packet;
+
+	if (f->type == F_UAC2) {
+		/* Async capture must accept what feedback asks for */
+		c_srate = f_attrs.uac2.c_srate;
+		if (strcmp(f_attrs.uac2.c_sync, "adaptive"))
+			c_srate = (long long)c_srate
+				* (1000 + f_attrs.uac2.fb_max) / 1000;
+
+		bw->playback = usbg_uac_packet_size(f_attrs.uac2.p_chmask,
+						    f_attrs.uac2.p_srate,
+						    f_attrs.uac2.p_ssize);
+		bw->capture = usbg_uac_packet_size(f_attrs.uac2.c_chmask,
+						   c_srate,
+						   f_attrs.uac2.c_ssize);
+	} else {
+		bw->playback = usbg_uac_packet_size(f_attrs.uac1.p_chmask,
+						    f_attrs.uac1.p_srate,
+						    f_attrs.uac1.p_ssize);
+		bw->capture = usbg_uac_packet_size(f_attrs.uac1.c_chmask,
+						   f_attrs.uac1.c_srate,
+						   f_attrs.uac1.c_ssize);
+	}
+
+	if (bw->playback > bw->max_packet || bw->capture > bw->max_packet) {
+		ERROR(&f->parent->parent->log,
+		      "%s needs %d bytes for playback and %d for capture, %s allows %d",
+		      f->name, bw->playback, bw->capture, udc,
+		      bw->max_packet);
+		return USBG_ERROR_INVALID_VALUE;
+	}
+
+	return USBG_SUCCESS;
+}
@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2014 Samsung Electronics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <usbg/usbg.h>
+
+#include "usbg_internal.h"
+
+/**
+ * @file usbg_uvc.c
+ * @brief Formats, frames and headers of UVC function
+ * @details Layout created in function directory:
+ * streaming/<type>/<format>/<frame>, streaming/header/h with link to
+ * each format, streaming/class/{fs,hs,ss}/h and control/class/{fs,ss}/h
+ * linking headers. Kernel refuses to bind function without them.
+ */
+
+/* Name of both streaming and control header */
+#define USBG_UVC_HEADER "h"
+
+static const struct {
+	const char *dir;
+	const char *name;
+} usbg_uvc_format_dirs[] = {
+	[USBG_UVC_FORMAT_UNCOMPRESSED] = { "uncompressed", "u" },
+	[USBG_UVC_FORMAT_MJPEG] = { "mjpeg", "m" },
+};
+
+static const char *const usbg_uvc_streaming_classes[] = { "fs", "hs", "ss" };
+static const char *const usbg_uvc_control_classes[] = { "fs", "ss" };
+
+/*
+ * Directories holding items created by user, in order of removal.
+ * Class links have to go before headers and headers before formats.
+ */
+static const char *const usbg_uvc_user_dirs[] = {
+	"streaming/class/fs",
+	"streaming/class/hs",
+	"streaming/class/ss",
+	"control/class/fs",
+	"control/class/ss",
+	"streaming/header",
+	"streaming/uncompressed",
+	"streaming/mjpeg",
+	"control/header",
+};
+
+/* Frame buffer size is computed for worst case of YUY2 */
+#define USBG_UVC_BYTES_PER_PIXEL 2
+#define USBG_UVC_INTERVALS_PER_SEC 10000000
+
+const char *usbg_get_uvc_format_dir(usbg_uvc_format_type type)
+{
+	return type >= 0 && type < USBG_UVC_FORMAT_TYPE_MAX ?
+		usbg_uvc_format_dirs[type].dir : NULL;
+}
+
+int usbg_lookup_uvc_format_type(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(usbg_uvc_format_dirs); ++i)
+		if (!strcmp(usbg_uvc_format_dirs[i].dir, name))
+			return i;
+
+	return USBG_ERROR_NOT_FOUND;
+}
+
+static int usbg_uvc_path(usbg_function *f, char *buf, size_t len,
+			 const char *fmt, ...)
+{
+	va_list ap;
+	int off, nmb;
+
+	off = snprintf(buf, len, "%s/%s/", f->path, f->name);
+	if (off >= len)
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	va_start(ap, fmt);
+	nmb = vsnprintf(buf + off, len - off, fmt, ap);
+	va_end(ap);
+
+	return nmb < len - off ? USBG_SUCCESS : USBG_ERROR_PATH_TOO_LONG;
+}
+
+static const char *usbg_uvc_format_name(const usbg_uvc_format *fmt)
+{
+	return fmt->name ? fmt->name : usbg_uvc_format_dirs[fmt->type].name;
+}
+
+static int usbg_uvc_write_attr(const char *dir, const char *attr,
+			       const char *buf)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int nmb;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	nmb = usbg_sys_write(path, buf, strlen(buf));
+	return nmb < 0 ? usbg_translate_error(errno) : USBG_SUCCESS;
+}
+
+static int usbg_uvc_write_u32(const char *dir, const char *attr,
+			      uint64_t val)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+
+	snprintf(buf, sizeof(buf), "%u\n",
+		 val > UINT32_MAX ? UINT32_MAX : (unsigned int)val);
+	return usbg_uvc_write_attr(dir, attr, buf);
+}
+
+static int usbg_uvc_read_attr(const char *dir, const char *attr, char *buf,
+			      size_t len)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int nmb;
+
+	nmb = snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	nmb = usbg_sys_read(path, buf, len - 1);
+	if (nmb < 0)
+		return usbg_translate_error(errno);
+
+	buf[nmb] = '\0';
+	return USBG_SUCCESS;
+}
+
+static int usbg_uvc_read_int(const char *dir, const char *attr, int *val)
+{
+	char buf[USBG_MAX_STR_LENGTH];
+	char *end;
+	int ret;
+
+	ret = usbg_uvc_read_attr(dir, attr, buf, sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	*val = strtol(buf, &end, 0);
+	return end != buf ? USBG_SUCCESS : USBG_ERROR_IO;
+}
+
+static int usbg_uvc_check_frame(const usbg_uvc_frame *frame)
+{
+	int i;
+
+	if (frame->width <= 0 || frame->height <= 0 ||
+	    frame->n_intervals <= 0 ||
+	    frame->n_intervals > USBG_UVC_MAX_INTERVALS)
+		return USBG_ERROR_INVALID_PARAM;
+
+	for (i = 0; i < frame->n_intervals; ++i)
+		if (frame->intervals[i] <= 0)
+			return USBG_ERROR_INVALID_PARAM;
+
+	return USBG_SUCCESS;
+}
+
+static int usbg_uvc_create_frame(const char *format_path,
+				 const usbg_uvc_frame *frame)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	char intervals[USBG_UVC_MAX_INTERVALS * sizeof("2147483647\n")];
+	uint64_t size;
+	int min, max, off;
+	int i, nmb, ret;
+
+	ret = usbg_uvc_check_frame(frame);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	nmb = snprintf(path, sizeof(path), "%s/%dx%d", format_path,
+		       frame->width, frame->height);
+	if (nmb >= sizeof(path))
+		return USBG_ERROR_PATH_TOO_LONG;
+
+	if (usbg_sys_mkdir(path) != 0)
+		return usbg_translate_error(errno);
+
+	min = max = frame->intervals[0];
+	for (i = 0, off = 0; i < frame->n_intervals; ++i) {
+		if (frame->intervals[i] < min)
+			min = frame->intervals[i];
+		if (frame->intervals[i] > max)
+			max = frame->intervals[i];
+		off += sprintf(intervals + off, "%d\n", frame->intervals[i]);
+	}
+
+	size = (uint64_t)frame->width * frame->height
+		* USBG_UVC_BYTES_PER_PIXEL;
+
+	ret = usbg_uvc_write_u32(path, "wWidth", frame->width);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_u32(path, "wHeight", frame->height);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_u32(path, "dwMaxVideoFrameBufferSize",
+					 size);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_u32(path, "dwMinBitRate", size * 8
+					 * USBG_UVC_INTERVALS_PER_SEC / max);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_u32(path, "dwMaxBitRate", size * 8
+					 * USBG_UVC_INTERVALS_PER_SEC / min);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_u32(path, "dwDefaultFrameInterval",
+					 frame->intervals[0]);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_write_attr(path, "dwFrameInterval", intervals);
+
+	return ret;
+}
+
+static int usbg_uvc_create_format(usbg_function *f,
+				  const usbg_uvc_format *fmt)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int i, ret;
+
+	if (fmt->type < 0 || fmt->type >= USBG_UVC_FORMAT_TYPE_MAX ||
+	    fmt->n_frames <= 0 || !fmt->frames)
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_uvc_path(f, path, sizeof(path), "streaming/%s/%s",
+			    usbg_uvc_format_dirs[fmt->type].dir,
+			    usbg_uvc_format_name(fmt));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_mkdir(path) != 0)
+		return usbg_translate_error(errno);
+
+	/* Index of frame follows order of creation, first is default */
+	for (i = 0; i < fmt->n_frames && ret == USBG_SUCCESS; ++i)
+		ret = usbg_uvc_create_frame(path, fmt->frames + i);
+
+	return ret;
+}
+
+/* Create header in dir and link it from class directory of each speed */
+static int usbg_uvc_create_header(usbg_function *f, const char *dir,
+				  const char *const *classes, int n_classes,
+				  const usbg_uvc_format *formats,
+				  int n_formats)
+{
+	char header[USBG_MAX_PATH_LENGTH];
+	char target[USBG_MAX_PATH_LENGTH];
+	char link[USBG_MAX_PATH_LENGTH];
+	const usbg_uvc_format *fmt;
+	int i, ret;
+
+	ret = usbg_uvc_path(f, header, sizeof(header), "%s/header/%s", dir,
+			    USBG_UVC_HEADER);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	if (usbg_sys_mkdir(header) != 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n_formats && ret == USBG_SUCCESS; ++i) {
+		fmt = formats + i;
+		ret = usbg_uvc_path(f, target, sizeof(target), "%s/%s/%s", dir,
+				    usbg_uvc_format_dirs[fmt->type].dir,
+				    usbg_uvc_format_name(fmt));
+		if (ret == USBG_SUCCESS)
+			ret = usbg_uvc_path(f, link, sizeof(link),
+					    "%s/header/%s/%s", dir,
+					    USBG_UVC_HEADER,
+					    usbg_uvc_format_name(fmt));
+		if (ret == USBG_SUCCESS && usbg_sys_symlink(target, link) != 0)
+			ret = usbg_translate_error(errno);
+	}
+
+	for (i = 0; i < n_classes && ret == USBG_SUCCESS; ++i) {
+		ret = usbg_uvc_path(f, link, sizeof(link), "%s/class/%s/%s",
+				    dir, classes[i], USBG_UVC_HEADER);
+		if (ret == USBG_SUCCESS && usbg_sys_symlink(header, link) != 0)
+			ret = usbg_translate_error(errno);
+	}
+
+	return ret;
+}
+
+static int usbg_uvc_select(const struct dirent *dent)
+{
+	return (dent->d_type == DT_DIR || dent->d_type == DT_LNK) &&
+		strcmp(dent->d_name, ".") && strcmp(dent->d_name, "..");
+}
+
+/* Remove links and directories below path, path itself is left */
+static int usbg_uvc_rm_children(char *path, size_t len)
+{
+	struct dirent **dent;
+	size_t off = strlen(path);
+	int i, n;
+	int ret = USBG_SUCCESS;
+
+	n = usbg_sys_scandir(path, &dent, usbg_uvc_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	for (i = 0; i < n; ++i) {
+		if (ret != USBG_SUCCESS)
+			goto next;
+
+		if (off + 1 + strlen(dent[i]->d_name) >= len) {
+			ret = USBG_ERROR_PATH_TOO_LONG;
+			goto next;
+		}
+
+		sprintf(path + off, "/%s", dent[i]->d_name);
+		if (dent[i]->d_type == DT_LNK) {
+			if (usbg_sys_unlink(path) != 0)
+				ret = usbg_translate_error(errno);
+		} else {
+			ret = usbg_uvc_rm_children(path, len);
+			if (ret == USBG_SUCCESS && usbg_sys_rmdir(path) != 0)
+				ret = usbg_translate_error(errno);
+		}
+		path[off] = '\0';
+next:
+		free(dent[i]);
+	}
+	free(dent);
+
+	return ret;
+}
+
+int usbg_rm_uvc_tree(usbg_function *f)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	int i, ret = USBG_SUCCESS;
+
+	for (i = 0; i < ARRAY_SIZE(usbg_uvc_user_dirs); ++i) {
+		ret = usbg_uvc_path(f, path, sizeof(path), "%s",
+				    usbg_uvc_user_dirs[i]);
+		if (ret != USBG_SUCCESS)
+			break;
+
+		/* Older kernels don't have all speeds */
+		ret = usbg_uvc_rm_children(path, sizeof(path));
+		if (ret == USBG_ERROR_NOT_FOUND)
+			ret = USBG_SUCCESS;
+		if (ret != USBG_SUCCESS)
+			break;
+	}
+
+	return ret;
+}
+
+static int usbg_uvc_build(usbg_function *f, const usbg_uvc_format *formats,
+			  int n_formats)
+{
+	int i, ret = USBG_SUCCESS;
+
+	for (i = 0; i < n_formats && ret == USBG_SUCCESS; ++i)
+		ret = usbg_uvc_create_format(f, formats + i);
+
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_create_header(f, "streaming",
+				usbg_uvc_streaming_classes,
+				ARRAY_SIZE(usbg_uvc_streaming_classes),
+				formats, n_formats);
+
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_create_header(f, "control",
+				usbg_uvc_control_classes,
+				ARRAY_SIZE(usbg_uvc_control_classes),
+				NULL, 0);
+
+	return ret;
+}
+
+int usbg_set_uvc_formats(usbg_function *f, const usbg_uvc_format *formats,
+			 int n_formats)
+{
+	int ret;
+
+	if (!f || f->type != F_UVC || n_formats < 0 ||
+	    (n_formats && !formats))
+		return USBG_ERROR_INVALID_PARAM;
+
+	ret = usbg_rm_uvc_tree(f);
+	if (ret == USBG_SUCCESS && n_formats) {
+		ret = usbg_uvc_build(f, formats, n_formats);
+		if (ret != USBG_SUCCESS) {
+			ERROR(&f->parent->parent->log,
+			      "building streaming tree of %s failed", f->name);
+			usbg_rm_uvc_tree(f);
+		}
+	}
+
+	usbg_gadget_changed(f->parent);
+	return ret;
+}
+
+static int usbg_uvc_read_frame(const char *path, usbg_uvc_frame *frame,
+			       int *index)
+{
+	char buf[USBG_UVC_MAX_INTERVALS * sizeof("2147483647\n")];
+	char *p, *end;
+	long val;
+	int def, i;
+	int ret;
+
+	ret = usbg_uvc_read_int(path, "bFrameIndex", index);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_read_int(path, "wWidth", &frame->width);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_read_int(path, "wHeight", &frame->height);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_read_int(path, "dwDefaultFrameInterval", &def);
+	if (ret == USBG_SUCCESS)
+		ret = usbg_uvc_read_attr(path, "dwFrameInterval", buf,
+					 sizeof(buf));
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	frame->n_intervals = 0;
+	for (p = buf; frame->n_intervals < USBG_UVC_MAX_INTERVALS; p = end) {
+		val = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		frame->intervals[frame->n_intervals++] = val;
+	}
+
+	/* Kernel keeps intervals sorted, default one goes first again */
+	for (i = 0; i < frame->n_intervals; ++i)
+		if (frame->intervals[i] == def)
+			break;
+
+	if (i < frame->n_intervals) {
+		memmove(frame->intervals + 1, frame->intervals,
+			i * sizeof(frame->intervals[0]));
+		frame->intervals[0] = def;
+	}
+
+	return USBG_SUCCESS;
+}
+
+/*
+ * Put frames in order of bFrameIndex, which follows order of creation.
+ * Insertion sort keeps directory order of frames with the same index.
+ */
+static void usbg_uvc_sort_frames(usbg_uvc_frame *frames, int *index, int n)
+{
+	usbg_uvc_frame frame;
+	int i, j, idx;
+
+	for (i = 1; i < n; ++i) {
+		frame = frames[i];
+		idx = index[i];
+		for (j = i; j > 0 && index[j - 1] > idx; --j) {
+			frames[j] = frames[j - 1];
+			index[j] = index[j - 1];
+		}
+		frames[j] = frame;
+		index[j] = idx;
+	}
+}
+
+static int usbg_uvc_dir_select(const struct dirent *dent)
+{
+	return dent->d_type == DT_DIR &&
+		strcmp(dent->d_name, ".") && strcmp(dent->d_name, "..");
+}
+
+static int usbg_uvc_read_format(usbg_function *f, usbg_uvc_format_type type,
+				const char *name, usbg_uvc_format *fmt)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	usbg_uvc_frame *frames;
+	int *index;
+	size_t off;
+	int i, n;
+	int ret;
+
+	ret = usbg_uvc_path(f, path, sizeof(path), "streaming/%s/%s",
+			    usbg_uvc_format_dirs[type].dir, name);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	n = usbg_sys_scandir(path, &dent, usbg_uvc_dir_select);
+	if (n < 0)
+		return usbg_translate_error(errno);
+
+	frames = calloc(n ? n : 1, sizeof(*frames));
+	index = calloc(n ? n : 1, sizeof(*index));
+	fmt->name = strdup(name);
+	if (!frames || !index || !fmt->name)
+		ret = USBG_ERROR_NO_MEM;
+
+	off = strlen(path);
+	for (i = 0; i < n; ++i) {
+		if (ret == USBG_SUCCESS) {
+			if (off + 1 + strlen(dent[i]->d_name) < sizeof(path)) {
+				sprintf(path + off, "/%s", dent[i]->d_name);
+				ret = usbg_uvc_read_frame(path, frames + i,
+							  index + i);
+				path[off] = '\0';
+			} else {
+				ret = USBG_ERROR_PATH_TOO_LONG;
+			}
+		}
+		free(dent[i]);
+	}
+	free(dent);
+
+	if (ret == USBG_SUCCESS)
+		usbg_uvc_sort_frames(frames, index, n);
+	free(index);
+
+	fmt->type = type;
+	fmt->frames = frames;
+	fmt->n_frames = ret == USBG_SUCCESS ? n : 0;
+	return ret;
+}
+
+int usbg_get_uvc_formats(usbg_function *f, usbg_uvc_format **formats,
+			 int *n_formats)
+{
+	char path[USBG_MAX_PATH_LENGTH];
+	struct dirent **dent;
+	usbg_uvc_format *fmts = NULL, *tmp;
+	int count = 0;
+	int type, i, n;
+	int ret = USBG_SUCCESS;
+
+	if (!f || f->type != F_UVC || !formats || !n_formats)
+		return USBG_ERROR_INVALID_PARAM;
+
+	for (type = 0; type < USBG_UVC_FORMAT_TYPE_MAX; ++type) {
+		ret = usbg_uvc_path(f, path, sizeof(path), "streaming/%s",
+				    usbg_uvc_format_dirs[type].dir);
+		if (ret != USBG_SUCCESS)
+			break;
+
+		n = usbg_sys_scandir(path, &dent, usbg_uvc_dir_select);
+		if (n < 0) {
+			ret = usbg_translate_error(errno);
+			break;
+		}
+
+		tmp = realloc(fmts, (count + n + 1) * sizeof(*fmts));
+		if (tmp)
+			fmts = tmp;
+		else
+			ret = USBG_ERROR_NO_MEM;
+
+		for (i = 0; i < n; ++i) {
+			if (ret == USBG_SUCCESS) {
+				ret = usbg_uvc_read_format(f, type,
+						dent[i]->d_name, fmts + count);
+				/* Partially read format is released too */
+				++count;
+			}
+			free(dent[i]);
+		}
+		free(dent);
+
+		if (ret != USBG_SUCCESS)
+			break;
+	}
+
+	if (ret != USBG_SUCCESS) {
+		usbg_free_uvc_formats(fmts, count);
+		return ret;
+	}
+
+	*formats = fmts;
+	*n_formats = count;
+	return USBG_SUCCESS;
+}
+
+void usbg_free_uvc_formats(usbg_uvc_format *formats, int n_formats)
+{
+	int i;
+
+	if (!formats)
+		return;
+
+	for (i = 0; i < n_formats; ++i) {
+		free((char *)formats[i].name);
+		free((usbg_uvc_frame *)formats[i].frames);
+	}
+	free(formats);
+}
+
+int usbg_create_uvc_function(usbg_gadget *g, const char *instance,
+			     usbg_f_uvc_attrs *attrs,
+			     const usbg_uvc_format *formats, int n_formats,
+			     usbg_function **f)
+{
+	usbg_function_attrs f_attrs;
+	int ret;
+
+	if (!f || !formats || n_formats <= 0)
+		return USBG_ERROR_INVALID_PARAM;
+
+	if (attrs)
+		f_attrs.uvc = *attrs;
+
+	ret = usbg_create_function(g, F_UVC, instance,
+				   attrs ? &f_attrs : NULL, f);
+	if (ret != USBG_SUCCESS)
+		return ret;
+
+	ret = usbg_set_uvc_formats(*f, formats, n_formats);
+	if (ret != USBG_SUCCESS) {
+		usbg_rm_function(*f, USBG_RM_RECURSE);
+		*f = NULL;
+	}
+
+	return ret;
+}